@@ -5,7 +5,14 @@
     unboarding shuttle buses. 
     
     The two sensors are used in combination to determine direction of travel and 
-    thereby if a person is boarding or exiting.
+    thereby if a person is boarding or exiting. Each sensor streams at 100 Hz and 
+    has its own reader task; the readings are paired up in time before the 
+    direction is decided. (See digameDualLIDAR.h)
+
+    By default the direction and walking speed come from the time lag between the 
+    two sensors' traces, passage by passage, so people close together are counted 
+    apart. (See digameDualLIDARPassages.h) The older first-seen state machine can 
+    still be picked from the menu.
     
     Data is reported in JSON format via Bluetooth classic. 
     
@@ -45,6 +52,8 @@
 
 #include <TFMPlus.h>         // Include TFMini Plus LIDAR Library v1.4.0
                              // https://github.com/budryerson/TFMini-Plus
+#include <digameDualLIDAR.h> // Reader tasks, time alignment and direction
+#include <digameDualLIDARPassages.h> // Direction and speed from the lag
 
 #include <SPIFFS.h>          // FLASH file system support.
 
@@ -63,34 +72,30 @@ AsyncWebServer server(80);
 
 TFMPlus tfmP_1;         // Create a TFMini Plus object for sensor 1
 TFMPlus tfmP_2;         // Create a TFMini Plus object for sensor 2
+                        //   (For commands. The reader tasks take the frames.)
+
+LIDARChannel lidar_1(tfMiniUART_1);           // Each sensor's reader task and readings
+LIDARChannel lidar_2(tfMiniUART_2);
+DualLIDARFusion lidarFusion(lidar_1, lidar_2); // Pairs them up at 100 Hz
+DualLIDARDirection direction;                  // Decides which way targets are going...
+DualLIDARPassages passages;                    //   or this does, from the lag between them
 
 BluetoothSerial btUART; // Create a BlueTooth Serial Port Object
 
 
 //****************************************************************************************
 //****************************************************************************************
-// Smoothing the LIDAR signals to get rid of noise and introduce a bit of a decay time. 
-float smoothed_LIDAR_1 = 0.0;
-float smoothed_LIDAR_2 = 0.0;
-
-// We're tracking the visibility of the target on both sensors. Valid events go from only 
-// visible on one sensor to being visible on both. Direction is determined by which sensor
-// sees the target first. 
-int previousState = 0; 
-int state         = 0; 
-
-#define OUTBOUND  1
-#define INBOUND   2
-#define BOTH      3
-
 unsigned int inCount  = 0;
 unsigned int outCount = 0;
 
 String deviceName        = "Shuttle 6";
 float  distanceThreshold = 160;
 float  smoothingFactor   = 0.95;
+float  sensorSpacing     = 20;     // cm between the sensors' spots on the floor
+bool   useLag            = true;   // Count with passages rather than direction
 
 bool streamingRawData = false; 
+bool streamingTrace = false;   // Print each pair of readings, for dualreplay
 bool menuActive = false;
 
 bool clearDataFlag = false; 
@@ -125,7 +130,10 @@ void  configureLIDARs();
 void  configureOTA();
 
 void initLIDAR(TFMPlus &tfmP, int port=1);
-int  processLIDAR(TFMPlus &tfmP, float &smoothed, int offset);
+void processLIDARPair(const LIDARPair &pair);
+void countEvent(int event, const DualLIDARPassage *passage);
+void showLIDARStats();
+void emulateLIDARs();
 
 
 //****************************************************************************************                            
@@ -170,47 +178,88 @@ void loop()  // Main
   }
 
   // Run a little state machine based on the visibility of a target
-  // on the two LIDAR sensors
+  // on the two LIDAR sensors, a pair of readings from the same moment at a time.
+  direction.distanceThreshold = distanceThreshold;
+  direction.smoothingFactor   = smoothingFactor;
+  passages.settings.distanceThreshold = distanceThreshold;
+  passages.settings.sensorSpacing     = sensorSpacing;
+
+  #if !HARDWARE_PRESENT
+    emulateLIDARs();
+  #endif
 
-  int visible = 0;
-  state = 0;
+  LIDARPair pairs[16];
+  int n;
+  while ((n = lidarFusion.read(pairs, 16, micros())) > 0){
+    for (int i = 0; i < n; i++) processLIDARPair(pairs[i]);
+  }
 
-  // Target visible on sensor 1?
-  visible = processLIDAR(tfmP_1, smoothed_LIDAR_1, 100); 
-  
-  if (visible>=0){
-    
-    state = state + visible;
+  delay(10); // The reader tasks collect the frames in the mean time.
+}
 
-    // Target visible on sensor 2?
-    visible = processLIDAR(tfmP_2, smoothed_LIDAR_2, 110);
-    state = state + visible * 2;
 
-    if (streamingRawData) dualPrintln(distanceThreshold);
+//****************************************************************************************
+// One synchronized pair of readings: count the target if it's reached both sensors.
+//****************************************************************************************
+void processLIDARPair(const LIDARPair &pair){
+  // Both run all the time, so switching is seamless. Only one counts.
+  int event = direction.update(pair);
 
-    if (state == BOTH){ // Visible on both Sensors
-      jsonPayload = jsonPrefix; 
-    
-      if ((previousState == INBOUND)){ // INBOUND event
-        inCount += 1;
-        jsonPayload = jsonPayload + "\",\"eventType\":\"inbound" +
-                       "\",\"count\":\"" + inCount + "\"" +
-                       "}";
-  
-        if ((!streamingRawData)&&(menuActive)) dualPrintln(jsonPayload); 
-      }
-    
-      if ((previousState == OUTBOUND)){ // OUTBOUND event
-        outCount += 1;
-        jsonPayload = jsonPayload + "\",\"eventType\":\"outbound" +
-                      "\",\"count\":\"" + outCount + "\"" +
-                      "}";
-  
-        if ((!streamingRawData)&&(menuActive)) dualPrintln(jsonPayload);
-      }
-      
-    }
-    previousState = state;
+  DualLIDARPassage passage[4];
+  int n = passages.update(pair, passage, 4);
+
+  if (streamingTrace) dualPrintln(getLIDARPairCSV(pair));
+
+  if (streamingRawData && (pair.sample[0].status == TFMP_READY) && 
+      (pair.sample[1].status == TFMP_READY)) {
+    float s1 = useLag ? passages.smoothed[0] : direction.smoothed[0];
+    float s2 = useLag ? passages.smoothed[1] : direction.smoothed[1];
+    bool  v1 = useLag ? passages.visible(0) : direction.visible(0);
+    bool  v2 = useLag ? passages.visible(1) : direction.visible(1);
+    dualPrint(s1);
+    dualPrint(" ");
+    dualPrint(v1 ? 400 : 300);
+    dualPrint(" ");
+    dualPrint(s2);
+    dualPrint(" ");
+    dualPrint(v2 ? 410 : 310);
+    dualPrint(" ");
+    dualPrintln(distanceThreshold);
+  }
+
+  if (useLag){
+    for (int i = 0; i < n; i++) countEvent(passage[i].direction, &passage[i]);
+  } else if (event != TARGET_NONE){
+    countEvent(event, NULL);
+  }
+}
+
+
+//****************************************************************************************
+// Count someone going in or out and report it. With the lag, how fast they went, too.
+//****************************************************************************************
+void countEvent(int event, const DualLIDARPassage *passage){
+  String speed = "";
+  if (passage) speed = ",\"speed\":\"" + String(passage->speed) + "\"";
+
+  if (event == INBOUND){
+    inCount += 1;
+    jsonPayload = jsonPrefix + "\",\"eventType\":\"inbound" +
+                  "\",\"count\":\"" + inCount + "\"" +
+                  speed + 
+                  "}";
+
+    if ((!streamingRawData)&&(!streamingTrace)&&(menuActive)) dualPrintln(jsonPayload); 
+  }
+
+  if (event == OUTBOUND){
+    outCount += 1;
+    jsonPayload = jsonPrefix + "\",\"eventType\":\"outbound" +
+                  "\",\"count\":\"" + outCount + "\"" +
+                  speed + 
+                  "}";
+
+    if ((!streamingRawData)&&(!streamingTrace)&&(menuActive)) dualPrintln(jsonPayload);
   }
 }
 
@@ -249,6 +298,10 @@ void configureLIDARs(){
     tfMiniUART_2.begin(115200,SERIAL_8N1,17,16);  // Initialize TFMPLus device serial port.
     delay(1000);
     initLIDAR(tfmP_2, 2);
+
+    // Both streaming: a reader task each, on core 0 out of the way of the loop.
+    lidar_1.start("LIDAR 1 Reader", 0);
+    lidar_2.start("LIDAR 2 Reader", 0);
   #endif
 
 }
@@ -363,9 +416,13 @@ void showMenu(){
   dualPrintln("  [N]ame               (" + deviceName +")");
   dualPrintln("  [D]istance threshold (" + String(distanceThreshold) + ")");
   dualPrintln("  [S]moothing factor   (" + String(smoothingFactor) + ")");
+  dualPrintln("  [A]lgorithm          (" + String(useLag ? "Lag" : "First seen") + ")");
+  dualPrintln("  [B]eam spacing       (" + String(sensorSpacing) + ")");
   dualPrintln("  [G]Get count data");
   dualPrintln("  [C]Clear count data");
   dualPrintln("  [R]aw Data Stream    (" + String(streamingRawData) + ")");
+  dualPrintln("  [T]race of readings  (" + String(streamingTrace) + ")");
+  dualPrintln("  [L]IDAR stats");
   dualPrintln();
   //dualPrintln("  Toggle [r]aw data stream ");
   }
@@ -387,6 +444,12 @@ void loadDefaults(){
     temp = readFile(SPIFFS, "/smooth.txt");
     if (temp.length() > 0) smoothingFactor = temp.toFloat();
     
+    temp = readFile(SPIFFS, "/spacing.txt");
+    if (temp.length() > 0) sensorSpacing = temp.toFloat();
+
+    temp = readFile(SPIFFS, "/algorithm.txt");
+    if (temp.length() > 0) useLag = (temp != "First seen");
+
     temp = readFile(SPIFFS, "/threshold.txt");
     if (temp.length() > 0) distanceThreshold = temp.toFloat();
   }
@@ -432,57 +495,37 @@ void initLIDAR(TFMPlus &tfmP, int port){
 }
 
 //****************************************************************************************
-// Read the LIDAR sensor and determine if a target is present in the field. Uses a bit of 
-// history in the form of an exponentially smoothed version of the raw signal.
+// How the two sensors and their links are doing.
 //****************************************************************************************
-int processLIDAR(TFMPlus &tfmP, float &smoothed, int offset){
-  int16_t tfDist = 0;    // Distance to object in centimeters
-  int16_t tfFlux = 0;    // Strength or quality of return signal
-  int16_t tfTemp = 0;    // Internal temperature of Lidar sensor chip
-  
-  int lidarUpdateRate = 5; // 100Hz -> 10 ms
-  int targetVisible = false;
-
-#if HARDWARE_PRESENT 
-  //tfmP.sendCommand(TRIGGER_DETECTION, 0);
-
-  //lightSleepMSec(lidarUpdateRate);
-  delay(lidarUpdateRate);
-
-  // Read the LIDAR Sensor
-  if( tfmP.getData( tfDist, tfFlux, tfTemp)) { 
-
-    //Filter the measured distance
-    smoothed = smoothed * smoothingFactor + (float)tfDist * (1-smoothingFactor); 
-
-    targetVisible = (smoothed < distanceThreshold);  
-
-    if (streamingRawData) {  
-      //dualPrint(tfDist + offset);
-      //dualPrint(" ");
-      dualPrint(smoothed);
-      dualPrint(" ");
-      if (targetVisible){
-         dualPrint(300 + offset);
-      } else {
-        dualPrint(200 + offset);
-      }
-      dualPrint(" ");
-    }
-
-    if (targetVisible) {
-      return 1;
-    } else {
-      return 0;
-    }
-   
+void showLIDARStats(){
+  LIDARChannel *channels[2] = {&lidar_1, &lidar_2};
+  for (int c = 0; c < 2; c++){
+    dualPrintln("  LIDAR " + String(c + 1) + ": " + 
+                String(channels[c]->frames) + " frames, " +
+                String(channels[c]->drops) + " dropped, " +
+                String(channels[c]->parser.stats.checksumErrors) + " checksum errors, " +
+                String(lidarFusion.missing[c]) + " of " + String(lidarFusion.pairs) + " pairs missing");
   }
+  dualPrintln("  Passages: " + String(passages.passages) + ", unmatched " + 
+              String(passages.unmatched[0]) + " and " + String(passages.unmatched[1]) + 
+              ", loitering " + String(passages.loitering));
+}
+
 
-  return -1; 
-#else // Emulating the presence of the LIDAR sensor
-  delay(10);
-  return random(2); // returns a random number from 0 to 1
-#endif
+//****************************************************************************************
+// Emulating the presence of the LIDAR sensors: random readings in the reader tasks' 
+// place, 100 a second each.
+//****************************************************************************************
+void emulateLIDARs(){
+  static uint32_t nextUS = micros();
+  while ((int32_t)(micros() - nextUS) >= 0){
+    LIDARSample s = {nextUS, (int16_t)random(50, 250), 1000, 30, TFMP_READY};
+    lidar_1.stream.push(s);
+    s.timeUS += 3000;
+    s.dist = (int16_t)random(50, 250);
+    lidar_2.stream.push(s);
+    nextUS += dualLIDARPeriodUS;
+  }
 }
 
 
@@ -565,6 +608,21 @@ void scanForUserInput()
       writeFile(SPIFFS, "/smooth.txt", String(smoothingFactor).c_str());
     }
 
+    if(inString == "a"){
+      useLag = !useLag;
+      dualPrint(" New Algorithm: ");
+      dualPrintln(useLag ? "Lag" : "First seen");
+      writeFile(SPIFFS, "/algorithm.txt", useLag ? "Lag" : "First seen");
+    }
+
+    if(inString == "b"){
+      dualPrintln(" Enter New Beam Spacing in cm. (" + String(sensorSpacing) + ")");
+      sensorSpacing = getUserInput().toFloat();
+      dualPrint(" New Beam Spacing: ");
+      dualPrintln(sensorSpacing);
+      writeFile(SPIFFS, "/spacing.txt", String(sensorSpacing).c_str());
+    }
+
     if(inString == "g"){
       String jsonPayload = jsonPrefix + "\",\"inbound\":\""  + inCount  + "\"" + 
                                           ",\"outbound\":\"" + outCount + "\"" +
@@ -581,7 +639,16 @@ void scanForUserInput()
     if(inString == "r"){
       streamingRawData = (!streamingRawData);
     } 
+
+    if(inString == "t"){
+      streamingTrace = (!streamingTrace);
+      if (streamingTrace) dualPrintln("timeUS,dist1,dist2");
+    } 
+
+    if(inString == "l"){
+      showLIDARStats();
+    } 
     
-    if (!streamingRawData) showMenu(); 
+    if ((!streamingRawData) && (!streamingTrace)) showMenu(); 
   }   
 }
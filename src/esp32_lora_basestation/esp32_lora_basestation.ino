@@ -33,6 +33,7 @@ long count = 0;
 #include <digamePowerMgt.h>   // Power management modes 
 #include <digameDisplay.h>    // eInk Display Functions
 #include <digameLoRa.h>       // Reyax LoRa module control functions
+#include <digameLoRaPayload.h> // Binary vehicle events
 
 #include <digameCounterWebServer.h>  // Handles parmater tweaks through a web page
 
@@ -199,43 +200,71 @@ String loraMsgToJSON(String msg){
   int idxstop  = msg.indexOf(','); 
   String strAddress = msg.substring(idxstart,idxstop);
   
-  // Start and end of the JSON payload in the msg.
-  idxstart = msg.indexOf('{');
-  idxstop = msg.lastIndexOf('}')+1; // The close of the JSON message payload.
-                                    // Using lastIndexOf since we are nesting JSON structs in some messages and 
-                                    // can have multiple {{}} situations. 
+  String strRSSI;
+  String strSNR;
+
+  if (msg.indexOf('{') < 0) {
+    // A vehicle event in a few bytes (digameLoRaPayload.h), as the terse JSON fields:
+    // +RCV=<address>,<length>,<base64 payload>,<RSSI>,<SNR>
+    int c1 = msg.indexOf(',');
+    int c2 = msg.indexOf(',', c1 + 1);
+    int c3 = msg.indexOf(',', c2 + 1);
+    uint8_t buf[loraPayloadMaxBytes];
+    int n = (c3 < 0) ? -1 : loraTextToBytes(msg.substring(c2 + 1, c3), buf, loraPayloadMaxBytes);
+    LoRaEvent e;
+    if ((n < 0) || !decodeLoRaEvent(buf, n, e)) {
+      debugUART.println("ERROR: Can't decode LoRa payload!");
+      return "IGNORE";
+    }
+    loraEventToTerseJSON(e, doc);
+
+    String trailer = msg.substring(c3 + 1);
+    idxstop = trailer.indexOf(',');
+    strRSSI = trailer.substring(0, idxstop);
+    strRSSI.trim();
+    strSNR = trailer.substring(idxstop + 1);
+    strSNR.trim();
+
+  } else {
+    // Start and end of the JSON payload in the msg.
+    idxstart = msg.indexOf('{');
+    idxstop = msg.lastIndexOf('}')+1; // The close of the JSON message payload.
+                                      // Using lastIndexOf since we are nesting JSON structs in some messages and 
+                                      // can have multiple {{}} situations. 
   
-  char json[512] = {};
-
-  // The message contains a JSON payload extract to the char array json
-  String payload = msg.substring(idxstart,idxstop); 
-  //debugUART.println("LORA Payload");
-  //debugUART.println(payload);
-  payload.toCharArray(json,payload.length()+1);
-
-  // Deserialize the JSON document
-  DeserializationError error = deserializeJson(doc, json);
-
-  // Test if parsing succeeds.
-  if (error) {
-    debugUART.print(F("deserializeJson() failed: "));
-    debugUART.println(error.f_str());
-    return "IGNORE";
-  }
+    char json[512] = {};
+
+    // The message contains a JSON payload extract to the char array json
+    String payload = msg.substring(idxstart,idxstop); 
+    //debugUART.println("LORA Payload");
+    //debugUART.println(payload);
+    payload.toCharArray(json,payload.length()+1);
+
+    // Deserialize the JSON document
+    DeserializationError error = deserializeJson(doc, json);
+
+    // Test if parsing succeeds.
+    if (error) {
+      debugUART.print(F("deserializeJson() failed: "));
+      debugUART.println(error.f_str());
+      return "IGNORE";
+    }
 
-  // After the payload comes the RSSI and SNR values;
-  String trailer = msg.substring(idxstop +1);
-  //debugUART.println(trailer);
-  idxstop = trailer.indexOf(',');
+    // After the payload comes the RSSI and SNR values;
+    String trailer = msg.substring(idxstop +1);
+    //debugUART.println(trailer);
+    idxstop = trailer.indexOf(',');
   
-  String strRSSI = trailer.substring(0,idxstop);
-  //debugUART.println(strRSSI);
-  strRSSI.trim();
+    strRSSI = trailer.substring(0,idxstop);
+    //debugUART.println(strRSSI);
+    strRSSI.trim();
 
-  String strSNR = trailer.substring(idxstop + 1);
-  //debugUART.println(strSNR);  
-  strSNR.trim();
+    strSNR = trailer.substring(idxstop + 1);
+    //debugUART.println(strSNR);  
+    strSNR.trim();
   
+  }
+
   // Fetch values.
   //
   // Most of the time, you can rely on the implicit casts.
@@ -275,6 +304,10 @@ String loraMsgToJSON(String msg){
 
   if (da == "t"){
     strDetAlg = "Threshold";
+  } else if (da == "v") {
+    strDetAlg = "Voting";
+  } else if (da == "d") {
+    strDetAlg = "Decay";
   } else if (da == "c") {
     strDetAlg = "Correlation";
   } else {
@@ -289,6 +322,7 @@ String loraMsgToJSON(String msg){
   String strDeviceMAC  = "00:01:02:03:04:05";
 
   String strSettings = doc["s"];
+  String strSettingsHash = doc["sh"]; // Older counters don't send it
 
   // TODO: move to a look up function and come up with a better storage scheme.
   if (strAddress == config.sens1Addr){
@@ -342,6 +376,10 @@ String loraMsgToJSON(String msg){
   if ((et=="b")||(et=="hb")){
     jsonPayload = jsonPayload + "\",\"settings\":" + strSettings;                  
   }
+
+  if (strSettingsHash != "null"){ // Which settings a vehicle was counted with
+    jsonPayload = jsonPayload + ",\"settingsHash\":\"" + strSettingsHash + "\"";
+  }
   
   jsonPayload = jsonPayload + "}";
   
@@ -5,18 +5,15 @@
  
 const int samples = 100;
 
-//Falling Edge Model 100 pts
-float fallingEdgeModel[] = {0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-float risingEdgeModel[] = {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1};
+// The falling edge, rising edge and notch models live in digameMatchedFilter.h
+#include <digameMatchedFilter.h>
+MatchedFilter<samples> fallingEdgeFilter(fallingEdgeModel); // Correlates as each reading arrives
 
 
 float tinyFallingEdgeModel[] = {1,1,1,1,1,1,1,1,1,1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1};
 
 
-float notchModel[] =       {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1};
 
-
-float data[samples];
 // 0.1 smooth of the falling edge model - 100 pts.
 float smoothedFallingEdgeModel[]{
 1,
@@ -228,11 +225,6 @@ float model2[] = {
 float crossCorr[samples*4+1];
 
 
-
-#include <CircularBuffer.h> // Adafruit library. Pretty small!
-CircularBuffer<int, samples> buffer; // 
-
-
 #include <TFMPlus.h>    // Include TFMini Plus LIDAR Library v1.4.0
 TFMPlus tfmP;           // Create a TFMini Plus object
 
@@ -291,133 +283,42 @@ void setup()
 // Math functions
 //****************************************************************************************
 
-float mean(float a[], int numSamples){
-    float result;
-    
-    result = 0;   
-    for (int i=0; i<numSamples; i++) {
-      result += a[i];
-    }
-    result /= numSamples;
-    return result;  
-}
-
-// Calculate the correlation coefficient between two arrays
-float correlation(float x[], float y[], int numSamples){ 
-    float sx, sy, sxy, denom; 
-    float mx, my; // means
-    float r; // correlation coefficient
-
-    /* Calculate the means */
-    mx = mean(x, numSamples);
-    my = mean(y, numSamples);
-    
-    /* Calculate the denominator */
-    sx = 0;
-    sy = 0;
-    
-    for (int i=0; i<numSamples; i++) {
-      sx += (x[i] - mx) * (x[i] - mx);
-      sy += (y[i] - my) * (y[i] - my);
-    }
-    
-    denom = sqrt(sx*sy);
-
-   /* Calculate the correlation coefficient */
-    sxy = 0;
-    for (int i=0; i<numSamples; i++) {
-          sxy += (x[i] - mx) * (y[i] - my); 
-    }
-    r = sxy / denom;
-    return r;
-}
+// mean() and correlation() come from digameMath.h
 
+// Every lag at once by FFT (digameFFT.h) rather than a pass over the data per lag.
+#include <digameFFT.h>
+FFTCorrelator<256> crossCorrelator; // Room for samples points at every lag
+const float *crossCorrelatorModel = NULL;
+int crossCorrelatorSamples = 0;
+float crossCorrLags[2*samples-1];
 
 float crossCorrelation(float x[] , float  y[], int numSamples, int maxdelay){
 
-   int i,j;
-   float mx,my,sx,sy,sxy,denom,r;
-   
-   //debugUART.println("In crossCorrelation");
-   /* Calculate the mean of the two series x[], y[] */
-   //debugUART.println("Calculating Means");
-   mx = 0;
-   my = 0;   
-   for (i=0;i<numSamples;i++) {
-      mx += x[i];
-      my += y[i];
-   }
-   mx /= numSamples;
-   my /= numSamples;
-
-   //debugUART.print("mx: ");
-   //debugUART.print(mx);
-   //debugUART.print("my: ");
-   //debugUART.println(my);
-   
-
-   /* Calculate the denominator */
-   //debugUART.println("Calculating Denominator");
-   sx = 0;
-   sy = 0;
-   for (i=0;i<numSamples;i++) {
-      sx += (x[i] - mx) * (x[i] - mx);
-      sy += (y[i] - my) * (y[i] - my);
+   // The model's transform is only worked out when the model changes.
+   if ((x != crossCorrelatorModel) || (numSamples != crossCorrelatorSamples)){
+      crossCorrelator.setModel(x, numSamples);
+      crossCorrelatorModel = x;
+      crossCorrelatorSamples = numSamples;
    }
-   //debugUART.println("Dividing...");
-   denom = sqrt(sx*sy);
+   crossCorrelator.correlate(y, crossCorrLags);
 
    /* Calculate the correlation series */
    float rMax=0.0; //Initialize.
    float rMin=0.0; 
-   int   rMaxIndex=0;
+   float r;
 
    debugUART.println("**********************");
    for (int myDelay=-maxdelay; myDelay<=maxdelay; myDelay++) {
-      //debugUART.print(myDelay);
-      //debugUART.println(" ");
-      sxy = 0;
-      for (i=0;i<numSamples;i++) {
-         j = i + myDelay;
-         
-         if (j < 0 || j >= numSamples)
-            continue;
-         else
-            sxy += (x[i] - mx) * (y[j] - my); 
-      }
-      //debugUART.print(denom);
-      //debugUART.print(" ");
-      
-      r = sxy / denom;
-      if (r>rMax){
-        rMax=r; rMaxIndex = myDelay + maxdelay;
-      }
+      // No overlap past +/-(numSamples-1)
+      r = (abs(myDelay) < numSamples) ? crossCorrLags[myDelay + numSamples - 1] : 0;
       
+      if (r>rMax){rMax=r;}
       if (r<rMin){rMin=r;}
       
-      //debugUART.print(myDelay+maxdelay);
-      //debugUART.print(" ");
-      //debugUART.println(r*100);
-      crossCorr[myDelay+maxdelay]=r;
-
-      //debugUART.print(myDelay+maxdelay);
-      //debugUART.print(" ");
-      //debugUART.println(r);
-      /* r is the correlation coefficient at "delay" */
-
+      crossCorr[myDelay+maxdelay]=r; /* r is the correlation coefficient at "delay" */
    }
    
-   
-   //return rMax*100;
-   
    return 400*(rMin+rMax)/2;
-
-   if (abs(rMin)>=rMax){
-     return rMin*100;
-   } else {
-     return rMax*100;
-   }
- 
 }
 
 
@@ -462,16 +363,11 @@ void loop(){
     if( tfmP.getData(tfDist, tfFlux, tfTemp) ) { 
       tfDist = tfDist + random(0,0); // +/- cm random noise...
      
-      buffer.push(tfDist);
-      
-      for (byte i = 0; i < buffer.size(); i++) {
-        data[i]=buffer[i];
-      }
-      
-      //correl1 = crossCorrelation(fallingEdgeModel, data, samples, samples*2) *2 ;
-      data[0]=1;
+      // Same as correlation(fallingEdgeModel, data, samples) over the last 100 readings,
+      // without copying them out of a buffer and rescanning them every time.
+      fallingEdgeFilter.push(tfDist);
 
-      correl1 = (correlation(fallingEdgeModel, data, samples)* 100)-10;//-83.0;
+      correl1 = (fallingEdgeFilter.correlation()* 100)-10;//-83.0;
       
       //Filter the correlated value
       smoothed = smoothed * 0.8 + (float)correl1 * 0.2;
@@ -25,6 +25,20 @@ String model_description = "(LIDAR Traffic Counter with WiFi Back Haul)";
 // the wifi JSON msg for analysis at the server.
 #endif
 
+// Let the LIDAR stream frames at its own rate (read by a task on core 0) instead of 
+// triggering a reading once per pass through the loop. The detector's window and decay 
+// are counted in samples, so revisit the LIDAR settings if you raise the rate.
+#define LIDAR_FREE_RUNNING false
+#define LIDAR_STREAM_RATE FRAME_100
+#define LIDAR_POLL_RATE 50 // Polled, one reading per pass through loop(): about 50 Hz
+
+// Lane discovery (digameLaneFinder.h): fold the distance histogram in once a minute, let
+// old data fade with a one week half-life, and (if lidar.autoLanes is set) apply the 
+// proposed zone limits once an hour.
+#define LANE_UPDATE_MS      60000UL
+#define LANE_HALF_LIFE      (7 * 24 * 60) // In updates
+#define LANE_AUTO_APPLY_MS  3600000UL
+
 //---------------------------------------------------------------------------------------------
 
 #include <digameDebug.h>      // Debug message handling.
@@ -37,29 +51,35 @@ String model_description = "(LIDAR Traffic Counter with WiFi Back Haul)";
 #include <digamePowerMgt.h>   // Power management modes 
 #include <digameDisplay.h>    // eInk Display Functions
 #include <digameLIDAR.h>      // Functions for working with the TFMini series LIDAR sensors
+#include <digameDetectors.h>  // The vehicle detector named in the config
 #if USE_LORA
 #include <digameLoRa.h>     // Functions for working with Reyax LoRa module
 #endif
 unsigned long count = 0;      // The number of vehicle events recorded
 #include <digameCounterWebServer.h>  // Web page to tweak parameters. Uses count. TODO: Fix.
 
-#include <CircularBuffer.h>   // Adafruit library for handling circular buffers of data. 
-// https://github.com/rlogiacco/CircularBuffer
+#include <digameEventQueue.h> // Fixed-size event records queued from core 1 to core 0
+#include <digameJournal.h>    // ...and kept on the SD card until they've been sent
+#include <digameBatchPost.h>  // ...and POSTed several at a time
+#include <digameDeliveryScheduler.h> // ...and tried again later if they don't get through
+#include <digameLoRaPayload.h> // Vehicle events over LoRa in a few bytes
 
 //---------------------------------------------------------------------------------------------
 
-const int samples = 200;      // The number of messages we'll buffer
-CircularBuffer<String *, samples> msgBuffer; // The buffer containing pointers JSON messages to
-// be sent to the LoRa basestation or server.
-String msgPayload;            // The message being sent to the base station.
-// (JSON format depends on link type: LoRa or WiFi)
+// Events waiting to be sent to the LoRa basestation or server, and the raw signals of the 
+// vehicles among them. The JSON (format depends on link type: LoRa or WiFi) is built when
+// they're sent.
+EventQueue<256, 16> eventQueue;
+EventJournal journal(SD);     // Where core 0 keeps them until they're ACKed.
+volatile bool journalSyncNeeded = false; // Set before a reboot: cleared once what's queued is committed
+bool serverTakesBatches = true;           // Until it answers a batch without "acked"
+DeliveryScheduler delivery;               // When to try again after a failed send
 
 // Access point mode
 bool accessPointMode = false; //
 bool usingWiFi = false;       // True if USE_WIFI or AP mode is enabled
 
 // Multi-Tasking
-SemaphoreHandle_t mutex_v;        // Mutex used to protect variables across RTOS tasks.
 TaskHandle_t messageManagerTask;  // A task for handling data reporting
 TaskHandle_t displayManagerTask;  // A task for updating the EInk display
 
@@ -108,6 +128,7 @@ void configureRTC(String &statusMsg);
 void configureNetworking(String &statusMsg);
 void configureCore0Tasks(String &statusMsg);
 void configureTimers(String &statusMsg);
+void configureJournal(String &statusMsg);
 
 // Used in loop()
 void handleBootEvent();       // Boot messages are sent at startup.
@@ -115,6 +136,8 @@ void handleResetEvent();      // Look for reset flag getting toggled
 void handleModeButtonPress(); // Check for display mode button being pressed and switch display
 void handleVehicleEvent();    // Read the LIDAR sensor and enque a count event msg, if needed
 void handleHeartBeatEvent();  // Check timers and enque a heartbeat event msg, if needed
+void handleLaneDiscovery();   // Learn lane positions from the distance histogram
+void reportVehicleEvent(const RuntimeConfig &rc); // Enque a count event msg for vehicleMessageNeeded
 
 
 //****************************************************************************************
@@ -127,8 +150,10 @@ void setup() // DEVICE INITIALIZATION
   showSplashScreen();
   configureEinkDisplay(statusMsg);
   loadParameters(statusMsg);     // Grab program settings from SD card
+  configureJournal(statusMsg);   // Pick up the events not sent before the last reboot
   lidarReadingAtBoot = configureLIDAR(statusMsg); // Sets up the LIDAR Sensor and
                                                   // returns an intial reading.
+  lidarLaneFinder.setHalfLife(LANE_HALF_LIFE);
   configureNetworking(statusMsg);
 
   #if USE_LORA
@@ -170,6 +195,7 @@ void loop() // MAIN LOOP
   handleModeButtonPress(); // Check for display mode button being pressed and switch display
   handleVehicleEvent();    // Read the LIDAR sensor and enque a count event msg, if needed
   handleHeartBeatEvent();  // Check timers and enque a heartbeat event msg, if needed
+  handleLaneDiscovery();   // Learn lane positions from the distance histogram
 
   // Tune loop to run at about 50Hz
   if (wifiConnected){ // 80Mhz clock
@@ -195,6 +221,15 @@ void loadParameters(String &statusMsg)
   };
 }
 
+//**************************************************************************************
+void configureJournal(String &statusMsg) {
+  if (journal.begin()) {
+    DEBUG_PRINTLN("  Message journal: " + String(journal.replayed) + " events to send");
+  } else { // Messages are sent from RAM, as they were
+    DEBUG_PRINTLN("  Message journal: ERROR! Not on the SD card.");
+  }
+}
+
 //**************************************************************************************
 void configureTimers(String &statusMsg) {
   bootMillis          = millis();
@@ -208,9 +243,6 @@ void configureTimers(String &statusMsg) {
 void configureCore0Tasks(String &statusMsg) {
   // Set up two tasks that run on CPU0 -- One to handle updating the display and one to
   // handle reporting data
-  mutex_v = xSemaphoreCreateMutex(); // The mutex we will use to protect variables
-  // across tasks
-
   // Create a task that will be executed in the messageManager() function,
   //   with priority 0 and executed on core 0
   xTaskCreatePinnedToCore(
@@ -343,7 +375,25 @@ void configureAPMode(String &statusMsg) {
 //**************************************************************************************
 int configureLIDAR(String &statusMsg) {
   // Turn on the LIDAR Sensor and take an initial reading (initLIDARDist)
-  if (initLIDAR(true)) {
+  selectLIDARDetectors(getRuntimeConfig()); // Fixed until reboot
+  DEBUG_PRINTLN("  Detection algorithm: " + String(getLIDARDetectorName()));
+  if (getShadowDetectorCount() > 0) {
+    DEBUG_PRINTLN("  Shadow detectors: " + config.lidarShadowDetectors);
+  }
+  lidarPreFilter.configure(getRuntimeConfig());
+  if (lidarPreFilter.active()) {
+    DEBUG_PRINTLN("  Pre-filter: " + config.lidarPreFilter + ", window " + config.lidarPreFilterWindow +
+                  ", min. run " + config.lidarMinRunLength + " (" + String(lidarPreFilter.delay()) +
+                  " readings late)");
+  }
+
+  if (initLIDAR(!LIDAR_FREE_RUNNING)) {
+    #if LIDAR_FREE_RUNNING
+      startLIDARStream(LIDAR_STREAM_RATE);
+      lidarHealth.setExpectedRate(LIDAR_STREAM_RATE);
+    #else
+      lidarHealth.setExpectedRate(LIDAR_POLL_RATE);
+    #endif
     statusMsg += "   LIDAR: OK\n\n";
   } else {
     statusMsg += "   LIDAR: ERROR!\n\n";
@@ -397,64 +447,100 @@ void showSplashScreen() {
 }
 
 //**************************************************************************************
-// Add a message to the queue for transmission.
-void pushMessage(String message) {
-  xSemaphoreTake(mutex_v, portMAX_DELAY);
-  #if USE_LORA
-    String * msgPtr = new String(message);
-    msgBuffer.push(msgPtr);
-  #endif
-  
+// An event as of now.
+CounterEvent makeEvent(uint8_t type, int lane = 0) {
+  CounterEvent e = {};
+  e.epoch   = rtcPresent() ? getRTCEpoch() : (uint32_t)time(nullptr);
+  e.count   = count;
+  e.tempC10 = (int16_t)lroundf(getRTCTemperature() * 10);
+  e.type    = type;
+  e.lane    = lane;
+  e.rawSlot = noRawSignal;
+  return e;
+}
+
+//**************************************************************************************
+// Add an event to the queue for transmission (with the raw signal filled in 
+// eventQueue.rawSlot(), if withRaw). Only loop() pushes: the queue has one producer.
+void pushEvent(const CounterEvent &e, bool withRaw = false) {
   #if USE_WIFI
-    if (accessPointMode == false) {
-      String * msgPtr = new String(message);
-      msgBuffer.push(msgPtr);
-    }
+    if (accessPointMode) return;
   #endif
-    xSemaphoreGive(mutex_v);
+  if (!eventQueue.push(e, withRaw) && !getRuntimeConfig().showDataStream) {
+    DEBUG_PRINTLN("Message queue full! Dropped: " + String(eventQueue.dropped));
+  }
 }
 
 
+//****************************************************************************************
+// The detector settings, as the LoRa boot and heartbeat messages carry them.
+String buildLoRaSettingsJSON() {
+  xSemaphoreTake(configMutex, portMAX_DELAY); // The web server and lane discovery change them
+  String retValue = String("{") +
+         "\"ui\":\"" + config.lidarUpdateInterval  + "\"" +
+         ",\"sf\":\"" + config.lidarSmoothingFactor + "\"" +
+         ",\"rt\":\"" + config.lidarResidenceTime   + "\"" +
+         ",\"1m\":\"" + config.lidarZone1Min        + "\"" +
+         ",\"1x\":\"" + config.lidarZone1Max        + "\"" +
+         ",\"2m\":\"" + config.lidarZone2Min        + "\"" +
+         ",\"2x\":\"" + config.lidarZone2Max        + "\"" +
+         "}";
+  xSemaphoreGive(configMutex);
+  return retValue;
+}
+
+//****************************************************************************************
+// A vehicle event over LoRa: a few bytes, base64 for AT+SEND (digameLoRaPayload.h). The
+// base station turns it back into the same message for the server.
+String buildLoRaPayload(const CounterEvent &e) {
+  LoRaEvent le = {};
+  le.epoch        = e.epoch;
+  le.count        = e.count;
+  le.tempC10      = e.tempC10;
+  le.type         = e.type;
+  le.lane         = e.lane;
+  le.detector     = strchr(loraDetectorCodes, getLIDARDetectorCode()[0]) - loraDetectorCodes;
+  le.retries      = (LoRaRetryCount < 15) ? LoRaRetryCount : 15; // Rebuilt for each try
+  le.settingsHash = loraSettingsHash(buildLoRaSettingsJSON());
+  le.firmware     = TERSE_SW_VERSION.toInt();
+
+  uint8_t buf[loraPayloadMaxBytes];
+  return loraBytesToText(buf, encodeLoRaEvent(le, buf));
+}
+
 //****************************************************************************************
 // LoRa can't handle big payloads. We use a terse JSON message in this case.
-String buildLoRaJSONHeader(String eventType, double count, String lane = "1") {
+String buildLoRaJSONHeader(const CounterEvent &e) {
   String loraHeader;
-  String strCount;
-
-  strCount = String(count, 0);
-  strCount.trim();
+  String eventType = (e.type == EVENT_BOOT) ? "b" : (e.type == EVENT_HEARTBEAT) ? "hb" : "v";
 
-  if (rtcPresent()) {
-    loraHeader = "{\"ts\":\"" + getRTCTime(); // Timestamp
-  } else {
-    loraHeader = "{\"ts\":\"" + getESPTime();
-  }
+  loraHeader = "{\"ts\":\"" + getEventTimeString(e.epoch); // Timestamp
 
   loraHeader = loraHeader +
                "\",\"v\":\""  + TERSE_SW_VERSION + // Firmware version
                "\",\"et\":\"" + eventType +        // Event type: boot, heartbeat, vehicle
-               "\",\"c\":\""  + strCount +         // Total counts registered
-               "\",\"t\":\""  + String(getRTCTemperature(), 1) + // Temperature in C
+               "\",\"c\":\""  + String(e.count) +  // Total counts registered
+               "\",\"t\":\""  + String(e.tempC10 / 10.0, 1) + // Temperature in C
                "\",\"r\":\"" + "0" ;               // Retries
 
   if (eventType == "v") {
     loraHeader = loraHeader +
-                 "\",\"da\":\"" + "t";             // Detection algorithm (Threshold)
+                 "\",\"da\":\"" + getLIDARDetectorCode(); // Detection algorithm (t, v, d, c)
     loraHeader = loraHeader +
-                 "\",\"l\":\"" + lane + "\"";      // Lane number for the vehicle event
+                 "\",\"l\":\"" + String(e.lane) + "\""; // Lane number for the vehicle event
   }
 
   if ((eventType == "b") || (eventType == "hb")) { //In the boot/heartbeat messages, send the current settings.
+    String settings = buildLoRaSettingsJSON();
     loraHeader = loraHeader +
-                 "\",\"s\":{" +
-                 "\"ui\":\"" + config.lidarUpdateInterval  + "\"" +
-                 ",\"sf\":\"" + config.lidarSmoothingFactor + "\"" +
-                 ",\"rt\":\"" + config.lidarResidenceTime   + "\"" +
-                 ",\"1m\":\"" + config.lidarZone1Min        + "\"" +
-                 ",\"1x\":\"" + config.lidarZone1Max        + "\"" +
-                 ",\"2m\":\"" + config.lidarZone2Min        + "\"" +
-                 ",\"2x\":\"" + config.lidarZone2Max        + "\"" +
-                 "}";
+                 "\",\"s\":" + settings +
+                 ",\"sh\":\"" + getSettingsHashString(loraSettingsHash(settings)) + "\""; // As vehicle events carry it
+  }
+
+  if (eventType == "hb") { // How the sensor's doing (digameLIDARHealth.h)
+    loraHeader = loraHeader + ",\"h\":" + getLIDARHealthJSON(lidarHealth.summary(micros()), true);
+    loraHeader = loraHeader + ",\"qd\":" + String(eventQueue.dropped); // Events lost to a full queue
+    loraHeader = loraHeader + ",\"jp\":" + String(journal.pending);     // Events waiting on the card
   }
   // DEBUG_PRINTLN(loraHeader);
   return loraHeader;
@@ -462,30 +548,24 @@ String buildLoRaJSONHeader(String eventType, double count, String lane = "1") {
 
 //****************************************************************************************
 // WiFi can handle a more human-readable JSON data payload.
-String buildWiFiJSONHeader(String eventType, double count, String lane = "1") {
+String buildWiFiJSONHeader(const CounterEvent &e) {
   String jsonHeader;
-  String strCount;
-
-  strCount = String(count, 0);
-  strCount.trim();
-
-  if (eventType == "b") eventType  = "Boot";
-  if (eventType == "hb") eventType = "Heartbeat";
-  if (eventType == "v") eventType  = "Vehicle";
+  String eventType = (e.type == EVENT_BOOT) ? "Boot" : (e.type == EVENT_HEARTBEAT) ? "Heartbeat" : "Vehicle";
 
+  xSemaphoreTake(configMutex, portMAX_DELAY); // The web server and lane discovery change config
   jsonHeader = "{\"deviceName\":\""      + config.deviceName +
                "\",\"deviceMAC\":\""   + myMACAddress +      // Read at boot
                "\",\"firmwareVer\":\"" + TERSE_SW_VERSION  +
-               "\",\"timeStamp\":\""   + currentTime +       // Updated in main loop from RTC
+               "\",\"timeStamp\":\""   + getEventTimeString(e.epoch) + // When it happened
                "\",\"eventType\":\""   + eventType +
-               "\",\"count\":\""       + strCount +          // Total counts registered
-               "\",\"temp\":\""        + String(getRTCTemperature(), 1); // Temperature in C
+               "\",\"count\":\""       + String(e.count) +   // Total counts registered
+               "\",\"temp\":\""        + String(e.tempC10 / 10.0, 1); // Temperature in C
 
   if (eventType == "Vehicle") {
     jsonHeader = jsonHeader +
-                 "\",\"detAlgorithm\":\"" + "Threshold";// Detection algorithm (Threshold)
+                 "\",\"detAlgorithm\":\"" + getLIDARDetectorName(); // Detection algorithm
     jsonHeader = jsonHeader +
-                 "\",\"lane\":\"" + lane + "\"";        // Lane in which the vehicle was seen
+                 "\",\"lane\":\"" + String(e.lane) + "\""; // Lane in which the vehicle was seen
   }
 
   if ((eventType == "Boot") || (eventType == "Heartbeat")) { //In the boot/heartbeat messages, send the current settings.
@@ -500,6 +580,16 @@ String buildWiFiJSONHeader(String eventType, double count, String lane = "1") {
                  ",\"2x\":\"" + config.lidarZone2Max        + "\"" +
                  "}";
   }
+  xSemaphoreGive(configMutex);
+
+  if (eventType == "Heartbeat") { // How the sensor's doing (digameLIDARHealth.h)
+    jsonHeader = jsonHeader + ",\"lidarHealth\":" + getLIDARHealthJSON(lidarHealth.summary(micros()));
+    jsonHeader = jsonHeader + ",\"queueDrops\":" + String(eventQueue.dropped) + // Events lost to a
+                 ",\"rawSignalDrops\":" + String(eventQueue.rawDropped) +       //   full queue
+                 ",\"journalPending\":" + String(journal.pending) +             // Waiting on the card
+                 ",\"http\":" + getHTTPSessionJSON(httpSession) +               // POST latencies
+                 ",\"delivery\":" + getDeliveryJSON(delivery);                  // Retries, radio time
+  }
 
   //  jsonHeader = jsonHeader + "\"";
 
@@ -508,21 +598,38 @@ String buildWiFiJSONHeader(String eventType, double count, String lane = "1") {
 
 //****************************************************************************************
 // LoRa messages to the server all have a similar format. This builds the common header.
-String buildJSONHeader(String eventType, double count, String lane = "1") {
+String buildJSONHeader(const CounterEvent &e) {
   String retValue = "";
 
 #if USE_LORA
-  retValue = buildLoRaJSONHeader(eventType, count, lane);
+  retValue = buildLoRaJSONHeader(e);
   //DEBUG_PRINTLN(retValue);
   return retValue;
 #endif
 
 #if USE_WIFI
-  return buildWiFiJSONHeader(eventType, count, lane);
+  return buildWiFiJSONHeader(e);
 #endif
 
 }
 
+//****************************************************************************************
+// The whole message for an event. Vehicle events may include raw data from the sensor.
+String buildJSONMessage(const CounterEvent &e, const RawSignal *raw) {
+  String msg = buildJSONHeader(e);
+  if (raw) {
+    msg = msg + ",\"rawSignal\":[";
+    for (int i = 0; i < raw->length; i++) {
+      msg = msg + raw->samples[i];
+      if (i < raw->length - 1) {
+        msg = msg + ",";
+      }
+    }
+    msg = msg + "]";
+  }
+  return msg + "}"; // Close out the JSON
+}
+
 //****************************************************************************************
 /* Playing around with scheduling message delivery to minimize interference between LoRa
     counters.
@@ -543,7 +650,7 @@ bool inTransmitWindow(int counterNumber, int numCounters = 3) {
 
   // return true; // Uncomment to turn off time window check and allow counters to respond at any time.
 
-  if (config.showDataStream == "false") {
+  if (!getRuntimeConfig().showDataStream) {
     DEBUG_PRINT("This Second: ");
     DEBUG_PRINTLN(thisSecond);
   }
@@ -566,9 +673,28 @@ bool inTransmitWindow(int counterNumber, int numCounters = 3) {
 }
 
 
+//****************************************************************************************
+// The server keeps refusing the oldest message: keep it in /undelivered.txt on the SD card
+// (one JSON message a line) and move on to the next.
+void setAsideOldestMessage() {
+  CounterEvent e;
+  const RawSignal *raw = nullptr;
+
+  if (journal.isOpen()) {
+    if (!journal.peek(e, raw)) return;
+    appendTextFile("/undelivered.txt", buildJSONMessage(e, raw));
+    journal.ack();
+  } else {
+    if (!eventQueue.peek(e)) return;
+    appendTextFile("/undelivered.txt", buildJSONMessage(e, eventQueue.rawSignal(e)));
+    eventQueue.pop();
+  }
+}
+
+
 //****************************************************************************************
 // A task that runs on Core0 using a circular buffer to enqueue messages to the server...
-// Current version keeps retrying forever if an ACK isn't received. TODO: Fix.
+// A message that isn't ACKed is tried again on the schedule in digameDeliveryScheduler.h.
 void messageManager(void *parameter) {
 
   bool messageACKed = true;
@@ -579,53 +705,120 @@ void messageManager(void *parameter) {
 
   for (;;) {
 
+    RuntimeConfig rc = getRuntimeConfig();
+    CounterEvent event;
+    const RawSignal *raw = nullptr;
+    bool haveEvent = false;
+
+    //*******************************
+    // Journal what the loop has queued: one write to the card for a burst
+    //*******************************
+    if (journal.isOpen()) {
+      bool sync = journalSyncNeeded; // Before the queue is read: it then has all the loop queued
+      while (eventQueue.peek(event) && journal.append(event, eventQueue.rawSignal(event))) {
+        eventQueue.pop();
+      }
+      if (sync || journal.commitDue(millis())) {
+        journal.commit();
+        if (sync) journalSyncNeeded = false;
+      }
+    }
+
+    // Only read the oldest event once a try is due: the breaker can hold off for many
+    // minutes, and there's no need to read the card ten times a second meanwhile.
+    if (delivery.wait(millis()) == 0) {
+      if (journal.isOpen()) {
+        haveEvent = journal.peek(event, raw);
+      } else {
+        haveEvent = eventQueue.peek(event);
+        raw = eventQueue.rawSignal(event);
+      }
+    }
+
     //*******************************
     // Process a message on the queue
     //*******************************
-    if ( (msgBuffer.size() > 0) &&
-         (inTransmitWindow(config.counterID.toInt(), config.counterPopulation.toInt())) )
+    if ( haveEvent &&
+         (inTransmitWindow(rc.counterID, rc.counterPopulation)) &&
+         delivery.due(millis()) )
     {
       
       wifiMessagePending = true;
         
-      if (config.showDataStream == "false") {
+      if (!rc.showDataStream) {
         DEBUG_PRINT("Buffer Size: ");
-        DEBUG_PRINTLN(msgBuffer.size());
+        DEBUG_PRINT(journal.isOpen() ? journal.pending : eventQueue.size());
+        DEBUG_PRINTLN(" (dropped: " + String(eventQueue.dropped) + ")");
       }
 
-      String activeMessage = String(msgBuffer.first()->c_str()); // Read from the buffer without removing the data from it.
+      bool batchPosted = false; // A batch POST acks what the server took itself
+      unsigned long tSend = millis();
 
-      // Send the data to the LoRa-WiFi base station that re-formats and routes it to the
-      // ParkData server.
-      #if USE_LORA
-        messageACKed = sendReceiveLoRa(activeMessage);
+      // Send a backlog to the ParkData server several events to a POST, if it takes
+      // batches. (Only from the journal: the queue in RAM goes one at a time.)
+      #if USE_WIFI
+        if (journal.isOpen() && (rc.postBatchSize > 1) && serverTakesBatches) {
+          int sent = postEventBatch(journal, rc.postBatchSize, buildJSONMessage, config);
+          if (sent == BATCH_POST_UNSUPPORTED) {
+            DEBUG_PRINTLN("Server doesn't take batches. Sending one event at a time.");
+            serverTakesBatches = false;
+          }
+          batchPosted = (sent != BATCH_POST_UNSUPPORTED);
+          messageACKed = (sent > 0);
+        }
       #endif
 
-      // Send the data directly to the ParkData server via http(s) POST
+      if (!batchPosted) {
+        // Send the data to the LoRa-WiFi base station that re-formats and routes it to the
+        // ParkData server. Vehicle events go as binary (digameLoRaPayload.h); the logs on
+        // the card keep the JSON.
+        #if USE_LORA
+          String activeMessage = (event.type == EVENT_VEHICLE) ? buildLoRaPayload(event)
+                                                               : buildJSONMessage(event, raw);
+          messageACKed = sendReceiveLoRa(activeMessage);
+        #endif
+
+        // Send the data directly to the ParkData server via http(s) POST
+        #if USE_WIFI
+          messageACKed = postJSON(buildJSONMessage(event, raw), config);
+        #endif
+      }
+
+      // How it went, for the retry schedule. LoRa only knows ACK or not; over WiFi only a
+      // 4xx is the message's fault (a 5xx mustn't set the backlog aside).
+      DeliveryOutcome outcome = messageACKed ? DELIVERY_OK : DELIVERY_NO_REPLY;
       #if USE_WIFI
-        messageACKed = postJSON(activeMessage, config);
-      #endif  
+        outcome = httpDeliveryOutcome(messageACKed, lastPostResponseCode);
+      #endif
+      bool giveUp = delivery.report(outcome, millis(), millis() - tSend);
 
       if (messageACKed)
       {
         // Message sent and received. Take it off of the queue.
-        xSemaphoreTake(mutex_v, portMAX_DELAY);
-        String  * entry = msgBuffer.shift();
-        delete entry;
-        xSemaphoreGive(mutex_v);
+        if (batchPosted) {
+          // postEventBatch() took what the server stored off the journal.
+        } else if (journal.isOpen()) {
+          journal.ack();
+        } else {
+          eventQueue.pop();
+        }
 
-        if (config.showDataStream == "false")
+        if (!rc.showDataStream)
         {
           DEBUG_PRINTLN("Success!");
           DEBUG_PRINTLN();
           wifiMessagePending = false;
       
         }
+      } else if (giveUp) {
+        DEBUG_PRINTLN("******* Server won't take it. Setting it aside. **********");
+        setAsideOldestMessage();
       } else {
-        if (config.showDataStream == "false")
+        if (!rc.showDataStream)
         {
           DEBUG_PRINTLN("******* Timeout Waiting for ACK **********");
-          DEBUG_PRINT("Retrying...");
+          DEBUG_PRINT("Retrying in " + String(delivery.wait(millis()) / 1000.0, 1) + " s");
+          DEBUG_PRINTLN((delivery.state() == BREAKER_CLOSED) ? "" : " (link down)");
         }
       }
     } else {
@@ -683,7 +876,7 @@ void countDisplayManager(void *parameter) {
   int countDisplayUpdateRate = 200;
   static unsigned int oldCount = 0;
 
-  if (config.showDataStream == "false") {
+  if (!getRuntimeConfig().showDataStream) {
     DEBUG_PRINT("Display Manager Running on Core #: ");
     DEBUG_PRINTLN(xPortGetCoreID());
     DEBUG_PRINTLN();
@@ -712,7 +905,8 @@ void handleModeButtonPress() {
   if (digitalRead(CTR_RESET) == LOW) {
     count = 0;
     clearLIDARDistanceHistogram();
-    if (config.showDataStream == "false") {
+    clearLIDARDwellHistograms();
+    if (!getRuntimeConfig().showDataStream) {
       DEBUG_PRINT("Loop: RESET button pressed. Count: ");
       DEBUG_PRINTLN(count);
     }
@@ -722,11 +916,10 @@ void handleModeButtonPress() {
 //**************************************************************************************
 void handleBootEvent() {
   if (bootMessageNeeded) {
-    msgPayload = buildJSONHeader("b", count);
-    msgPayload = msgPayload + "}";
-    pushMessage(msgPayload);
-    if (config.logBootEvents == "checked") {
-      appendTextFile("/eventlog.txt", msgPayload);
+    CounterEvent e = makeEvent(EVENT_BOOT);
+    pushEvent(e);
+    if (getRuntimeConfig().logBootEvents) {
+      appendTextFile("/eventlog.txt", buildJSONMessage(e, nullptr));
     }
     bootMessageNeeded = false;
   }
@@ -737,7 +930,13 @@ void handleBootEvent() {
 void handleResetEvent() {
   if (resetFlag) {
     DEBUG_PRINTLN("Reset flag has been flipped. Rebooting the processor.");
-    delay(1000);
+    // Have the message manager commit the journal (events and checkpoint) and wait till
+    // it has: it may be in the middle of a POST (5 s) or a LoRa wait (2.5 s).
+    journalSyncNeeded = true;
+    unsigned long t0 = millis();
+    while (journal.isOpen() && journalSyncNeeded && (millis() - t0 < 10000)) {
+      delay(10);
+    }
     ESP.restart();
   }
 }
@@ -745,15 +944,16 @@ void handleResetEvent() {
 //**************************************************************************************
 void handleHeartBeatEvent() { // Issue a heartbeat message, if needed.
 
+  RuntimeConfig rc = getRuntimeConfig();
   unsigned long deltaT = (millis() - lastHeartbeatMillis);
   unsigned long slippedMilliSeconds = 0;
-  if ( (deltaT) >= config.heartbeatInterval.toInt() * 1000 ) {
-    if (config.showDataStream == "false") {
+  if ( (deltaT) >= rc.heartbeatInterval * 1000 ) {
+    if (!rc.showDataStream) {
       DEBUG_PRINT("millis: ");
       DEBUG_PRINTLN(deltaT);
     }
-    slippedMilliSeconds = deltaT - config.heartbeatInterval.toInt() * 1000; // Since this Task is on a 100 msec schedule, we'll always be a little late...
-    if (config.showDataStream == "false") {
+    slippedMilliSeconds = deltaT - rc.heartbeatInterval * 1000; // Since this Task is on a 100 msec schedule, we'll always be a little late...
+    if (!rc.showDataStream) {
       DEBUG_PRINT("slipped ms: ");
       DEBUG_PRINTLN(slippedMilliSeconds);
     }
@@ -761,11 +961,10 @@ void handleHeartBeatEvent() { // Issue a heartbeat message, if needed.
   }
 
   if (heartbeatMessageNeeded) {
-    msgPayload = buildJSONHeader("hb", count);
-    msgPayload = msgPayload + "}";
-    pushMessage(msgPayload);
-    if (config.logHeartBeatEvents == "checked") {
-      appendTextFile("/eventlog.txt", msgPayload);
+    CounterEvent e = makeEvent(EVENT_HEARTBEAT);
+    pushEvent(e);
+    if (rc.logHeartBeatEvents) {
+      appendTextFile("/eventlog.txt", buildJSONMessage(e, nullptr));
     }
     heartbeatMessageNeeded = false;
     lastHeartbeatMillis = millis() - slippedMilliSeconds;
@@ -773,24 +972,86 @@ void handleHeartBeatEvent() { // Issue a heartbeat message, if needed.
 }
 
 
+//---------------------------------------------------------------------------------------------
+void handleLaneDiscovery() { // Update the lane finder and apply its proposal, if enabled.
+
+  static unsigned long lastUpdateMillis = 0;
+  static unsigned long lastApplyMillis = 0;
+
+  if ((millis() - lastUpdateMillis) < LANE_UPDATE_MS) return;
+  lastUpdateMillis = millis();
+
+  // The web server's /lanes page reads the finder and changes config too.
+  RuntimeConfig rc = getRuntimeConfig();
+  xSemaphoreTake(configMutex, portMAX_DELAY);
+  lidarLaneFinder.update(lidarDistanceHistogram);
+
+  String newLimits;
+  if (rc.lidarAutoLanes && ((millis() - lastApplyMillis) >= LANE_AUTO_APPLY_MS)) {
+    lastApplyMillis = millis();
+    LaneProposal proposal = lidarLaneFinder.propose();
+    if (applyLaneProposal(proposal, config)) {
+      publishRuntimeConfig(config);
+      saveConfiguration(filename, config);
+      newLimits = getLaneProposalJSON(proposal, config);
+    }
+  }
+  xSemaphoreGive(configMutex);
+
+  if ((newLimits.length() > 0) && !rc.showDataStream) {
+    DEBUG_PRINTLN("New lane limits: " + newLimits);
+  }
+}
+
+
 //**************************************************************************************
-String appendRawDataToMsgPayload(){
-  // Vehicle passing event messages may include raw data from the sensor.
-  // If so, tack the data buffer on the JSON message.
-  msgPayload = msgPayload + ",\"rawSignal\":[";
+// Copy the raw data from the sensor into the queue's next raw signal slot, if there's one
+// free. Returns it, or nullptr.
+RawSignal *copyRawSignal(){
+  RawSignal *raw = eventQueue.rawSlot();
+  if (!raw) return nullptr;
   using index_t = decltype(lidarHistoryBuffer)::index_t;
-  for (index_t i = 0; i < lidarHistoryBuffer.size(); i++) {
-    msgPayload = msgPayload + lidarHistoryBuffer[i];
-    if (i < lidarHistoryBuffer.size() - 1) {
-      msgPayload = msgPayload + ",";
-    }
+  raw->length = 0;
+  for (index_t i = 0; (i < lidarHistoryBuffer.size()) && (raw->length < eventRawSignalLength); i++) {
+    raw->samples[raw->length++] = lidarHistoryBuffer[i];
   }
-  msgPayload = msgPayload + "]";
+  return raw;
 }
 
 //**************************************************************************************
 void handleVehicleEvent() { // Test if vehicle event has occured. Route message if needed.
-  vehicleMessageNeeded = processLIDARSignal3(config); //
+  RuntimeConfig rc = getRuntimeConfig(); // No Strings on the detection path.
+
+  static bool rawLogWanted = false; // Follow the logRawData setting. (It can change from 
+  if (rc.logRawData != rawLogWanted) { //   the web page.)
+    rawLogWanted = rc.logRawData;
+    if (rawLogWanted) {
+      startRawLog("/rawdata.bin");
+    } else {
+      stopRawLog();
+    }
+  }
+
+  // Each vehicle is reported as the detector sees it, so the raw signal sent with it
+  // ends at the event.
+  auto onVehicle = [&rc](int lane) {
+    vehicleMessageNeeded = lane;
+    reportVehicleEvent(rc);
+  };
+
+#if LIDAR_FREE_RUNNING
+  LIDARSample samples[32]; // Whatever has arrived since the last pass.
+  int n = readLIDARSamples(samples, 32);
+  processLIDARSamples(rc, samples, n, onVehicle);
+#else
+  LIDARSample sample = readLIDARSample();
+  processLIDARSamples(rc, &sample, 1, onVehicle);
+  tfmP.sendCommand(TRIGGER_DETECTION, 0); // Trigger the next measurement
+#endif
+}
+
+//**************************************************************************************
+void reportVehicleEvent(const RuntimeConfig &rc) { // Route a message for vehicleMessageNeeded.
 
   //DEBUG_PRINTLN(vehicleMessageNeeded);
 
@@ -798,27 +1059,29 @@ void handleVehicleEvent() { // Test if vehicle event has occured. Route message
     if (lidarBuffer.size() == lidarSamples) { // Fill up the buffer before processing so
                                               // we don't get false events at startup.
       count++;
+      xSemaphoreTake(configMutex, portMAX_DELAY); // The web server reads it
       config.lidarZone1Count = String(count); // Update this so entities making use of config have access to the current count.
                                               // e.g., digameWebServer.h
                                               // TODO: revisit having count data live in config.-- Seems way too coupled.
+      xSemaphoreGive(configMutex);
 
-      if (config.showDataStream == "false") {
+      if (!rc.showDataStream) {
         DEBUG_PRINT("Vehicle event! Counts: ");
         DEBUG_PRINTLN(count);
         DEBUG_PRINTLN("LANE " + String(vehicleMessageNeeded) + " Event !");
-        msgPayload = buildJSONHeader("v", count, String(vehicleMessageNeeded));
       }
 
+      CounterEvent e = makeEvent(EVENT_VEHICLE, vehicleMessageNeeded);
+      RawSignal *raw = nullptr;
       #if (USE_WIFI) && (APPEND_RAW_DATA_WIFI)
-        appendRawDataToMsgPayload();
+        raw = copyRawSignal();
+        if (!raw) eventQueue.rawDropped++; // Sent without it
       #endif
 
-      msgPayload = msgPayload + "}"; // Close out the JSON
-
-      pushMessage(msgPayload);
-      if (config.logVehicleEvents == "checked") {
-        appendTextFile("/eventlog.txt", msgPayload);
+      if (rc.logVehicleEvents) { // Before it's pushed: after, the raw signal is core 0's
+        appendTextFile("/eventlog.txt", buildJSONMessage(e, raw));
       }
+      pushEvent(e, raw != nullptr);
     }    
     vehicleMessageNeeded = 0; 
   } 
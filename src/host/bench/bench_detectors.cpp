@@ -0,0 +1,79 @@
+/* bench_detectors.cpp
+ *
+ *  Cycles per reading through processLIDARSamples() for each detector
+ *  alone, and with shadows. The shadows share the pass over the readings
+ *  and the bookkeeping (histogram, lidarBuffer, dwell times), so three
+ *  detectors cost less than three runs.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameDetectors.h>
+
+#include <vector>
+
+#include "hostBench.h"
+
+static std::vector<LIDARSample> samples;
+
+//****************************************************************************************
+// Synthetic traffic: empty road with cars in both lanes every so often, 100 Hz.
+static void makeSamples(int n)
+{
+  samples.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    int phase = i % 400;
+    int d = 999 + random(-2, 3);
+    if (phase >= 100 && phase < 160) d = 200 + random(-20, 20);
+    if (phase >= 260 && phase < 320) d = 500 + random(-20, 20);
+    samples[i].dist = (int16_t)d;
+    samples[i].flux = 1000;
+    samples[i].temp = 30;
+    samples[i].status = TFMP_READY;
+    samples[i].timeUS = (uint32_t)i * 10000;
+  }
+}
+
+static double cycles(const char *detector, const char *shadows, long n)
+{
+  Config c = config;
+  c.lidarDetectionAlgorithm = detector;
+  c.lidarShadowDetectors = shadows;
+  selectLIDARDetectors(buildRuntimeConfig(c));
+
+  RuntimeConfig rc = getRuntimeConfig();
+  long events = 0;
+  const int batch = 32;
+  double perBatch = benchCyclesPerCall([&](long i) {
+    processLIDARSamples(rc, &samples[(i * batch) % (n - batch)], batch, [&](int) { events++; });
+  }, n / batch);
+  benchKeep(events);
+  return perBatch / batch;
+}
+
+int main()
+{
+  const long n = 200000;
+  makeSamples(n);
+  config.lidarZone1Min = "0";
+  config.lidarZone1Max = "300";
+  config.lidarZone2Min = "400";
+  config.lidarZone2Max = "700";
+  publishRuntimeConfig(config);
+
+  printf("Detectors, %ld readings in batches of 32\n", n);
+  printf("%-36s %12s\n", "", "cycles");
+  double sum = 0;
+  for (int a = 0; a < DETECT_ALGORITHMS; a++)
+  {
+    double c = cycles(detectionAlgorithmNames[a], "", n);
+    if ((a == DETECT_THRESHOLD) || (a == DETECT_DECAY) || (a == DETECT_CORRELATION)) sum += c;
+    printf("%-36s %12.1f\n", detectionAlgorithmNames[a], c);
+  }
+  printf("%-36s %12.1f\n", "Decay + Threshold (shadow)", cycles("Decay", "Threshold", n));
+  printf("%-36s %12.1f\n", "Decay + Threshold + Correlation", cycles("Decay", "Threshold,Correlation", n));
+  printf("%-36s %12.1f\n", "  (the three run separately)", sum);
+  printf("(cycles per reading)\n");
+  return 0;
+}
@@ -0,0 +1,60 @@
+/* bench_dual_lidar_passages.cpp
+ *
+ *  Cycles per pair of readings through the people counter's passage engine,
+ *  with an empty doorway and with someone through it every second, and so
+ *  what a passage's correlation costs. At 100 Hz an ESP32 at 240 MHz has
+ *  2.4 million cycles per pair.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "../tools/digameDualReplay.h"
+
+#include "hostBench.h"
+
+// n pairs; with busy, someone 40 cm long at 1 m/s every second, alternating ways.
+static std::vector<LIDARPair> makePairs(int n, bool busy)
+{
+  std::vector<LIDARPair> pairs(n);
+  for (int i = 0; i < n; i++)
+  {
+    int phase = i % 100; // 10 ms steps
+    bool outbound = (i / 100) % 2;
+    pairs[i].timeUS = (uint32_t)i * dualLIDARPeriodUS;
+    for (int c = 0; c < 2; c++)
+    {
+      int enters = (outbound == (c == 0)) ? 0 : 20;
+      bool seen = busy && (phase >= enters) && (phase < enters + 40);
+      pairs[i].sample[c] = {pairs[i].timeUS, (int16_t)((seen ? 70 : 230) + random(-2, 3)), 500, 30, TFMP_READY};
+    }
+  }
+  return pairs;
+}
+
+static double cycles(const std::vector<LIDARPair> &pairs, unsigned long &passages)
+{
+  DualLIDARPassages engine;
+  DualLIDARPassage out[4];
+  long sum = 0;
+  double perCall = benchCyclesPerCall([&](long i) { sum += engine.update(pairs[i], out, 4); },
+                                      (long)pairs.size());
+  benchKeep(sum);
+  passages = engine.passages / 3;
+  return perCall;
+}
+
+int main()
+{
+  const int n = 100000; // 1000 s
+  unsigned long idlePassages, busyPassages;
+  double idle = cycles(makePairs(n, false), idlePassages);
+  double busy = cycles(makePairs(n, true), busyPassages);
+
+  printf("Passage engine, %d pairs\n", n);
+  printf("%-36s %12s\n", "", "cycles");
+  printf("%-36s %12.1f\n", "Empty doorway, per pair", idle);
+  printf("%-36s %12.1f\n", "A passage a second, per pair", busy);
+  if (busyPassages > 0) printf("%-36s %12.0f\n", "Per passage", (busy - idle) * n / busyPassages);
+  printf("(%lu passages)\n", busyPassages);
+  return 0;
+}
@@ -0,0 +1,139 @@
+/* bench_fft_correlation.cpp
+ *
+ *  Cycles to cross-correlate a window with a model at every lag, direct sum
+ *  (the correlation test sketch's crossCorrelation()) against the FFT, in
+ *  float and Q15, for a range of window lengths -- to find where the FFT
+ *  starts to pay. Also the sketch's own call: 100 points, lags -200..200.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameFFT.h>
+#include <digameMatchedFilter.h>
+
+#include "hostBench.h"
+
+static float crossCorr[4 * 128 + 1];
+
+// The ESP32 has no vector unit; keep the compiler from using the host's on the direct
+// sums (the FFT's strided butterflies don't vectorize anyway), so the ratios carry over.
+#define SCALAR __attribute__((optimize("no-tree-vectorize")))
+
+//****************************************************************************************
+// The sketch's crossCorrelation(), without the prints.
+SCALAR static float direct(const float *x, const float *y, int numSamples, int maxdelay)
+{
+  float mx = 0, my = 0;
+  for (int i = 0; i < numSamples; i++)
+  {
+    mx += x[i];
+    my += y[i];
+  }
+  mx /= numSamples;
+  my /= numSamples;
+  float sx = 0, sy = 0;
+  for (int i = 0; i < numSamples; i++)
+  {
+    sx += (x[i] - mx) * (x[i] - mx);
+    sy += (y[i] - my) * (y[i] - my);
+  }
+  float denom = sqrt(sx * sy);
+
+  for (int delay = -maxdelay; delay <= maxdelay; delay++)
+  {
+    float sxy = 0;
+    for (int i = 0; i < numSamples; i++)
+    {
+      int j = i + delay;
+      if (j < 0 || j >= numSamples) continue;
+      sxy += (x[i] - mx) * (y[j] - my);
+    }
+    crossCorr[delay + maxdelay] = sxy / denom;
+  }
+  return crossCorr[maxdelay];
+}
+
+// The same in integers (Q15 model, distances less their mean).
+SCALAR static int32_t directQ15(const int16_t *x, const int16_t *y, int n, int32_t *out)
+{
+  int32_t sum = 0;
+  for (int i = 0; i < n; i++) sum += y[i];
+  int16_t b[128];
+  for (int i = 0; i < n; i++) b[i] = (int16_t)(y[i] - sum / n);
+  for (int delay = -(n - 1); delay < n; delay++)
+  {
+    int32_t sxy = 0;
+    int from = (delay < 0) ? -delay : 0, to = (delay > 0) ? n - delay : n;
+    for (int i = from; i < to; i++) sxy += x[i] * b[i + delay];
+    out[delay + n - 1] = sxy;
+  }
+  return out[n - 1];
+}
+
+struct Row
+{
+  int n;
+  double direct, directQ15, fft, fftQ15;
+};
+
+//****************************************************************************************
+template <int M>
+static Row measure(int n)
+{
+  static FFTCorrelator<M> fft;
+  static FFTCorrelatorQ15<M> fftQ15;
+  fft.setModel(fallingEdgeModel, n);
+  fftQ15.setModel(fallingEdgeModel, n);
+
+  float y[128], r[2 * 128];
+  int16_t yq[128], xq[128], rq[2 * 128];
+  int32_t out[2 * 128];
+  for (int i = 0; i < n; i++)
+  {
+    y[i] = (i < n / 3) ? 999 + random(-3, 4) : 300 + random(-10, 11);
+    yq[i] = (int16_t)y[i];
+    xq[i] = (int16_t)(fallingEdgeModel[i] * 32767);
+  }
+
+  const long calls = 20000;
+  Row row;
+  row.n = n;
+  row.direct = benchCyclesPerCall([&](long) { benchKeep(direct(fallingEdgeModel, y, n, n - 1)); }, calls);
+  row.directQ15 = benchCyclesPerCall([&](long) { benchKeep(directQ15(xq, yq, n, out)); }, calls);
+  row.fft = benchCyclesPerCall([&](long) { benchKeep(fft.correlate(y, r)); }, calls);
+  row.fftQ15 = benchCyclesPerCall([&](long) { benchKeep(fftQ15.correlate(yq, rq)); }, calls);
+  return row;
+}
+
+int main()
+{
+  Row rows[] = {measure<8>(4),    measure<16>(8),   measure<32>(16),  measure<64>(32),
+                measure<128>(50), measure<128>(64), measure<256>(100), measure<256>(128)};
+
+  printf("Cross-correlation at every lag, falling edge model (cycles per call)\n");
+  printf("%6s %6s %12s %12s %12s %12s\n", "n", "M", "direct", "FFT", "direct Q15", "FFT Q15");
+  int crossover = 0, crossoverQ15 = 0;
+  for (const Row &row : rows)
+  {
+    int m = 4;
+    while (m < 2 * row.n - 1) m *= 2;
+    printf("%6d %6d %12.0f %12.0f %12.0f %12.0f\n", row.n, m, row.direct, row.fft, row.directQ15,
+           row.fftQ15);
+    if (!crossover && (row.fft < row.direct)) crossover = row.n;
+    if (!crossoverQ15 && (row.fftQ15 < row.directQ15)) crossoverQ15 = row.n;
+  }
+  printf("FFT faster from n = %d (float), ", crossover);
+  if (crossoverQ15) printf("n = %d (Q15)\n", crossoverQ15);
+  else printf("not below n = %d (Q15)\n", rows[sizeof(rows) / sizeof(rows[0]) - 1].n);
+
+  // What the sketch actually asks for: lags -2n..2n.
+  static FFTCorrelator<256> fft;
+  fft.setModel(fallingEdgeModel, 100);
+  float y[100], r[199];
+  for (int i = 0; i < 100; i++) y[i] = (i < 30) ? 999 : 300;
+  double sketch = benchCyclesPerCall([&](long) { benchKeep(direct(fallingEdgeModel, y, 100, 200)); }, 5000);
+  double viaFFT = benchCyclesPerCall([&](long) { benchKeep(fft.correlate(y, r)); }, 5000);
+  printf("Sketch call (100 points, lags -200..200): %.0f cycles direct, %.0f by FFT (%.1fx)\n", sketch,
+         viaFFT, sketch / viaFFT);
+  return 0;
+}
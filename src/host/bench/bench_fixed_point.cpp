@@ -0,0 +1,132 @@
+/* bench_fixed_point.cpp
+ *
+ *  Cycles per call for each kernel in digameFixedPoint.h -- smoothing,
+ *  decay, mean and variance over 100 readings, correlation with a 100 point
+ *  model -- and per reading for the v1 and v3 detectors, in float, Q15 and
+ *  Q31.
+ *
+ *  The host has a fast FPU, so float does well here; the ESP32 at 40 MHz
+ *  does the double-precision steps (the detectors' constants) in software
+ *  and has no 64-bit multiply, so read the rows as what each kernel costs
+ *  in operations rather than as ESP32 timings. Vectorizing is off, as the
+ *  ESP32 has no equivalent.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#pragma GCC optimize("no-tree-vectorize")
+
+#include <digameLIDAR.h>
+#include <digameMatchedFilter.h>
+
+#include <vector>
+
+#include "hostBench.h"
+
+static std::vector<int16_t> samples;
+
+//****************************************************************************************
+// Synthetic traffic: empty road with cars in both lanes every so often.
+static void makeSamples(int n)
+{
+  samples.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    int phase = i % 400;
+    int d = 999 + random(-2, 3);
+    if (phase >= 100 && phase < 160) d = 200 + random(-20, 20);
+    if (phase >= 260 && phase < 320) d = 500 + random(-20, 20);
+    samples[i] = (int16_t)d;
+  }
+}
+
+//****************************************************************************************
+template <typename K>
+static double smoothCycles(long n)
+{
+  typename K::Value s = K::fromInt(0);
+  typename K::Coeff a = K::coeff(0.6);
+  return benchCyclesPerCall([&](long i) { benchKeep(s = K::smooth(s, samples[i], a)); }, n);
+}
+
+template <typename K>
+static double decayCycles(long n)
+{
+  typename K::Value s = K::fromInt(100);
+  typename K::Coeff k = K::coeff(0.05);
+  return benchCyclesPerCall([&](long i) {
+    if ((i & 63) == 0) s = K::fromInt(100);
+    benchKeep(s = K::decay(s, k));
+  }, n);
+}
+
+template <typename K>
+static double meanVarianceCycles(long n)
+{
+  long windows = (long)samples.size() - modelSamples;
+  return benchCyclesPerCall([&](long i) {
+    typename K::Value m;
+    typename K::Wide v;
+    K::meanVariance(&samples[i % windows], modelSamples, m, v);
+    benchKeep(m);
+    benchKeep(v);
+  }, n);
+}
+
+template <typename K>
+static double correlationCycles(long n)
+{
+  typename K::Model model[modelSamples];
+  K::makeModel(fallingEdgeModel, modelSamples, model);
+  long windows = (long)samples.size() - modelSamples;
+  return benchCyclesPerCall([&](long i) {
+    benchKeep(K::correlation(model, &samples[i % windows], modelSamples));
+  }, n);
+}
+
+template <int (*detect)(const RuntimeConfig &, const LIDARSample &)>
+static double detectorCycles(long n)
+{
+  RuntimeConfig rc = getRuntimeConfig();
+  LIDARSample sample;
+  sample.temp = 30;
+  sample.flux = 1000;
+  sample.status = TFMP_READY;
+  sample.timeUS = 0;
+  return benchCyclesPerCall([&](long i) {
+    sample.dist = samples[i];
+    benchKeep(detect(rc, sample));
+  }, n);
+}
+
+//****************************************************************************************
+static void row(const char *name, double f, double q15, double q31)
+{
+  printf("%-28s %10.1f %10.1f %10.1f\n", name, f, q15, q31);
+}
+
+int main()
+{
+  const long n = 200000;
+  makeSamples(n);
+  config.lidarZone1Min = "0";
+  config.lidarZone1Max = "300";
+  config.lidarZone2Min = "400";
+  config.lidarZone2Max = "700";
+  publishRuntimeConfig(config);
+
+  printf("Detector arithmetic, %ld readings\n", n);
+  printf("%-28s %10s %10s %10s\n", "", FloatKernels::name(), Q15Kernels::name(), Q31Kernels::name());
+  row("smooth", smoothCycles<FloatKernels>(n), smoothCycles<Q15Kernels>(n), smoothCycles<Q31Kernels>(n));
+  row("decay", decayCycles<FloatKernels>(n), decayCycles<Q15Kernels>(n), decayCycles<Q31Kernels>(n));
+  row("mean/variance (100)", meanVarianceCycles<FloatKernels>(n / 10),
+      meanVarianceCycles<Q15Kernels>(n / 10), meanVarianceCycles<Q31Kernels>(n / 10));
+  row("correlation (100)", correlationCycles<FloatKernels>(n / 10),
+      correlationCycles<Q15Kernels>(n / 10), correlationCycles<Q31Kernels>(n / 10));
+  row("processLIDARSample", detectorCycles<processLIDARSample<FloatKernels>>(n),
+      detectorCycles<processLIDARSample<Q15Kernels>>(n), detectorCycles<processLIDARSample<Q31Kernels>>(n));
+  row("processLIDARSample3", detectorCycles<processLIDARSample3<FloatKernels>>(n),
+      detectorCycles<processLIDARSample3<Q15Kernels>>(n), detectorCycles<processLIDARSample3<Q31Kernels>>(n));
+  printf("(cycles per call)\n");
+  return 0;
+}
@@ -0,0 +1,125 @@
+/* bench_lidar_zones.cpp
+ *
+ *  Cycles per sample for the zone-strength step of processLIDARSignal2/3:
+ *  the original rescan of lidarBuffer (with its per-element String
+ *  conversions of the zone limits) against the running counts kept by
+ *  pushLIDARSample() with the limits taken from the RuntimeConfig.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameLIDAR.h>
+
+#include <vector>
+
+#include "hostBench.h"
+
+static std::vector<int> samples;
+
+//****************************************************************************************
+// Synthetic traffic: empty road with cars in both lanes every so often.
+static void makeSamples(int n)
+{
+  samples.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    int phase = i % 400;
+    int d = 999;
+    if (phase >= 100 && phase < 140) d = 200 + random(-20, 20);
+    if (phase >= 250 && phase < 290) d = 550 + random(-20, 20);
+    samples[i] = d;
+  }
+}
+
+//****************************************************************************************
+// The original per-sample rescan (processLIDARSignal2 / processLIDARSignal3).
+static long rescan2(Config &config, int dist)
+{
+  lidarBuffer.push(dist);
+
+  long zone1Strength = 0;
+  long zone2Strength = 0;
+  for (int i = 0; i < lidarBuffer.size(); i++)
+  {
+    if ((lidarBuffer[i] < config.lidarZone1Max.toInt()) &&
+        (lidarBuffer[i] > config.lidarZone1Min.toInt()))
+    {
+      zone1Strength = zone1Strength + 1;
+    }
+    if ((lidarBuffer[i] < config.lidarZone2Max.toInt()) &&
+        (lidarBuffer[i] > config.lidarZone2Min.toInt()))
+    {
+      zone2Strength = zone2Strength + 1;
+    }
+  }
+  zone1Strength = (100 * zone1Strength / lidarBuffer.size());
+  zone2Strength = (100 * zone2Strength / lidarBuffer.size());
+  return zone1Strength + zone2Strength;
+}
+
+static float rescan3(Config &config, int dist)
+{
+  lidarBuffer.push(dist);
+
+  float bufferInteg1 = 0;
+  float bufferInteg2 = 0;
+  for (int i = 0; i < lidarBuffer.size(); i++)
+  {
+    if ((lidarBuffer[i] < config.lidarZone1Max.toInt()) &&
+        (lidarBuffer[i] > config.lidarZone1Min.toInt()))
+    {
+      bufferInteg1 += 100 / lidarBuffer.size();
+    }
+    if ((lidarBuffer[i] < config.lidarZone2Max.toInt()) &&
+        (lidarBuffer[i] > config.lidarZone2Min.toInt()))
+    {
+      bufferInteg2 += 100 / lidarBuffer.size();
+    }
+  }
+  return bufferInteg1 + bufferInteg2;
+}
+
+//****************************************************************************************
+// The running-count versions.
+static long running2(const RuntimeConfig &rc, int dist)
+{
+  setLIDARZoneLimits(rc.lidarZone1Min, rc.lidarZone1Max, rc.lidarZone2Min, rc.lidarZone2Max);
+  pushLIDARSample(dist);
+
+  long zone1Strength = lidarZoneCounts.zone1;
+  long zone2Strength = lidarZoneCounts.zone2;
+  zone1Strength = (100 * zone1Strength / lidarBuffer.size());
+  zone2Strength = (100 * zone2Strength / lidarBuffer.size());
+  return zone1Strength + zone2Strength;
+}
+
+static float running3(const RuntimeConfig &rc, int dist)
+{
+  setLIDARZoneLimits(rc.lidarZone1Min, rc.lidarZone1Max, rc.lidarZone2Min, rc.lidarZone2Max);
+  pushLIDARSample(dist);
+
+  float bufferInteg1 = lidarZoneCounts.zone1 * (100 / lidarBuffer.size());
+  float bufferInteg2 = lidarZoneCounts.zone2 * (100 / lidarBuffer.size());
+  return bufferInteg1 + bufferInteg2;
+}
+
+//****************************************************************************************
+int main()
+{
+  const long n = 200000;
+  makeSamples(n);
+  Config config;
+  RuntimeConfig rc = getRuntimeConfig();
+
+  double c2Old = benchCyclesPerCall([&](long i) { benchKeep(rescan2(config, samples[i])); }, n);
+  double c2New = benchCyclesPerCall([&](long i) { benchKeep(running2(rc, samples[i])); }, n);
+  double c3Old = benchCyclesPerCall([&](long i) { benchKeep(rescan3(config, samples[i])); }, n);
+  double c3New = benchCyclesPerCall([&](long i) { benchKeep(running3(rc, samples[i])); }, n);
+
+  printf("Zone strength, lidarSamples = %d, %ld samples\n", lidarSamples, n);
+  printf("%-22s %12s %12s %9s\n", "", "rescan", "running", "speedup");
+  printf("%-22s %12.1f %12.1f %8.1fx\n", "processLIDARSignal2", c2Old, c2New, c2Old / c2New);
+  printf("%-22s %12.1f %12.1f %8.1fx\n", "processLIDARSignal3", c3Old, c3New, c3Old / c3New);
+  printf("(cycles per sample)\n");
+  return 0;
+}
@@ -0,0 +1,78 @@
+/* bench_matched_filter.cpp
+ *
+ *  Cycles per reading for correlating the last 100 readings with a model:
+ *  the correlation test sketch's way (copy the CircularBuffer into data[],
+ *  then correlation()) against MatchedFilter, for the step and notch models
+ *  and for a smoothed model with no flat stretches.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameMatchedFilter.h>
+
+#include <CircularBuffer.h>
+#include <vector>
+
+#include "hostBench.h"
+
+static std::vector<int16_t> samples;
+
+//****************************************************************************************
+// Synthetic traffic: empty road with cars every so often.
+static void makeSamples(int n)
+{
+  samples.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    int phase = i % 400;
+    int d = 999 + random(-2, 3);
+    if (phase >= 100 && phase < 160) d = 300 + random(-20, 20);
+    samples[i] = (int16_t)d;
+  }
+}
+
+static CircularBuffer<int, modelSamples> buffer;
+static float data[modelSamples];
+
+// The sketch's loop body.
+static float rescan(const float *model, int16_t dist)
+{
+  buffer.push(dist);
+  for (byte i = 0; i < buffer.size(); i++)
+  {
+    data[i] = buffer[i];
+  }
+  return correlation((float *)model, data, modelSamples);
+}
+
+//****************************************************************************************
+static void row(const char *name, const float *model, long n)
+{
+  MatchedFilter<modelSamples> filter(model);
+  buffer.clear();
+  double cOld = benchCyclesPerCall([&](long i) { benchKeep(rescan(model, samples[i])); }, n);
+  double cNew = benchCyclesPerCall([&](long i) {
+    filter.push(samples[i]);
+    benchKeep(filter.correlation());
+  }, n);
+  printf("%-22s %10d %12.1f %12.1f %8.1fx\n", name, filter.stretches(), cOld, cNew, cOld / cNew);
+}
+
+int main()
+{
+  const long n = 200000;
+  makeSamples(n);
+
+  float smoothed[modelSamples];
+  float s = fallingEdgeModel[0];
+  for (int i = 0; i < modelSamples; i++) smoothed[i] = s = 0.9f * s + 0.1f * fallingEdgeModel[i];
+
+  printf("Correlation with a %d point model, %ld readings\n", modelSamples, n);
+  printf("%-22s %10s %12s %12s %9s\n", "", "stretches", "rescan", "streaming", "speedup");
+  row("falling edge", fallingEdgeModel, n);
+  row("rising edge", risingEdgeModel, n);
+  row("notch", notchModel, n);
+  row("smoothed falling edge", smoothed, n);
+  printf("(cycles per reading)\n");
+  return 0;
+}
@@ -0,0 +1,76 @@
+/* bench_pre_filter.cpp
+ *
+ *  Cycles per reading through lidarPreFilter for each filter and window
+ *  size, on traffic in heavy rain. The median's cost grows with the window
+ *  (it keeps the window sorted), the gate's hardly at all.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digamePreFilter.h>
+
+#include <vector>
+
+#include "hostBench.h"
+
+static std::vector<LIDARSample> samples;
+
+//****************************************************************************************
+// Cars in both lanes every so often, and a glimpse of rain one reading in ten. 100 Hz.
+static void makeSamples(int n)
+{
+  samples.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    int phase = i % 400;
+    int d = 999 + random(-2, 3);
+    if (phase >= 100 && phase < 160) d = 200 + random(-20, 20);
+    if (phase >= 260 && phase < 320) d = 500 + random(-20, 20);
+    if (random(0, 10) == 0) d = random(100, 300);
+    samples[i].dist = (int16_t)d;
+    samples[i].flux = 1000;
+    samples[i].temp = 30;
+    samples[i].status = TFMP_READY;
+    samples[i].timeUS = (uint32_t)i * 10000;
+  }
+}
+
+static double cycles(const char *filter, int window, int minRun, long n)
+{
+  Config c = config;
+  c.lidarPreFilter = filter;
+  c.lidarPreFilterWindow = String(window);
+  c.lidarMinRunLength = String(minRun);
+  LIDARPreFilter f;
+  f.configure(buildRuntimeConfig(c));
+
+  long sum = 0;
+  double perCall = benchCyclesPerCall([&](long i) { sum += f.process(samples[i % n]).dist; }, n);
+  benchKeep(sum);
+  return perCall;
+}
+
+int main()
+{
+  const long n = 200000;
+  makeSamples(n);
+
+  printf("Pre-filters, %ld readings\n", n);
+  printf("%-36s %12s\n", "", "cycles");
+  printf("%-36s %12.1f\n", "None", cycles("None", 5, 1, n));
+  for (int window : {3, 5, 9, 15, 31})
+  {
+    printf("%-36s %12.1f\n", ("Median " + String(window)).c_str(), cycles("Median", window, 1, n));
+  }
+  for (int window : {5, 7, 15, 31})
+  {
+    printf("%-36s %12.1f\n", ("Hampel " + String(window)).c_str(), cycles("Hampel", window, 1, n));
+  }
+  for (int minRun : {2, 4, 32})
+  {
+    printf("%-36s %12.1f\n", ("Min. run " + String(minRun)).c_str(), cycles("None", 5, minRun, n));
+  }
+  printf("%-36s %12.1f\n", "Median 5, min. run 3", cycles("Median", 5, 3, n));
+  printf("(cycles per reading)\n");
+  return 0;
+}
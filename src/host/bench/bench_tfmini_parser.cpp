@@ -0,0 +1,117 @@
+/* bench_tfmini_parser.cpp
+ *
+ *  Throughput (MB/s) of TFMiniParser over a recorded-style byte stream, for
+ *  a few UART chunk sizes, clean and with 1% of frames damaged. For
+ *  reference, the byte-at-a-time approach of TFMPlus::getData() (shift each
+ *  byte into a 9-byte window, check the header, then the checksum) runs
+ *  over the same stream.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameTFMiniParser.h>
+
+#include <random>
+#include <vector>
+
+#include "hostBench.h"
+
+//****************************************************************************************
+static std::vector<uint8_t> makeStream(size_t frames, int damagePerCent)
+{
+  std::mt19937 rng(7);
+  std::vector<uint8_t> stream;
+  stream.reserve(frames * TFMP_FRAME_SIZE);
+  for (size_t i = 0; i < frames; i++)
+  {
+    uint8_t frame[TFMP_FRAME_SIZE];
+    TFMPlus::hostEncodeFrame(frame, (int16_t)(rng() % 1200), (int16_t)(rng() % 30000), 35);
+    if ((int)(rng() % 100) < damagePerCent)
+    {
+      if (rng() % 2) frame[2 + rng() % 7] ^= 0x04; // Bad checksum
+      else
+      {
+        stream.insert(stream.end(), frame, frame + 4); // Dropped bytes
+        continue;
+      }
+    }
+    stream.insert(stream.end(), frame, frame + TFMP_FRAME_SIZE);
+  }
+  return stream;
+}
+
+//****************************************************************************************
+// The TFMPlus way: every byte shifts the window along by one.
+static unsigned long byteAtATime(const std::vector<uint8_t> &stream, long &sum)
+{
+  uint8_t window[TFMP_FRAME_SIZE] = {0};
+  unsigned long frames = 0;
+  for (uint8_t b : stream)
+  {
+    memmove(window, window + 1, TFMP_FRAME_SIZE - 1);
+    window[TFMP_FRAME_SIZE - 1] = b;
+    if (window[0] != TFMINI_HEADER || window[1] != TFMINI_HEADER) continue;
+
+    uint8_t chkSum = 0;
+    for (int i = 0; i < TFMP_FRAME_SIZE - 1; i++) chkSum += window[i];
+    if (chkSum != window[TFMP_FRAME_SIZE - 1]) continue;
+
+    sum += window[2] + (window[3] << 8);
+    frames++;
+    memset(window, 0, sizeof(window));
+  }
+  return frames;
+}
+
+//****************************************************************************************
+static unsigned long chunked(const std::vector<uint8_t> &stream, size_t chunk, long &sum)
+{
+  TFMiniParser parser;
+  for (size_t pos = 0; pos < stream.size(); pos += chunk)
+  {
+    size_t n = (stream.size() - pos < chunk) ? stream.size() - pos : chunk;
+    parser.parse(stream.data() + pos, n, [&](const uint8_t *frame) {
+      sum += frame[2] + (frame[3] << 8);
+    });
+  }
+  return parser.stats.frames;
+}
+
+//****************************************************************************************
+template <typename F>
+static double megabytesPerSecond(size_t bytes, F fn)
+{
+  double best = 0;
+  for (int run = 0; run < 5; run++)
+  {
+    double t0 = benchSeconds();
+    fn();
+    double rate = bytes / (benchSeconds() - t0) / 1e6;
+    if (rate > best) best = rate;
+  }
+  return best;
+}
+
+int main()
+{
+  const size_t chunkSizes[] = {16, 64, 512};
+
+  for (int damage : {0, 1})
+  {
+    std::vector<uint8_t> stream = makeStream(1000000, damage);
+    printf("%d%% damaged frames, %zu bytes\n", damage, stream.size());
+
+    long sum = 0;
+    unsigned long frames = 0;
+    double rate = megabytesPerSecond(stream.size(), [&] { frames = byteAtATime(stream, sum); });
+    printf("  byte at a time      %8.1f MB/s  (%lu frames)\n", rate, frames);
+
+    for (size_t chunk : chunkSizes)
+    {
+      rate = megabytesPerSecond(stream.size(), [&] { frames = chunked(stream, chunk, sum); });
+      printf("  parser, %3zu B chunks %8.1f MB/s  (%lu frames)\n", chunk, rate, frames);
+    }
+    benchKeep(sum);
+  }
+  printf("(A TFMini-Plus at 1000 Hz sends 0.009 MB/s.)\n");
+}
@@ -0,0 +1,60 @@
+/* hostBench.h
+ *
+ *  Timing helpers for the host benchmarks. Cycle counts come from the x86
+ *  time stamp counter (nanoseconds elsewhere), so compare numbers from the
+ *  same machine only; the ratios are what carry over to the ESP32.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_BENCH_H__
+#define __HOST_BENCH_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+inline uint64_t benchCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+inline double benchSeconds()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Keeps the optimizer from discarding a result.
+template <typename T>
+inline void benchKeep(const T &value)
+{
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Average cycles per call of fn(i) for i in [0, n), best of three runs.
+template <typename F>
+double benchCyclesPerCall(F fn, long n)
+{
+  double best = 0;
+  for (int run = 0; run < 3; run++)
+  {
+    uint64_t t0 = benchCycles();
+    for (long i = 0; i < n; i++) fn(i);
+    double perCall = (double)(benchCycles() - t0) / n;
+    if (run == 0 || perCall < best) best = perCall;
+  }
+  return best;
+}
+
+#endif // __HOST_BENCH_H__
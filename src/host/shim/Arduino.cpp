@@ -0,0 +1,118 @@
+/* Arduino.cpp (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "Arduino.h"
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+EspClass ESP;
+
+static std::atomic<uint64_t> hostMicros{0};
+static std::atomic<uint32_t> cpuFreqMhz{240};
+static std::mt19937 rng(1);
+static int pinLevels[64];
+static bool pinLevelsInit = false;
+
+unsigned long millis() { return (unsigned long)(hostMicros.load() / 1000); }
+unsigned long micros() { return (unsigned long)hostMicros.load(); }
+int64_t esp_timer_get_time() { return (int64_t)hostMicros.load(); }
+
+void delay(unsigned long ms) { hostMicros += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { hostMicros += us; }
+void yield() { std::this_thread::yield(); }
+
+static uint64_t sleepWakeupMicros = 0;
+
+int esp_sleep_enable_timer_wakeup(uint64_t timeInUs)
+{
+  sleepWakeupMicros = timeInUs;
+  return 0;
+}
+
+int esp_light_sleep_start()
+{
+  hostMicros += sleepWakeupMicros;
+  return 0;
+}
+
+void hostAdvanceMicros(uint64_t us) { hostMicros += us; }
+void hostSetMicros(uint64_t us) { hostMicros = us; }
+
+long random(long howBig)
+{
+  if (howBig <= 0) return 0;
+  return (long)(rng() % (unsigned long)howBig);
+}
+
+long random(long howSmall, long howBig)
+{
+  if (howSmall >= howBig) return howSmall;
+  return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed) { rng.seed((uint32_t)seed); }
+
+//****************************************************************************************
+// GPIO. Inputs read HIGH (pulled up, button not pressed) unless a test says otherwise.
+static void initPins()
+{
+  if (!pinLevelsInit)
+  {
+    for (auto &level : pinLevels) level = HIGH;
+    pinLevelsInit = true;
+  }
+}
+
+void pinMode(uint8_t, uint8_t) { initPins(); }
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  initPins();
+  if (pin < 64) pinLevels[pin] = val;
+}
+
+int digitalRead(uint8_t pin)
+{
+  initPins();
+  return pin < 64 ? pinLevels[pin] : LOW;
+}
+
+void hostSetPinLevel(uint8_t pin, int level)
+{
+  initPins();
+  if (pin < 64) pinLevels[pin] = level;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz)
+{
+  cpuFreqMhz = mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() { return cpuFreqMhz; }
+
+uint32_t EspClass::getCycleCount()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return (uint32_t)__rdtsc();
+#else
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+void EspClass::restart()
+{
+  fflush(stdout);
+  exit(0);
+}
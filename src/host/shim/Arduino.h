@@ -0,0 +1,81 @@
+/* Arduino.h (host shim)
+ *
+ *  Just enough of the Arduino-ESP32 core to build the Digame headers
+ *  natively on Linux for testing, profiling and benchmarking.
+ *
+ *  Time: millis()/micros() read a host clock that only moves when the
+ *  firmware calls delay()/delayMicroseconds() or a test calls
+ *  hostAdvanceMicros(). Replays are therefore deterministic and run as fast
+ *  as the CPU allows. vTaskDelay() sleeps for real so background tasks don't
+ *  spin.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_ARDUINO_H__
+#define __HOST_ARDUINO_H__
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "WString.h"
+#include "Print.h"
+#include "HardwareSerial.h"
+#include "freertos/FreeRTOS.h"
+#include "Esp.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define PROGMEM
+#define F(string_literal) (string_literal)
+
+using std::max;
+using std::min;
+
+template <typename T, typename L, typename H>
+inline T constrain(T x, L low, H high)
+{
+  return x < (T)low ? (T)low : (x > (T)high ? (T)high : x);
+}
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+bool setCpuFrequencyMhz(uint32_t cpuFreqMhz);
+uint32_t getCpuFrequencyMhz();
+
+// Host-only clock and GPIO control
+void hostAdvanceMicros(uint64_t us);
+void hostSetMicros(uint64_t us);
+void hostSetPinLevel(uint8_t pin, int level);
+
+#endif // __HOST_ARDUINO_H__
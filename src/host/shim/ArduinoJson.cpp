@@ -0,0 +1,649 @@
+/* ArduinoJson.cpp (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "ArduinoJson.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace hostjson
+{
+  Node *Node::find(const std::string &key)
+  {
+    if (type != Object) return nullptr;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+      if (keys[i] == key) return children[i].get();
+    }
+    return nullptr;
+  }
+
+  Node &Node::member(const std::string &key)
+  {
+    if (type != Object)
+    {
+      clear();
+      type = Object;
+    }
+    Node *n = find(key);
+    if (n) return *n;
+    keys.push_back(key);
+    children.emplace_back(new Node());
+    return *children.back();
+  }
+
+  //**************************************************************************************
+  // Serialization
+  //**************************************************************************************
+  static void serializeString(const std::string &s, std::string &out)
+  {
+    out.push_back('"');
+    for (char c : s)
+    {
+      switch (c)
+      {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      default:
+        if ((unsigned char)c < 0x20)
+        {
+          char tmp[8];
+          snprintf(tmp, sizeof(tmp), "\\u%04x", (unsigned char)c);
+          out += tmp;
+        }
+        else
+        {
+          out.push_back(c);
+        }
+      }
+    }
+    out.push_back('"');
+  }
+
+  void serialize(const Node &node, std::string &out)
+  {
+    switch (node.type)
+    {
+    case Node::Null: out += "null"; break;
+    case Node::Bool: out += node.b ? "true" : "false"; break;
+    case Node::Integer: out += std::to_string(node.i); break;
+    case Node::Float:
+    {
+      char tmp[32];
+      snprintf(tmp, sizeof(tmp), "%.9g", node.d);
+      out += tmp;
+      break;
+    }
+    case Node::Str: serializeString(node.s, out); break;
+    case Node::Object:
+      out.push_back('{');
+      for (size_t i = 0; i < node.children.size(); i++)
+      {
+        if (i) out.push_back(',');
+        serializeString(node.keys[i], out);
+        out.push_back(':');
+        serialize(*node.children[i], out);
+      }
+      out.push_back('}');
+      break;
+    case Node::Array:
+      out.push_back('[');
+      for (size_t i = 0; i < node.children.size(); i++)
+      {
+        if (i) out.push_back(',');
+        serialize(*node.children[i], out);
+      }
+      out.push_back(']');
+      break;
+    }
+  }
+
+  //**************************************************************************************
+  // Parsing
+  //**************************************************************************************
+  struct Parser
+  {
+    const char *p;
+    const char *end;
+    int depth = 0;
+
+    void skipSpace()
+    {
+      while (p < end && isspace((unsigned char)*p)) p++;
+    }
+
+    int parseValue(Node &out)
+    {
+      skipSpace();
+      if (p >= end) return DeserializationError::IncompleteInput;
+      if (++depth > 32) return DeserializationError::TooDeep;
+      int err;
+      switch (*p)
+      {
+      case '{': err = parseObject(out); break;
+      case '[': err = parseArray(out); break;
+      case '"':
+      case '\'':
+        out.type = Node::Str;
+        err = parseString(out.s);
+        break;
+      default: err = parseLiteral(out); break;
+      }
+      depth--;
+      return err;
+    }
+
+    int parseObject(Node &out)
+    {
+      out.clear();
+      out.type = Node::Object;
+      p++; // '{'
+      skipSpace();
+      if (p < end && *p == '}')
+      {
+        p++;
+        return DeserializationError::Ok;
+      }
+      for (;;)
+      {
+        skipSpace();
+        if (p >= end) return DeserializationError::IncompleteInput;
+        if (*p != '"' && *p != '\'') return DeserializationError::InvalidInput;
+        std::string key;
+        int err = parseString(key);
+        if (err) return err;
+        skipSpace();
+        if (p >= end) return DeserializationError::IncompleteInput;
+        if (*p++ != ':') return DeserializationError::InvalidInput;
+        Node &child = out.member(key);
+        err = parseValue(child);
+        if (err) return err;
+        skipSpace();
+        if (p >= end) return DeserializationError::IncompleteInput;
+        if (*p == ',')
+        {
+          p++;
+          continue;
+        }
+        if (*p == '}')
+        {
+          p++;
+          return DeserializationError::Ok;
+        }
+        return DeserializationError::InvalidInput;
+      }
+    }
+
+    int parseArray(Node &out)
+    {
+      out.clear();
+      out.type = Node::Array;
+      p++; // '['
+      skipSpace();
+      if (p < end && *p == ']')
+      {
+        p++;
+        return DeserializationError::Ok;
+      }
+      for (;;)
+      {
+        out.children.emplace_back(new Node());
+        int err = parseValue(*out.children.back());
+        if (err) return err;
+        skipSpace();
+        if (p >= end) return DeserializationError::IncompleteInput;
+        if (*p == ',')
+        {
+          p++;
+          continue;
+        }
+        if (*p == ']')
+        {
+          p++;
+          return DeserializationError::Ok;
+        }
+        return DeserializationError::InvalidInput;
+      }
+    }
+
+    int parseString(std::string &out)
+    {
+      char quote = *p++;
+      out.clear();
+      while (p < end && *p != quote)
+      {
+        char c = *p++;
+        if (c == '\\')
+        {
+          if (p >= end) return DeserializationError::IncompleteInput;
+          char e = *p++;
+          switch (e)
+          {
+          case 'n': out.push_back('\n'); break;
+          case 'r': out.push_back('\r'); break;
+          case 't': out.push_back('\t'); break;
+          case 'b': out.push_back('\b'); break;
+          case 'f': out.push_back('\f'); break;
+          case 'u':
+          {
+            if (end - p < 4) return DeserializationError::IncompleteInput;
+            unsigned code = (unsigned)strtoul(std::string(p, 4).c_str(), nullptr, 16);
+            p += 4;
+            if (code < 0x80)
+            {
+              out.push_back((char)code);
+            }
+            else if (code < 0x800)
+            {
+              out.push_back((char)(0xC0 | (code >> 6)));
+              out.push_back((char)(0x80 | (code & 0x3F)));
+            }
+            else
+            {
+              out.push_back((char)(0xE0 | (code >> 12)));
+              out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+              out.push_back((char)(0x80 | (code & 0x3F)));
+            }
+            break;
+          }
+          default: out.push_back(e); break;
+          }
+        }
+        else
+        {
+          out.push_back(c);
+        }
+      }
+      if (p >= end) return DeserializationError::IncompleteInput;
+      p++; // closing quote
+      return DeserializationError::Ok;
+    }
+
+    int parseLiteral(Node &out)
+    {
+      const char *start = p;
+      while (p < end && (isalnum((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.'))
+      {
+        p++;
+      }
+      std::string token(start, p - start);
+      if (token.empty()) return DeserializationError::InvalidInput;
+      if (token == "null")
+      {
+        out.clear();
+        return DeserializationError::Ok;
+      }
+      if (token == "true" || token == "false")
+      {
+        out.clear();
+        out.type = Node::Bool;
+        out.b = (token == "true");
+        return DeserializationError::Ok;
+      }
+      char *stop = nullptr;
+      bool isFloat = token.find_first_of(".eE") != std::string::npos;
+      out.clear();
+      if (isFloat)
+      {
+        out.type = Node::Float;
+        out.d = strtod(token.c_str(), &stop);
+      }
+      else
+      {
+        out.type = Node::Integer;
+        out.i = strtoll(token.c_str(), &stop, 10);
+      }
+      if (stop != token.c_str() + token.size()) return DeserializationError::InvalidInput;
+      return DeserializationError::Ok;
+    }
+  };
+
+  bool parse(const char *json, size_t len, Node &out, int &errorCode)
+  {
+    out.clear();
+    Parser parser{json, json + len};
+    parser.skipSpace();
+    if (parser.p >= parser.end)
+    {
+      errorCode = DeserializationError::EmptyInput;
+      return false;
+    }
+    errorCode = parser.parseValue(out);
+    return errorCode == DeserializationError::Ok;
+  }
+} // namespace hostjson
+
+using hostjson::Node;
+
+const char *DeserializationError::c_str() const
+{
+  switch (errorCode)
+  {
+  case Ok: return "Ok";
+  case EmptyInput: return "EmptyInput";
+  case IncompleteInput: return "IncompleteInput";
+  case InvalidInput: return "InvalidInput";
+  case NoMemory: return "NoMemory";
+  case TooDeep: return "TooDeep";
+  }
+  return "???";
+}
+
+//****************************************************************************************
+// JsonVariant
+//****************************************************************************************
+Node *JsonVariant::resolve() const
+{
+  if (!base || !pending.empty()) return nullptr;
+  return base;
+}
+
+Node *JsonVariant::materialize() const
+{
+  if (!base) return nullptr;
+  Node *n = base;
+  for (const auto &key : pending)
+  {
+    n = &n->member(key);
+  }
+  return n;
+}
+
+JsonVariant JsonVariant::operator[](const char *key) const
+{
+  JsonVariant child;
+  child.base = base;
+  child.pending = pending;
+  std::string k = key ? key : "";
+  if (pending.empty() && base)
+  {
+    Node *found = base->find(k);
+    if (found)
+    {
+      child.base = found;
+      return child;
+    }
+  }
+  child.pending.push_back(k);
+  return child;
+}
+
+JsonVariant JsonVariant::operator[](int index) const
+{
+  Node *n = resolve();
+  if (!n || n->type != Node::Array || index < 0 || (size_t)index >= n->children.size())
+  {
+    return JsonVariant();
+  }
+  return JsonVariant(n->children[index].get());
+}
+
+bool JsonVariant::containsKey(const char *key) const
+{
+  Node *n = resolve();
+  return n && n->find(key ? key : "") != nullptr;
+}
+
+size_t JsonVariant::size() const
+{
+  Node *n = resolve();
+  if (!n || (n->type != Node::Array && n->type != Node::Object)) return 0;
+  return n->children.size();
+}
+
+JsonVariant::operator const char *() const
+{
+  Node *n = resolve();
+  if (!n || n->type != Node::Str) return nullptr;
+  return n->s.c_str();
+}
+
+JsonVariant::operator String() const
+{
+  Node *n = resolve();
+  if (!n) return String("null");
+  if (n->type == Node::Str) return String(n->s);
+  std::string out;
+  hostjson::serialize(*n, out);
+  return String(out);
+}
+
+JsonVariant::operator bool() const
+{
+  Node *n = resolve();
+  if (!n) return false;
+  switch (n->type)
+  {
+  case Node::Bool: return n->b;
+  case Node::Integer: return n->i != 0;
+  case Node::Float: return n->d != 0;
+  default: return false;
+  }
+}
+
+int64_t JsonVariant::asInteger() const
+{
+  Node *n = resolve();
+  if (!n) return 0;
+  switch (n->type)
+  {
+  case Node::Bool: return n->b ? 1 : 0;
+  case Node::Integer: return n->i;
+  case Node::Float: return (int64_t)n->d;
+  case Node::Str: return strtoll(n->s.c_str(), nullptr, 10);
+  default: return 0;
+  }
+}
+
+double JsonVariant::asDouble() const
+{
+  Node *n = resolve();
+  if (!n) return 0;
+  switch (n->type)
+  {
+  case Node::Bool: return n->b ? 1 : 0;
+  case Node::Integer: return (double)n->i;
+  case Node::Float: return n->d;
+  case Node::Str: return strtod(n->s.c_str(), nullptr);
+  default: return 0;
+  }
+}
+
+JsonVariant &JsonVariant::set(const char *v)
+{
+  Node *n = materialize();
+  if (!n) return *this;
+  n->clear();
+  if (v)
+  {
+    n->type = Node::Str;
+    n->s = v;
+  }
+  base = n;
+  pending.clear();
+  return *this;
+}
+
+JsonVariant &JsonVariant::operator=(bool v)
+{
+  Node *n = materialize();
+  if (!n) return *this;
+  n->clear();
+  n->type = Node::Bool;
+  n->b = v;
+  base = n;
+  pending.clear();
+  return *this;
+}
+
+JsonVariant &JsonVariant::setInteger(int64_t v)
+{
+  Node *n = materialize();
+  if (!n) return *this;
+  n->clear();
+  n->type = Node::Integer;
+  n->i = v;
+  base = n;
+  pending.clear();
+  return *this;
+}
+
+JsonVariant &JsonVariant::setFloat(double v)
+{
+  Node *n = materialize();
+  if (!n) return *this;
+  n->clear();
+  n->type = Node::Float;
+  n->d = v;
+  base = n;
+  pending.clear();
+  return *this;
+}
+
+static void copyNode(const Node &from, Node &to)
+{
+  to.clear();
+  to.type = from.type;
+  to.b = from.b;
+  to.i = from.i;
+  to.d = from.d;
+  to.s = from.s;
+  to.keys = from.keys;
+  for (const auto &child : from.children)
+  {
+    to.children.emplace_back(new Node());
+    copyNode(*child, *to.children.back());
+  }
+}
+
+JsonVariant &JsonVariant::operator=(const JsonVariant &other)
+{
+  if (this == &other) return *this;
+  Node *src = other.resolve();
+  Node *n = materialize();
+  if (!n) return *this;
+  if (src != n)
+  {
+    Node tmp;
+    if (src) copyNode(*src, tmp);
+    *n = std::move(tmp);
+  }
+  base = n;
+  pending.clear();
+  return *this;
+}
+
+JsonVariant JsonVariant::add()
+{
+  Node *n = materialize();
+  if (!n) return JsonVariant();
+  if (n->type != Node::Array)
+  {
+    n->clear();
+    n->type = Node::Array;
+  }
+  n->children.emplace_back(new Node());
+  return JsonVariant(n->children.back().get());
+}
+
+JsonObject JsonVariant::createNestedObject()
+{
+  return add().to<JsonObject>();
+}
+
+JsonObject JsonVariant::createNestedObject(const char *key)
+{
+  return (*this)[key].to<JsonObject>();
+}
+
+JsonArray JsonVariant::createNestedArray()
+{
+  return add().to<JsonArray>();
+}
+
+JsonArray JsonVariant::createNestedArray(const char *key)
+{
+  return (*this)[key].to<JsonArray>();
+}
+
+//****************************************************************************************
+// Free functions
+//****************************************************************************************
+DeserializationError deserializeJson(JsonDocument &doc, const char *json, size_t len)
+{
+  int code = DeserializationError::Ok;
+  if (!json)
+  {
+    doc.clear();
+    return DeserializationError::EmptyInput;
+  }
+  hostjson::parse(json, len, doc.root, code);
+  return DeserializationError((DeserializationError::Code)code);
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, const char *json)
+{
+  return deserializeJson(doc, json, json ? strlen(json) : 0);
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, const String &json)
+{
+  return deserializeJson(doc, json.c_str(), json.length());
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, Stream &input)
+{
+  String all = input.readString();
+  return deserializeJson(doc, all);
+}
+
+size_t serializeJson(const JsonDocument &doc, String &output)
+{
+  std::string out;
+  hostjson::serialize(doc.root, out);
+  output = String(out);
+  return out.size();
+}
+
+size_t serializeJson(const JsonDocument &doc, Print &output)
+{
+  std::string out;
+  hostjson::serialize(doc.root, out);
+  return output.write((const uint8_t *)out.data(), out.size());
+}
+
+size_t serializeJson(const JsonDocument &doc, char *output, size_t size)
+{
+  std::string out;
+  hostjson::serialize(doc.root, out);
+  if (!output || size == 0) return 0;
+  size_t n = out.size() < size - 1 ? out.size() : size - 1;
+  memcpy(output, out.data(), n);
+  output[n] = 0;
+  return n;
+}
+
+size_t serializeJson(const JsonVariant &v, String &output)
+{
+  std::string out;
+  Node *n = v.resolve();
+  if (n) hostjson::serialize(*n, out);
+  else out = "null";
+  output = String(out);
+  return out.size();
+}
+
+size_t measureJson(const JsonDocument &doc)
+{
+  std::string out;
+  hostjson::serialize(doc.root, out);
+  return out.size();
+}
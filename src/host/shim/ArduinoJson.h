@@ -0,0 +1,293 @@
+/* ArduinoJson.h (host shim)
+ *
+ *  A small DOM with the ArduinoJson 6 surface the Digame code uses:
+ *  StaticJsonDocument / DynamicJsonDocument, chained operator[] that only
+ *  creates members on assignment, implicit conversions, as<T>(), arrays via
+ *  add()/createNestedObject(), deserializeJson() and serializeJson().
+ *  Document capacity is not enforced.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_ARDUINO_JSON_H__
+#define __HOST_ARDUINO_JSON_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Arduino.h"
+
+namespace hostjson
+{
+  struct Node
+  {
+    enum Type
+    {
+      Null,
+      Bool,
+      Integer,
+      Float,
+      Str,
+      Object,
+      Array
+    } type = Null;
+
+    bool b = false;
+    int64_t i = 0;
+    double d = 0;
+    std::string s;
+    std::vector<std::string> keys;             // Object member names (parallel to children)
+    std::vector<std::unique_ptr<Node>> children; // Object member values or array elements.
+                                                 // Boxed so references survive new siblings.
+
+    Node *find(const std::string &key);
+    Node &member(const std::string &key); // Creates the member if missing.
+    void clear() { *this = Node(); }
+  };
+
+  void serialize(const Node &node, std::string &out);
+  bool parse(const char *json, size_t len, Node &out, int &errorCode);
+} // namespace hostjson
+
+class DeserializationError
+{
+public:
+  enum Code
+  {
+    Ok,
+    EmptyInput,
+    IncompleteInput,
+    InvalidInput,
+    NoMemory,
+    TooDeep
+  };
+
+  DeserializationError(Code c = Ok) : errorCode(c) {}
+  explicit operator bool() const { return errorCode != Ok; }
+  Code code() const { return errorCode; }
+  const char *c_str() const;
+  const char *f_str() const { return c_str(); }
+
+private:
+  Code errorCode;
+};
+
+class JsonVariant;
+class JsonArray;
+class JsonObject;
+
+//****************************************************************************************
+// A reference into a document. Members that don't exist yet are tracked as a base
+// node plus pending keys; they are only created when something is assigned.
+class JsonVariant
+{
+public:
+  JsonVariant() {}
+  explicit JsonVariant(hostjson::Node *node) : base(node) {}
+  JsonVariant(const JsonVariant &) = default;
+
+  JsonVariant operator[](const char *key) const;
+  JsonVariant operator[](const String &key) const { return (*this)[key.c_str()]; }
+  JsonVariant operator[](int index) const;
+  JsonVariant operator[](size_t index) const { return (*this)[(int)index]; }
+
+  bool isNull() const { return resolve() == nullptr || resolve()->type == hostjson::Node::Null; }
+  bool containsKey(const char *key) const;
+  size_t size() const;
+
+  template <typename T>
+  T as() const;
+  template <typename T>
+  bool is() const;
+
+  operator const char *() const;
+  operator String() const;
+  operator bool() const;
+  operator int() const { return (int)asInteger(); }
+  operator long() const { return (long)asInteger(); }
+  operator unsigned int() const { return (unsigned int)asInteger(); }
+  operator unsigned long() const { return (unsigned long)asInteger(); }
+  operator long long() const { return (long long)asInteger(); }
+  operator unsigned long long() const { return (unsigned long long)asInteger(); }
+  operator float() const { return (float)asDouble(); }
+  operator double() const { return asDouble(); }
+
+  JsonVariant &operator=(const String &v) { return set(v.c_str()); }
+  JsonVariant &operator=(const char *v) { return set(v); }
+  JsonVariant &operator=(char *v) { return set((const char *)v); }
+  JsonVariant &operator=(bool v);
+  JsonVariant &operator=(int v) { return setInteger(v); }
+  JsonVariant &operator=(unsigned int v) { return setInteger(v); }
+  JsonVariant &operator=(long v) { return setInteger(v); }
+  JsonVariant &operator=(unsigned long v) { return setInteger((int64_t)v); }
+  JsonVariant &operator=(long long v) { return setInteger(v); }
+  JsonVariant &operator=(unsigned long long v) { return setInteger((int64_t)v); }
+  JsonVariant &operator=(float v) { return setFloat(v); }
+  JsonVariant &operator=(double v) { return setFloat(v); }
+  JsonVariant &operator=(const JsonVariant &other);
+
+  JsonVariant add();
+  template <typename T>
+  bool add(const T &value)
+  {
+    JsonVariant v = add();
+    v = value;
+    return true;
+  }
+  JsonObject createNestedObject();
+  JsonObject createNestedObject(const char *key);
+  JsonArray createNestedArray();
+  JsonArray createNestedArray(const char *key);
+
+  template <typename T>
+  T to();
+
+  hostjson::Node *resolve() const;
+  hostjson::Node *materialize() const;
+
+private:
+  JsonVariant &set(const char *v);
+  JsonVariant &setInteger(int64_t v);
+  JsonVariant &setFloat(double v);
+  int64_t asInteger() const;
+  double asDouble() const;
+
+  hostjson::Node *base = nullptr;
+  std::vector<std::string> pending;
+};
+
+class JsonObject : public JsonVariant
+{
+public:
+  JsonObject() {}
+  explicit JsonObject(const JsonVariant &v) : JsonVariant(v) {}
+  using JsonVariant::operator=;
+};
+
+class JsonArray : public JsonVariant
+{
+public:
+  JsonArray() {}
+  explicit JsonArray(const JsonVariant &v) : JsonVariant(v) {}
+  using JsonVariant::operator=;
+};
+
+template <>
+inline JsonObject JsonVariant::to<JsonObject>()
+{
+  hostjson::Node *n = materialize();
+  n->clear();
+  n->type = hostjson::Node::Object;
+  return JsonObject(JsonVariant(n));
+}
+
+template <>
+inline JsonArray JsonVariant::to<JsonArray>()
+{
+  hostjson::Node *n = materialize();
+  n->clear();
+  n->type = hostjson::Node::Array;
+  return JsonArray(JsonVariant(n));
+}
+
+//****************************************************************************************
+class JsonDocument
+{
+public:
+  JsonVariant operator[](const char *key) { return JsonVariant(&root)[key]; }
+  JsonVariant operator[](const String &key) { return JsonVariant(&root)[key.c_str()]; }
+  JsonVariant operator[](int index) { return JsonVariant(&root)[index]; }
+  bool containsKey(const char *key) { return JsonVariant(&root).containsKey(key); }
+  bool isNull() const { return root.type == hostjson::Node::Null; }
+  size_t size() const { return root.children.size(); }
+  void clear() { root.clear(); }
+  size_t memoryUsage() const { return 0; }
+
+  JsonVariant add() { return JsonVariant(&root).add(); }
+  template <typename T>
+  bool add(const T &value) { return JsonVariant(&root).add(value); }
+  JsonObject createNestedObject() { return JsonVariant(&root).createNestedObject(); }
+  JsonObject createNestedObject(const char *key) { return JsonVariant(&root).createNestedObject(key); }
+  JsonArray createNestedArray() { return JsonVariant(&root).createNestedArray(); }
+  JsonArray createNestedArray(const char *key) { return JsonVariant(&root).createNestedArray(key); }
+  template <typename T>
+  T to() { return JsonVariant(&root).to<T>(); }
+  template <typename T>
+  T as() const { return JsonVariant(const_cast<hostjson::Node *>(&root)).as<T>(); }
+
+  hostjson::Node root;
+};
+
+template <size_t capacity>
+class StaticJsonDocument : public JsonDocument
+{
+};
+
+class DynamicJsonDocument : public JsonDocument
+{
+public:
+  explicit DynamicJsonDocument(size_t) {}
+};
+
+DeserializationError deserializeJson(JsonDocument &doc, const char *json);
+DeserializationError deserializeJson(JsonDocument &doc, const char *json, size_t len);
+DeserializationError deserializeJson(JsonDocument &doc, const String &json);
+DeserializationError deserializeJson(JsonDocument &doc, Stream &input);
+inline DeserializationError deserializeJson(JsonDocument &doc, char *json)
+{
+  return deserializeJson(doc, (const char *)json);
+}
+
+size_t serializeJson(const JsonDocument &doc, String &output);
+size_t serializeJson(const JsonDocument &doc, Print &output);
+size_t serializeJson(const JsonDocument &doc, char *output, size_t size);
+size_t serializeJson(const JsonVariant &v, String &output);
+size_t measureJson(const JsonDocument &doc);
+
+//****************************************************************************************
+template <typename T>
+T JsonVariant::as() const
+{
+  return (T)(*this);
+}
+
+template <>
+inline String JsonVariant::as<String>() const
+{
+  return (String)(*this);
+}
+
+template <>
+inline JsonObject JsonVariant::as<JsonObject>() const
+{
+  return JsonObject(*this);
+}
+
+template <>
+inline JsonArray JsonVariant::as<JsonArray>() const
+{
+  return JsonArray(*this);
+}
+
+template <typename T>
+bool JsonVariant::is() const
+{
+  const hostjson::Node *n = resolve();
+  if (!n) return false;
+  if (std::is_same<T, bool>::value) return n->type == hostjson::Node::Bool;
+  if (std::is_integral<T>::value) return n->type == hostjson::Node::Integer;
+  if (std::is_floating_point<T>::value)
+    return n->type == hostjson::Node::Float || n->type == hostjson::Node::Integer;
+  if (std::is_same<T, const char *>::value || std::is_same<T, String>::value)
+    return n->type == hostjson::Node::Str;
+  if (std::is_same<T, JsonObject>::value) return n->type == hostjson::Node::Object;
+  if (std::is_same<T, JsonArray>::value) return n->type == hostjson::Node::Array;
+  return false;
+}
+
+#endif // __HOST_ARDUINO_JSON_H__
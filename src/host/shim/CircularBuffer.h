@@ -0,0 +1,108 @@
+/* CircularBuffer.h (host shim)
+ *
+ *  API-compatible stand-in for rlogiacco's CircularBuffer v1.3.x
+ *  (https://github.com/rlogiacco/CircularBuffer) so the firmware's buffers
+ *  behave the same on the host: push() on a full buffer overwrites the
+ *  oldest element and returns false, operator[] counts from the head.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_CIRCULAR_BUFFER_H__
+#define __HOST_CIRCULAR_BUFFER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <type_traits>
+
+template <typename T, size_t S,
+          typename IT = typename std::conditional<
+              (S <= UINT8_MAX), uint8_t,
+              typename std::conditional<(S <= UINT16_MAX), uint16_t, uint32_t>::type>::type>
+class CircularBuffer
+{
+public:
+  static constexpr IT capacity = static_cast<IT>(S);
+  using index_t = IT;
+
+  CircularBuffer() : head(buffer), tail(buffer), count(0) {}
+  CircularBuffer(const CircularBuffer &) = delete;
+  CircularBuffer &operator=(const CircularBuffer &) = delete;
+
+  // Adds an element to the beginning of buffer. Returns false if the tail was overwritten.
+  bool unshift(T value)
+  {
+    if (head == buffer) head = buffer + capacity;
+    *--head = value;
+    if (count == capacity)
+    {
+      if (tail-- == buffer) tail = buffer + capacity - 1;
+      return false;
+    }
+    if (count++ == 0) tail = head;
+    return true;
+  }
+
+  // Adds an element to the end of buffer. Returns false if the head was overwritten.
+  bool push(T value)
+  {
+    if (++tail == buffer + capacity) tail = buffer;
+    *tail = value;
+    if (count == capacity)
+    {
+      if (++head == buffer + capacity) head = buffer;
+      return false;
+    }
+    if (count++ == 0) head = tail;
+    return true;
+  }
+
+  // Removes an element from the beginning of the buffer.
+  T shift()
+  {
+    if (count == 0) return *head;
+    T result = *head++;
+    if (head >= buffer + capacity) head = buffer;
+    count--;
+    return result;
+  }
+
+  // Removes an element from the end of the buffer.
+  T pop()
+  {
+    if (count == 0) return *tail;
+    T result = *tail--;
+    if (tail < buffer) tail = buffer + capacity - 1;
+    count--;
+    return result;
+  }
+
+  T first() const { return *head; }
+  T last() const { return *tail; }
+
+  T operator[](IT index) const
+  {
+    if (index >= count) return *tail;
+    return *(buffer + ((head - buffer + index) % capacity));
+  }
+
+  IT size() const { return count; }
+  IT available() const { return capacity - count; }
+  bool isEmpty() const { return count == 0; }
+  bool isFull() const { return count == capacity; }
+
+  void clear()
+  {
+    head = tail = buffer;
+    count = 0;
+  }
+
+private:
+  T buffer[S];
+  T *head;
+  T *tail;
+  IT count;
+};
+
+#endif // __HOST_CIRCULAR_BUFFER_H__
@@ -0,0 +1,28 @@
+/* Esp.h (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_ESP_H__
+#define __HOST_ESP_H__
+
+#include <stdint.h>
+
+class EspClass
+{
+public:
+  uint32_t getFreeHeap() { return 200 * 1024; }
+  uint32_t getHeapSize() { return 320 * 1024; }
+  uint32_t getCycleCount(); // Host: TSC (x86) or nanoseconds elsewhere.
+  void restart();           // Host: exits the process.
+};
+
+extern EspClass ESP;
+
+int64_t esp_timer_get_time(); // Microseconds on the host clock.
+
+// Light sleep just advances the host clock by the wakeup interval.
+int esp_sleep_enable_timer_wakeup(uint64_t timeInUs);
+int esp_light_sleep_start();
+
+#endif // __HOST_ESP_H__
@@ -0,0 +1,295 @@
+/* FS.cpp (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "FS.h"
+#include "SD.h"
+#include "SPIFFS.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+namespace stdfs = std::filesystem;
+
+SPIClass SPI;
+fs::SDFS SD;
+fs::SPIFFSFS SPIFFS;
+
+namespace fs
+{
+
+  struct FileImpl
+  {
+    FILE *fp = nullptr;
+    std::string hostPath;
+    std::string path;
+    std::string name;
+    bool directory = false;
+    std::vector<std::string> entries; // Directory listing for openNextFile()
+    size_t nextEntry = 0;
+    const FS *owner = nullptr;
+
+    ~FileImpl()
+    {
+      if (fp) fclose(fp);
+    }
+  };
+
+  //**************************************************************************************
+  // Power cuts
+  //**************************************************************************************
+  static std::atomic<long> powerBudget{-1}; // Bytes until the cut; -1: no cut coming
+  static std::atomic<unsigned long> writeCount{0};
+
+  void hostCutPowerAfter(unsigned long bytes) { powerBudget = (long)bytes; }
+  void hostRestorePower() { powerBudget = -1; }
+  bool hostPowerOn() { return powerBudget != 0; }
+  unsigned long hostWriteCount() { return writeCount; }
+
+  // How much of size bytes get written before the power goes.
+  static size_t spendPower(size_t size)
+  {
+    long budget = powerBudget;
+    if (budget < 0) return size;
+    size_t n = ((long)size < budget) ? size : (size_t)budget;
+    powerBudget = budget - (long)n;
+    return n;
+  }
+
+  //**************************************************************************************
+  // File
+  //**************************************************************************************
+  size_t File::write(uint8_t c) { return write(&c, 1); }
+
+  size_t File::write(const uint8_t *buf, size_t size)
+  {
+    if (!impl || !impl->fp) return 0;
+    writeCount++;
+    size = spendPower(size);
+    return size ? fwrite(buf, 1, size, impl->fp) : 0;
+  }
+
+  int File::available()
+  {
+    if (!impl || !impl->fp) return 0;
+    long pos = ftell(impl->fp);
+    fseek(impl->fp, 0, SEEK_END);
+    long end = ftell(impl->fp);
+    fseek(impl->fp, pos, SEEK_SET);
+    return (int)(end - pos);
+  }
+
+  int File::read()
+  {
+    if (!impl || !impl->fp) return -1;
+    int c = fgetc(impl->fp);
+    return c == EOF ? -1 : c;
+  }
+
+  size_t File::read(uint8_t *buf, size_t size)
+  {
+    if (!impl || !impl->fp) return 0;
+    return fread(buf, 1, size, impl->fp);
+  }
+
+  int File::peek()
+  {
+    if (!impl || !impl->fp) return -1;
+    int c = fgetc(impl->fp);
+    if (c == EOF) return -1;
+    ungetc(c, impl->fp);
+    return c;
+  }
+
+  static std::atomic<unsigned long> flushLatencyMs{0};
+
+  void hostSetFlushLatency(unsigned long ms) { flushLatencyMs = ms; }
+
+  void File::flush()
+  {
+    if (impl && impl->fp) fflush(impl->fp);
+    if (flushLatencyMs) std::this_thread::sleep_for(std::chrono::milliseconds(flushLatencyMs.load()));
+  }
+
+  bool File::seek(uint32_t pos, SeekMode mode)
+  {
+    if (!impl || !impl->fp) return false;
+    int whence = (mode == SeekSet) ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END);
+    return fseek(impl->fp, (long)pos, whence) == 0;
+  }
+
+  size_t File::position() const
+  {
+    if (!impl || !impl->fp) return 0;
+    return (size_t)ftell(impl->fp);
+  }
+
+  size_t File::size() const
+  {
+    if (!impl) return 0;
+    if (impl->fp) fflush(impl->fp);
+    std::error_code ec;
+    auto n = stdfs::file_size(impl->hostPath, ec);
+    return ec ? 0 : (size_t)n;
+  }
+
+  void File::close()
+  {
+    if (impl && impl->fp)
+    {
+      fclose(impl->fp);
+      impl->fp = nullptr;
+    }
+    impl.reset();
+  }
+
+  File::operator bool() const { return impl && (impl->fp || impl->directory); }
+  const char *File::path() const { return impl ? impl->path.c_str() : nullptr; }
+  const char *File::name() const { return impl ? impl->name.c_str() : nullptr; }
+  bool File::isDirectory() const { return impl && impl->directory; }
+
+  File File::openNextFile(const char *mode)
+  {
+    if (!impl || !impl->directory || !impl->owner) return File();
+    if (impl->nextEntry >= impl->entries.size()) return File();
+    std::string child = impl->path;
+    if (child.empty() || child.back() != '/') child += "/";
+    child += impl->entries[impl->nextEntry++];
+    return const_cast<FS *>(impl->owner)->open(child.c_str(), mode);
+  }
+
+  void File::rewindDirectory()
+  {
+    if (impl) impl->nextEntry = 0;
+  }
+
+  //**************************************************************************************
+  // FS
+  //**************************************************************************************
+  FS::FS(const char *subdir)
+  {
+    const char *base = getenv("DIGAME_HOST_FS");
+    root = std::string(base ? base : "./host_fs") + "/" + subdir;
+  }
+
+  void FS::hostSetRoot(const char *dir) { root = dir; }
+
+  std::string FS::hostPath(const char *path) const
+  {
+    std::string p = path ? path : "/";
+    if (p.empty() || p[0] != '/') p = "/" + p;
+    return root + p;
+  }
+
+  bool FS::mount()
+  {
+    std::error_code ec;
+    stdfs::create_directories(root, ec);
+    return stdfs::is_directory(root, ec);
+  }
+
+  File FS::open(const char *path, const char *mode, bool create)
+  {
+    auto impl = std::make_shared<FileImpl>();
+    impl->hostPath = hostPath(path);
+    impl->path = path ? path : "/";
+    impl->name = stdfs::path(impl->path).filename().string();
+    impl->owner = this;
+
+    std::error_code ec;
+    if (stdfs::is_directory(impl->hostPath, ec))
+    {
+      impl->directory = true;
+      for (auto &entry : stdfs::directory_iterator(impl->hostPath, ec))
+      {
+        impl->entries.push_back(entry.path().filename().string());
+      }
+      std::sort(impl->entries.begin(), impl->entries.end());
+      return File(impl);
+    }
+
+    std::string m = mode ? mode : FILE_READ;
+    if ((m != FILE_READ) && (spendPower(1) == 0)) return File();
+    if (m != FILE_READ || create)
+    {
+      stdfs::create_directories(stdfs::path(impl->hostPath).parent_path(), ec);
+    }
+    // "rb"/"wb"/"ab" plus read access so append/write handles can be read back.
+    std::string cmode = (m == FILE_READ) ? "rb" : (m == FILE_WRITE ? "w+b" : "a+b");
+    impl->fp = fopen(impl->hostPath.c_str(), cmode.c_str());
+    if (!impl->fp) return File();
+    return File(impl);
+  }
+
+  bool FS::exists(const char *path)
+  {
+    std::error_code ec;
+    return stdfs::exists(hostPath(path), ec);
+  }
+
+  bool FS::remove(const char *path)
+  {
+    if (spendPower(1) == 0) return false;
+    std::error_code ec;
+    return stdfs::remove(hostPath(path), ec);
+  }
+
+  bool FS::rename(const char *pathFrom, const char *pathTo)
+  {
+    if (spendPower(1) == 0) return false;
+    std::error_code ec;
+    stdfs::rename(hostPath(pathFrom), hostPath(pathTo), ec);
+    return !ec;
+  }
+
+  bool FS::mkdir(const char *path)
+  {
+    std::error_code ec;
+    stdfs::create_directories(hostPath(path), ec);
+    return !ec;
+  }
+
+  bool FS::rmdir(const char *path)
+  {
+    std::error_code ec;
+    return stdfs::remove(hostPath(path), ec);
+  }
+
+  static uint64_t directoryBytes(const std::string &dir)
+  {
+    uint64_t total = 0;
+    std::error_code ec;
+    for (auto &entry : stdfs::recursive_directory_iterator(dir, ec))
+    {
+      if (entry.is_regular_file(ec)) total += entry.file_size(ec);
+    }
+    return total;
+  }
+
+  //**************************************************************************************
+  // SD / SPIFFS
+  //**************************************************************************************
+  bool SDFS::begin(uint8_t, SPIClass &, uint32_t, const char *, uint8_t, bool)
+  {
+    mounted = mount();
+    return mounted;
+  }
+
+  uint64_t SDFS::usedBytes() { return directoryBytes(root); }
+
+  bool SPIFFSFS::begin(bool, const char *, uint8_t, const char *) { return mount(); }
+
+  bool SPIFFSFS::format()
+  {
+    std::error_code ec;
+    stdfs::remove_all(root, ec);
+    return mount();
+  }
+
+  size_t SPIFFSFS::usedBytes() { return (size_t)directoryBytes(root); }
+
+} // namespace fs
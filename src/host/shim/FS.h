@@ -0,0 +1,120 @@
+/* FS.h (host shim)
+ *
+ *  The ESP32 file system API (SD and SPIFFS) backed by a directory on the
+ *  host. Paths like "/params.txt" are resolved under the file system's root,
+ *  which defaults to $DIGAME_HOST_FS/<sd|spiffs> (or ./host_fs/<sd|spiffs>)
+ *  and can be moved with hostSetRoot(). hostSetFlushLatency() makes every
+ *  flush() take a while (in real time), like an SD card doing housekeeping.
+ *  hostCutPowerAfter() lets only so many more bytes reach the card (a write
+ *  across the cut is torn) and then fails every write, open for writing,
+ *  remove and rename until hostRestorePower().
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_FS_H__
+#define __HOST_FS_H__
+
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+
+  enum SeekMode
+  {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+  };
+
+  struct FileImpl;
+
+  class File : public Stream
+  {
+  public:
+    File() {}
+    explicit File(std::shared_ptr<FileImpl> impl) : impl(impl) {}
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+    size_t read(uint8_t *buf, size_t size);
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void close();
+    operator bool() const;
+    const char *path() const;
+    const char *name() const;
+    bool isDirectory() const;
+    File openNextFile(const char *mode = FILE_READ);
+    void rewindDirectory();
+
+  private:
+    std::shared_ptr<FileImpl> impl;
+  };
+
+  class FS
+  {
+  public:
+    explicit FS(const char *subdir);
+
+    File open(const char *path, const char *mode = FILE_READ, bool create = false);
+    File open(const String &path, const char *mode = FILE_READ, bool create = false)
+    {
+      return open(path.c_str(), mode, create);
+    }
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *pathFrom, const char *pathTo);
+    bool mkdir(const char *path);
+    bool rmdir(const char *path);
+
+    // Host only
+    void hostSetRoot(const char *dir);
+    std::string hostPath(const char *path) const;
+
+  protected:
+    bool mount();
+    std::string root;
+  };
+
+  // Host only: sleep this long in every File::flush().
+  void hostSetFlushLatency(unsigned long ms);
+
+  // Host only: power cuts. Opening for writing, remove() and rename() count as a byte.
+  void hostCutPowerAfter(unsigned long bytes);
+  void hostRestorePower();
+  bool hostPowerOn();
+  unsigned long hostWriteCount(); // File::write() calls so far
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekSet;
+using fs::hostSetFlushLatency;
+using fs::hostCutPowerAfter;
+using fs::hostRestorePower;
+using fs::hostPowerOn;
+using fs::hostWriteCount;
+
+#endif // __HOST_FS_H__
@@ -0,0 +1,212 @@
+/* HTTPClient.cpp (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "HTTPClient.h"
+#include "WiFi.h"
+
+#include <strings.h>
+
+HTTPClient::~HTTPClient() { disconnect(); }
+
+//****************************************************************************************
+// http://host[:port]/path
+bool HTTPClient::parseURL(const String &url)
+{
+  headers.clear();
+  responseBody.clear();
+  std::string u = url.c_str();
+  const std::string scheme = "http://";
+  if (u.compare(0, scheme.size(), scheme) != 0) return false;
+  u = u.substr(scheme.size());
+
+  size_t slash = u.find('/');
+  std::string hostPort = u.substr(0, slash);
+  path = (slash == std::string::npos) ? "/" : u.substr(slash);
+  size_t colon = hostPort.find(':');
+  host = hostPort.substr(0, colon);
+  port = (colon == std::string::npos) ? 80 : (uint16_t)atoi(hostPort.substr(colon + 1).c_str());
+  return !host.empty();
+}
+
+bool HTTPClient::begin(const String &url)
+{
+  client = &ownClient; // (Leaving any other client to whoever gave it)
+  if (!parseURL(url)) return false;
+  // A kept-open connection somewhere else is no use.
+  if ((host != connectedHost) || (port != connectedPort)) disconnect();
+  return true;
+}
+
+bool HTTPClient::begin(WiFiClient &c, const String &url)
+{
+  if (client == &ownClient) disconnect();
+  client = &c;
+  connectedHost.clear(); // Whoever connected it knows where to
+  return parseURL(url);
+}
+
+void HTTPClient::end()
+{
+  headers.clear();
+  if (!(reuseConnection && serverKeepAlive)) disconnect();
+}
+
+bool HTTPClient::connected() { return client->connected(); }
+
+void HTTPClient::addHeader(const String &name, const String &value, bool first, bool replace)
+{
+  if (replace)
+  {
+    for (auto &h : headers)
+    {
+      if (strcasecmp(h.first.c_str(), name.c_str()) == 0)
+      {
+        h.second = value.c_str();
+        return;
+      }
+    }
+  }
+  auto h = std::make_pair(std::string(name.c_str()), std::string(value.c_str()));
+  if (first) headers.insert(headers.begin(), h);
+  else headers.push_back(h);
+}
+
+//****************************************************************************************
+bool HTTPClient::connect()
+{
+  if (client->connected()) return true;
+  if (!client->connect(host.c_str(), port)) return false;
+  if (client == &ownClient)
+  {
+    connectedHost = host;
+    connectedPort = port;
+  }
+  return true;
+}
+
+void HTTPClient::disconnect()
+{
+  client->stop();
+  connectedHost.clear();
+  serverKeepAlive = false;
+}
+
+//****************************************************************************************
+int HTTPClient::GET() { return sendRequest("GET", nullptr, 0); }
+int HTTPClient::POST(const String &payload) { return POST((const uint8_t *)payload.c_str(), payload.length()); }
+int HTTPClient::POST(const uint8_t *payload, size_t size) { return sendRequest("POST", payload, size); }
+
+int HTTPClient::sendRequest(const char *type, const uint8_t *payload, size_t size)
+{
+  responseBody.clear();
+  if ((WiFi.status() != WL_CONNECTED) || !connect())
+  {
+    disconnect();
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+
+  std::string request = std::string(type) + " " + path + " HTTP/1.1\r\nHost: " + host + "\r\n" +
+                        "User-Agent: ESP32HTTPClient\r\n" +
+                        "Connection: " + (reuseConnection ? "keep-alive" : "close") + "\r\n";
+  for (auto &h : headers) request += h.first + ": " + h.second + "\r\n";
+  if (payload || !strcmp(type, "POST")) request += "Content-Length: " + std::to_string(size) + "\r\n";
+  request += "\r\n";
+
+  if (client->write((const uint8_t *)request.data(), request.size()) != request.size())
+  {
+    disconnect();
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  if (size && (client->write(payload, size) != size))
+  {
+    disconnect();
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+  return readResponse();
+}
+
+//****************************************************************************************
+// The status line, the headers we care about and a Content-Length (or read-to-close)
+// body.
+int HTTPClient::readResponse()
+{
+  std::string data;
+  // 1: more data, 0: the server closed the connection, -1: timed out
+  auto more = [&]() {
+    if (!client->hostWait(timeoutMs)) return -1;
+    uint8_t buffer[4096];
+    int n = client->read(buffer, sizeof(buffer));
+    if (n <= 0) return 0;
+    data.append((const char *)buffer, (size_t)n);
+    return 1;
+  };
+
+  size_t headerEnd;
+  while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos)
+  {
+    int got = more();
+    if (got <= 0)
+    {
+      disconnect();
+      return (got < 0) ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    }
+  }
+
+  int code = 0;
+  if (sscanf(data.c_str(), "HTTP/%*d.%*d %d", &code) != 1)
+  {
+    disconnect();
+    return HTTPC_ERROR_NO_HTTP_SERVER;
+  }
+
+  long length = -1;
+  serverKeepAlive = (data.compare(0, 8, "HTTP/1.1") == 0);
+  size_t lineStart = data.find("\r\n") + 2;
+  while (lineStart < headerEnd)
+  {
+    size_t lineEnd = data.find("\r\n", lineStart);
+    std::string line = data.substr(lineStart, lineEnd - lineStart);
+    if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0) length = atol(line.c_str() + 15);
+    if (strncasecmp(line.c_str(), "Connection:", 11) == 0)
+    {
+      serverKeepAlive = (strcasestr(line.c_str() + 11, "close") == nullptr);
+    }
+    lineStart = lineEnd + 2;
+  }
+
+  data.erase(0, headerEnd + 4);
+  while ((length < 0) || ((long)data.size() < length))
+  {
+    int got = more();
+    if (got > 0) continue;
+    if ((got == 0) && (length < 0)) break; // Read to close
+    disconnect();
+    return (got < 0) ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+  }
+  if (length < 0) serverKeepAlive = false;
+  if ((length >= 0) && ((long)data.size() > length)) data.resize((size_t)length);
+  responseBody = data;
+  return code;
+}
+
+//****************************************************************************************
+String HTTPClient::errorToString(int error)
+{
+  switch (error)
+  {
+  case HTTPC_ERROR_CONNECTION_REFUSED: return "connection refused";
+  case HTTPC_ERROR_SEND_HEADER_FAILED: return "send header failed";
+  case HTTPC_ERROR_SEND_PAYLOAD_FAILED: return "send payload failed";
+  case HTTPC_ERROR_NOT_CONNECTED: return "not connected";
+  case HTTPC_ERROR_CONNECTION_LOST: return "connection lost";
+  case HTTPC_ERROR_NO_STREAM: return "no stream";
+  case HTTPC_ERROR_NO_HTTP_SERVER: return "no HTTP server";
+  case HTTPC_ERROR_TOO_LESS_RAM: return "too less ram";
+  case HTTPC_ERROR_ENCODING: return "Transfer-Encoding not supported";
+  case HTTPC_ERROR_STREAM_WRITE: return "Stream write error";
+  case HTTPC_ERROR_READ_TIMEOUT: return "read Timeout";
+  default: return String();
+  }
+}
@@ -0,0 +1,80 @@
+/* HTTPClient.h (host shim)
+ *
+ *  The Arduino-ESP32 HTTPClient on the WiFiClient shim, for http:// URLs
+ *  (no TLS), so the network code can be run against a server on the host.
+ *  As on the ESP32, with setReuse(true) (the default) the connection is kept
+ *  open after end() if the server allows it, and used again by the next
+ *  request if it's still open. begin(client, url) uses a client the caller
+ *  has connected (or will let this connect). Fails like the ESP32 does
+ *  (HTTPC_ERROR_*) when WiFi isn't connected or the server goes away.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_HTTP_CLIENT_H__
+#define __HOST_HTTP_CLIENT_H__
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTP_CODE_OK 200
+
+class HTTPClient
+{
+public:
+  HTTPClient() {}
+  ~HTTPClient();
+
+  bool begin(const String &url);
+  bool begin(WiFiClient &client, const String &url);
+  void end();
+  bool connected();
+  void setReuse(bool reuse) { reuseConnection = reuse; }
+  void setTimeout(uint16_t ms) { timeoutMs = ms; }
+  void setConnectTimeout(int32_t ms) { connectTimeoutMs = ms; }
+  void addHeader(const String &name, const String &value, bool first = false, bool replace = true);
+
+  int GET();
+  int POST(const String &payload);
+  int POST(const uint8_t *payload, size_t size);
+  int sendRequest(const char *type, const uint8_t *payload, size_t size);
+
+  String getString() { return String(responseBody.c_str()); }
+  int getSize() { return (int)responseBody.size(); }
+  static String errorToString(int error);
+
+private:
+  std::string host, path, connectedHost;
+  uint16_t port = 80, connectedPort = 0;
+  WiFiClient ownClient;
+  WiFiClient *client = &ownClient;
+  bool reuseConnection = true;
+  bool serverKeepAlive = false;
+  uint16_t timeoutMs = 5000;
+  int32_t connectTimeoutMs = 5000;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string responseBody;
+
+  bool parseURL(const String &url);
+  bool connect();
+  void disconnect();
+  int readResponse();
+};
+
+#endif // __HOST_HTTP_CLIENT_H__
@@ -0,0 +1,136 @@
+/* HardwareSerial.cpp (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "HardwareSerial.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+HardwareSerial Serial(0, getenv("DIGAME_HOST_QUIET") == nullptr);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+
+void HardwareSerial::begin(unsigned long baudRate, uint32_t, int8_t, int8_t, bool, unsigned long)
+{
+  baud = baudRate;
+}
+
+int HardwareSerial::available()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return (int)rx.size();
+}
+
+int HardwareSerial::peek()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return rx.empty() ? -1 : rx.front();
+}
+
+int HardwareSerial::read()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (rx.empty()) return -1;
+  int c = rx.front();
+  rx.pop_front();
+  return c;
+}
+
+size_t HardwareSerial::read(uint8_t *buffer, size_t size)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  size_t n = 0;
+  while (n < size && !rx.empty())
+  {
+    buffer[n++] = rx.front();
+    rx.pop_front();
+  }
+  return n;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  std::function<void(HardwareSerial &, const String &)> fn;
+  std::string completed;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (echo)
+    {
+      fwrite(buffer, 1, size, stdout);
+    }
+    else
+    {
+      tx.append((const char *)buffer, size);
+    }
+    if (responder)
+    {
+      for (size_t i = 0; i < size; i++)
+      {
+        if (buffer[i] == '\n')
+        {
+          completed = txLine;
+          fn = responder;
+          txLine.clear();
+        }
+        else if (buffer[i] != '\r')
+        {
+          txLine.push_back((char)buffer[i]);
+        }
+      }
+    }
+  }
+  // Call the responder outside the lock so it can inject a reply.
+  if (fn) fn(*this, String(completed));
+  return size;
+}
+
+size_t HardwareSerial::setRxBufferSize(size_t size)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  rxCapacity = size;
+  return size;
+}
+
+void HardwareSerial::hostInject(const uint8_t *data, size_t len)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  size_t room = rxCapacity > rx.size() ? rxCapacity - rx.size() : 0;
+  size_t n = len < room ? len : room;
+  rx.insert(rx.end(), data, data + n);
+  rxOverruns += (unsigned long)(len - n);
+}
+
+unsigned long HardwareSerial::hostRxOverruns()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return rxOverruns;
+}
+
+void HardwareSerial::hostSetResponder(std::function<void(HardwareSerial &, const String &)> fn)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  responder = fn;
+  txLine.clear();
+}
+
+String HardwareSerial::hostTxLog()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return String(tx);
+}
+
+void HardwareSerial::hostClear()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  rx.clear();
+  tx.clear();
+  txLine.clear();
+  rxOverruns = 0;
+}
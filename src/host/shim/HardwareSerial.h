@@ -0,0 +1,75 @@
+/* HardwareSerial.h (host shim)
+ *
+ *  UARTs backed by in-memory byte queues. Host code feeds bytes into a port
+ *  with hostInject() (e.g. a recorded TFMini stream) and can watch what the
+ *  firmware writes with hostTxLog() or a line responder (e.g. a fake Reyax
+ *  module answering AT commands). Serial echoes to stdout unless muted.
+ *
+ *  Like the ESP32 driver, the receive buffer has a fixed size (256 bytes
+ *  unless changed with setRxBufferSize()); bytes that arrive while it is
+ *  full are lost and counted in hostRxOverruns().
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_HARDWARE_SERIAL_H__
+#define __HOST_HARDWARE_SERIAL_H__
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "Print.h"
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial : public Stream
+{
+public:
+  explicit HardwareSerial(int uartNum, bool echo = false) : uartNum(uartNum), echo(echo) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1,
+             int8_t txPin = -1, bool invert = false, unsigned long timeoutMs = 20000UL);
+  void end() {}
+  operator bool() const { return true; }
+  size_t setRxBufferSize(size_t size);
+
+  int available() override;
+  int peek() override;
+  int read() override;
+  size_t read(uint8_t *buffer, size_t size);
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  void flush() override {}
+
+  unsigned long baudRate() const { return baud; }
+
+  // Host-side plumbing
+  void hostInject(const uint8_t *data, size_t len);
+  void hostInject(const String &s) { hostInject((const uint8_t *)s.c_str(), s.length()); }
+  void hostSetEcho(bool on) { echo = on; }
+  void hostSetResponder(std::function<void(HardwareSerial &, const String &)> fn);
+  String hostTxLog();
+  void hostClear();
+  unsigned long hostRxOverruns();
+
+private:
+  int uartNum;
+  bool echo;
+  unsigned long baud = 0;
+  std::mutex lock;
+  std::deque<uint8_t> rx;
+  size_t rxCapacity = 256;
+  unsigned long rxOverruns = 0;
+  std::string tx;
+  std::string txLine;
+  std::function<void(HardwareSerial &, const String &)> responder;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+#endif // __HOST_HARDWARE_SERIAL_H__
@@ -0,0 +1,30 @@
+/* IPAddress.h (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_IPADDRESS_H__
+#define __HOST_IPADDRESS_H__
+
+#include <stdint.h>
+
+#include "Print.h"
+
+class IPAddress : public Printable
+{
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets{a, b, c, d} {}
+
+  uint8_t operator[](int index) const { return octets[index & 3]; }
+  String toString() const
+  {
+    return String(octets[0]) + "." + String(octets[1]) + "." + String(octets[2]) + "." +
+           String(octets[3]);
+  }
+  size_t printTo(Print &p) const override { return p.print(toString()); }
+
+private:
+  uint8_t octets[4];
+};
+
+#endif // __HOST_IPADDRESS_H__
@@ -0,0 +1,42 @@
+/* SD.h (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_SD_H__
+#define __HOST_SD_H__
+
+#include "FS.h"
+#include "SPI.h"
+
+typedef enum
+{
+  CARD_NONE,
+  CARD_MMC,
+  CARD_SD,
+  CARD_SDHC,
+  CARD_UNKNOWN
+} sdcard_type_t;
+
+namespace fs
+{
+  class SDFS : public FS
+  {
+  public:
+    SDFS() : FS("sd") {}
+    bool begin(uint8_t ssPin = 5, SPIClass &spi = SPI, uint32_t frequency = 4000000,
+               const char *mountpoint = "/sd", uint8_t maxFiles = 5, bool formatIfEmpty = false);
+    void end() {}
+    sdcard_type_t cardType() { return mounted ? CARD_SDHC : CARD_NONE; }
+    uint64_t cardSize() { return 8ULL * 1024 * 1024 * 1024; }
+    uint64_t totalBytes() { return cardSize(); }
+    uint64_t usedBytes();
+
+  private:
+    bool mounted = false;
+  };
+} // namespace fs
+
+extern fs::SDFS SD;
+
+#endif // __HOST_SD_H__
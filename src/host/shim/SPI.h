@@ -0,0 +1,18 @@
+/* SPI.h (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_SPI_H__
+#define __HOST_SPI_H__
+
+class SPIClass
+{
+public:
+  void begin() {}
+  void end() {}
+};
+
+extern SPIClass SPI;
+
+#endif // __HOST_SPI_H__
@@ -0,0 +1,28 @@
+/* SPIFFS.h (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_SPIFFS_H__
+#define __HOST_SPIFFS_H__
+
+#include "FS.h"
+
+namespace fs
+{
+  class SPIFFSFS : public FS
+  {
+  public:
+    SPIFFSFS() : FS("spiffs") {}
+    bool begin(bool formatOnFail = false, const char *basePath = "/spiffs", uint8_t maxOpenFiles = 10,
+               const char *partitionLabel = nullptr);
+    bool format();
+    size_t totalBytes() { return 1408 * 1024; }
+    size_t usedBytes();
+    void end() {}
+  };
+} // namespace fs
+
+extern fs::SPIFFSFS SPIFFS;
+
+#endif // __HOST_SPIFFS_H__
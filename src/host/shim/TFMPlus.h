@@ -0,0 +1,210 @@
+/* TFMPlus.h (host shim)
+ *
+ *  Stand-in for Bud Ryerson's TFMini-Plus library v1.4.x
+ *  (https://github.com/budryerson/TFMini-Plus). getData() parses real
+ *  Benewake 9-byte frames (0x59 0x59 ...) from the serial port exactly as the
+ *  library does, so recorded byte streams can be replayed through the
+ *  firmware by injecting them into the UART with hostInject(). The one
+ *  difference: with no data buffered it fails immediately with TFMP_HEADER
+ *  instead of spinning for its one second timeout.
+ *
+ *  sendCommand() writes the command frame to the port and reports success.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_TFMPLUS_H__
+#define __HOST_TFMPLUS_H__
+
+#include <stdint.h>
+
+#include "Arduino.h"
+
+#define TFMP_FRAME_SIZE 9
+#define TFMP_REPLY_SIZE 8
+#define TFMP_COMMAND_MAX 8
+
+// System Error Status Condition
+#define TFMP_READY 0     // no error
+#define TFMP_SERIAL 1    // serial timeout
+#define TFMP_HEADER 2    // no header found
+#define TFMP_CHECKSUM 3  // checksum doesn't match
+#define TFMP_TIMEOUT 4   // I2C timeout
+#define TFMP_PASS 5      // reply from some system commands
+#define TFMP_FAIL 6      //           "
+#define TFMP_I2CREAD 7
+#define TFMP_I2CWRITE 8
+#define TFMP_I2CLENGTH 9
+#define TFMP_WEAK 10     // Signal Strength ≤ 100
+#define TFMP_STRONG 11   // Signal Strength saturation
+#define TFMP_FLOOD 12    // Ambient Light saturation
+#define TFMP_MEASURE 13
+
+// Command encodings: 0xPPLLCC (reply length, command length, command code)
+#define GET_FIRMWARE_VERSION 0x00070401
+#define TRIGGER_DETECTION 0x00090404
+#define SOFT_RESET 0x00050402
+#define HARD_RESET 0x00051004
+#define SYSTEM_RESET SOFT_RESET
+#define SET_FRAME_RATE 0x00060603
+#define STANDARD_FORMAT_CM 0x00050501
+#define PIXHAWK_FORMAT 0x00050502
+#define STANDARD_FORMAT_MM 0x00050506
+#define ENABLE_OUTPUT 0x00050701
+#define DISABLE_OUTPUT 0x00050700
+#define SET_BAUD_RATE 0x00080806
+#define SAVE_SETTINGS 0x00051104
+
+// Frame rates
+#define FRAME_0 0x0000 // internal measurement rate
+#define FRAME_1 0x0001
+#define FRAME_2 0x0002
+#define FRAME_5 0x0005
+#define FRAME_10 0x000A
+#define FRAME_20 0x0014
+#define FRAME_25 0x0019
+#define FRAME_50 0x0032
+#define FRAME_100 0x0064
+#define FRAME_125 0x007D
+#define FRAME_200 0x00C8
+#define FRAME_250 0x00FA
+#define FRAME_500 0x01F4
+#define FRAME_1000 0x03E8
+
+class TFMPlus
+{
+public:
+  uint8_t version[3] = {1, 4, 0};
+  uint8_t status = TFMP_READY;
+
+  bool begin(Stream *serialPort)
+  {
+    pStream = serialPort;
+    return true;
+  }
+
+  bool getData(int16_t &dist, int16_t &flux, int16_t &temp);
+  bool getData(int16_t &dist)
+  {
+    int16_t flux, temp;
+    return getData(dist, flux, temp);
+  }
+  bool sendCommand(uint32_t cmnd, uint32_t param);
+
+  void printFrame() {}
+  void printReply() {}
+  void printStatus() {}
+
+  // Host only: the frame rate last requested with SET_FRAME_RATE.
+  uint16_t hostFrameRate() const { return frameRate; }
+
+  // Host only: build the 9-byte frame the sensor would send for a reading.
+  static void hostEncodeFrame(uint8_t out[TFMP_FRAME_SIZE], int16_t dist, int16_t flux,
+                              int16_t tempC)
+  {
+    uint16_t tempCode = (uint16_t)((tempC + 256) * 8);
+    out[0] = 0x59;
+    out[1] = 0x59;
+    out[2] = (uint8_t)(dist & 0xFF);
+    out[3] = (uint8_t)((dist >> 8) & 0xFF);
+    out[4] = (uint8_t)(flux & 0xFF);
+    out[5] = (uint8_t)((flux >> 8) & 0xFF);
+    out[6] = (uint8_t)(tempCode & 0xFF);
+    out[7] = (uint8_t)(tempCode >> 8);
+    uint8_t chkSum = 0;
+    for (int i = 0; i < TFMP_FRAME_SIZE - 1; i++) chkSum += out[i];
+    out[8] = chkSum;
+  }
+
+private:
+  Stream *pStream = nullptr;
+  uint8_t frame[TFMP_FRAME_SIZE + 1];
+  uint16_t frameRate = FRAME_100;
+};
+
+//****************************************************************************************
+inline bool TFMPlus::getData(int16_t &dist, int16_t &flux, int16_t &temp)
+{
+  if (pStream == nullptr)
+  {
+    status = TFMP_SERIAL;
+    return false;
+  }
+
+  // Flush all but last frame of data from the serial buffer.
+  while (pStream->available() > TFMP_FRAME_SIZE) pStream->read();
+
+  memset(frame, 0, sizeof(frame));
+
+  // Shift bytes in until the two header bytes line up at the front of the frame.
+  while ((frame[0] != 0x59) || (frame[1] != 0x59))
+  {
+    if (!pStream->available())
+    {
+      status = TFMP_HEADER;
+      return false;
+    }
+    frame[TFMP_FRAME_SIZE] = (uint8_t)pStream->read();
+    memmove(frame, frame + 1, TFMP_FRAME_SIZE);
+  }
+
+  uint16_t chkSum = 0;
+  for (uint8_t i = 0; i < (TFMP_FRAME_SIZE - 1); i++) chkSum += frame[i];
+  if ((uint8_t)chkSum != frame[TFMP_FRAME_SIZE - 1])
+  {
+    status = TFMP_CHECKSUM;
+    return false;
+  }
+
+  int16_t dataArray[3];
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    dataArray[i] = (int16_t)(frame[(i * 2) + 2] + (frame[(i * 2) + 3] << 8));
+  }
+  dist = dataArray[0];
+  flux = dataArray[1];
+  temp = dataArray[2];
+  temp = int16_t(temp / 8 - 256);
+
+  if (dist == -1) status = TFMP_WEAK;
+  else if (flux == -1) status = TFMP_STRONG;
+  else if (dist == -4) status = TFMP_FLOOD;
+  else
+  {
+    status = TFMP_READY;
+    return true;
+  }
+  return false;
+}
+
+//****************************************************************************************
+inline bool TFMPlus::sendCommand(uint32_t cmnd, uint32_t param)
+{
+  if (pStream == nullptr)
+  {
+    status = TFMP_SERIAL;
+    return false;
+  }
+
+  uint8_t cmndLen = (uint8_t)((cmnd >> 8) & 0xFF);
+  uint8_t cmndData[TFMP_COMMAND_MAX] = {0};
+  if (cmndLen < 4 || cmndLen > TFMP_COMMAND_MAX) cmndLen = 4;
+  cmndData[0] = 0x5A;
+  cmndData[1] = cmndLen;
+  cmndData[2] = (uint8_t)(cmnd & 0xFF);
+  if (cmnd == SET_FRAME_RATE)
+  {
+    cmndData[3] = (uint8_t)(param & 0xFF);
+    cmndData[4] = (uint8_t)((param >> 8) & 0xFF);
+    frameRate = (uint16_t)param;
+  }
+  uint8_t chkSum = 0;
+  for (uint8_t i = 0; i < cmndLen - 1; i++) chkSum += cmndData[i];
+  cmndData[cmndLen - 1] = chkSum;
+  pStream->write(cmndData, cmndLen);
+
+  status = TFMP_READY;
+  return true;
+}
+
+#endif // __HOST_TFMPLUS_H__
@@ -0,0 +1,253 @@
+/* WString.cpp (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "WString.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//****************************************************************************************
+// Format an integer the way Arduino's itoa/ultoa do (no sign for bases other than 10).
+static std::string formatUnsigned(unsigned long long value, unsigned char base)
+{
+  if (base < 2 || base > 36) base = 10;
+  char tmp[72];
+  int i = 0;
+  do
+  {
+    int digit = (int)(value % base);
+    tmp[i++] = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  } while (value > 0);
+  std::string out;
+  while (i > 0) out.push_back(tmp[--i]);
+  return out;
+}
+
+static std::string formatSigned(long long value, unsigned char base)
+{
+  if (base == 10 && value < 0)
+  {
+    return "-" + formatUnsigned((unsigned long long)(-(value + 1)) + 1, base);
+  }
+  return formatUnsigned((unsigned long long)value, base);
+}
+
+static std::string formatDouble(double value, unsigned char decimalPlaces)
+{
+  char tmp[64];
+  snprintf(tmp, sizeof(tmp), "%.*f", (int)decimalPlaces, value);
+  return tmp;
+}
+
+String::String(const char *cstr) : buf(cstr ? cstr : "") {}
+String::String(char c) : buf(1, c) {}
+String::String(unsigned char value, unsigned char base) : buf(formatUnsigned(value, base)) {}
+String::String(int value, unsigned char base)
+    : buf(base == 10 ? formatSigned(value, base) : formatUnsigned((unsigned int)value, base)) {}
+String::String(unsigned int value, unsigned char base) : buf(formatUnsigned(value, base)) {}
+String::String(long value, unsigned char base)
+    : buf(base == 10 ? formatSigned(value, base) : formatUnsigned((unsigned long)value, base)) {}
+String::String(unsigned long value, unsigned char base) : buf(formatUnsigned(value, base)) {}
+String::String(long long value, unsigned char base)
+    : buf(base == 10 ? formatSigned(value, base) : formatUnsigned((unsigned long long)value, base)) {}
+String::String(unsigned long long value, unsigned char base) : buf(formatUnsigned(value, base)) {}
+String::String(float value, unsigned char decimalPlaces) : buf(formatDouble(value, decimalPlaces)) {}
+String::String(double value, unsigned char decimalPlaces) : buf(formatDouble(value, decimalPlaces)) {}
+
+String &String::operator=(const char *cstr)
+{
+  buf = cstr ? cstr : "";
+  return *this;
+}
+
+bool String::reserve(unsigned int size)
+{
+  buf.reserve(size);
+  return true;
+}
+
+bool String::concat(const String &s)
+{
+  buf += s.buf;
+  return true;
+}
+
+bool String::concat(const char *cstr)
+{
+  if (!cstr) return false;
+  buf += cstr;
+  return true;
+}
+
+bool String::concat(char c)
+{
+  buf.push_back(c);
+  return true;
+}
+
+bool String::equalsIgnoreCase(const String &s) const
+{
+  if (buf.size() != s.buf.size()) return false;
+  for (size_t i = 0; i < buf.size(); i++)
+  {
+    if (tolower((unsigned char)buf[i]) != tolower((unsigned char)s.buf[i])) return false;
+  }
+  return true;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+  return buf.compare(0, prefix.buf.size(), prefix.buf) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+  if (suffix.buf.size() > buf.size()) return false;
+  return buf.compare(buf.size() - suffix.buf.size(), suffix.buf.size(), suffix.buf) == 0;
+}
+
+char String::charAt(unsigned int index) const
+{
+  return index < buf.size() ? buf[index] : 0;
+}
+
+void String::setCharAt(unsigned int index, char c)
+{
+  if (index < buf.size()) buf[index] = c;
+}
+
+char &String::operator[](unsigned int index)
+{
+  static char dummy;
+  if (index >= buf.size())
+  {
+    dummy = 0;
+    return dummy;
+  }
+  return buf[index];
+}
+
+void String::getBytes(unsigned char *buffer, unsigned int bufsize, unsigned int index) const
+{
+  if (!bufsize || !buffer) return;
+  if (index >= buf.size())
+  {
+    buffer[0] = 0;
+    return;
+  }
+  unsigned int n = bufsize - 1;
+  if (n > buf.size() - index) n = (unsigned int)(buf.size() - index);
+  memcpy(buffer, buf.data() + index, n);
+  buffer[n] = 0;
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const
+{
+  size_t pos = buf.find(ch, fromIndex);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &s, unsigned int fromIndex) const
+{
+  size_t pos = buf.find(s.buf, fromIndex);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char ch) const
+{
+  size_t pos = buf.rfind(ch);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const String &s) const
+{
+  size_t pos = buf.rfind(s.buf);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int beginIndex) const
+{
+  if (beginIndex >= buf.size()) return String();
+  return String(buf.substr(beginIndex));
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+  if (beginIndex > endIndex)
+  {
+    unsigned int t = beginIndex;
+    beginIndex = endIndex;
+    endIndex = t;
+  }
+  if (beginIndex >= buf.size()) return String();
+  if (endIndex > buf.size()) endIndex = (unsigned int)buf.size();
+  return String(buf.substr(beginIndex, endIndex - beginIndex));
+}
+
+void String::replace(char find, char replace)
+{
+  for (auto &c : buf)
+  {
+    if (c == find) c = replace;
+  }
+}
+
+void String::replace(const String &find, const String &replace)
+{
+  if (find.buf.empty()) return;
+  size_t pos = 0;
+  while ((pos = buf.find(find.buf, pos)) != std::string::npos)
+  {
+    buf.replace(pos, find.buf.size(), replace.buf);
+    pos += replace.buf.size();
+  }
+}
+
+void String::remove(unsigned int index)
+{
+  if (index < buf.size()) buf.erase(index);
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+  if (index < buf.size()) buf.erase(index, count);
+}
+
+void String::toLowerCase()
+{
+  for (auto &c : buf) c = (char)tolower((unsigned char)c);
+}
+
+void String::toUpperCase()
+{
+  for (auto &c : buf) c = (char)toupper((unsigned char)c);
+}
+
+void String::trim()
+{
+  size_t begin = 0;
+  while (begin < buf.size() && isspace((unsigned char)buf[begin])) begin++;
+  size_t end = buf.size();
+  while (end > begin && isspace((unsigned char)buf[end - 1])) end--;
+  buf = buf.substr(begin, end - begin);
+}
+
+long String::toInt() const { return atol(buf.c_str()); }
+float String::toFloat() const { return (float)atof(buf.c_str()); }
+double String::toDouble() const { return atof(buf.c_str()); }
+
+String operator+(const String &lhs, const String &rhs) { return String(lhs.str() + rhs.str()); }
+String operator+(const String &lhs, const char *rhs) { return String(lhs.str() + (rhs ? rhs : "")); }
+String operator+(const char *lhs, const String &rhs) { return String((lhs ? lhs : "") + rhs.str()); }
+String operator+(const String &lhs, char rhs) { return String(lhs.str() + rhs); }
+String operator+(const String &lhs, int rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, unsigned int rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, long rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, unsigned long rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, float rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, double rhs) { return lhs + String(rhs); }
@@ -0,0 +1,131 @@
+/* WString.h (host shim)
+ *
+ *  The subset of the Arduino String class used by the Digame headers, backed
+ *  by std::string so the library can be built and profiled on Linux.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_WSTRING_H__
+#define __HOST_WSTRING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class __FlashStringHelper;
+
+class String
+{
+public:
+  String(const char *cstr = "");
+  String(const std::string &s) : buf(s) {}
+  String(const String &) = default;
+  String(String &&) = default;
+  explicit String(char c);
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(long long value, unsigned char base = 10);
+  explicit String(unsigned long long value, unsigned char base = 10);
+  explicit String(float value, unsigned char decimalPlaces = 2);
+  explicit String(double value, unsigned char decimalPlaces = 2);
+
+  String &operator=(const String &) = default;
+  String &operator=(String &&) = default;
+  String &operator=(const char *cstr);
+
+  unsigned int length() const { return (unsigned int)buf.size(); }
+  bool isEmpty() const { return buf.empty(); }
+  const char *c_str() const { return buf.c_str(); }
+  bool reserve(unsigned int size);
+
+  bool concat(const String &s);
+  bool concat(const char *cstr);
+  bool concat(char c);
+  bool concat(int value) { return concat(String(value)); }
+  bool concat(unsigned int value) { return concat(String(value)); }
+  bool concat(long value) { return concat(String(value)); }
+  bool concat(unsigned long value) { return concat(String(value)); }
+  bool concat(float value) { return concat(String(value)); }
+  bool concat(double value) { return concat(String(value)); }
+
+  template <typename T>
+  String &operator+=(const T &rhs)
+  {
+    concat(rhs);
+    return *this;
+  }
+
+  bool equals(const String &s) const { return buf == s.buf; }
+  bool equals(const char *cstr) const { return buf == (cstr ? cstr : ""); }
+  bool equalsIgnoreCase(const String &s) const;
+  bool startsWith(const String &prefix) const;
+  bool endsWith(const String &suffix) const;
+  int compareTo(const String &s) const { return buf.compare(s.buf); }
+
+  bool operator==(const String &rhs) const { return equals(rhs); }
+  bool operator==(const char *cstr) const { return equals(cstr); }
+  bool operator!=(const String &rhs) const { return !equals(rhs); }
+  bool operator!=(const char *cstr) const { return !equals(cstr); }
+  bool operator<(const String &rhs) const { return buf < rhs.buf; }
+  bool operator>(const String &rhs) const { return buf > rhs.buf; }
+
+  char charAt(unsigned int index) const;
+  void setCharAt(unsigned int index, char c);
+  char operator[](unsigned int index) const { return charAt(index); }
+  char &operator[](unsigned int index);
+
+  void getBytes(unsigned char *buffer, unsigned int bufsize, unsigned int index = 0) const;
+  void toCharArray(char *buffer, unsigned int bufsize, unsigned int index = 0) const
+  {
+    getBytes((unsigned char *)buffer, bufsize, index);
+  }
+
+  int indexOf(char ch, unsigned int fromIndex = 0) const;
+  int indexOf(const String &s, unsigned int fromIndex = 0) const;
+  int lastIndexOf(char ch) const;
+  int lastIndexOf(const String &s) const;
+  String substring(unsigned int beginIndex) const;
+  String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+  void replace(char find, char replace);
+  void replace(const String &find, const String &replace);
+  void remove(unsigned int index);
+  void remove(unsigned int index, unsigned int count);
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+
+  long toInt() const;
+  float toFloat() const;
+  double toDouble() const;
+
+  const std::string &str() const { return buf; }
+
+private:
+  std::string buf;
+};
+
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+String operator+(const String &lhs, char rhs);
+String operator+(const String &lhs, int rhs);
+String operator+(const String &lhs, unsigned int rhs);
+String operator+(const String &lhs, long rhs);
+String operator+(const String &lhs, unsigned long rhs);
+String operator+(const String &lhs, float rhs);
+String operator+(const String &lhs, double rhs);
+
+inline bool operator==(const char *lhs, const String &rhs) { return rhs == lhs; }
+inline bool operator!=(const char *lhs, const String &rhs) { return rhs != lhs; }
+
+#endif // __HOST_WSTRING_H__
@@ -0,0 +1,75 @@
+/* WiFi.cpp (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "WiFi.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+
+WiFiClass WiFi;
+
+static const uint8_t hostMAC[6] = {0x24, 0x0a, 0xc4, 0x00, 0xd1, 0x6a};
+
+wl_status_t WiFiClass::begin(const char *, const char *)
+{
+  associated = linkUp;
+  return status();
+}
+
+bool WiFiClass::disconnect(bool wifiOff)
+{
+  associated = false;
+  if (wifiOff) wifiMode = WIFI_OFF;
+  return true;
+}
+
+bool WiFiClass::mode(wifi_mode_t m)
+{
+  wifiMode = m;
+  if (m == WIFI_OFF) associated = false;
+  return true;
+}
+
+wl_status_t WiFiClass::status() const
+{
+  return (associated && linkUp) ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+int WiFiClass::hostByName(const char *host, IPAddress &result)
+{
+  lookups++;
+  if (status() != WL_CONNECTED) return 0;
+  struct addrinfo hints = {}, *found = nullptr;
+  hints.ai_family = AF_INET;
+  if (getaddrinfo(host, nullptr, &hints, &found) != 0) return 0;
+  uint32_t a = ntohl(((struct sockaddr_in *)found->ai_addr)->sin_addr.s_addr);
+  freeaddrinfo(found);
+  result = IPAddress(a >> 24, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff);
+  return 1;
+}
+
+bool WiFiClass::setHostname(const char *)
+{
+  return true;
+}
+
+void WiFiClass::macAddress(uint8_t *mac) const
+{
+  for (int i = 0; i < 6; i++) mac[i] = hostMAC[i];
+}
+
+String WiFiClass::macAddress() const
+{
+  char buffer[18];
+  snprintf(buffer, sizeof(buffer), "%02X:%02X:%02X:%02X:%02X:%02X", hostMAC[0], hostMAC[1],
+           hostMAC[2], hostMAC[3], hostMAC[4], hostMAC[5]);
+  return String(buffer);
+}
+
+bool WiFiClass::softAP(const char *, const char *)
+{
+  wifiMode = WIFI_AP;
+  return true;
+}
@@ -0,0 +1,70 @@
+/* WiFi.h (host shim)
+ *
+ *  A WiFi stack that is always one call away from connected. Tests can take
+ *  the link down with hostSetLinkUp(false) to exercise reconnect paths.
+ *  hostByName() resolves with the host's resolver.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_WIFI_H__
+#define __HOST_WIFI_H__
+
+#include <stdint.h>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+typedef enum
+{
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+} wifi_mode_t;
+
+typedef enum
+{
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass
+{
+public:
+  wl_status_t begin(const char *ssid, const char *password = nullptr);
+  bool disconnect(bool wifiOff = false);
+  bool mode(wifi_mode_t m);
+  wifi_mode_t getMode() const { return wifiMode; }
+  wl_status_t status() const;
+  bool setHostname(const char *name);
+  bool setSleep(bool) { return true; }
+
+  void macAddress(uint8_t *mac) const;
+  String macAddress() const;
+  IPAddress localIP() const { return IPAddress(127, 0, 0, 1); }
+
+  int hostByName(const char *host, IPAddress &result);
+
+  bool softAP(const char *ssid, const char *password = nullptr);
+  IPAddress softAPIP() const { return IPAddress(192, 168, 4, 1); }
+
+  // Host only
+  void hostSetLinkUp(bool up) { linkUp = up; }
+  unsigned long hostLookups() const { return lookups; } // Calls to hostByName()
+
+private:
+  wifi_mode_t wifiMode = WIFI_OFF;
+  bool associated = false;
+  bool linkUp = true;
+  unsigned long lookups = 0;
+};
+
+extern WiFiClass WiFi;
+
+#endif // __HOST_WIFI_H__
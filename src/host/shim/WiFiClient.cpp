@@ -0,0 +1,141 @@
+/* WiFiClient.cpp (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "WiFiClient.h"
+#include "WiFi.h"
+
+#include <atomic>
+#include <chrono>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::atomic<unsigned long> connections{0};
+
+unsigned long WiFiClient::hostConnections() { return connections; }
+
+// Moves the virtual clock by the real time from construction to destruction.
+class NetworkTime
+{
+public:
+  NetworkTime() : start(std::chrono::steady_clock::now()) {}
+  ~NetworkTime()
+  {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    hostAdvanceMicros((uint64_t)us.count());
+  }
+
+private:
+  std::chrono::steady_clock::time_point start;
+};
+
+//****************************************************************************************
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+  stop();
+  if (WiFi.status() != WL_CONNECTED) return 0;
+  NetworkTime t;
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3]);
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if ((fd < 0) || (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+  {
+    stop();
+    return 0;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  struct timeval tv = {(time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000)};
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  connections++;
+  return 1;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+  IPAddress ip;
+  if (!WiFi.hostByName(host, ip)) return 0;
+  return connect(ip, port);
+}
+
+// Open, or closed by the server with something still to read.
+uint8_t WiFiClient::connected()
+{
+  if (fd < 0) return 0;
+  if (available() > 0) return 1;
+  char c;
+  ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if ((n == 0) || ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)))
+  {
+    stop();
+    return 0;
+  }
+  return 1;
+}
+
+void WiFiClient::stop()
+{
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
+
+//****************************************************************************************
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+  if (fd < 0) return 0;
+  NetworkTime t;
+  size_t sent = 0;
+  while (sent < size)
+  {
+    ssize_t n = send(fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+    if (n <= 0) break;
+    sent += (size_t)n;
+  }
+  return sent;
+}
+
+int WiFiClient::available()
+{
+  int n = 0;
+  if ((fd < 0) || (ioctl(fd, FIONREAD, &n) != 0)) return 0;
+  return n;
+}
+
+int WiFiClient::read()
+{
+  uint8_t c;
+  return (read(&c, 1) == 1) ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+  if (fd < 0) return -1;
+  ssize_t n = recv(fd, buffer, size, MSG_DONTWAIT);
+  return (n > 0) ? (int)n : -1;
+}
+
+int WiFiClient::peek()
+{
+  uint8_t c;
+  if (fd < 0) return -1;
+  return (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1) ? c : -1;
+}
+
+bool WiFiClient::hostWait(uint32_t waitMs)
+{
+  if (fd < 0) return false;
+  NetworkTime t;
+  struct pollfd p = {fd, POLLIN, 0};
+  return poll(&p, 1, (int)waitMs) > 0;
+}
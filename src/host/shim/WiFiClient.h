@@ -0,0 +1,54 @@
+/* WiFiClient.h (host shim)
+ *
+ *  A TCP client on a host socket. As on the ESP32, read() and available()
+ *  don't wait; hostWait() does, for the HTTPClient shim. Time spent blocked
+ *  on the network (connecting, sending, waiting for a reply) moves the
+ *  virtual clock by the real time it took, so code timing its requests with
+ *  millis()/micros() sees the server's latency.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_WIFI_CLIENT_H__
+#define __HOST_WIFI_CLIENT_H__
+
+#include <stdint.h>
+
+#include "IPAddress.h"
+#include "Print.h"
+
+class WiFiClient : public Stream
+{
+public:
+  WiFiClient() {}
+  ~WiFiClient() { stop(); }
+  WiFiClient(const WiFiClient &) = delete;
+  WiFiClient &operator=(const WiFiClient &) = delete;
+
+  int connect(IPAddress ip, uint16_t port);
+  int connect(const char *host, uint16_t port);
+  uint8_t connected();
+  void stop();
+  void setTimeout(uint32_t seconds) { timeoutMs = seconds * 1000; }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buffer, size_t size);
+  int peek() override;
+
+  operator bool() { return connected(); }
+
+  // Host only: wait up to timeoutMs for something to read (or the connection to
+  // close). False on a timeout.
+  bool hostWait(uint32_t timeoutMs);
+  // TCP connections opened by all clients so far.
+  static unsigned long hostConnections();
+
+private:
+  int fd = -1;
+  uint32_t timeoutMs = 5000;
+};
+
+#endif // __HOST_WIFI_CLIENT_H__
@@ -0,0 +1,12 @@
+/* driver/adc.h (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_DRIVER_ADC_H__
+#define __HOST_DRIVER_ADC_H__
+
+inline void adc_power_on() {}
+inline void adc_power_off() {}
+
+#endif // __HOST_DRIVER_ADC_H__
@@ -0,0 +1,12 @@
+/* esp_bt.h (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_ESP_BT_H__
+#define __HOST_ESP_BT_H__
+
+inline int esp_bt_controller_disable() { return 0; }
+inline bool btStop() { return true; }
+
+#endif // __HOST_ESP_BT_H__
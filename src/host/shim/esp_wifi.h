@@ -0,0 +1,11 @@
+/* esp_wifi.h (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_ESP_WIFI_H__
+#define __HOST_ESP_WIFI_H__
+
+inline int esp_wifi_stop() { return 0; }
+
+#endif // __HOST_ESP_WIFI_H__
@@ -0,0 +1,173 @@
+/* freertos.cpp (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "freertos/FreeRTOS.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+unsigned long millis();
+
+struct HostTask
+{
+  std::string name;
+  BaseType_t core;
+  std::thread thread;
+};
+
+struct HostSemaphore
+{
+  std::mutex lock;
+  std::condition_variable cv;
+  UBaseType_t count;
+  UBaseType_t maxCount;
+};
+
+namespace
+{
+  struct TaskDeleted
+  {
+  };
+
+  thread_local BaseType_t currentCore = 1; // The Arduino loop runs on core 1.
+  thread_local HostTask *currentTask = nullptr;
+
+  // Tasks whose function hasn't returned yet. A task frees itself when it ends, so
+  // hostJoinTask() waits for it to leave this set rather than joining its thread.
+  std::mutex tasksLock;
+  std::condition_variable taskEnded;
+  std::set<HostTask *> runningTasks;
+}
+
+BaseType_t xPortGetCoreID()
+{
+  return currentCore;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t,
+                                   void *param, UBaseType_t, TaskHandle_t *handle,
+                                   BaseType_t coreID)
+{
+  HostTask *task = new HostTask();
+  task->name = name ? name : "";
+  task->core = (coreID == tskNO_AFFINITY) ? 0 : coreID;
+
+  std::lock_guard<std::mutex> guard(tasksLock); // Held until task->thread is set
+  runningTasks.insert(task);
+  task->thread = std::thread([task, fn, param]() {
+    currentCore = task->core;
+    currentTask = task;
+    try
+    {
+      fn(param);
+    }
+    catch (const TaskDeleted &)
+    {
+    }
+
+    std::lock_guard<std::mutex> guard(tasksLock);
+    runningTasks.erase(task);
+    task->thread.detach();
+    delete task;
+    currentTask = nullptr;
+    taskEnded.notify_all();
+  });
+  if (handle) *handle = task;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+  return xTaskCreatePinnedToCore(fn, name, stackDepth, param, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  if (task == nullptr || task == currentTask)
+  {
+    throw TaskDeleted();
+  }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount()
+{
+  return (TickType_t)(millis() / portTICK_PERIOD_MS);
+}
+
+void hostJoinTask(TaskHandle_t task)
+{
+  std::unique_lock<std::mutex> guard(tasksLock);
+  taskEnded.wait(guard, [task] { return runningTasks.count(task) == 0; });
+}
+
+//****************************************************************************************
+// Semaphores
+//****************************************************************************************
+static SemaphoreHandle_t createSemaphore(UBaseType_t maxCount, UBaseType_t initialCount)
+{
+  SemaphoreHandle_t sem = new HostSemaphore();
+  sem->count = initialCount;
+  sem->maxCount = maxCount;
+  return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return createSemaphore(1, 1); }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return createSemaphore(1, 0); }
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount)
+{
+  return createSemaphore(maxCount, initialCount);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) { delete sem; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticksToWait)
+{
+  std::unique_lock<std::mutex> guard(sem->lock);
+  if (ticksToWait == portMAX_DELAY)
+  {
+    sem->cv.wait(guard, [sem] { return sem->count > 0; });
+  }
+  else if (!sem->cv.wait_for(guard, std::chrono::milliseconds(ticksToWait * portTICK_PERIOD_MS),
+                             [sem] { return sem->count > 0; }))
+  {
+    return pdFALSE;
+  }
+  sem->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  {
+    std::lock_guard<std::mutex> guard(sem->lock);
+    if (sem->count >= sem->maxCount) return pdFALSE;
+    sem->count++;
+  }
+  sem->cv.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *higherPriorityTaskWoken)
+{
+  if (higherPriorityTaskWoken) *higherPriorityTaskWoken = pdFALSE;
+  return xSemaphoreGive(sem);
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem)
+{
+  std::lock_guard<std::mutex> guard(sem->lock);
+  return sem->count;
+}
@@ -0,0 +1,37 @@
+/* freertos/FreeRTOS.h (host shim)
+ *
+ *  FreeRTOS tasks and semaphores backed by pthreads. Tasks run as detached
+ *  threads; the "core" a task was pinned to is remembered so
+ *  xPortGetCoreID() reports what the firmware expects. The Arduino loop is
+ *  core 1, as on the ESP32.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY (TickType_t)0xffffffffUL
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+#define IRAM_ATTR
+
+BaseType_t xPortGetCoreID();
+
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#endif // __HOST_FREERTOS_H__
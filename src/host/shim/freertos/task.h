@@ -0,0 +1,33 @@
+/* freertos/task.h (host shim)
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_FREERTOS_TASK_H__
+#define __HOST_FREERTOS_TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+struct HostTask;
+typedef HostTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth,
+                                   void *param, UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t coreID);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle);
+
+// Deleting another task is not supported on the host; a task may delete itself.
+void vTaskDelete(TaskHandle_t task);
+
+// Sleeps the calling thread for real time. (delay() only advances the host clock.)
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+// Host only: block until a task returns or deletes itself. The handle is freed then.
+void hostJoinTask(TaskHandle_t task);
+
+#endif // __HOST_FREERTOS_TASK_H__
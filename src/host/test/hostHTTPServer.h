@@ -0,0 +1,203 @@
+/* hostHTTPServer.h
+ *
+ *  A stand-in for the ParkData server: an HTTP/1.1 server on a free port of
+ *  127.0.0.1, a thread per connection, keep-alive unless the client asks
+ *  for close. Each request is answered by the test's handler after
+ *  `latencyMS` (real time) to stand in for the round trip over the air, the
+ *  first on a connection `connectLatencyMS` later still for the handshake.
+ *  Counts requests and connections.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_HTTP_SERVER_H__
+#define __HOST_HTTP_SERVER_H__
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct HostHTTPRequest
+{
+  std::string method, path, body;
+  std::vector<std::pair<std::string, std::string>> headers;
+
+  std::string header(const char *name) const
+  {
+    for (auto &h : headers)
+    {
+      if (strcasecmp(h.first.c_str(), name) == 0) return h.second;
+    }
+    return "";
+  }
+};
+
+struct HostHTTPResponse
+{
+  int code = 200;
+  std::string body;
+  bool close = false; // Close the connection after this one
+  bool drop = false;  // Close it without answering
+};
+
+class HostHTTPServer
+{
+public:
+  typedef std::function<HostHTTPResponse(const HostHTTPRequest &)> Handler;
+
+  std::atomic<int> latencyMS{0};
+  std::atomic<int> connectLatencyMS{0};
+  std::atomic<unsigned long> requests{0};
+  std::atomic<unsigned long> connections{0};
+
+  explicit HostHTTPServer(Handler h) : handler(h)
+  {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listenFd, 16);
+    socklen_t len = sizeof(addr);
+    getsockname(listenFd, (struct sockaddr *)&addr, &len);
+    port = ntohs(addr.sin_port);
+    acceptThread = std::thread([this]() { acceptLoop(); });
+  }
+
+  ~HostHTTPServer()
+  {
+    stopping = true;
+    shutdown(listenFd, SHUT_RDWR);
+    close(listenFd);
+    acceptThread.join();
+    dropConnections();
+    for (auto &t : clientThreads) t.join(); // No more are started: the accept thread's gone
+  }
+
+  std::string url(const char *path = "/") const
+  {
+    return "http://127.0.0.1:" + std::to_string(port) + path;
+  }
+
+  // Drop every open connection, as a server timing out idle clients does.
+  void dropConnections()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int fd : clientFds)
+    {
+      if (fd >= 0) shutdown(fd, SHUT_RDWR);
+    }
+  }
+
+private:
+  Handler handler;
+  int listenFd;
+  uint16_t port;
+  std::atomic<bool> stopping{false};
+  std::thread acceptThread;
+  std::mutex mutex;
+  std::vector<std::thread> clientThreads;
+  std::vector<int> clientFds;
+
+  void acceptLoop()
+  {
+    for (;;)
+    {
+      int fd = accept(listenFd, nullptr, nullptr);
+      if (fd < 0)
+      {
+        if (stopping) return;
+        continue;
+      }
+      connections++;
+      std::lock_guard<std::mutex> lock(mutex);
+      clientFds.push_back(fd);
+      clientThreads.emplace_back([this, fd]() { serve(fd); });
+    }
+  }
+
+  void serve(int fd)
+  {
+    std::string data;
+    char buffer[4096];
+    bool first = true;
+    for (;;)
+    {
+      size_t headerEnd;
+      while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos)
+      {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return finish(fd);
+        data.append(buffer, (size_t)n);
+      }
+
+      HostHTTPRequest request;
+      size_t lineEnd = data.find("\r\n");
+      std::string requestLine = data.substr(0, lineEnd);
+      size_t sp1 = requestLine.find(' '), sp2 = requestLine.rfind(' ');
+      request.method = requestLine.substr(0, sp1);
+      request.path = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+      size_t lineStart = lineEnd + 2;
+      while (lineStart < headerEnd)
+      {
+        lineEnd = data.find("\r\n", lineStart);
+        std::string line = data.substr(lineStart, lineEnd - lineStart);
+        size_t colon = line.find(':');
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+        request.headers.push_back({line.substr(0, colon), value});
+        lineStart = lineEnd + 2;
+      }
+
+      size_t length = (size_t)atol(request.header("Content-Length").c_str());
+      data.erase(0, headerEnd + 4);
+      while (data.size() < length)
+      {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return finish(fd);
+        data.append(buffer, (size_t)n);
+      }
+      request.body = data.substr(0, length);
+      data.erase(0, length);
+
+      requests++;
+      int wait = latencyMS + (first ? connectLatencyMS.load() : 0);
+      first = false;
+      if (wait > 0) std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+      HostHTTPResponse response = handler(request);
+      if (response.drop) return finish(fd);
+      bool closing = response.close || (strcasecmp(request.header("Connection").c_str(), "close") == 0);
+      std::string reply = "HTTP/1.1 " + std::to_string(response.code) + " OK\r\n" +
+                          "Content-Type: application/json\r\n" +
+                          "Content-Length: " + std::to_string(response.body.size()) + "\r\n" +
+                          "Connection: " + (closing ? "close" : "keep-alive") + "\r\n\r\n" + response.body;
+      send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+      if (closing) return finish(fd);
+    }
+  }
+
+  void finish(int fd)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &c : clientFds)
+    {
+      if (c == fd) c = -1;
+    }
+    close(fd);
+  }
+};
+
+#endif // __HOST_HTTP_SERVER_H__
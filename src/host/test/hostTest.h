@@ -0,0 +1,68 @@
+/* hostTest.h
+ *
+ *  A tiny check harness for the host tests. Each test is a plain executable
+ *  registered with ctest; CHECK records a failure and keeps going,
+ *  TEST_REPORT() returns the process exit code.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <stdio.h>
+
+#include <type_traits>
+
+static int hostTestFailures = 0;
+static int hostTestChecks = 0;
+
+#define CHECK(cond)                                                          \
+  do                                                                         \
+  {                                                                          \
+    hostTestChecks++;                                                        \
+    if (!(cond))                                                             \
+    {                                                                        \
+      hostTestFailures++;                                                    \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+    }                                                                        \
+  } while (0)
+
+// a == b, without the usual conversions between signed and unsigned: a negative value
+// never equals an unsigned one.
+template <typename A, typename B>
+static bool hostTestEqual(A a, B b)
+{
+  if constexpr (std::is_integral<A>::value && std::is_integral<B>::value &&
+                (std::is_signed<A>::value != std::is_signed<B>::value))
+  {
+    if constexpr (std::is_signed<A>::value)
+      return (a >= 0) && ((unsigned long long)a == (unsigned long long)b);
+    else
+      return (b >= 0) && ((unsigned long long)a == (unsigned long long)b);
+  }
+  else
+  {
+    return a == b;
+  }
+}
+
+#define CHECK_EQ(a, b)                                                       \
+  do                                                                         \
+  {                                                                          \
+    hostTestChecks++;                                                        \
+    auto _va = (a);                                                          \
+    auto _vb = (b);                                                          \
+    if (!hostTestEqual(_va, _vb))                                            \
+    {                                                                        \
+      hostTestFailures++;                                                    \
+      fprintf(stderr, "%s:%d: CHECK_EQ failed: %s == %s (%lld vs %lld)\n",   \
+              __FILE__, __LINE__, #a, #b, (long long)_va, (long long)_vb);   \
+    }                                                                        \
+  } while (0)
+
+#define TEST_REPORT()                                                        \
+  (fprintf(stderr, "%d checks, %d failures\n", hostTestChecks, hostTestFailures), \
+   hostTestFailures == 0 ? 0 : 1)
+
+#endif // __HOST_TEST_H__
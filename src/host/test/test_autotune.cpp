@@ -0,0 +1,211 @@
+/* test_autotune.cpp
+ *
+ *  The autotuner: detections match labels in the same lane and window, one
+ *  each; the Pareto front holds exactly the settings nothing beats on both
+ *  accuracy and latency. On traces where short blips (rain, birds) get
+ *  counted with the default settings, the grid and the Bayesian search both
+ *  find settings that count only the vehicles -- the same ones with 1 or 4
+ *  threads -- and the PARAMS.TXT section they print loads back as tuned.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "../tools/digameTuner.h"
+
+#include "hostTest.h"
+
+static std::string dir;
+
+//****************************************************************************************
+// Empty road, vehicles in either lane labeled at the last reading they're in the beam,
+// with the odd dropout, and unlabeled blips a few readings long between them. 100 Hz.
+static LabeledTrace makeTrace(int vehicles, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  LabeledTrace t;
+  t.trace.name = "trace" + std::to_string(seed);
+  auto push = [&](int d) {
+    t.trace.samples.push_back(replaySample((uint32_t)t.trace.samples.size() * replayIntervalUS, d));
+  };
+  for (int i = 0; i < 500; i++) push(999);
+  for (int v = 0; v < vehicles; v++)
+  {
+    for (int i = 0; i < 300 + (int)(rng() % 200); i++) push(999 - (int)(rng() % 3));
+    if (v % 2) // A blip
+    {
+      int d = 150 + (int)(rng() % 100);
+      for (int i = 0; i < 3 + (int)(rng() % 3); i++) push(d);
+      for (int i = 0; i < 300; i++) push(999);
+    }
+    int lane = 1 + (int)(rng() % 2);
+    int d = (lane == 1) ? 150 + (int)(rng() % 100) : 450 + (int)(rng() % 150);
+    int length = 40 + (int)(rng() % 100);
+    for (int i = 0; i < length; i++)
+    {
+      push(d + (int)(rng() % 11) - 5);
+      if ((i > 10) && (i < length - 10) && (rng() % 40 == 0)) // A dropout: a quick decay ends it
+      {
+        for (int k = 0; k < 4 + (int)(rng() % 8); k++) push(0);
+      }
+    }
+    t.labels.push_back({t.trace.samples.back().timeUS, lane});
+  }
+  for (int i = 0; i < 500; i++) push(999);
+  return t;
+}
+
+//****************************************************************************************
+static void testScoring()
+{
+  std::vector<TuneLabel> labels = {{1000000, 1}, {3000000, 2}, {5000000, 1}, {9000000, 1}};
+  std::vector<ReplayEvent> events = {
+      {0, 1, 400000},  // Too early for the first
+      {0, 1, 1200000}, // The first, 0.2 s late
+      {0, 1, 3100000}, // Wrong lane for the second
+      {0, 2, 3500000}, // The second, 0.5 s late
+      {0, 1, 4800000}, // The third, a little early: no latency
+      {0, 1, 5100000}, // A second count of the third
+      {0, 1, 11500000} // Too late for the fourth
+  };
+  TuneScore s = scoreTuneEvents(events, labels);
+  CHECK_EQ(s.matched, 3);
+  CHECK_EQ(s.missed, 1);
+  CHECK_EQ(s.falseAlarms, 4);
+  CHECK(fabs(s.latency() - 0.7 / 3) < 1e-9);
+  CHECK(fabs(s.f1() - 2 * (3.0 / 7) * 0.75 / (3.0 / 7 + 0.75)) < 1e-9);
+
+  // Across the wrap of the microsecond clock
+  s = scoreTuneEvents({{0, 2, 100000}}, {{4294867296u, 2}});
+  CHECK_EQ(s.matched, 1);
+  CHECK(fabs(s.latency() - 0.2) < 1e-6);
+}
+
+static void testDimensions()
+{
+  TuneDimension dim;
+  std::string error;
+  CHECK(parseTuneDimension("decay=0.01:0.2:0.01", dim, error));
+  CHECK(dim.field == &Config::lidarDecay);
+  CHECK(!dim.integer);
+  CHECK(!parseTuneDimension("decay=0.2:0.01:0.01", dim, error));
+  CHECK(!parseTuneDimension("wheels=1:4:1", dim, error));
+  CHECK(error.find("presenceCutoff") != std::string::npos);
+  CHECK_EQ(defaultTuneDimensions(DETECT_DECAY).size(), (size_t)3);
+  CHECK(DetectorTuner::format(dim, 0.05) == "0.05");
+  CHECK(parseTuneDimension("residenceTime=1:60:3", dim, error));
+  CHECK(DetectorTuner::format(dim, 7.0) == "7");
+}
+
+static bool samePoints(const std::vector<TunePoint> &a, const std::vector<TunePoint> &b)
+{
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++)
+  {
+    if ((a[i].values != b[i].values) || (a[i].score.matched != b[i].score.matched) ||
+        (a[i].score.falseAlarms != b[i].score.falseAlarms) || (a[i].score.latencySum != b[i].score.latencySum))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//****************************************************************************************
+static void testSearch()
+{
+  std::vector<LabeledTrace> traces = {makeTrace(40, 1), makeTrace(40, 2), makeTrace(40, 3)};
+  std::vector<TuneDimension> dims(2);
+  std::string error;
+  CHECK(parseTuneDimension("residenceTime=5:60:5", dims[0], error));
+  CHECK(parseTuneDimension("decay=0.02:0.2:0.06", dims[1], error));
+
+  // The defaults count the blips.
+  DetectorTuner defaults(config, {dims[0]}, traces, 2);
+  defaults.grid();
+  TuneScore atDefault = defaults.results()[0].score; // residenceTime 5, decay 0.05
+  fprintf(stderr, "Default: F1 %.3f, %ld false\n", atDefault.f1(), atDefault.falseAlarms);
+  CHECK(atDefault.falseAlarms > 20);
+
+  DetectorTuner grid(config, dims, traces, 1);
+  grid.grid();
+  CHECK_EQ(grid.results().size(), (size_t)(12 * 4));
+  TunePoint best = grid.best();
+  fprintf(stderr, "Grid: F1 %.3f, latency %.2f s at %s\n", best.score.f1(), best.score.latency(),
+          grid.fragment(best.values).c_str());
+  CHECK(best.score.f1() > 0.98);
+  CHECK(best.values[0] >= 25);
+
+  // The front: nothing tried beats anything on it on both counts; the most accurate ends it.
+  std::vector<TunePoint> front = grid.paretoFront();
+  CHECK(front.size() >= 2);
+  bool nondominated = true, sorted = true;
+  for (size_t i = 0; i < front.size(); i++)
+  {
+    if (i) sorted &= (front[i].score.latency() > front[i - 1].score.latency()) &&
+                     (front[i].score.f1() > front[i - 1].score.f1());
+    for (const TunePoint &p : grid.results())
+    {
+      if (p.score.matched == 0) continue;
+      bool better = (p.score.f1() >= front[i].score.f1()) && (p.score.latency() <= front[i].score.latency()) &&
+                    ((p.score.f1() > front[i].score.f1()) || (p.score.latency() < front[i].score.latency()));
+      nondominated &= !better;
+    }
+  }
+  CHECK(nondominated);
+  CHECK(sorted);
+  CHECK(fabs(front.back().score.f1() - best.score.f1()) < 1e-12);
+  TunePoint quick = grid.best(front[0].score.latency());
+  CHECK(quick.score.latency() <= front[0].score.latency());
+
+  // The same with more threads.
+  DetectorTuner grid4(config, dims, traces, 4);
+  grid4.grid();
+  CHECK(samePoints(grid.results(), grid4.results()));
+
+  // The Bayesian search, on a finer grid, gets there in fewer tries.
+  std::vector<TuneDimension> fine(3);
+  CHECK(parseTuneDimension("residenceTime=1:60:1", fine[0], error));
+  CHECK(parseTuneDimension("decay=0.01:0.3:0.01", fine[1], error));
+  CHECK(parseTuneDimension("presenceCutoff=2:60:2", fine[2], error));
+  DetectorTuner bayes(config, fine, traces, 4);
+  bayes.bayesian(40, 8);
+  CHECK_EQ(bayes.results().size(), (size_t)40);
+  TunePoint found = bayes.best();
+  fprintf(stderr, "Bayesian: F1 %.3f, latency %.2f s at %s\n", found.score.f1(), found.score.latency(),
+          bayes.fragment(found.values).c_str());
+  CHECK(found.score.f1() > 0.98);
+
+  DetectorTuner bayes1(config, fine, traces, 1);
+  bayes1.bayesian(40, 8);
+  CHECK(samePoints(bayes.results(), bayes1.results()));
+
+  // The section loads back.
+  String fragment = bayes.fragment(found.values);
+  CHECK(fragment.startsWith("\"lidar\": {"));
+  FILE *fp = fopen((dir + "/params.txt").c_str(), "w");
+  fprintf(fp, "{%s}\n", fragment.c_str());
+  fclose(fp);
+  SD.hostSetRoot(dir.c_str());
+  Config loaded;
+  loadConfiguration("/params.txt", loaded);
+  Config expect = bayes.configFor(found.values);
+  CHECK(loaded.lidarDetectionAlgorithm == "Decay");
+  CHECK(loaded.lidarResidenceTime == expect.lidarResidenceTime);
+  CHECK(loaded.lidarDecay == expect.lidarDecay);
+  CHECK(loaded.lidarPresenceCutoff == expect.lidarPresenceCutoff);
+  CHECK(loaded.lidarZone1Max == Config().lidarZone1Max); // Untouched
+}
+
+int main()
+{
+  char tmp[] = "/tmp/digame_autotuneXXXXXX";
+  CHECK(mkdtemp(tmp) != nullptr);
+  dir = tmp;
+  Serial.hostSetEcho(false);
+  config.showDataStream = "false";
+
+  testScoring();
+  testDimensions();
+  testSearch();
+  return TEST_REPORT();
+}
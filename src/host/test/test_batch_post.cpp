@@ -0,0 +1,282 @@
+/* test_batch_post.cpp
+ *
+ *  Batched delivery against a stand-in server on localhost with a few ms of
+ *  latency a request. A 200 event backlog (what a WiFi outage leaves) goes
+ *  one event per POST, then 32 to a POST: the requests, requests/s and the
+ *  time the radio would be on for each. Then the contract: a server that
+ *  stores only part of a batch gets the rest again, in order, and nothing
+ *  twice; big events make smaller batches; a server that doesn't take
+ *  batches, or fails, or no network, takes nothing off the journal.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <SD.h>
+#include <digameBatchPost.h>
+
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <stdlib.h>
+#include <vector>
+
+#include "hostHTTPServer.h"
+#include "hostTest.h"
+
+static CounterEvent makeEvent(uint32_t id)
+{
+  CounterEvent e = {};
+  e.epoch = 1650000000 + id;
+  e.count = id;
+  e.type = EVENT_VEHICLE;
+  e.lane = 1;
+  e.rawSlot = noRawSignal;
+  return e;
+}
+
+// Roughly the size of a real vehicle message; with the raw signal if there is one.
+static String formatEvent(const CounterEvent &e, const RawSignal *raw)
+{
+  String msg = "{\"deviceName\":\"Digame Systems\",\"deviceMAC\":\"24:0a:c4:00:d1:6a\","
+               "\"firmwareVer\":\"host\",\"timeStamp\":\"" + getEventTimeString(e.epoch) +
+               "\",\"eventType\":\"v\",\"count\":" + String(e.count) + ",\"lane\":" + String(e.lane);
+  if (raw)
+  {
+    msg += ",\"rawSignal\":[";
+    for (int i = 0; i < raw->length; i++) msg += String(i ? "," : "") + String(raw->samples[i]);
+    msg += "]";
+  }
+  return msg + "}";
+}
+
+// The counts in a request body, in order.
+static std::vector<uint32_t> countsIn(const std::string &body)
+{
+  std::vector<uint32_t> counts;
+  for (size_t at = body.find("\"count\":"); at != std::string::npos; at = body.find("\"count\":", at + 1))
+  {
+    counts.push_back((uint32_t)atol(body.c_str() + at + 8));
+  }
+  return counts;
+}
+
+// What the server stored, and how the requests looked.
+struct Ingest
+{
+  std::mutex mutex;
+  std::vector<uint32_t> stored;
+  size_t largestBody = 0;
+  int ackLimit = 1000;    // Stores at most this many of a batch
+  bool takesBatches = true;
+  int failCode = 0;       // Answer this instead, if not 0
+
+  HostHTTPResponse handle(const HostHTTPRequest &request)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    HostHTTPResponse response;
+    largestBody = std::max(largestBody, request.body.size());
+    if (failCode)
+    {
+      response.code = failCode;
+      return response;
+    }
+    std::vector<uint32_t> counts = countsIn(request.body);
+    bool batch = !request.header("X-Digame-Batch").empty();
+    if (!batch || !takesBatches) // The single-event endpoint
+    {
+      if (!batch) stored.insert(stored.end(), counts.begin(), counts.end());
+      response.body = "OK";
+      return response;
+    }
+    if (atoi(request.header("X-Digame-Batch").c_str()) != (int)counts.size() || request.body[0] != '[')
+    {
+      response.code = 400;
+      return response;
+    }
+    int k = std::min((int)counts.size(), ackLimit);
+    stored.insert(stored.end(), counts.begin(), counts.begin() + k);
+    response.body = "{\"acked\":" + std::to_string(k) + "}";
+    return response;
+  }
+};
+
+static std::string makeCard()
+{
+  char dir[] = "/tmp/digame_batchXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  SD.hostSetRoot(dir);
+  return dir;
+}
+
+// A fresh journal with a backlog of events 1..n, every rawEvery'th with a raw signal.
+static EventJournal *makeBacklog(uint32_t n, uint32_t rawEvery = 0)
+{
+  static uint8_t storage[sizeof(EventJournal)] __attribute__((aligned(8)));
+  static bool constructed = false;
+  if (constructed) // A reboot: what's been acked is checkpointed first, as the sketch does
+  {
+    CHECK(((EventJournal *)storage)->commit());
+    ((EventJournal *)storage)->~EventJournal();
+  }
+  EventJournal *journal = new (storage) EventJournal(SD);
+  constructed = true;
+  CHECK(journal->begin());
+  static RawSignal raw;
+  raw.length = eventRawSignalLength;
+  for (int i = 0; i < raw.length; i++) raw.samples[i] = (int16_t)(1000 + i);
+  for (uint32_t id = 1; id <= n; id++)
+  {
+    CHECK(journal->append(makeEvent(id), (rawEvery && (id % rawEvery == 0)) ? &raw : nullptr));
+  }
+  CHECK(journal->commit());
+  CHECK_EQ(journal->pending, (unsigned long)n);
+  return journal;
+}
+
+static bool inOrder(const std::vector<uint32_t> &stored, uint32_t n)
+{
+  if (stored.size() != n) return false;
+  for (uint32_t i = 0; i < n; i++)
+  {
+    if (stored[i] != i + 1) return false;
+  }
+  return true;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+//****************************************************************************************
+// The backlog one at a time (as the sketch does with postBatchSize 1) and then in batches.
+static void testBacklog()
+{
+  const uint32_t backlog = 200;
+  Ingest ingest;
+  HostHTTPServer server([&](const HostHTTPRequest &r) { return ingest.handle(r); });
+  server.latencyMS = 5;
+  config.serverURL = server.url("/import").c_str();
+  std::string card = makeCard();
+
+  EventJournal *journal = makeBacklog(backlog);
+  auto t0 = std::chrono::steady_clock::now();
+  CounterEvent e;
+  const RawSignal *raw = nullptr;
+  while (journal->peek(e, raw) && postJSON(formatEvent(e, raw), config)) journal->ack();
+  double singleSeconds = secondsSince(t0);
+  unsigned long singleRequests = server.requests;
+  CHECK(inOrder(ingest.stored, backlog));
+  CHECK_EQ(journal->pending, 0ul);
+
+  ingest.stored.clear();
+  journal = makeBacklog(backlog);
+  unsigned long before = server.requests;
+  t0 = std::chrono::steady_clock::now();
+  int sent;
+  while ((sent = postEventBatch(*journal, journalMaxBatch, formatEvent, config)) > 0) {}
+  double batchSeconds = secondsSince(t0);
+  unsigned long batchRequests = server.requests - before;
+  CHECK_EQ(sent, 0);
+  CHECK(inOrder(ingest.stored, backlog));
+  CHECK_EQ(journal->pending, 0ul);
+
+  fprintf(stderr, "%u events, %d ms a request:\n", backlog, server.latencyMS.load());
+  fprintf(stderr, "  One to a POST: %4lu requests, %6.1f requests/s, %6.1f events/s, radio on %.3f s\n",
+          singleRequests, singleRequests / singleSeconds, backlog / singleSeconds, singleSeconds);
+  fprintf(stderr, "  %d to a POST:  %4lu requests, %6.1f requests/s, %6.1f events/s, radio on %.3f s\n",
+          journalMaxBatch, batchRequests, batchRequests / batchSeconds, backlog / batchSeconds, batchSeconds);
+  CHECK_EQ(singleRequests, (unsigned long)backlog);
+  CHECK_EQ(batchRequests, (unsigned long)((backlog + journalMaxBatch - 1) / journalMaxBatch));
+  CHECK(batchSeconds * 5 < singleSeconds);
+  std::filesystem::remove_all(card);
+}
+
+//****************************************************************************************
+static void testPartialAck()
+{
+  const uint32_t backlog = 100;
+  Ingest ingest;
+  ingest.ackLimit = 7;
+  HostHTTPServer server([&](const HostHTTPRequest &r) { return ingest.handle(r); });
+  config.serverURL = server.url("/import").c_str();
+  std::string card = makeCard();
+
+  EventJournal *journal = makeBacklog(backlog);
+  int sent;
+  while ((sent = postEventBatch(*journal, 20, formatEvent, config)) > 0) CHECK(sent <= 7);
+  CHECK_EQ(sent, 0);
+  CHECK(inOrder(ingest.stored, backlog)); // The rest of each batch came again, nothing twice
+  CHECK_EQ(server.requests.load(), (unsigned long)((backlog + 6) / 7));
+
+  // Stored none of it: nothing comes off.
+  journal = makeBacklog(10);
+  ingest.ackLimit = 0;
+  CHECK_EQ(postEventBatch(*journal, 20, formatEvent, config), 0);
+  CHECK_EQ(journal->pending, 10ul);
+  std::filesystem::remove_all(card);
+}
+
+//****************************************************************************************
+// Events with raw signals are ~700 bytes: batches stop at postBatchMaxBytes.
+static void testByteLimit()
+{
+  const uint32_t backlog = 120;
+  Ingest ingest;
+  HostHTTPServer server([&](const HostHTTPRequest &r) { return ingest.handle(r); });
+  config.serverURL = server.url("/import").c_str();
+  std::string card = makeCard();
+
+  EventJournal *journal = makeBacklog(backlog, 1);
+  int sent, batches = 0;
+  while ((sent = postEventBatch(*journal, journalMaxBatch, formatEvent, config)) > 0)
+  {
+    CHECK(sent < journalMaxBatch);
+    batches++;
+  }
+  CHECK(inOrder(ingest.stored, backlog));
+  CHECK(ingest.largestBody <= postBatchMaxBytes);
+  CHECK(batches > (int)(backlog / journalMaxBatch));
+  std::filesystem::remove_all(card);
+}
+
+//****************************************************************************************
+static void testNoDelivery()
+{
+  Ingest ingest;
+  HostHTTPServer server([&](const HostHTTPRequest &r) { return ingest.handle(r); });
+  config.serverURL = server.url("/import").c_str();
+  std::string card = makeCard();
+  EventJournal *journal = makeBacklog(10);
+
+  ingest.takesBatches = false;
+  CHECK_EQ(postEventBatch(*journal, 5, formatEvent, config), BATCH_POST_UNSUPPORTED);
+  CHECK_EQ(journal->pending, 10ul);
+
+  ingest.takesBatches = true;
+  ingest.failCode = 500;
+  CHECK_EQ(postEventBatch(*journal, 5, formatEvent, config), BATCH_POST_FAILED);
+  CHECK_EQ(journal->pending, 10ul);
+
+  ingest.failCode = 0;
+  WiFi.hostSetLinkUp(false);
+  CHECK_EQ(postEventBatch(*journal, 5, formatEvent, config), BATCH_POST_FAILED);
+  CHECK_EQ(journal->pending, 10ul);
+  WiFi.hostSetLinkUp(true);
+
+  // And when it all comes back, the same ten, from the start.
+  CHECK_EQ(postEventBatch(*journal, 20, formatEvent, config), 10);
+  CHECK(inOrder(ingest.stored, 10));
+  std::filesystem::remove_all(card);
+}
+
+int main()
+{
+  WiFi.mode(WIFI_STA);
+  WiFi.begin("ssid", "password");
+  testBacklog();
+  testPartialAck();
+  testByteLimit();
+  testNoDelivery();
+  return TEST_REPORT();
+}
@@ -0,0 +1,224 @@
+/* test_delivery_scheduler.cpp
+ *
+ *  The retry schedule, step by step: backoff that doubles with jitter, the
+ *  breaker opening after failures in a row with no reply, probes that back
+ *  off in turn, a refused message set aside -- but only for a 4xx, not a
+ *  server that's down. Then a day on a lossy link --
+ *  15% of tries lost, ten minutes down every three hours and three hours
+ *  down overnight -- with a vehicle every 20 s, sent the old way (a try
+ *  every pass of the 100 ms loop) and on the schedule. Each try keeps the
+ *  radio on: 300 ms for an answer, 2.5 s for the LoRa ACK timeout. Radio-on
+ *  ms per event delivered is the energy proxy. Then the same day with a
+ *  message now and then the server never takes.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <ArduinoJson.h>
+#include <digameDeliveryScheduler.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+
+#include "hostTest.h"
+
+//****************************************************************************************
+static void testSchedule()
+{
+  randomSeed(24);
+  DeliveryScheduler d;
+  unsigned long t = 0;
+  CHECK(d.due(t));
+
+  // Backoff: 1, 2, 4, 8 s, each somewhere in its upper half.
+  for (int i = 0; i < breakerThreshold - 1; i++)
+  {
+    CHECK(!d.report(DELIVERY_NO_REPLY, t, 2500));
+    unsigned long full = retryBaseMS << i;
+    unsigned long w = d.wait(t);
+    CHECK(w >= full / 2 && w <= full);
+    CHECK(!d.due(t + w - 1));
+    t += w;
+    CHECK(d.due(t));
+    CHECK(d.state() == BREAKER_CLOSED);
+  }
+  CHECK_EQ(d.attempts, breakerThreshold - 1);
+
+  // One more with no reply: the link's down. Nothing until the probe.
+  CHECK(!d.report(DELIVERY_NO_REPLY, t, 2500));
+  CHECK(d.state() == BREAKER_OPEN);
+  CHECK_EQ(d.breakerOpens, 1ul);
+  unsigned long w = d.wait(t);
+  CHECK(w >= probeBaseMS / 2 && w <= probeBaseMS);
+  CHECK(!d.due(t + w - 1));
+  CHECK(d.state() == BREAKER_OPEN);
+  t += w;
+  CHECK(d.due(t));
+  CHECK(d.state() == BREAKER_HALF_OPEN);
+
+  // Probes that fail back off too, to probeMaxMS.
+  for (int i = 1; i < 10; i++)
+  {
+    CHECK(!d.report(DELIVERY_NO_REPLY, t, 2500));
+    CHECK(d.state() == BREAKER_OPEN);
+    unsigned long full = std::min(probeBaseMS << i, probeMaxMS);
+    w = d.wait(t);
+    CHECK(w >= full / 2 && w <= full);
+    t += w;
+    CHECK(d.due(t));
+  }
+  CHECK_EQ(d.probes, 9ul);
+  CHECK_EQ(d.breakerOpens, 1ul);
+
+  // A probe gets through: closed, and the next message goes now.
+  CHECK(!d.report(DELIVERY_OK, t, 300));
+  CHECK(d.state() == BREAKER_CLOSED);
+  CHECK_EQ(d.attempts, 0);
+  CHECK(d.due(t));
+  CHECK_EQ(d.delivered, 1ul);
+
+  // The server refuses one: retried, never opens the breaker, set aside in the end.
+  for (int i = 1; i < maxRejections; i++)
+  {
+    CHECK(!d.report(DELIVERY_REJECTED, t, 300));
+    CHECK(d.state() == BREAKER_CLOSED);
+    t += d.wait(t);
+  }
+  CHECK(d.report(DELIVERY_REJECTED, t, 300));
+  CHECK_EQ(d.givenUp, 1ul);
+  CHECK(d.due(t));
+  CHECK_EQ(d.attempts, 0);
+
+  // What a POST's response code means. A 502 from a proxy is an outage, not a bad message.
+  CHECK(httpDeliveryOutcome(true, 200) == DELIVERY_OK);
+  CHECK(httpDeliveryOutcome(false, 400) == DELIVERY_REJECTED);
+  CHECK(httpDeliveryOutcome(false, 422) == DELIVERY_REJECTED);
+  CHECK(httpDeliveryOutcome(false, 500) == DELIVERY_NO_REPLY);
+  CHECK(httpDeliveryOutcome(false, 503) == DELIVERY_NO_REPLY);
+  CHECK(httpDeliveryOutcome(false, -1) == DELIVERY_NO_REPLY);
+  CHECK(httpDeliveryOutcome(false, 0) == DELIVERY_NO_REPLY);
+
+  // Failures with no reply in between answers don't add up to an open breaker.
+  for (int i = 0; i < 3 * breakerThreshold; i++)
+  {
+    t += d.wait(t);
+    d.report((i % 3 == 2) ? DELIVERY_OK : DELIVERY_NO_REPLY, t, 300);
+  }
+  CHECK(d.state() == BREAKER_CLOSED);
+  CHECK_EQ(d.breakerOpens, 1ul);
+
+  CHECK_EQ(d.tries, 4ul + 1ul + 9ul + 1ul + 5ul + 15ul);
+  StaticJsonDocument<512> doc;
+  CHECK(!deserializeJson(doc, getDeliveryJSON(d)));
+  CHECK_EQ(doc["setAside"].as<int>(), 1);
+  CHECK(doc["breaker"].as<String>() == "closed");
+  CHECK_EQ(doc["radioOnMS"].as<long>(), (long)d.radioOnMS);
+}
+
+//****************************************************************************************
+// A day on a lossy link.
+struct DayResult
+{
+  unsigned long events = 0, tries = 0, delivered = 0, setAside = 0;
+  double radioMS = 0, radioDownMS = 0; // Radio on, and on while the link was down
+  double meanDelayS = 0, maxDelayS = 0;
+};
+
+static const unsigned long dayMS = 24UL * 3600 * 1000;
+
+static bool linkUp(unsigned long t)
+{
+  unsigned long hour = (t / 3600000) % 24;
+  if ((hour >= 2) && (hour < 5)) return false;            // Overnight
+  return (t % (3 * 3600000UL)) >= 10 * 60000UL;           // Ten minutes every three hours
+}
+
+static DayResult simulateDay(bool scheduled, unsigned long poisonEvery)
+{
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  randomSeed(7);
+  DeliveryScheduler delivery;
+  std::deque<std::pair<unsigned long, unsigned long>> queue; // Event number, arrival time
+  DayResult r;
+  double delaySum = 0;
+  unsigned long nextEventMS = 0;
+
+  // A vehicle every 20 s for a day, then an hour more to catch up.
+  for (unsigned long t = 0; t < dayMS + 3600000UL; t += 100)
+  {
+    for (; (nextEventMS <= t) && (nextEventMS < dayMS); nextEventMS += 20000)
+      queue.push_back({++r.events, nextEventMS});
+    if (queue.empty() || (scheduled && !delivery.due(t))) continue;
+
+    DeliveryOutcome outcome;
+    bool poison = poisonEvery && (queue.front().first % poisonEvery == 0);
+    if (!linkUp(t) || (uniform(rng) < 0.15)) outcome = DELIVERY_NO_REPLY;
+    else outcome = poison ? DELIVERY_REJECTED : DELIVERY_OK;
+    unsigned long radio = (outcome == DELIVERY_NO_REPLY) ? 2500 : 300;
+
+    r.tries++;
+    r.radioMS += radio;
+    if (!linkUp(t)) r.radioDownMS += radio;
+    bool giveUp = scheduled && delivery.report(outcome, t + radio, radio);
+    if (outcome == DELIVERY_OK)
+    {
+      double delay = (t + radio - queue.front().second) / 1000.0;
+      delaySum += delay;
+      if (delay > r.maxDelayS) r.maxDelayS = delay;
+      r.delivered++;
+      queue.pop_front();
+    }
+    else if (giveUp)
+    {
+      r.setAside++;
+      queue.pop_front();
+    }
+    t += radio; // The task is busy for the try, then the loop's 100 ms
+  }
+  r.meanDelayS = r.delivered ? delaySum / r.delivered : 0;
+  return r;
+}
+
+static void printDay(const char *name, const DayResult &r)
+{
+  fprintf(stderr, "  %-12s %6lu tries, %5lu/%5lu delivered, %3lu set aside, radio on %7.0f s "
+          "(%6.0f s link down), %7.1f ms per event, delay mean %6.1f s max %6.0f s\n",
+          name, r.tries, r.delivered, r.events, r.setAside, r.radioMS / 1000, r.radioDownMS / 1000,
+          r.delivered ? r.radioMS / r.delivered : 0.0, r.meanDelayS, r.maxDelayS);
+}
+
+static void testLossyDay()
+{
+  DayResult loop = simulateDay(false, 0);
+  DayResult scheduled = simulateDay(true, 0);
+  fprintf(stderr, "A day, 15%% lost, 10 min down every 3 h and 3 h overnight:\n");
+  printDay("every 100 ms", loop);
+  printDay("scheduled", scheduled);
+
+  CHECK_EQ(loop.delivered, loop.events);
+  CHECK_EQ(scheduled.delivered, scheduled.events); // Late, but all of them
+  CHECK(scheduled.tries < loop.tries);
+  CHECK(scheduled.radioMS * 3 < loop.radioMS);
+  CHECK(scheduled.radioDownMS * 20 < loop.radioDownMS);
+  CHECK(scheduled.maxDelayS < 3 * 3600 + probeMaxMS / 1000 + 600);
+
+  // One in 500 the server won't take: the loop is stuck on the first for the rest of the
+  // day; the schedule sets each aside and carries on.
+  DayResult stuck = simulateDay(false, 500);
+  DayResult aside = simulateDay(true, 500);
+  fprintf(stderr, "The same, and one message in 500 refused:\n");
+  printDay("every 100 ms", stuck);
+  printDay("scheduled", aside);
+  CHECK(stuck.delivered < 500);
+  CHECK_EQ(aside.setAside, aside.events / 500);
+  CHECK_EQ(aside.delivered + aside.setAside, aside.events);
+}
+
+int main()
+{
+  testSchedule();
+  testLossyDay();
+  return TEST_REPORT();
+}
@@ -0,0 +1,225 @@
+/* test_detectors.cpp
+ *
+ *  The detector registry: lidar.detector picks the detector (any case,
+ *  with unknown names and older PARAMS.TXT files falling back to Decay),
+ *  the name and the LoRa code report it, and processLIDARSamples() gives
+ *  exactly the events the detector's own function gives, in order, batch
+ *  by batch. The threshold detector keeps its smoothed distance in
+ *  lidarBuffer. The correlation detector must count vehicles on a roadside
+ *  trace, in the right lanes.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameDetectors.h>
+
+#include <random>
+#include <vector>
+
+#include "hostTest.h"
+
+struct Event
+{
+  long at;
+  int lane;
+};
+
+//****************************************************************************************
+// Empty road at 999 cm, one vehicle at a time in either lane for 0.6-1.5 s at 100 Hz,
+// with noise and the odd dropout. lanes gets the lane of each vehicle.
+static std::vector<int16_t> makeTrace(long n, unsigned seed, std::vector<int> &lanes)
+{
+  std::mt19937 rng(seed);
+  std::vector<int16_t> trace(500, 999);
+  while ((long)trace.size() < n)
+  {
+    int quiet = 200 + (int)(rng() % 400);
+    for (int i = 0; i < quiet; i++) trace.push_back((int16_t)(999 + (int)(rng() % 5) - 2));
+    int lane = 1 + (int)(rng() % 2);
+    int car = (lane == 1) ? 150 + (int)(rng() % 100) : 450 + (int)(rng() % 150);
+    int length = 60 + (int)(rng() % 90);
+    for (int i = 0; i < length; i++)
+    {
+      int d = car + (int)(rng() % 21) - 10;
+      if (rng() % 50 == 0) d = 0;
+      trace.push_back((int16_t)d);
+    }
+    lanes.push_back(lane);
+  }
+  trace.insert(trace.end(), 500, 999);
+  return trace;
+}
+
+static LIDARSample reading(int16_t d, uint32_t timeUS = micros())
+{
+  LIDARSample sample;
+  sample.dist = d;
+  sample.flux = 1000;
+  sample.temp = 30;
+  sample.status = TFMP_READY;
+  sample.timeUS = timeUS;
+  return sample;
+}
+
+//****************************************************************************************
+static void testSelection()
+{
+  const char *names[] = {"Threshold", "voting", "DECAY", "Correlation", "Bogus", ""};
+  const DetectionAlgorithm expect[] = {DETECT_THRESHOLD, DETECT_VOTING, DETECT_DECAY,
+                                       DETECT_CORRELATION, DETECT_DECAY, DETECT_DECAY};
+  const char *codes[] = {"t", "v", "d", "c", "d", "d"};
+  for (int i = 0; i < 6; i++)
+  {
+    Config c;
+    c.lidarDetectionAlgorithm = names[i];
+    RuntimeConfig rc = buildRuntimeConfig(c);
+    CHECK_EQ(rc.lidarDetectionAlgorithm, expect[i]);
+    selectLIDARDetector(rc.lidarDetectionAlgorithm);
+    CHECK_EQ(getLIDARDetector(), expect[i]);
+    CHECK(String(getLIDARDetectorName()) == detectionAlgorithmNames[expect[i]]);
+    CHECK(getLIDARDetectorCode() == codes[i]);
+  }
+  CHECK(Config().lidarDetectionAlgorithm == "Decay"); // What the counter has always run
+
+  // PARAMS.TXT from older firmware always says Threshold, but that firmware ran Decay.
+  File f = SD.open("/legacy.txt", FILE_WRITE);
+  f.print("{\"lidar\": {\"detectionAlgorithm\": \"Threshold\", \"zone1Max\": \"250\"}}");
+  f.close();
+  Config legacy;
+  loadConfiguration("/legacy.txt", legacy);
+  CHECK(legacy.lidarZone1Max == "250");
+  CHECK_EQ(buildRuntimeConfig(legacy).lidarDetectionAlgorithm, DETECT_DECAY);
+
+  // A choice saved by this firmware is kept.
+  legacy.lidarDetectionAlgorithm = "Threshold";
+  saveConfiguration("/chosen.txt", legacy);
+  Config chosen;
+  loadConfiguration("/chosen.txt", chosen);
+  CHECK_EQ(buildRuntimeConfig(chosen).lidarDetectionAlgorithm, DETECT_THRESHOLD);
+}
+
+//****************************************************************************************
+// The threshold detector keeps its smoothed distance (x 10) in lidarBuffer, as it always
+// has; the zone counts the others use still see the readings.
+static void testThresholdBuffer()
+{
+  for (int i = 0; i < 100; i++)
+  {
+    processLIDARSample<LIDAR_KERNELS>(getRuntimeConfig(), reading(250));
+    delay(10);
+  }
+  CHECK(abs(lidarBuffer[lidarBuffer.size() - 1] - 2500) <= 10);
+  CHECK_EQ(lidarZoneCounts.zone1, lidarSamples);
+  CHECK_EQ(lidarZoneCounts.zone2, 0);
+  CHECK_EQ(lidarZoneBuffer[lidarZoneBuffer.size() - 1], 250);
+
+  for (int i = 0; i < 100; i++)
+  {
+    processLIDARSample<LIDAR_KERNELS>(getRuntimeConfig(), reading(999));
+    delay(10);
+  }
+  CHECK_EQ(lidarZoneCounts.zone1, 0);
+}
+
+//****************************************************************************************
+// The detector's own function, one reading at a time, 10 ms apart. The clock moves once a
+// batch, as it would between calls to readLIDARSamples(); each reading has its own time.
+static std::vector<Event> runDirect(int (*detect)(const RuntimeConfig &, const LIDARSample &),
+                                    const std::vector<int16_t> &trace, int batch)
+{
+  std::vector<Event> events;
+  for (size_t t = 0; t < trace.size(); t++)
+  {
+    int lane = detect(getRuntimeConfig(), reading(trace[t], micros() + (t % batch) * 10000));
+    if (lane > 0) events.push_back({(long)(t / batch), lane});
+    if ((t + 1) % batch == 0) delay(10 * batch);
+  }
+  return events;
+}
+
+// The same through the registry, batch readings at a time (as from readLIDARSamples()).
+static std::vector<Event> runRegistry(const std::vector<int16_t> &trace, int batch)
+{
+  std::vector<Event> events;
+  std::vector<LIDARSample> samples(batch);
+  long b = 0;
+  for (size_t t = 0; t < trace.size(); t += batch, b++)
+  {
+    int n = 0;
+    for (; (n < batch) && (t + n < trace.size()); n++) samples[n] = reading(trace[t + n], micros() + n * 10000);
+    processLIDARSamples(getRuntimeConfig(), samples.data(), n,
+                        [&](int lane) { events.push_back({b, lane}); });
+    delay(10 * batch);
+  }
+  return events;
+}
+
+static void testDispatch()
+{
+  std::vector<int> lanes;
+  std::vector<int16_t> trace = makeTrace(100000, 1, lanes);
+
+  int (*direct[DETECT_ALGORITHMS])(const RuntimeConfig &, const LIDARSample &) = {
+      processLIDARSample<LIDAR_KERNELS>, processLIDARSample2<>, processLIDARSample3<LIDAR_KERNELS>,
+      processLIDARSampleCorrelation<LIDAR_KERNELS>};
+
+  for (int a = 0; a < DETECT_ALGORITHMS; a++)
+  {
+    const int batch = 32;
+    runDirect(direct[a], std::vector<int16_t>(500, 999), 1); // Settle its filters on empty road
+    std::vector<Event> single = runDirect(direct[a], trace, 1);
+    runDirect(direct[a], std::vector<int16_t>(500, 999), 1);
+    std::vector<Event> expect = runDirect(direct[a], trace, batch);
+    selectLIDARDetector((DetectionAlgorithm)a);
+    std::vector<Event> got = runRegistry(trace, batch);
+
+    bool same = (expect.size() == got.size());
+    for (size_t i = 0; same && i < got.size(); i++)
+    {
+      same = (expect[i].at == got[i].at) && (expect[i].lane == got[i].lane);
+    }
+    fprintf(stderr, "%-12s %5zu events (%zu vehicles)\n", getLIDARDetectorName(), got.size(),
+            lanes.size());
+    CHECK(same);
+    CHECK(got.size() > 0);
+    CHECK_EQ(got.size(), single.size()); // Batches count what one reading at a time does
+  }
+}
+
+//****************************************************************************************
+static void testCorrelationCounts()
+{
+  std::vector<int> lanes;
+  std::vector<int16_t> trace = makeTrace(300000, 2, lanes);
+
+  selectLIDARDetector(DETECT_CORRELATION);
+  std::vector<Event> events = runRegistry(trace, 32);
+
+  int truth[3] = {0, 0, 0}, counted[3] = {0, 0, 0};
+  for (int lane : lanes) truth[lane]++;
+  for (const Event &e : events) counted[e.lane]++;
+  fprintf(stderr, "Correlation: lane 1 %d of %d, lane 2 %d of %d\n", counted[1], truth[1],
+          counted[2], truth[2]);
+  for (int lane = 1; lane <= 2; lane++)
+  {
+    CHECK(abs(counted[lane] - truth[lane]) <= truth[lane] / 20);
+  }
+}
+
+int main()
+{
+  char dir[] = "/tmp/digame_detectorsXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  SD.hostSetRoot(dir);
+  config.lidarZone1Min = "0";
+  config.lidarZone1Max = "300";
+  config.lidarZone2Min = "400";
+  config.lidarZone2Max = "700";
+  publishRuntimeConfig(config);
+
+  testSelection();
+  testThresholdBuffer();
+  testDispatch();
+  testCorrelationCounts();
+  return TEST_REPORT();
+}
@@ -0,0 +1,316 @@
+/* test_dual_lidar.cpp
+ *
+ *  Two sensors read at once for the people counter. A frame gets the time it
+ *  arrived, however long it waited in the UART buffer. The fusion pairs each
+ *  100 Hz tick with each sensor's nearest reading -- checked against a
+ *  brute-force search -- with the sensors out of phase, one running slow and
+ *  dropping frames, one going quiet for a while, and the loop stalling. People
+ *  stepping through the door both ways at 0.6 to 1.5 m/s are all counted, the
+ *  right way. And both reader tasks keep up with their sensors at once.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameDualLIDAR.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "hostTest.h"
+
+static void inject(HardwareSerial &uart, int16_t dist, int16_t flux, int bytes = TFMP_FRAME_SIZE)
+{
+  uint8_t frame[TFMP_FRAME_SIZE];
+  TFMPlus::hostEncodeFrame(frame, dist, flux, 30);
+  uart.hostInject(frame, bytes);
+}
+
+//****************************************************************************************
+// Frames put back by the bytes that came in after them: 86.8 us each at 115200.
+static void testTimestamps()
+{
+  Serial1.hostClear();
+  Serial1.setRxBufferSize(1024);
+  LIDARChannel channel(Serial1);
+  auto at = [](uint32_t nowUS, int bytesAfter) { return nowUS - (uint32_t)(bytesAfter * 86805ULL / 1000); };
+
+  // Three frames and the start of a fourth.
+  for (int i = 0; i < 3; i++) inject(Serial1, 100, (int16_t)i);
+  uint8_t frame[TFMP_FRAME_SIZE];
+  TFMPlus::hostEncodeFrame(frame, 100, 3, 30);
+  Serial1.hostInject(frame, 4);
+  CHECK_EQ(channel.pump(1000000), 31);
+
+  LIDARSample s;
+  for (int i = 0; i < 3; i++)
+  {
+    CHECK(channel.stream.pop(s));
+    CHECK_EQ(s.flux, i);
+    CHECK_EQ(s.timeUS, at(1000000, 4 + 9 * (2 - i)));
+  }
+  CHECK(!channel.stream.pop(s));
+
+  // The rest of it, read as soon as it's in.
+  Serial1.hostInject(frame + 4, TFMP_FRAME_SIZE - 4);
+  channel.pump(1000500);
+  CHECK(channel.stream.pop(s));
+  CHECK_EQ(s.flux, 3);
+  CHECK_EQ(s.timeUS, 1000500u);
+
+  // Twenty frames waiting: more than one read. The ones left behind count too.
+  for (int i = 0; i < 20; i++) inject(Serial1, 100, (int16_t)i);
+  while (channel.pump(2000000) > 0)
+  {
+  }
+  bool times = true;
+  for (int i = 0; i < 20; i++)
+  {
+    times &= channel.stream.pop(s) && (s.flux == i) && (s.timeUS == at(2000000, 9 * (19 - i)));
+  }
+  CHECK(times);
+  CHECK_EQ(channel.frames, 24ul);
+  CHECK_EQ(channel.drops, 0ul);
+}
+
+//****************************************************************************************
+// Two sensors' readings: sensor 1 every 10 ms, dropping one in 97; sensor 2 3.7 ms later
+// and 0.3% slow, silent for 200 ms at 3 s. The reading's number goes in flux.
+static void makeReadings(std::vector<LIDARSample> r[2], uint32_t startUS, int n)
+{
+  for (int i = 0; i < n; i++)
+  {
+    if (i % 97 != 50) r[0].push_back({startUS + (uint32_t)i * 10000, 200, (int16_t)i, 30, TFMP_READY});
+    uint32_t t = startUS + 3700 + (uint32_t)i * 10030;
+    if ((t < startUS + 3000000) || (t > startUS + 3200000)) r[1].push_back({t, 300, (int16_t)i, 30, TFMP_READY});
+  }
+}
+
+// What read() should pair the tick with: the last reading at or before it, or the first
+// after, whichever is nearer, if it's within dualLIDARMaxSkewUS.
+static int nearestReading(const std::vector<LIDARSample> &r, uint32_t tickUS)
+{
+  int best = -1;
+  uint32_t bestSkew = UINT32_MAX;
+  for (size_t i = 0; i < r.size(); i++)
+  {
+    bool before = (int32_t)(r[i].timeUS - tickUS) <= 0;
+    uint32_t skew = before ? tickUS - r[i].timeUS : r[i].timeUS - tickUS;
+    if ((skew < bestSkew) || ((skew == bestSkew) && before))
+    {
+      best = (int)i;
+      bestSkew = skew;
+    }
+  }
+  return (bestSkew <= dualLIDARMaxSkewUS) ? r[best].flux : -1;
+}
+
+static void testFusion()
+{
+  LIDARChannel a(Serial1), b(Serial2);
+  DualLIDARFusion fusion(a, b);
+  const uint32_t startUS = 4294967295u - 2000000; // Across the wrap
+  std::vector<LIDARSample> r[2];
+  makeReadings(r, startUS, 600);
+
+  size_t next[2] = {0, 0};
+  std::vector<LIDARPair> pairs;
+  LIDARPair batch[8];
+  bool prompt = true;
+  for (uint32_t step = 1; step <= 300; step++) // The loop every 20 ms
+  {
+    uint32_t nowUS = startUS + step * 20000;
+    for (int c = 0; c < 2; c++)
+    {
+      while ((next[c] < r[c].size()) && ((int32_t)(r[c][next[c]].timeUS - nowUS) <= 0))
+      {
+        (c ? b : a).stream.push(r[c][next[c]++]);
+      }
+    }
+    int n;
+    while ((n = fusion.read(batch, 8, nowUS)) > 0) pairs.insert(pairs.end(), batch, batch + n);
+    // Everything but the last few ticks is out, sensor 2 quiet or not.
+    prompt &= !pairs.empty() && ((uint32_t)(nowUS - pairs.back().timeUS) < dualLIDARLatencyUS + dualLIDARPeriodUS);
+  }
+  CHECK(prompt);
+  CHECK(pairs.size() > 590);
+
+  bool spacing = true, matches = true;
+  int missing[2] = {0, 0};
+  for (size_t i = 0; i < pairs.size(); i++)
+  {
+    if (i > 0) spacing &= (pairs[i].timeUS - pairs[i - 1].timeUS == dualLIDARPeriodUS);
+    for (int c = 0; c < 2; c++)
+    {
+      const LIDARSample &s = pairs[i].sample[c];
+      int expected = nearestReading(r[c], pairs[i].timeUS);
+      matches &= (expected < 0) ? (s.status == TFMP_HEADER) : (s.status == TFMP_READY) && (s.flux == expected);
+      missing[c] += (s.status == TFMP_HEADER);
+    }
+  }
+  CHECK(spacing);
+  CHECK(matches);
+  CHECK_EQ(fusion.pairs, (unsigned long)pairs.size());
+  CHECK_EQ(fusion.missing[0], (unsigned long)missing[0]);
+  CHECK_EQ(missing[0], 0); // A dropped reading's neighbours are near enough
+  CHECK((missing[1] >= 16) && (missing[1] <= 21)); // 200 ms gone
+  fprintf(stderr, "Fusion: %zu pairs, missing %d and %d\n", pairs.size(), missing[0], missing[1]);
+
+  // The loop stalls for two seconds: the rings fill and then drop, and the fusion picks
+  // up where the readings are now rather than working through the gap.
+  uint32_t nowUS = startUS + 8000000;
+  for (int i = 0; i < 100; i++)
+  {
+    LIDARSample s = {nowUS - 990000 + (uint32_t)i * 10000, 200, 0, 30, TFMP_READY};
+    a.stream.push(s);
+    s.timeUS += 4000;
+    b.stream.push(s);
+  }
+  int n = fusion.read(batch, 8, nowUS);
+  CHECK(n > 0);
+  CHECK((uint32_t)(nowUS - batch[0].timeUS) <= dualLIDARLatencyUS);
+}
+
+//****************************************************************************************
+// People stepping through the door under the two sensors, 20 cm apart: 230 cm to the
+// floor, their shoulders 50 to 90 cm below the sensors and, with arms and bags, 35 to
+// 50 cm front to back. Outbound, sensor 1 sees them first. Both sensors run at 100 Hz,
+// out of phase, and drop the odd frame.
+static void testDirection()
+{
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<double> u(0, 1);
+  LIDARChannel a(Serial1), b(Serial2);
+  DualLIDARFusion fusion(a, b);
+  DualLIDARDirection direction;
+
+  struct Walker
+  {
+    double startS, speed, width;
+    int16_t dist;
+    bool outbound;
+  };
+  std::vector<Walker> walkers;
+  int out = 0, in = 0;
+  double t = 3;
+  for (int i = 0; i < 200; i++)
+  {
+    Walker w = {t, 0.6 + 0.9 * u(rng), 0.35 + 0.15 * u(rng), (int16_t)(50 + rng() % 40), (rng() % 2) == 0};
+    walkers.push_back(w);
+    (w.outbound ? out : in)++;
+    t += 1.5 + 2 * u(rng);
+  }
+
+  // Distance under sensor c (at 0 or 20 cm) at time s
+  auto distance = [&](int c, double s) {
+    for (const Walker &w : walkers)
+    {
+      double x = (s - w.startS) * w.speed * 100; // cm into the doorway...
+      double beam = w.outbound ? (c ? 20 : 0) : (c ? 0 : 20); // ...for the sensor they meet first at 0
+      if ((x >= beam) && (x < beam + w.width * 100)) return (int)w.dist + (int)(rng() % 5);
+    }
+    return 230 + (int)(rng() % 5);
+  };
+
+  const double phase[2] = {0.0021, 0.0087};
+  int counted[3] = {0, 0, 0};
+  int64_t frame[2] = {0, 0};
+  const uint32_t endUS = (uint32_t)((t + 3) * 1e6);
+  for (uint32_t nowUS = 20000; nowUS < endUS; nowUS += 20000)
+  {
+    for (int c = 0; c < 2; c++)
+    {
+      double s;
+      while ((s = phase[c] + frame[c] * 0.01) * 1e6 <= nowUS)
+      {
+        LIDARSample r = {(uint32_t)(s * 1e6), (int16_t)distance(c, s), 500, 30, TFMP_READY};
+        if (rng() % 100 != 0) (c ? b : a).stream.push(r);
+        frame[c]++;
+      }
+    }
+    LIDARPair pairs[8];
+    int n;
+    while ((n = fusion.read(pairs, 8, nowUS)) > 0)
+    {
+      for (int i = 0; i < n; i++) counted[direction.update(pairs[i])]++;
+    }
+  }
+  fprintf(stderr, "Walkers: %d out, %d in; counted %d out, %d in\n", out, in, counted[OUTBOUND], counted[INBOUND]);
+  CHECK_EQ(counted[OUTBOUND], out);
+  CHECK_EQ(counted[INBOUND], in);
+}
+
+//****************************************************************************************
+// Both reader tasks at once, each sensor streaming at 100 Hz on its own UART.
+static void testReaderTasks()
+{
+  const int numFrames = 100;
+  Serial1.hostClear();
+  Serial2.hostClear();
+  LIDARChannel a(Serial1), b(Serial2);
+  CHECK(a.start("LIDAR 1 Reader"));
+  CHECK(b.start("LIDAR 2 Reader"));
+  TaskHandle_t readers[2] = {a.readerTask, b.readerTask};
+
+  std::atomic<int> streaming{2};
+  std::thread sensors[2];
+  for (int c = 0; c < 2; c++)
+  {
+    sensors[c] = std::thread([c, &streaming]() {
+      auto next = std::chrono::steady_clock::now() + std::chrono::microseconds(c * 4000);
+      for (int i = 0; i < numFrames; i++)
+      {
+        std::this_thread::sleep_until(next);
+        inject(c ? Serial2 : Serial1, (int16_t)(100 + c), (int16_t)i);
+        next += std::chrono::milliseconds(10);
+      }
+      streaming--;
+    });
+  }
+
+  // The loop takes what's come in every 20 ms.
+  std::vector<LIDARSample> received[2];
+  auto take = [&]() {
+    LIDARSample s;
+    while (a.stream.pop(s)) received[0].push_back(s);
+    while (b.stream.pop(s)) received[1].push_back(s);
+  };
+  while (streaming > 0)
+  {
+    take();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  for (std::thread &s : sensors) s.join();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  take();
+  a.stop();
+  b.stop();
+  hostJoinTask(readers[0]);
+  hostJoinTask(readers[1]);
+
+  for (int c = 0; c < 2; c++)
+  {
+    LIDARChannel &ch = c ? b : a;
+    bool inOrder = true;
+    for (size_t i = 0; i < received[c].size(); i++)
+    {
+      inOrder &= (received[c][i].flux == (int)i) && (received[c][i].dist == 100 + c);
+    }
+    CHECK_EQ((int)received[c].size(), numFrames);
+    CHECK(inOrder);
+    CHECK_EQ(ch.drops, 0ul);
+    CHECK_EQ(ch.parser.stats.checksumErrors, 0ul);
+  }
+}
+
+int main()
+{
+  Serial.hostSetEcho(false);
+  testTimestamps();
+  testFusion();
+  testDirection();
+  testReaderTasks();
+  return TEST_REPORT();
+}
@@ -0,0 +1,243 @@
+/* test_dual_lidar_passages.cpp
+ *
+ *  The people counter's passage engine on simulated doorways. People
+ *  walking through alone, either way, at 0.5 to 2 m/s: the direction is
+ *  always right and the speed within 10%. People in single file, a hand's
+ *  width apart, and people going opposite ways one right after the other:
+ *  each counted once, the right way, where the first-seen state machine is
+ *  off by more than one in ten. Someone standing under a sensor or leaning into one
+ *  isn't counted. Traces saved in the counter's [T]race format and loaded
+ *  back replay the same.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "../tools/digameDualReplay.h"
+
+#include <math.h>
+#include <random>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hostTest.h"
+
+//****************************************************************************************
+// A doorway with the sensors 20 cm apart along the way through, 230 cm above the floor.
+// Outbound walkers pass under sensor 1 first. Their shoulders are 50 to 90 cm below
+// the sensors; with arms and bags they're 35 to 50 cm front to back.
+struct Walker
+{
+  double startS; // When their front reaches the first spot
+  double speed;  // m/s
+  double length; // m
+  int16_t dist;  // cm
+  bool outbound;
+};
+
+const double spacingM = 0.2;
+
+static Walker makeWalker(std::mt19937 &rng, double startS, bool outbound, double speed = 0)
+{
+  std::uniform_real_distribution<double> u(0, 1);
+  if (speed == 0) speed = 0.6 + 0.9 * u(rng);
+  return {startS, speed, 0.35 + 0.15 * u(rng), (int16_t)(50 + rng() % 40), outbound};
+}
+
+// Pairs at 100 Hz from 0 to the end of the last walker and a second, with a couple of cm
+// of noise and the given share of readings missing.
+static DualTrace makeTrace(const std::vector<Walker> &walkers, unsigned seed, double missing = 0)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> u(0, 1);
+  double endS = 2;
+  for (const Walker &w : walkers) endS = fmax(endS, w.startS + (w.length + spacingM) / w.speed + 1);
+
+  DualTrace t;
+  t.name = "sim" + std::to_string(seed);
+  for (int i = 0; i * 0.01 < endS; i++)
+  {
+    double s = i * 0.01;
+    LIDARPair p;
+    p.timeUS = 5000000 + (uint32_t)i * dualLIDARPeriodUS;
+    for (int c = 0; c < 2; c++)
+    {
+      int16_t d = 230;
+      for (const Walker &w : walkers)
+      {
+        double front = (s - w.startS) * w.speed;
+        double spot = (w.outbound == (c == 0)) ? 0 : spacingM;
+        if ((front >= spot) && (front - w.length < spot)) d = w.dist;
+      }
+      p.sample[c] = {p.timeUS, (int16_t)(d + (int)(rng() % 5) - 2), 500, 30, TFMP_READY};
+      if (u(rng) < missing) p.sample[c].status = TFMP_HEADER;
+    }
+    t.pairs.push_back(p);
+  }
+  return t;
+}
+
+//****************************************************************************************
+static void testSingleWalkers()
+{
+  std::mt19937 rng(3);
+  std::vector<Walker> walkers;
+  double t = 1;
+  for (int i = 0; i < 150; i++)
+  {
+    walkers.push_back(makeWalker(rng, t, (i % 3) != 0, 0.5 + 1.5 * (i % 16) / 15.0));
+    t += 3;
+  }
+  DualReplayResult r = replayDualTrace(makeTrace(walkers, 1, 0.01), DualLIDARPassageSettings());
+
+  CHECK_EQ(r.passages.size(), walkers.size());
+  bool directions = true;
+  double worst = 0, sum = 0;
+  for (size_t i = 0; (i < r.passages.size()) && (i < walkers.size()); i++)
+  {
+    const DualLIDARPassage &p = r.passages[i];
+    const Walker &w = walkers[i];
+    directions &= (p.direction == (w.outbound ? OUTBOUND : INBOUND));
+    directions &= ((p.lagMS > 0) == w.outbound);
+    double error = fabs(p.speed - w.speed) / w.speed;
+    worst = fmax(worst, error);
+    sum += error;
+    // It was between the sensors about when its middle was.
+    double midS = w.startS + (spacingM / 2 + w.length / 2) / w.speed;
+    CHECK(fabs((p.timeUS - 5000000) / 1e6 - midS) < 0.05);
+  }
+  fprintf(stderr, "Speed error: mean %.1f%%, worst %.1f%%\n", 100 * sum / walkers.size(), 100 * worst);
+  CHECK(directions);
+  CHECK(worst < 0.10);
+  float weakest = 1;
+  for (const DualLIDARPassage &p : r.passages) weakest = fminf(weakest, p.correlation);
+  CHECK(weakest > 0.5);
+  CHECK_EQ(r.counts[OUTBOUND], r.firstSeenCounts[OUTBOUND]); // Both manage alone
+  CHECK_EQ(r.counts[INBOUND], r.firstSeenCounts[INBOUND]);
+}
+
+//****************************************************************************************
+// Groups of two or three in single file, 15 to 40 cm apart, then someone going the other
+// way as soon as the door's clear.
+static void testCrowds()
+{
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<double> u(0, 1);
+  std::vector<Walker> walkers;
+  int expected[3] = {0, 0, 0};
+  double t = 1;
+  for (int group = 0; group < 60; group++)
+  {
+    bool outbound = (group % 2) == 0;
+    double speed = 0.6 + 0.9 * u(rng);
+    int size = 2 + (int)(rng() % 2);
+    for (int i = 0; i < size; i++)
+    {
+      Walker w = makeWalker(rng, t, outbound, speed);
+      walkers.push_back(w);
+      expected[outbound ? OUTBOUND : INBOUND]++;
+      t += (w.length + 0.15 + 0.25 * u(rng)) / speed;
+    }
+    const Walker &last = walkers.back();
+    t = last.startS + (last.length + spacingM) / speed + 0.1 + 0.3 * u(rng);
+    Walker other = makeWalker(rng, t, !outbound);
+    walkers.push_back(other);
+    expected[other.outbound ? OUTBOUND : INBOUND]++;
+    t += (other.length + spacingM) / other.speed + 2;
+  }
+  DualReplayResult r = replayDualTrace(makeTrace(walkers, 2, 0.01), DualLIDARPassageSettings());
+
+  int firstSeenWrong = abs(r.firstSeenCounts[OUTBOUND] - expected[OUTBOUND]) +
+                       abs(r.firstSeenCounts[INBOUND] - expected[INBOUND]);
+  fprintf(stderr, "Crowds: %d out, %d in; passages %d out, %d in; first seen %d out, %d in\n",
+          expected[OUTBOUND], expected[INBOUND], r.counts[OUTBOUND], r.counts[INBOUND],
+          r.firstSeenCounts[OUTBOUND], r.firstSeenCounts[INBOUND]);
+  CHECK_EQ(r.counts[OUTBOUND], expected[OUTBOUND]);
+  CHECK_EQ(r.counts[INBOUND], expected[INBOUND]);
+  CHECK(firstSeenWrong > (int)walkers.size() / 10); // Counts the second of a pair the wrong way
+
+  bool order = true;
+  for (size_t i = 0; (i < r.passages.size()) && (i < walkers.size()); i++)
+  {
+    order &= (r.passages[i].direction == (walkers[i].outbound ? OUTBOUND : INBOUND));
+  }
+  CHECK(order);
+}
+
+//****************************************************************************************
+// Someone standing under sensor 1 for five seconds, someone leaning into sensor 2's spot,
+// then someone walking through.
+static void testNotPassing()
+{
+  DualTrace t = makeTrace({}, 3);
+  t.pairs.resize(1200);
+  for (int i = 100; i < 600; i++) t.pairs[i].sample[0].dist = 80;
+  for (int i = 700; i < 740; i++) t.pairs[i].sample[1].dist = 120;
+  std::mt19937 rng(4);
+  DualTrace walk = makeTrace({makeWalker(rng, 1, true)}, 5);
+  for (size_t i = 0; i < walk.pairs.size(); i++)
+  {
+    t.pairs.push_back(walk.pairs[i]);
+    t.pairs.back().timeUS = t.pairs[t.pairs.size() - 2].timeUS + dualLIDARPeriodUS;
+  }
+
+  DualReplayResult r = replayDualTrace(t, DualLIDARPassageSettings());
+  CHECK_EQ(r.counts[OUTBOUND], 1);
+  CHECK_EQ(r.counts[INBOUND], 0);
+  CHECK_EQ(r.loitering, 1ul);
+  CHECK_EQ(r.unmatched[1], 1ul);
+}
+
+//****************************************************************************************
+static void testReplay()
+{
+  char dir[] = "/tmp/digame_dualXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+
+  std::mt19937 rng(6);
+  for (unsigned seed = 1; seed <= 3; seed++)
+  {
+    std::vector<Walker> walkers;
+    for (int i = 0; i < 20; i++) walkers.push_back(makeWalker(rng, 1 + 2.5 * i, rng() % 2));
+    DualTrace trace = makeTrace(walkers, seed, 0.02);
+    std::string path = std::string(dir) + "/trace" + std::to_string(seed) + ".csv";
+    CHECK(saveDualTrace(path, trace));
+
+    DualTrace loaded;
+    std::string error;
+    CHECK(loadDualTrace(path, loaded, error));
+    CHECK_EQ(loaded.pairs.size(), trace.pairs.size());
+    bool same = true;
+    for (size_t i = 0; (i < trace.pairs.size()) && (i < loaded.pairs.size()); i++)
+    {
+      same &= (getLIDARPairCSV(loaded.pairs[i]) == getLIDARPairCSV(trace.pairs[i]));
+    }
+    CHECK(same);
+
+    DualReplayResult a = replayDualTrace(trace, DualLIDARPassageSettings());
+    DualReplayResult b = replayDualTrace(loaded, DualLIDARPassageSettings());
+    CHECK_EQ(a.passages.size(), walkers.size());
+    CHECK_EQ(b.passages.size(), a.passages.size());
+    bool lags = true;
+    for (size_t i = 0; (i < a.passages.size()) && (i < b.passages.size()); i++)
+    {
+      lags &= (a.passages[i].lagMS == b.passages[i].lagMS) && (a.passages[i].timeUS == b.passages[i].timeUS);
+    }
+    CHECK(lags);
+    unlink(path.c_str());
+  }
+
+  DualTrace none;
+  std::string error;
+  CHECK(!loadDualTrace(std::string(dir) + "/missing.csv", none, error));
+  rmdir(dir);
+}
+
+int main()
+{
+  Serial.hostSetEcho(false);
+  testSingleWalkers();
+  testCrowds();
+  testNotPassing();
+  testReplay();
+  return TEST_REPORT();
+}
@@ -0,0 +1,222 @@
+/* test_event_queue.cpp
+ *
+ *  The counter's outgoing event queue. Events come out in order, with their
+ *  raw signals; a full queue refuses (and counts) new events instead of
+ *  overwriting old ones, and vehicles with no raw signal slot free go without
+ *  one. A producer and a consumer thread going flat out, with the consumer
+ *  stalling now and then (as it does waiting for an ACK), lose nothing they
+ *  don't count. And months of events don't touch the heap.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameEventQueue.h>
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <thread>
+
+#include "hostTest.h"
+
+// Heap allocations, counted.
+static std::atomic<unsigned long> allocations{0};
+
+void *operator new(size_t size)
+{
+  allocations++;
+  void *p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static CounterEvent makeEvent(uint32_t count, uint8_t type = EVENT_VEHICLE)
+{
+  CounterEvent e = {};
+  e.epoch = 1650000000 + count;
+  e.count = count;
+  e.tempC10 = 215;
+  e.type = type;
+  e.lane = 1 + (count % 2);
+  return e;
+}
+
+static void fillRaw(RawSignal *raw, uint32_t count)
+{
+  raw->length = eventRawSignalLength;
+  for (int i = 0; i < eventRawSignalLength; i++) raw->samples[i] = (int16_t)(count * 7 + i);
+}
+
+static bool rawMatches(const RawSignal *raw, uint32_t count)
+{
+  if (!raw || (raw->length != eventRawSignalLength)) return false;
+  for (int i = 0; i < eventRawSignalLength; i++)
+  {
+    if (raw->samples[i] != (int16_t)(count * 7 + i)) return false;
+  }
+  return true;
+}
+
+//****************************************************************************************
+static void testOrderAndDrops()
+{
+  CHECK_EQ(sizeof(CounterEvent), 16u);
+  static EventQueue<8, 4> q;
+  CounterEvent e;
+  CHECK(!q.peek(e));
+  q.pop(); // Nothing to pop: no harm
+
+  // Every other one with a raw signal: 4 slots for 8 events.
+  for (uint32_t i = 0; i < 10; i++)
+  {
+    bool withRaw = false;
+    if (i % 2 == 0)
+    {
+      RawSignal *raw = q.rawSlot();
+      CHECK((raw != nullptr) == (i < 8));
+      if (raw) fillRaw(raw, i);
+      withRaw = (raw != nullptr);
+    }
+    CHECK_EQ(q.push(makeEvent(i), withRaw), i < 8);
+  }
+  CHECK_EQ(q.size(), 8u);
+  CHECK_EQ(q.pushed, 8ul);
+  CHECK_EQ(q.dropped, 2ul); // The newest, not the oldest
+  CHECK(q.rawSlot() == nullptr);
+
+  for (uint32_t i = 0; i < 8; i++)
+  {
+    CHECK(q.peek(e));
+    CHECK_EQ(e.count, i);
+    CHECK_EQ(e.lane, 1 + (i % 2));
+    CHECK_EQ(e.epoch, 1650000000 + i);
+    CHECK((q.rawSignal(e) != nullptr) == (i % 2 == 0));
+    if (i % 2 == 0) CHECK(rawMatches(q.rawSignal(e), i));
+    CHECK(q.peek(e)); // Peeking again: the same one
+    CHECK_EQ(e.count, i);
+    q.pop();
+  }
+  CHECK(!q.peek(e));
+
+  // All raw slots back. Ask for one more than there are: the last event goes without.
+  for (uint32_t i = 0; i < 5; i++)
+  {
+    RawSignal *raw = q.rawSlot();
+    if (raw) fillRaw(raw, 200 + i);
+    CHECK(q.push(makeEvent(200 + i), true));
+  }
+  CHECK_EQ(q.rawDropped, 1ul);
+  for (uint32_t i = 0; i < 5; i++)
+  {
+    CHECK(q.peek(e));
+    CHECK_EQ(e.count, 200 + i);
+    CHECK((i < 4) ? rawMatches(q.rawSignal(e), 200 + i) : (q.rawSignal(e) == nullptr));
+    q.pop();
+  }
+}
+
+//****************************************************************************************
+// One thread pushing as fast as it can, the other sending: pausing every so often.
+static void testThreads()
+{
+  static EventQueue<256, 16> q;
+  const uint32_t events = 1000000;
+  std::atomic<bool> done{false};
+  unsigned long received = 0, outOfOrder = 0, badRaw = 0, withRaw = 0;
+
+  std::thread consumer([&]() {
+    CounterEvent e;
+    uint32_t last = 0;
+    bool first = true;
+    for (;;)
+    {
+      if (!q.peek(e))
+      {
+        if (done.load()) break;
+        std::this_thread::yield();
+        continue;
+      }
+      if (!first && (e.count <= last)) outOfOrder++;
+      first = false;
+      last = e.count;
+      if (e.rawSlot != noRawSignal)
+      {
+        withRaw++;
+        if (!rawMatches(q.rawSignal(e), e.count)) badRaw++;
+      }
+      q.pop();
+      received++;
+      if (received % 5000 == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    // Anything pushed after the last look.
+    while (q.peek(e))
+    {
+      q.pop();
+      received++;
+    }
+  });
+
+  for (uint32_t i = 0; i < events; i++)
+  {
+    bool raw = false;
+    if (i % 3 == 0)
+    {
+      RawSignal *slot = q.rawSlot();
+      if (slot) fillRaw(slot, i);
+      raw = (slot != nullptr);
+    }
+    q.push(makeEvent(i), raw);
+    if (i % 256 == 0) std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  done = true;
+  consumer.join();
+
+  fprintf(stderr, "Threads: %lu sent, %lu dropped, %lu with raw signals\n", received, q.dropped, withRaw);
+  CHECK_EQ(q.pushed + q.dropped, (unsigned long)events);
+  CHECK_EQ(received, q.pushed);
+  CHECK_EQ(outOfOrder, 0ul);
+  CHECK_EQ(badRaw, 0ul);
+  CHECK(withRaw > 0);
+  CHECK(q.dropped > 0); // It did fill up
+}
+
+//****************************************************************************************
+// A busy road for a few months: a vehicle every few seconds, heartbeats, the link down
+// for hours now and then. No heap.
+static void testNoHeap()
+{
+  static EventQueue<256, 16> q;
+  unsigned long before = allocations.load();
+  uint32_t count = 0;
+  CounterEvent e;
+  for (uint32_t second = 0; second < 90 * 24 * 3600; second += 4)
+  {
+    RawSignal *raw = q.rawSlot();
+    if (raw) fillRaw(raw, count);
+    q.push(makeEvent(count++), raw != nullptr);
+    if (second % 3600 == 0) q.push(makeEvent(count, EVENT_HEARTBEAT));
+    bool linkUp = (second / 3600) % 50 < 45;
+    if (linkUp && q.peek(e)) q.pop();
+    if (linkUp && q.peek(e)) q.pop();
+  }
+  CHECK_EQ(allocations.load() - before, 0ul);
+  CHECK(q.dropped > 0);
+}
+
+//****************************************************************************************
+static void testTimeString()
+{
+  CHECK(getEventTimeString(0) == "1970-01-01 00:00:00");
+  CHECK(getEventTimeString(1650000000) == "2022-04-15 05:20:00");
+}
+
+int main()
+{
+  testOrderAndDrops();
+  testThreads();
+  testNoHeap();
+  testTimeString();
+  return TEST_REPORT();
+}
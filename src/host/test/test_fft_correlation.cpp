@@ -0,0 +1,203 @@
+/* test_fft_correlation.cpp
+ *
+ *  The FFT cross-correlation must match the direct sum at every lag: the
+ *  real FFT against a plain DFT and back again, then the float and Q15
+ *  correlators against a double-precision direct cross-correlation of
+ *  roadside windows with the falling edge, rising edge and notch models.
+ *  A window that's a shifted copy of a model peaks at that shift; a flat
+ *  window gives zeros.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameFFT.h>
+#include <digameMatchedFilter.h>
+
+#include <random>
+#include <vector>
+
+#include "hostTest.h"
+
+const int M = 256; // Fits the 100 point models at every lag
+
+//****************************************************************************************
+// As the sketch's crossCorrelation(), in double, lags -(n-1)..(n-1).
+static std::vector<double> direct(const float *x, const float *y, int n)
+{
+  double mx = 0, my = 0;
+  for (int i = 0; i < n; i++)
+  {
+    mx += x[i];
+    my += y[i];
+  }
+  mx /= n;
+  my /= n;
+  double sx = 0, sy = 0;
+  for (int i = 0; i < n; i++)
+  {
+    sx += (x[i] - mx) * (x[i] - mx);
+    sy += (y[i] - my) * (y[i] - my);
+  }
+  double denom = sqrt(sx * sy);
+
+  std::vector<double> r;
+  for (int lag = -(n - 1); lag < n; lag++)
+  {
+    double sxy = 0;
+    for (int i = 0; i < n; i++)
+    {
+      int j = i + lag;
+      if ((j >= 0) && (j < n)) sxy += (x[i] - mx) * (y[j] - my);
+    }
+    r.push_back(sxy / denom);
+  }
+  return r;
+}
+
+//****************************************************************************************
+static void testTransform()
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> u(-1, 1);
+  static FFTCorrelator<M> fft;
+  float x[M], Xre[M / 2 + 1], Xim[M / 2 + 1], back[M];
+  for (int i = 0; i < M; i++) x[i] = u(rng);
+
+  fft.forward(x, Xre, Xim);
+  double worst = 0;
+  for (int k = 0; k <= M / 2; k++)
+  {
+    double re = 0, im = 0;
+    for (int i = 0; i < M; i++)
+    {
+      re += x[i] * cos(2 * M_PI * k * i / M);
+      im -= x[i] * sin(2 * M_PI * k * i / M);
+    }
+    worst = fmax(worst, fmax(fabs(re - Xre[k]), fabs(im - Xim[k])));
+  }
+  CHECK(worst < 1e-4);
+
+  fft.inverse(Xre, Xim, back);
+  double worstBack = 0;
+  for (int i = 0; i < M; i++) worstBack = fmax(worstBack, fabs(back[i] - x[i]));
+  CHECK(worstBack < 1e-5);
+  fprintf(stderr, "Real FFT, M = %d: worst error %.1e vs DFT, %.1e round trip\n", M, worst, worstBack);
+
+  // The Q15 transform is the same, up to the block exponent it reports.
+  static FFTCorrelatorQ15<M> fftQ15;
+  int16_t xq[M], Xq[2][M / 2 + 1], backq[M];
+  for (int i = 0; i < M; i++) xq[i] = (int16_t)lround(x[i] * 16000);
+  int e = fftQ15.forward(xq, Xq[0], Xq[1]);
+  double worstQ = 0;
+  for (int k = 0; k <= M / 2; k++)
+  {
+    worstQ = fmax(worstQ, fabs(ldexp(Xq[0][k], e) / 16000.0 - Xre[k]));
+    worstQ = fmax(worstQ, fabs(ldexp(Xq[1][k], e) / 16000.0 - Xim[k]));
+  }
+  CHECK(worstQ < 0.05); // Of values up to ~M/4
+  e += fftQ15.inverse(Xq[0], Xq[1], backq);
+  double worstBackQ = 0;
+  for (int i = 0; i < M; i++) worstBackQ = fmax(worstBackQ, fabs(ldexp(backq[i], e) / (M / 2) / 16000.0 - x[i]));
+  fprintf(stderr, "Q15: worst error %.1e vs DFT, %.1e round trip\n", worstQ, worstBackQ);
+  CHECK(worstBackQ < 0.01);
+}
+
+//****************************************************************************************
+static void compare(const char *name, const float *model)
+{
+  const int n = modelSamples;
+  static FFTCorrelator<M> fft;
+  static FFTCorrelatorQ15<M> fftQ15;
+  CHECK(fft.setModel(model, n));
+  CHECK(fftQ15.setModel(model, n));
+
+  std::mt19937 rng(7);
+  float y[n], r[2 * n - 1];
+  int16_t yq[n], rq[2 * n - 1];
+  double worst = 0, worstQ = 0, worstCentre = 0;
+  for (int w = 0; w < 300; w++)
+  {
+    // A window of road with a car somewhere in it (or not), noise and dropouts.
+    int carStart = (int)(rng() % (2 * n)) - n / 2, carLength = 20 + (int)(rng() % 80);
+    int car = 150 + (int)(rng() % 600);
+    for (int i = 0; i < n; i++)
+    {
+      int d = ((i >= carStart) && (i < carStart + carLength)) ? car : 999;
+      d += (int)(rng() % 11) - 5;
+      if (rng() % 40 == 0) d = 0;
+      yq[i] = (int16_t)d;
+      y[i] = d;
+    }
+
+    std::vector<double> truth = direct(model, y, n);
+    CHECK_EQ(fft.correlate(y, r), 2 * n - 1);
+    CHECK_EQ(fftQ15.correlate(yq, rq), 2 * n - 1);
+    for (int i = 0; i < 2 * n - 1; i++)
+    {
+      worst = fmax(worst, fabs(r[i] - truth[i]));
+      worstQ = fmax(worstQ, fabs(rq[i] / 32768.0 - truth[i]));
+    }
+    worstCentre = fmax(worstCentre, fabs(r[n - 1] - correlation((float *)model, y, n)));
+  }
+  fprintf(stderr, "%-14s worst error over all lags: float %.1e, Q15 %.1e\n", name, worst, worstQ);
+  CHECK(worst < 1e-5);
+  CHECK(worstQ < 0.005);
+  CHECK(worstCentre < 1e-5);
+}
+
+//****************************************************************************************
+static void testLag()
+{
+  const int n = modelSamples;
+  static FFTCorrelator<M> fft;
+  static FFTCorrelatorQ15<M> fftQ15;
+  fft.setModel(notchModel, n);
+  fftQ15.setModel(notchModel, n);
+
+  // The notch, 17 readings later than in the model.
+  float y[n], r[2 * n - 1];
+  int16_t yq[n], rq[2 * n - 1];
+  for (int i = 0; i < n; i++)
+  {
+    int j = i - 17;
+    y[i] = (j >= 0 && notchModel[j] == 0) ? 300 : 900;
+    yq[i] = (int16_t)y[i];
+  }
+  fft.correlate(y, r);
+  fftQ15.correlate(yq, rq);
+  int best = 0, bestQ = 0;
+  for (int i = 1; i < 2 * n - 1; i++)
+  {
+    if (r[i] > r[best]) best = i;
+    if (rq[i] > rq[bestQ]) bestQ = i;
+  }
+  CHECK_EQ(best - (n - 1), 17);
+  CHECK_EQ(bestQ - (n - 1), 17);
+
+  // Flat: nothing to correlate.
+  for (int i = 0; i < n; i++)
+  {
+    y[i] = 999;
+    yq[i] = 999;
+  }
+  fft.correlate(y, r);
+  fftQ15.correlate(yq, rq);
+  bool zeros = true;
+  for (int i = 0; i < 2 * n - 1; i++) zeros &= (r[i] == 0) && (rq[i] == 0);
+  CHECK(zeros);
+
+  CHECK(!fft.setModel(notchModel, M / 2 + 1));
+  FFTCorrelator<16> small;
+  CHECK(!small.setModel(notchModel, 9));
+  CHECK(small.setModel(notchModel, 8));
+}
+
+int main()
+{
+  testTransform();
+  compare("falling edge", fallingEdgeModel);
+  compare("rising edge", risingEdgeModel);
+  compare("notch", notchModel);
+  testLag();
+  return TEST_REPORT();
+}
@@ -0,0 +1,221 @@
+/* test_fixed_point.cpp
+ *
+ *  The Q15 and Q31 kernels against the float ones: smoothing and decay
+ *  trajectories, mean and variance, and correlation against the step,
+ *  notch and smoothed models, each within the resolution of its format.
+ *  Then the detectors themselves: the v1 and v3 detectors run on a
+ *  roadside trace with each set of kernels must report the same vehicles,
+ *  in the same lanes, at (nearly) the same readings.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameLIDAR.h>
+#include <digameMatchedFilter.h>
+
+#include <random>
+#include <vector>
+
+#include "hostTest.h"
+
+struct Event
+{
+  long at;
+  int lane;
+};
+
+//****************************************************************************************
+// Empty road at 999 cm with cars in either lane for 0.3-1.5 s at 100 Hz, noise, the odd
+// dropout, and some empty road at each end so every detector starts and finishes idle.
+static std::vector<int16_t> makeTrace(long n, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<int16_t> trace(500, 999);
+  while ((long)trace.size() < n)
+  {
+    int quiet = 200 + (int)(rng() % 400);
+    for (int i = 0; i < quiet; i++) trace.push_back((int16_t)(999 + (int)(rng() % 5) - 2));
+    int car = (rng() % 2) ? 150 + (int)(rng() % 100) : 450 + (int)(rng() % 150);
+    int length = 30 + (int)(rng() % 120);
+    for (int i = 0; i < length; i++)
+    {
+      int d = car + (int)(rng() % 21) - 10;
+      if (rng() % 50 == 0) d = 0;
+      trace.push_back((int16_t)d);
+    }
+  }
+  trace.insert(trace.end(), 500, 999);
+  return trace;
+}
+
+//****************************************************************************************
+template <typename K>
+static void testSmoothing()
+{
+  const float factors[] = {0.0f, 0.3f, 0.6f, 0.9f, 0.99f};
+  std::mt19937 rng(3);
+  float worst = 0;
+  for (float a : factors)
+  {
+    float f = 0;
+    typename K::Value s = K::fromInt(0);
+    typename K::Coeff c = K::coeff(a);
+    for (int i = 0; i < 20000; i++)
+    {
+      int x = ((i / 500) % 2) ? 999 : 150 + (int)(rng() % 21);
+      f = FloatKernels::smooth(f, x, a);
+      s = K::smooth(s, x, c);
+      worst = fmaxf(worst, fabsf(K::toFloat(s) - f));
+    }
+  }
+  // Each step rounds to the format's resolution; the filter's gain keeps that bounded.
+  fprintf(stderr, "%s smoothing: worst |error| %.4f cm\n", K::name(), worst);
+  CHECK(worst < 20.0f / (1 << K::fraction) + 1e-3f);
+
+  // Decay from 100 towards the 10 cutoff: the same number of steps, give or take one (the
+  // float version ends at 9.94, one Q15 step under the cutoff).
+  float f = 100;
+  typename K::Value s = K::fromInt(100);
+  typename K::Coeff k = K::coeff(0.05);
+  int stepsFloat = 0, stepsFixed = 0;
+  while (f > 10) { f = FloatKernels::decay(f, 0.05); stepsFloat++; }
+  while (s > K::fromInt(10)) { s = K::decay(s, k); stepsFixed++; }
+  fprintf(stderr, "%s decay: %d steps to the cutoff, %d in float\n", K::name(), stepsFixed, stepsFloat);
+  CHECK(abs(stepsFixed - stepsFloat) <= 1);
+}
+
+template <typename K>
+static void testMeanVariance()
+{
+  std::vector<int16_t> trace = makeTrace(5000, 4);
+  float worstMean = 0, worstVariance = 0;
+  for (size_t t = 0; t + 100 < trace.size(); t += 37)
+  {
+    float fm, fv;
+    typename K::Value m;
+    typename K::Wide v;
+    FloatKernels::meanVariance(&trace[t], 100, fm, fv);
+    K::meanVariance(&trace[t], 100, m, v);
+    worstMean = fmaxf(worstMean, fabsf(K::toFloat(m) - fm));
+    // Within one step of the format, or float's own rounding on the big ones.
+    float error = fabsf((float)v / (1 << K::fraction) - fv);
+    worstVariance = fmaxf(worstVariance, (error - 1e-5f * fv) * (1 << K::fraction));
+  }
+  fprintf(stderr, "%s mean/variance: worst |error| %.4f cm, variance %.2f steps\n", K::name(), worstMean,
+          worstVariance);
+  CHECK(worstMean <= 1.0f / (1 << K::fraction));
+  CHECK(worstVariance <= 1.0f);
+}
+
+template <typename K>
+static void testCorrelation()
+{
+  float smoothed[modelSamples];
+  float s = fallingEdgeModel[0];
+  for (int i = 0; i < modelSamples; i++) smoothed[i] = s = 0.9f * s + 0.1f * fallingEdgeModel[i];
+  const float *models[] = {fallingEdgeModel, risingEdgeModel, notchModel, smoothed};
+
+  std::vector<int16_t> trace = makeTrace(20000, 5);
+  float worst = 0;
+  long compared = 0;
+  for (const float *model : models)
+  {
+    typename K::Model fixedModel[modelSamples];
+    K::makeModel(model, modelSamples, fixedModel);
+    for (size_t t = 0; t + modelSamples < trace.size(); t += 13)
+    {
+      const int16_t *y = &trace[t];
+      bool flat = true;
+      for (int i = 1; i < modelSamples; i++) flat &= (y[i] == y[0]);
+      if (flat) continue;
+      float r = FloatKernels::correlation(model, y, modelSamples);
+      worst = fmaxf(worst, fabsf(K::ratioToFloat(K::correlation(fixedModel, y, modelSamples)) - r));
+      compared++;
+    }
+  }
+  fprintf(stderr, "%s correlation: worst |error| %.2e over %ld windows\n", K::name(), worst, compared);
+  CHECK(compared > 0);
+  CHECK(worst < 1e-3f);
+
+  std::vector<float> ones(modelSamples, 1.0f);
+  typename K::Model flatModel[modelSamples];
+  K::makeModel(ones.data(), modelSamples, flatModel);
+  CHECK_EQ(K::ratioToFloat(K::correlation(flatModel, &trace[0], modelSamples)), 0.0f);
+}
+
+//****************************************************************************************
+// Run a trace through a detector, 100 Hz on the virtual clock.
+template <typename K, int (*detect)(const RuntimeConfig &, const LIDARSample &)>
+static std::vector<Event> run(const std::vector<int16_t> &trace)
+{
+  std::vector<Event> events;
+  LIDARSample sample;
+  sample.temp = 30;
+  sample.flux = 1000;
+  sample.status = TFMP_READY;
+  for (size_t t = 0; t < trace.size(); t++)
+  {
+    sample.dist = trace[t];
+    sample.timeUS = micros();
+    int event = detect(getRuntimeConfig(), sample);
+    if (event > 0) events.push_back({(long)t, event});
+    delay(10);
+  }
+  return events;
+}
+
+// Same vehicles, same lanes, and no more than slack readings apart.
+static void compareEvents(const char *name, const std::vector<Event> &a, const std::vector<Event> &b,
+                          long slack)
+{
+  CHECK_EQ(a.size(), b.size());
+  long worst = 0;
+  bool sameLanes = true;
+  for (size_t i = 0; i < a.size() && i < b.size(); i++)
+  {
+    sameLanes &= (a[i].lane == b[i].lane);
+    worst = std::max(worst, labs(a[i].at - b[i].at));
+  }
+  fprintf(stderr, "%-12s %zu events, %zu float; worst offset %ld readings\n", name, b.size(), a.size(), worst);
+  CHECK(sameLanes);
+  CHECK(worst <= slack);
+}
+
+static void testDetectors()
+{
+  std::vector<int16_t> trace = makeTrace(200000, 6);
+
+  // The float kernels decay by the same double the v3 detector always had in its source.
+  CHECK(FloatKernels::coeff(getRuntimeConfig().lidarDecay) == 0.05);
+
+  std::vector<Event> v1 = run<FloatKernels, processLIDARSample<FloatKernels>>(trace);
+  CHECK(v1.size() > 100);
+  compareEvents("v1 Q15", v1, run<Q15Kernels, processLIDARSample<Q15Kernels>>(trace), 1);
+  compareEvents("v1 Q31", v1, run<Q31Kernels, processLIDARSample<Q31Kernels>>(trace), 1);
+
+  std::vector<Event> v3 = run<FloatKernels, processLIDARSample3<FloatKernels>>(trace);
+  CHECK(v3.size() > 100);
+  compareEvents("v3 Q15", v3, run<Q15Kernels, processLIDARSample3<Q15Kernels>>(trace), 1); // See testSmoothing
+  compareEvents("v3 Q31", v3, run<Q31Kernels, processLIDARSample3<Q31Kernels>>(trace), 0);
+}
+
+int main()
+{
+  char dir[] = "/tmp/digame_fixedXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  SD.hostSetRoot(dir);
+  config.lidarZone1Min = "0";
+  config.lidarZone1Max = "300";
+  config.lidarZone2Min = "400";
+  config.lidarZone2Max = "700";
+  publishRuntimeConfig(config);
+
+  testSmoothing<Q15Kernels>();
+  testSmoothing<Q31Kernels>();
+  testMeanVariance<Q15Kernels>();
+  testMeanVariance<Q31Kernels>();
+  testCorrelation<Q15Kernels>();
+  testCorrelation<Q31Kernels>();
+  testDetectors();
+  return TEST_REPORT();
+}
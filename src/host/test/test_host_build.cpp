@@ -0,0 +1,217 @@
+/* test_host_build.cpp
+ *
+ *  Smoke test for the host build: the Digame headers compile against the
+ *  shim and behave sensibly end to end (config load from the "SD card",
+ *  config updates from two tasks while a third reads, LIDAR frames through
+ *  processLIDARSignal2, correlation, a LoRa exchange with a fake Reyax
+ *  module and a FreeRTOS task hand-off).
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameJSONConfig.h>
+#include <digameLIDAR.h>
+#include <digameLoRa.h>
+#include <digameMath.h>
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+
+#include "hostTest.h"
+
+static void injectDistance(int16_t dist)
+{
+  uint8_t frame[TFMP_FRAME_SIZE];
+  TFMPlus::hostEncodeFrame(frame, dist, 2000, 40);
+  tfMiniUART.hostInject(frame, sizeof(frame));
+}
+
+//****************************************************************************************
+static void testConfig()
+{
+  char dir[] = "/tmp/digame_sdXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  SD.hostSetRoot(dir);
+
+  // First boot: no params.txt, so the defaults are written out and read back.
+  CHECK(initJSONConfig(filename, config));
+  CHECK(SD.exists(filename));
+  CHECK(config.lidarZone1Max == "300");
+
+  // Edit the file the way the web UI would and reload.
+  config.lidarZone1Max = "250";
+  config.deviceName = "Test Counter";
+  saveConfiguration(filename, config);
+  Config reloaded;
+  loadConfiguration(filename, reloaded);
+  CHECK(reloaded.lidarZone1Max == "250");
+  CHECK(reloaded.deviceName == "Test Counter");
+  CHECK(reloaded.lidarZone2Max == "700");
+
+  // The detection loop sees changes once they are published.
+  RuntimeConfig before = getRuntimeConfig();
+  CHECK_EQ(before.lidarZone1Max, 300);
+  config.showDataStream = "true";
+  config.logVehicleEvents = "checked";
+  publishRuntimeConfig(config);
+  RuntimeConfig after = getRuntimeConfig();
+  CHECK_EQ(after.lidarZone1Max, 250);
+  CHECK(after.showDataStream);
+  CHECK(after.logVehicleEvents);
+  CHECK(!after.logRawData);
+  CHECK_EQ(before.lidarZone1Max, 300); // The copy in use is left alone.
+
+  config = Config();
+  publishRuntimeConfig(config);
+}
+
+//****************************************************************************************
+// Two tasks publishing (the web server and the counting loop) while another reads: every
+// copy is all one update or all the other.
+static void testConfigUpdates()
+{
+  std::atomic<bool> done{false};
+  auto publish = [&](const char *min, const char *max) {
+    Config c;
+    c.lidarZone1Min = min;
+    c.lidarZone1Max = max;
+    for (int i = 0; i < 5000; i++) publishRuntimeConfig(c);
+  };
+  publish("10", "110");
+  std::thread a(publish, "10", "110"), b(publish, "20", "220");
+
+  long copies = 0, torn = 0;
+  std::thread reader([&] {
+    while (!done)
+    {
+      RuntimeConfig rc = getRuntimeConfig();
+      if (rc.lidarZone1Max != 11 * rc.lidarZone1Min) torn++;
+      copies++;
+    }
+  });
+  a.join();
+  b.join();
+  done = true;
+  reader.join();
+  CHECK(copies > 0);
+  CHECK_EQ(torn, 0);
+  CHECK_EQ(runtimeConfigSequence.load() & 1, 0u);
+
+  publishRuntimeConfig(Config());
+}
+
+//****************************************************************************************
+static void testLIDAR()
+{
+  CHECK(initLIDAR(true));
+  CHECK_EQ(tfmP.hostFrameRate(), FRAME_0);
+
+  int lane1Events = 0;
+  int lane2Events = 0;
+  auto run = [&](int16_t dist, int n) {
+    for (int i = 0; i < n; i++)
+    {
+      injectDistance(dist);
+      int event = processLIDARSignal2(getRuntimeConfig());
+      if (event == 1) lane1Events++;
+      if (event == 2) lane2Events++;
+    }
+  };
+
+  run(0, 30);   // Nothing in view (reported as zero => 999)
+  run(200, 40); // A car in lane 1
+  run(0, 40);
+  CHECK_EQ(lane1Events, 1);
+  CHECK_EQ(lane2Events, 0);
+
+  run(550, 40); // A car in lane 2
+  run(0, 40);
+  CHECK_EQ(lane1Events, 1);
+  CHECK_EQ(lane2Events, 1);
+
+  CHECK_EQ(lastDistanceMeasured, 999);
+  CHECK(lidarDistanceHistogram[20] == 40);
+
+  // A corrupted frame is rejected by the checksum.
+  uint8_t frame[TFMP_FRAME_SIZE];
+  TFMPlus::hostEncodeFrame(frame, 200, 2000, 40);
+  frame[3] ^= 0x10;
+  unsigned long checksumErrors = lidarParser.stats.checksumErrors;
+  tfMiniUART.hostInject(frame, sizeof(frame));
+  LIDARSample sample = readLIDARSample();
+  CHECK_EQ(sample.status, TFMP_CHECKSUM);
+  CHECK_EQ(lidarParser.stats.checksumErrors, checksumErrors + 1);
+}
+
+//****************************************************************************************
+static void testMath()
+{
+  float ramp[50], x[50], y[50], z[50];
+  for (int i = 0; i < 50; i++)
+  {
+    ramp[i] = i + 1;
+    x[i] = sinf(i * 0.3f);
+    y[i] = 3 * x[i] + 7;
+    z[i] = -x[i];
+  }
+  CHECK(fabsf(mean(ramp, 50) - 25.5f) < 1e-5f);
+  CHECK(fabsf(correlation(x, y, 50) - 1.0f) < 1e-5f);
+  CHECK(fabsf(correlation(x, z, 50) + 1.0f) < 1e-5f);
+}
+
+//****************************************************************************************
+static void testLoRa()
+{
+  // A fake Reyax module: "+OK" to every command, an ACK from the base station
+  // for every send.
+  LoRaUART.hostSetResponder([](HardwareSerial &port, const String &line) {
+    port.hostInject("+OK\r\n");
+    if (line.startsWith("AT+SEND=1,"))
+    {
+      port.hostInject("+RCV=1,3,ACK,-40,11\r\n");
+    }
+  });
+
+  initLoRa();
+  CHECK(configureLoRa(config));
+  CHECK(sendReceiveLoRa("{\"et\":\"hb\",\"c\":\"12\"}"));
+  CHECK(LoRaUART.hostTxLog().indexOf("AT+PARAMETER=10,7,1,7") >= 0);
+  CHECK(LoRaUART.hostTxLog().indexOf("\"r\":\"0\"") >= 0);
+  LoRaUART.hostSetResponder(nullptr);
+}
+
+//****************************************************************************************
+static SemaphoreHandle_t ready;
+static volatile int taskCore = -1;
+
+static void worker(void *)
+{
+  xSemaphoreTake(ready, portMAX_DELAY);
+  taskCore = xPortGetCoreID();
+  vTaskDelete(NULL);
+}
+
+static void testFreeRTOS()
+{
+  ready = xSemaphoreCreateBinary();
+  TaskHandle_t task;
+  xTaskCreatePinnedToCore(worker, "worker", 10000, NULL, 0, &task, 0);
+  CHECK_EQ(xSemaphoreTake(ready, 10), pdFALSE);
+  xSemaphoreGive(ready);
+  hostJoinTask(task);
+  CHECK_EQ(taskCore, 0);
+  CHECK_EQ(xPortGetCoreID(), 1);
+}
+
+int main()
+{
+  testConfig();
+  testConfigUpdates();
+  testLIDAR();
+  testMath();
+  testLoRa();
+  testFreeRTOS();
+  return TEST_REPORT();
+}
@@ -0,0 +1,200 @@
+/* test_http_session.cpp
+ *
+ *  The kept-open connection to the server, against a stand-in server on
+ *  localhost that takes 10 ms to answer and 30 ms more on a new connection
+ *  (the handshake over the air: loopback connects take no time, so it shows
+ *  in the first reply). 50 messages with a connection each, as
+ *  postJSON() used to send them, then 50 through postJSON() on the
+ *  session: the latency per message, the connections and DNS lookups. Then
+ *  the ways a kept-open connection goes away -- the server timing it out,
+ *  closing it mid-request, saying Connection: close, moving -- and the
+ *  latency histograms and their JSON for the heartbeat.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <ArduinoJson.h>
+#include <digameNetwork.h>
+
+#include <chrono>
+#include <string>
+
+#include "hostHTTPServer.h"
+#include "hostTest.h"
+
+static HostHTTPResponse ok(const HostHTTPRequest &)
+{
+  HostHTTPResponse r;
+  r.body = "OK";
+  return r;
+}
+
+static String message(int i)
+{
+  return "{\"deviceName\":\"Digame Systems\",\"eventType\":\"v\",\"count\":" + String(i) + "}";
+}
+
+// The server's URL by name, so there's something to look up.
+static String serverURL(const HostHTTPServer &server)
+{
+  std::string url = server.url("/import");
+  url.replace(url.find("127.0.0.1"), 9, "localhost");
+  return url.c_str();
+}
+
+static double msSince(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+//****************************************************************************************
+static void testLatency()
+{
+  const int messages = 50;
+  HostHTTPServer server(ok);
+  server.latencyMS = 10;
+  server.connectLatencyMS = 30;
+  config.serverURL = serverURL(server);
+
+  // A connection a message.
+  HTTPClient once;
+  once.setReuse(false);
+  unsigned long lookups = WiFi.hostLookups();
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < messages; i++)
+  {
+    once.begin(config.serverURL);
+    once.addHeader("Content-Type", "application/json");
+    CHECK_EQ(once.POST(message(i)), 200);
+    once.end();
+  }
+  double onceMS = msSince(t0) / messages;
+  unsigned long onceConnections = server.connections;
+  unsigned long onceLookups = WiFi.hostLookups() - lookups;
+
+  // The session.
+  lookups = WiFi.hostLookups();
+  t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < messages; i++) CHECK(postJSON(message(i), config));
+  double sessionMS = msSince(t0) / messages;
+  unsigned long sessionConnections = server.connections - onceConnections;
+
+  fprintf(stderr, "%d messages, %d ms a request, %d ms more a connection:\n", messages,
+          server.latencyMS.load(), server.connectLatencyMS.load());
+  fprintf(stderr, "  A connection a message: %5.1f ms a message, %3lu connections, %3lu lookups\n",
+          onceMS, onceConnections, onceLookups);
+  fprintf(stderr, "  Kept open:              %5.1f ms a message, %3lu connections, %3lu lookups\n",
+          sessionMS, sessionConnections, WiFi.hostLookups() - lookups);
+  fprintf(stderr, "  %s\n", getHTTPSessionJSON(httpSession).c_str());
+
+  CHECK_EQ(onceConnections, (unsigned long)messages);
+  CHECK_EQ(sessionConnections, 1ul);
+  CHECK_EQ(httpSession.lookups, 1ul);
+  CHECK_EQ(WiFi.hostLookups() - lookups, 1ul);
+  CHECK(sessionMS * 2 < onceMS);
+
+  // The histograms: one connection, every POST ~10 ms to the first byte but the first.
+  CHECK_EQ(httpSession.posts, (unsigned long)messages);
+  CHECK_EQ(httpSession.connectMS.n, 1ul);
+  CHECK_EQ(httpSession.ttfbMS.n, (unsigned long)messages);
+  CHECK_EQ(httpSession.totalMS.n, (unsigned long)messages);
+  CHECK(httpSession.ttfbMS.percentile(0.5f) >= 10 && httpSession.ttfbMS.percentile(0.5f) <= 16);
+  CHECK(httpSession.ttfbMS.maxMS >= 40);
+  CHECK(httpSession.totalMS.percentile(0.9f) <= 32);
+
+  StaticJsonDocument<1024> doc;
+  CHECK(!deserializeJson(doc, getHTTPSessionJSON(httpSession)));
+  CHECK_EQ(doc["posts"].as<int>(), messages);
+  CHECK_EQ(doc["connects"].as<int>(), 1);
+  CHECK_EQ(doc["ttfbMS"]["n"].as<int>(), messages);
+  CHECK(doc["totalMS"]["p90"].as<int>() > 0);
+}
+
+//****************************************************************************************
+static void testReconnects()
+{
+  int served = 0;
+  bool closeEach = false;
+  HostHTTPServer server([&](const HostHTTPRequest &r) {
+    HostHTTPResponse response = ok(r);
+    served++;
+    response.drop = (served == 3);
+    response.close = closeEach;
+    return response;
+  });
+  HTTPSession session;
+  CHECK(!session.begin("https://localhost/import")); // Not for https
+  CHECK(session.begin(serverURL(server)));
+  CHECK(!session.connected()); // Nothing until there's something to send
+
+  // The third request is on a connection the server closes without answering: it goes
+  // again on a new one.
+  for (int i = 0; i < 4; i++) CHECK_EQ(session.post(message(i)), 200);
+  CHECK(session.reply() == "OK");
+  CHECK_EQ(session.retries, 1ul);
+  CHECK_EQ(session.connects, 2ul);
+  CHECK_EQ(session.failures, 0ul);
+  CHECK_EQ(server.requests.load(), 5ul);
+
+  // The server times out idle connections.
+  server.dropConnections();
+  CHECK_EQ(session.post(message(5)), 200);
+  CHECK_EQ(session.connects, 3ul);
+  CHECK_EQ(session.retries, 1ul);
+
+  // A server that closes after every reply: a connection each, still one lookup.
+  closeEach = true;
+  for (int i = 0; i < 3; i++) CHECK_EQ(session.post(message(i)), 200);
+  CHECK_EQ(session.connects, 5ul);
+  CHECK_EQ(session.lookups, 1ul);
+  closeEach = false;
+
+  // The headers go through.
+  std::string batch;
+  HostHTTPServer headers([&](const HostHTTPRequest &r) {
+    batch = r.header("X-Digame-Batch");
+    return ok(r);
+  });
+  CHECK(session.begin(serverURL(headers))); // Another port: a new address and connection
+  CHECK_EQ(session.post("[]", "X-Digame-Batch", "0"), 200);
+  CHECK(batch == "0");
+  CHECK_EQ(session.lookups, 2ul);
+  CHECK_EQ(server.connections.load(), 5ul);
+
+  // No network: it fails and says so.
+  session.close();
+  WiFi.hostSetLinkUp(false);
+  CHECK(session.post(message(9)) < 0);
+  CHECK_EQ(session.failures, 1ul);
+  WiFi.hostSetLinkUp(true);
+  CHECK_EQ(session.post(message(9)), 200);
+}
+
+//****************************************************************************************
+static void testHistogram()
+{
+  LatencyHistogram h;
+  CHECK_EQ(h.percentile(0.5f), 0ul);
+  for (int i = 0; i < 90; i++) h.add(5);     // Under 8
+  for (int i = 0; i < 10; i++) h.add(300);   // Under 512
+  h.add(10000);                              // Off the end
+  CHECK_EQ(h.n, 101ul);
+  CHECK_EQ(h.counts[3], 90ul);
+  CHECK_EQ(h.counts[9], 10ul);
+  CHECK_EQ(h.counts[latencyBuckets - 1], 1ul);
+  CHECK_EQ(h.percentile(0.5f), 8ul);
+  CHECK_EQ(h.percentile(0.95f), 512ul);
+  CHECK_EQ(h.percentile(1.0f), 10000ul);
+  CHECK_EQ(h.maxMS, 10000ul);
+  CHECK(h.mean() > 133 && h.mean() < 134);
+}
+
+int main()
+{
+  WiFi.mode(WIFI_STA);
+  WiFi.begin("ssid", "password");
+  testLatency();
+  testReconnects();
+  testHistogram();
+  return TEST_REPORT();
+}
@@ -0,0 +1,271 @@
+/* test_journal.cpp
+ *
+ *  The outgoing event journal. Events appended and committed come back in
+ *  order after a reboot, raw signals and all; a burst of them is one write
+ *  to the card, and so is a run of ACKs. Then the torture test: hundreds of
+ *  lives, each cut short by a power cut at a random byte -- mid-record,
+ *  mid-checkpoint, between the server's ACK and the checkpoint. Every event
+ *  whose commit() returned true is sent, the content intact, in order;
+ *  nothing is sent that wasn't appended; an event is sent twice only if it
+ *  was acked after the last commit before a cut. And once everything's sent
+ *  the segments are gone.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <SD.h>
+#include <digameJournal.h>
+
+#include <filesystem>
+#include <random>
+#include <set>
+#include <stdlib.h>
+#include <vector>
+
+#include "hostTest.h"
+
+static CounterEvent makeEvent(uint32_t id)
+{
+  CounterEvent e = {};
+  e.epoch = 1650000000 + id;
+  e.count = id;
+  e.tempC10 = (int16_t)(id % 400);
+  e.type = (id % 50 == 0) ? EVENT_HEARTBEAT : EVENT_VEHICLE;
+  e.lane = 1 + (id % 2);
+  e.rawSlot = noRawSignal;
+  return e;
+}
+
+// Every third one has a raw signal, of a length and content that depend on the id.
+static const RawSignal *makeRaw(uint32_t id)
+{
+  static RawSignal raw;
+  if (id % 3 != 0) return nullptr;
+  raw.length = 1 + id % eventRawSignalLength;
+  for (int i = 0; i < raw.length; i++) raw.samples[i] = (int16_t)(id * 13 + i);
+  return &raw;
+}
+
+static bool intact(const CounterEvent &e, const RawSignal *raw)
+{
+  CounterEvent want = makeEvent(e.count);
+  const RawSignal *wantRaw = makeRaw(e.count);
+  if ((e.epoch != want.epoch) || (e.tempC10 != want.tempC10) || (e.type != want.type) || (e.lane != want.lane))
+  {
+    return false;
+  }
+  if ((raw == nullptr) != (wantRaw == nullptr)) return false;
+  if (!raw) return true;
+  if (raw->length != wantRaw->length) return false;
+  return memcmp(raw->samples, wantRaw->samples, 2 * raw->length) == 0;
+}
+
+static int countSegments(const std::string &dir)
+{
+  int n = 0;
+  for (auto &entry : std::filesystem::directory_iterator(dir))
+  {
+    if (entry.path().extension() == ".seg") n++;
+  }
+  return n;
+}
+
+static std::string makeCard()
+{
+  char dir[] = "/tmp/digame_journalXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  SD.hostSetRoot(dir);
+  return dir;
+}
+
+//****************************************************************************************
+static void testReplay()
+{
+  std::string card = makeCard();
+  static EventJournal journal(SD);
+  CHECK(journal.begin());
+  CounterEvent e;
+  const RawSignal *raw = nullptr;
+  CHECK(!journal.peek(e, raw));
+
+  // A burst of 60 vehicles: one write (the batch is big enough for all of them).
+  unsigned long before = hostWriteCount();
+  for (uint32_t id = 1; id <= 60; id++) CHECK(journal.append(makeEvent(id), makeRaw(id)));
+  CHECK(!journal.peek(e, raw)); // Not on the card yet
+  CHECK(!journal.commitDue(millis()));
+  delay(journal.commitIntervalMS);
+  CHECK(journal.commitDue(millis()));
+  CHECK(journal.commit());
+  CHECK_EQ(hostWriteCount() - before, 1ul);
+  CHECK_EQ(journal.pending, 60ul);
+
+  // Send ten: the checkpoint waits for the commit. Then reboot.
+  before = hostWriteCount();
+  for (int i = 0; i < 10; i++)
+  {
+    CHECK(journal.peek(e, raw));
+    CHECK(journal.ack());
+  }
+  CHECK_EQ(hostWriteCount() - before, 0ul);
+  CHECK(!journal.commitDue(millis()));
+  delay(journal.commitIntervalMS);
+  CHECK(journal.commitDue(millis()));
+  for (uint32_t id = 200; id < 300; id++) CHECK(journal.append(makeEvent(id), makeRaw(id)));
+  CHECK(journal.commit());
+  CHECK(!journal.commitDue(millis()));
+
+  static EventJournal rebooted(SD);
+  CHECK(rebooted.begin());
+  CHECK_EQ(rebooted.replayed, 150ul);
+  std::vector<uint32_t> sent;
+  bool good = true;
+  while (rebooted.peek(e, raw))
+  {
+    good &= intact(e, raw);
+    sent.push_back(e.count);
+    CHECK(rebooted.ack());
+  }
+  CHECK(good);
+  CHECK_EQ(sent.size(), 150u);
+  CHECK(sent.size() == 150 && sent[0] == 11 && sent[49] == 60 && sent[50] == 200 && sent[149] == 299);
+  CHECK_EQ(rebooted.pending, 0ul);
+  CHECK_EQ(rebooted.corrupt, 0ul);
+  CHECK(rebooted.commit());
+
+  // Everything's sent: nothing to replay, and the old segments are gone.
+  static EventJournal again(SD);
+  CHECK(again.begin());
+  CHECK_EQ(again.replayed, 0ul);
+  CHECK(!again.peek(e, raw));
+  CHECK_EQ(countSegments(card + "/journal"), 0);
+  std::filesystem::remove_all(card);
+}
+
+//****************************************************************************************
+// Lives of random bursts, sends and reboots, each ended by a power cut.
+static void testPowerCuts()
+{
+  std::string card = makeCard();
+  std::mt19937 rng(21);
+  std::set<uint32_t> appended, committed, sent;
+  std::vector<uint32_t> order; // First sends
+  unsigned long duplicates = 0, damaged = 0, outOfOrder = 0, cuts = 0, corrupt = 0, tornCommits = 0;
+  unsigned long mayRepeat = 0; // Acked but, when the power went, maybe not checkpointed
+  uint32_t nextId = 1;
+  const int lives = 400;
+
+  for (int life = 0; life <= lives; life++)
+  {
+    bool last = (life == lives); // The last one has the power on to the end
+    static EventJournal *journal = nullptr;
+    static uint8_t storage[sizeof(EventJournal)] __attribute__((aligned(8)));
+    journal = new (storage) EventJournal(SD); // In place: it's big, and this is a reboot
+    CHECK(journal->begin());
+    if (!last) hostCutPowerAfter(rng() % 6000);
+
+    std::vector<uint32_t> batch;
+    unsigned long unsaved = 0; // Acks since the last commit that went through
+    for (int step = 0; (step < 200) && (hostPowerOn() || last); step++)
+    {
+      int what = rng() % 4;
+      if (what == 0) // A burst
+      {
+        int n = 1 + rng() % 12;
+        for (int i = 0; i < n; i++)
+        {
+          uint32_t id = nextId++;
+          if (journal->append(makeEvent(id), makeRaw(id)))
+          {
+            appended.insert(id);
+            batch.push_back(id);
+          }
+        }
+      }
+      else if (what == 1)
+      {
+        if (journal->commit())
+        {
+          committed.insert(batch.begin(), batch.end());
+          batch.clear();
+          unsaved = 0;
+        }
+        else
+        {
+          tornCommits++;
+        }
+      }
+      else // Send one or two
+      {
+        for (int i = 0; i < 1 + what - 2; i++)
+        {
+          CounterEvent e;
+          const RawSignal *raw = nullptr;
+          if (!journal->peek(e, raw)) break;
+          if (!appended.count(e.count) || !intact(e, raw)) damaged++;
+          if (sent.count(e.count))
+          {
+            duplicates++;
+          }
+          else
+          {
+            if (!order.empty() && (e.count < order.back())) outOfOrder++;
+            order.push_back(e.count);
+            sent.insert(e.count);
+          }
+          journal->ack();
+          unsaved++;
+        }
+      }
+    }
+    if (last)
+    {
+      journal->commit();
+      committed.insert(batch.begin(), batch.end());
+      CounterEvent e;
+      const RawSignal *raw = nullptr;
+      while (journal->peek(e, raw))
+      {
+        if (!appended.count(e.count) || !intact(e, raw)) damaged++;
+        if (sent.count(e.count)) duplicates++;
+        else
+        {
+          if (!order.empty() && (e.count < order.back())) outOfOrder++;
+          order.push_back(e.count);
+          sent.insert(e.count);
+        }
+        journal->ack();
+      }
+      CHECK(journal->commit());
+    }
+    else
+    {
+      cuts += !hostPowerOn();
+      mayRepeat += unsaved;
+    }
+    hostRestorePower();
+    corrupt += journal->corrupt;
+    journal->~EventJournal();
+  }
+
+  unsigned long missing = 0;
+  for (uint32_t id : committed) missing += !sent.count(id);
+  fprintf(stderr, "Power cuts: %lu cuts, %zu appended, %zu committed, %zu sent, %lu sent twice, "
+          "%lu torn segments, %lu commits failed\n",
+          cuts, appended.size(), committed.size(), sent.size(), duplicates, corrupt, tornCommits);
+  CHECK(cuts > lives / 2);
+  CHECK(corrupt > 0); // It did tear records
+  CHECK_EQ(missing, 0ul);
+  CHECK_EQ(damaged, 0ul);
+  CHECK_EQ(outOfOrder, 0ul);
+  CHECK(duplicates <= mayRepeat);
+  CHECK(committed.size() > 1000);
+  CHECK(countSegments(card + "/journal") <= 1);
+  std::filesystem::remove_all(card);
+}
+
+int main()
+{
+  testReplay();
+  testPowerCuts();
+  return TEST_REPORT();
+}
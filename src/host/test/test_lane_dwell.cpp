@@ -0,0 +1,152 @@
+/* test_lane_dwell.cpp
+ *
+ *  Dwell-time histograms: vehicles with known times in view, in both lanes,
+ *  run through the v3 detector at 100 Hz. Each one counted must land in the
+ *  right lane and the right tenth-of-a-second bin; the median and 90th
+ *  percentile must match. The last-hour histogram must forget old traffic
+ *  while the cumulative one keeps it, and a reset clears both.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameLIDAR.h>
+
+#include <random>
+#include <vector>
+
+#include "hostTest.h"
+
+static int events[3];
+
+//****************************************************************************************
+// One 100 Hz reading through the detector, on the (virtual) clock.
+static void feed(int16_t d)
+{
+  LIDARSample sample;
+  sample.dist = d;
+  sample.flux = 1000;
+  sample.temp = 30;
+  sample.status = TFMP_READY;
+  sample.timeUS = micros();
+  int event = processLIDARSample3(getRuntimeConfig(), sample);
+  if (event > 0) events[event]++;
+  delay(10);
+}
+
+// A vehicle in view for samples readings, then 3 s of empty road.
+static void pass(int16_t d, int samples)
+{
+  for (int i = 0; i < samples; i++) feed(d + (int16_t)random(-2, 3));
+  for (int i = 0; i < 300; i++) feed(999);
+}
+
+static unsigned long total(int lane, bool recent)
+{
+  unsigned long counts[histogramSize];
+  return getDwellHistogram(lane, recent, counts);
+}
+
+//****************************************************************************************
+static void testBins()
+{
+  clearLIDARDwellHistograms();
+  events[1] = events[2] = 0;
+
+  // Lane 1: 0.5 to 1.4 s in view, lane 2 (slower traffic): 2.0 to 2.9 s.
+  std::vector<int> expect1(histogramSize, 0), expect2(histogramSize, 0);
+  for (int i = 0; i < 10; i++)
+  {
+    pass(200, 51 + i * 10); // First to last reading: 0.5 s, 0.6 s...
+    expect1[5 + i]++;
+    pass(550, 201 + i * 10);
+    expect2[20 + i]++;
+  }
+  pass(550, 2000); // 20 s: off the end of the chart
+  expect2[histogramSize - 1]++;
+
+  CHECK_EQ(events[1], 10);
+  CHECK_EQ(events[2], 11);
+
+  unsigned long counts[histogramSize], recent[histogramSize];
+  bool same1 = true, same2 = true;
+  getDwellHistogram(1, false, counts);
+  getDwellHistogram(1, true, recent);
+  for (int i = 0; i < histogramSize; i++) same1 &= (counts[i] == (unsigned long)expect1[i]) && (recent[i] == counts[i]);
+  CHECK(same1);
+  CHECK_EQ(getDwellPercentile(counts, 10, 50), 1.0f); // Five of ten at or under 0.9 s
+  CHECK_EQ(getDwellPercentile(counts, 10, 90), 1.4f);
+
+  unsigned long n = getDwellHistogram(2, false, counts);
+  for (int i = 0; i < histogramSize; i++) same2 &= (counts[i] == (unsigned long)expect2[i]);
+  CHECK(same2);
+  CHECK_EQ(n, 11UL);
+  CHECK_EQ(getDwellPercentile(counts, n, 100), 12.1f);
+
+  String page = getDwellHistogramString();
+  CHECK(page.indexOf("# Lane 1 (total): 10 vehicles, median 1.0 s, 90% 1.4 s") >= 0);
+  CHECK(page.indexOf("# Lane 2 (last hour): 11 vehicles") >= 0);
+  CHECK(page.indexOf("\n0.5, 1, 1, 0, 0\n") >= 0);
+}
+
+//****************************************************************************************
+// An hour of free-flowing traffic, then a queue forms. The last-hour histogram shows it;
+// the cumulative one is still dominated by the earlier traffic.
+static void testCongestion()
+{
+  clearLIDARDwellHistograms();
+  unsigned long counts[histogramSize];
+
+  for (int minute = 0; minute < 90; minute++)
+  {
+    for (int k = 0; k < 4; k++) pass(200, 40 + (int)random(0, 20)); // About half a second
+    delay(60000 - 4 * 3500);
+  }
+  unsigned long all = getDwellHistogram(1, false, counts);
+  CHECK_EQ(all, 360UL);
+  CHECK(getDwellPercentile(counts, all, 90) <= 0.6f);
+
+  for (int minute = 0; minute < 20; minute++)
+  {
+    pass(200, 500 + (int)random(0, 200)); // Creeping past: five to seven seconds
+    delay(60000 - 9000);
+  }
+
+  all = getDwellHistogram(1, false, counts);
+  float totalMedian = getDwellPercentile(counts, all, 50);
+  unsigned long hour = getDwellHistogram(1, true, counts);
+  float hourMedian = getDwellPercentile(counts, hour, 50);
+  fprintf(stderr, "Congestion: median %.1f s over %lu vehicles in the last hour, %.1f s over all %lu\n",
+          hourMedian, hour, totalMedian, all);
+  CHECK_EQ(all, 380UL);
+  CHECK(hour >= 20 + 30 * 4 && hour <= 20 + 40 * 4); // The window is 50 to 60 minutes long
+  CHECK(hourMedian <= 0.6f);
+  CHECK(getDwellPercentile(counts, hour, 90) >= 5.0f);
+  CHECK(totalMedian <= 0.6f);
+
+  // A quiet night: the last hour empties, the totals stay.
+  delay(3UL * 3600 * 1000);
+  CHECK_EQ(total(1, true), 0UL);
+  CHECK_EQ(total(1, false), 380UL);
+  pass(200, 100);
+  CHECK_EQ(total(1, true), 1UL);
+
+  clearLIDARDwellHistograms();
+  CHECK_EQ(total(1, false), 0UL);
+  CHECK_EQ(total(1, true), 0UL);
+}
+
+int main()
+{
+  char dir[] = "/tmp/digame_dwellXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  SD.hostSetRoot(dir);
+  config.lidarZone1Min = "0";
+  config.lidarZone1Max = "300";
+  config.lidarZone2Min = "400";
+  config.lidarZone2Max = "700";
+  publishRuntimeConfig(config);
+
+  testBins();
+  testCongestion();
+  return TEST_REPORT();
+}
@@ -0,0 +1,276 @@
+/* test_lane_finder.cpp
+ *
+ *  Lane discovery against simulated roadside traces: vehicles pass in each
+ *  lane at their own distances and rates in front of a wall (or open
+ *  space), with some stray readings mixed in. The proposed zone limits must
+ *  cover each lane and keep the lanes apart, and counting with them must
+ *  match counting with hand-set limits. Old data must fade so a lane that
+ *  moves is followed.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameLIDAR.h>
+
+#include <random>
+#include <vector>
+
+#include "hostTest.h"
+
+struct Lane
+{
+  int nearCM, farCM; // Where vehicles' sides are seen in this lane
+  int perHour;
+};
+
+struct Site
+{
+  int backgroundCM; // 0 = nothing in range
+  std::vector<Lane> lanes;
+};
+
+//****************************************************************************************
+// Readings at 50 Hz (the v2 sketch's loop rate), one vehicle at a time. Returns the lane
+// (1, 2...) of each vehicle in passes.
+static std::vector<int16_t> makeTrace(const Site &site, double hours, std::mt19937 &rng,
+                                      std::vector<int> &passes)
+{
+  const int rate = 50;
+  long n = (long)(hours * 3600 * rate);
+  std::vector<int16_t> trace;
+  trace.reserve(n);
+
+  int perHour = 0;
+  for (const Lane &lane : site.lanes) perHour += lane.perHour;
+  std::exponential_distribution<double> gap(perHour / 3600.0);
+
+  while ((long)trace.size() < n)
+  {
+    long quiet = (long)(gap(rng) * rate) + rate; // At least a second between vehicles
+    for (long i = 0; i < quiet; i++)
+    {
+      int16_t d = site.backgroundCM ? (int16_t)(site.backgroundCM + (int)(rng() % 7) - 3) : -1;
+      if (rng() % 1000 == 0) d = (int16_t)(rng() % 1000); // A bird, a leaf...
+      trace.push_back(d);
+    }
+
+    int pick = (int)(rng() % perHour), k = 0;
+    while (pick >= site.lanes[k].perHour) pick -= site.lanes[k++].perHour;
+    const Lane &lane = site.lanes[k];
+    int side = lane.nearCM + (int)(rng() % (lane.farCM - lane.nearCM + 1));
+    int length = rate / 3 + (int)(rng() % rate); // 0.3 - 1.3 s in view
+    for (int i = 0; i < length; i++) trace.push_back((int16_t)(side + (int)(rng() % 5) - 2));
+    passes.push_back(k + 1);
+  }
+  return trace;
+}
+
+//****************************************************************************************
+// Run a trace through the v2 detector. Returns events per lane.
+static std::vector<int> countTrace(const std::vector<int16_t> &trace)
+{
+  std::vector<int> events(3, 0);
+  RuntimeConfig rc = getRuntimeConfig();
+  LIDARSample sample;
+  sample.temp = 30;
+  sample.flux = 1000;
+  for (int16_t d : trace)
+  {
+    sample.dist = d;
+    sample.status = (d < 0) ? TFMP_WEAK : TFMP_READY;
+    int event = processLIDARSample3(rc, sample);
+    if ((event > 0) && (lidarBuffer.size() == lidarSamples)) events[event]++;
+  }
+  return events;
+}
+
+static void setZones(int z1Min, int z1Max, int z2Min, int z2Max)
+{
+  config.lidarZone1Min = String(z1Min);
+  config.lidarZone1Max = String(z1Max);
+  config.lidarZone2Min = String(z2Min);
+  config.lidarZone2Max = String(z2Max);
+  publishRuntimeConfig(config);
+}
+
+//****************************************************************************************
+// Feed a trace to the finder the way the sketch does: histogram from the detector, one
+// update a minute.
+static void learn(const std::vector<int16_t> &trace, LaneFinder &finder)
+{
+  const long perMinute = 50 * 60;
+  for (size_t i = 0; i < trace.size(); i += perMinute)
+  {
+    size_t end = std::min(trace.size(), i + perMinute);
+    countTrace(std::vector<int16_t>(trace.begin() + i, trace.begin() + end));
+    finder.update(lidarDistanceHistogram);
+  }
+}
+
+//****************************************************************************************
+static void testTwoLanes()
+{
+  std::mt19937 rng(11);
+  Site site = {900, {{170, 260, 90}, {470, 620, 60}}};
+  std::vector<int> passes;
+  std::vector<int16_t> trace = makeTrace(site, 3.0, rng, passes);
+
+  clearLIDARDistanceHistogram();
+  LaneFinder finder;
+  setZones(0, 300, 400, 700);
+  learn(trace, finder);
+
+  LaneProposal p = finder.propose();
+  CHECK(p.ready);
+  CHECK_EQ(p.lanes, 2);
+  CHECK_EQ(p.backgroundCM, 900);
+  if (p.lanes != 2) return;
+  CHECK(p.lane[0].minCM <= 170 && p.lane[0].maxCM > 260);
+  CHECK(p.lane[1].minCM <= 470 && p.lane[1].maxCM > 620);
+  CHECK(p.lane[0].maxCM <= p.lane[1].minCM);
+  CHECK(p.lane[1].maxCM < 880);
+  CHECK(p.lane[0].share > p.lane[1].share);
+  fprintf(stderr, "Two lanes: %d-%d, %d-%d (truth 170-260, 470-620)\n", p.lane[0].minCM,
+          p.lane[0].maxCM, p.lane[1].minCM, p.lane[1].maxCM);
+
+  // Count a fresh hour with hand-set limits and with the proposal.
+  passes.clear();
+  std::vector<int16_t> hour = makeTrace(site, 1.0, rng, passes);
+  int truth[3] = {0, 0, 0};
+  for (int lane : passes) truth[lane]++;
+
+  setZones(0, 300, 400, 700);
+  std::vector<int> byHand = countTrace(hour);
+  CHECK(applyLaneProposal(p, config));
+  publishRuntimeConfig(config);
+  std::vector<int> byProposal = countTrace(hour);
+
+  for (int lane = 1; lane <= 2; lane++)
+  {
+    CHECK(abs(byProposal[lane] - byHand[lane]) <= 1 + byHand[lane] / 50);
+    CHECK(abs(byProposal[lane] - truth[lane]) <= 2 + truth[lane] / 20);
+  }
+  fprintf(stderr, "  Lane 1: %d true, %d by hand, %d proposed. Lane 2: %d, %d, %d\n", truth[1],
+          byHand[1], byProposal[1], truth[2], byHand[2], byProposal[2]);
+
+  // Applying again changes nothing; a small wobble is ignored.
+  CHECK(!applyLaneProposal(p, config));
+  LaneProposal wobble = p;
+  wobble.lane[0].maxCM += 10;
+  CHECK(!applyLaneProposal(wobble, config));
+  CHECK(applyLaneProposal(wobble, config, 0));
+
+  // The /lanes page
+  DynamicJsonDocument doc(2048);
+  CHECK(!deserializeJson(doc, getLaneProposalJSON(p, config)));
+  CHECK(doc["ready"].as<bool>());
+  CHECK_EQ(doc["lanes"][1]["minCM"].as<int>(), p.lane[1].minCM);
+  CHECK_EQ(doc["current"][0]["maxCM"].as<int>(), p.lane[0].maxCM + 10);
+}
+
+//****************************************************************************************
+// Nothing in range across the road (readings of 999), one busy lane, one nearly empty.
+static void testOpenRoad()
+{
+  std::mt19937 rng(12);
+  Site site = {0, {{250, 340, 120}, {600, 700, 2}}};
+  std::vector<int> passes;
+  std::vector<int16_t> trace = makeTrace(site, 2.0, rng, passes);
+
+  clearLIDARDistanceHistogram();
+  LaneFinder finder;
+  learn(trace, finder);
+
+  LaneProposal p = finder.propose();
+  CHECK_EQ(p.backgroundCM, 990);
+  CHECK_EQ(p.lanes, 1); // Too little traffic in the far lane to call it
+  CHECK(p.ready);
+  CHECK(p.lane[0].minCM <= 250 && p.lane[0].maxCM > 340);
+
+  // Applying a one-lane proposal leaves lane 2 alone.
+  setZones(0, 300, 400, 700);
+  CHECK(applyLaneProposal(p, config));
+  CHECK(config.lidarZone2Min == "400");
+  CHECK(config.lidarZone2Max == "700");
+}
+
+//****************************************************************************************
+static void testQuietRoad()
+{
+  LaneFinder finder;
+  LaneProposal p = finder.propose();
+  CHECK(!p.ready);
+  CHECK_EQ(p.lanes, 0);
+
+  std::mt19937 rng(13);
+  Site site = {800, {{200, 300, 30}}};
+  std::vector<int> passes;
+  std::vector<int16_t> trace = makeTrace(site, 0.1, rng, passes); // A handful of cars
+
+  clearLIDARDistanceHistogram();
+  learn(trace, finder);
+  p = finder.propose();
+  CHECK_EQ(p.lanes, 1);
+  CHECK(!p.ready); // Seen, but not enough to trust.
+  CHECK(!applyLaneProposal(p, config));
+}
+
+//****************************************************************************************
+// A lane moves 80 cm (say, a snow bank). With a 6 hour half-life the finder follows it
+// within a day; without fading it would still be split between the two. (Updates here
+// are hourly rather than every minute.)
+static void testLaneMoves()
+{
+  std::mt19937 rng(14);
+  Site before = {900, {{200, 280, 60}, {500, 600, 60}}};
+  Site after = {900, {{280, 360, 60}, {500, 600, 60}}};
+
+  LaneFinder fading, forever;
+  fading.setHalfLife(6);
+  std::vector<int> passes;
+
+  clearLIDARDistanceHistogram();
+  for (int hour = 0; hour < 24; hour++)
+  {
+    std::vector<int16_t> trace = makeTrace(before, 1.0, rng, passes);
+    for (int16_t d : trace) lidarDistanceHistogram[(d < 0 ? 999 : d) / 10]++;
+    if (hour % 2) // Update every other hour; the counts just pile up in between.
+    {
+      fading.update(lidarDistanceHistogram);
+      forever.update(lidarDistanceHistogram);
+    }
+  }
+  LaneProposal p = fading.propose();
+  CHECK(p.lanes == 2 && p.lane[0].minCM <= 200 && p.lane[0].maxCM > 280);
+
+  for (int hour = 0; hour < 24; hour++)
+  {
+    std::vector<int16_t> trace = makeTrace(after, 1.0, rng, passes);
+    for (int16_t d : trace) lidarDistanceHistogram[(d < 0 ? 999 : d) / 10]++;
+    fading.update(lidarDistanceHistogram);
+    forever.update(lidarDistanceHistogram);
+  }
+  p = fading.propose();
+  fprintf(stderr, "Moved lane: %d-%d, %d-%d (truth 280-360, 500-600)\n", p.lane[0].minCM,
+          p.lane[0].maxCM, p.lane[1].minCM, p.lane[1].maxCM);
+  CHECK_EQ(p.lanes, 2);
+  CHECK(p.lane[0].minCM >= 250 && p.lane[0].minCM <= 280 && p.lane[0].maxCM > 360);
+  CHECK(p.lane[1].minCM <= 500 && p.lane[1].maxCM > 600);
+
+  LaneProposal stale = forever.propose();
+  CHECK(stale.lanes >= 1 && stale.lane[0].minCM <= 200);
+}
+
+int main()
+{
+  char dir[] = "/tmp/digame_lanesXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  SD.hostSetRoot(dir);
+  publishRuntimeConfig(config);
+
+  testTwoLanes();
+  testOpenRoad();
+  testQuietRoad();
+  testLaneMoves();
+  return TEST_REPORT();
+}
@@ -0,0 +1,217 @@
+/* test_lidar_health.cpp
+ *
+ *  Sensor health: frames fed through the UART and polled with
+ *  readLIDARSample() show up in lidarHealth with the right flux and
+ *  temperature min/mean/max, weak share, checksum error rate and sample
+ *  rate; old slots leave the window. A lens going dirty after a few clean
+ *  hours raises lowFlux and weak, and cleaning it clears them; a noisy
+ *  cable, a hot chip, a slow and a silent sensor raise theirs. The JSON
+ *  parses, in both forms.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameLIDAR.h>
+
+#include <math.h>
+
+#include "hostTest.h"
+
+static void inject(int16_t dist, int16_t flux, int16_t temp, bool corrupt = false)
+{
+  uint8_t frame[TFMP_FRAME_SIZE];
+  TFMPlus::hostEncodeFrame(frame, dist, flux, temp);
+  if (corrupt) frame[4] ^= 0x10;
+  tfMiniUART.hostInject(frame, sizeof(frame));
+}
+
+//****************************************************************************************
+// Five minutes polled at 50 Hz, as the counter runs it, then ten more.
+static void testPolled()
+{
+  hostSetMicros(4294967296ULL - 60000000ULL); // micros() wraps a minute in
+  lidarHealth.setExpectedRate(50);
+  lidarHealth.update(micros());
+
+  long frames = 0, weak = 0, corrupt = 0;
+  double fluxSum = 0, tempSum = 0;
+  for (int i = 0; i < 5 * 60 * 50; i++)
+  {
+    hostAdvanceMicros(20000);
+    if (i % 200 == 199) // A corrupt frame: the poll gets nothing
+    {
+      inject(500, 300, 30, true);
+      corrupt++;
+    }
+    else
+    {
+      int16_t flux = (int16_t)(200 + (i % 201));   // 200 ... 400
+      int16_t temp = (int16_t)(30 + (i / 50) % 5); // 30 ... 34
+      bool isWeak = (i % 20 == 0);
+      inject(isWeak ? -1 : (int16_t)(999 - (i % 900)), flux, temp);
+      frames++;
+      weak += isWeak;
+      fluxSum += flux;
+      tempSum += temp;
+    }
+    readLIDARSample();
+  }
+
+  LIDARHealthSummary h = lidarHealth.summary(micros());
+  CHECK(fabs(h.seconds - 300) < 0.1);
+  CHECK_EQ(h.frames, (unsigned long)frames);
+  CHECK(fabs(h.sampleRate - frames / 300.0) < 0.05);
+  CHECK_EQ(h.fluxMin, 200);
+  CHECK_EQ(h.fluxMax, 400);
+  CHECK(fabs(h.fluxMean - fluxSum / frames) < 0.01);
+  CHECK_EQ(h.tempMin, 30);
+  CHECK_EQ(h.tempMax, 34);
+  CHECK(fabs(h.tempMean - tempSum / frames) < 0.01);
+  CHECK(fabs(h.weakRatio - (double)weak / frames) < 1e-6);
+  CHECK(fabs(h.checksumErrorRate - (double)corrupt / (frames + corrupt)) < 1e-6);
+  CHECK_EQ(h.warnings, 0);
+  CHECK_EQ(lidarHealth.lastSummary().frames, h.frames);
+
+  // Ten more minutes, cooler: the warm ones leave the window.
+  for (int i = 0; i < 10 * 60 * 50; i++)
+  {
+    hostAdvanceMicros(20000);
+    inject(300, 250, 20);
+    readLIDARSample();
+  }
+  h = lidarHealth.summary(micros());
+  CHECK((h.seconds >= 540) && (h.seconds <= 600)); // Nine slots and the one being filled
+  CHECK_EQ(h.tempMax, 20);
+  CHECK_EQ(h.fluxMin, 250);
+  CHECK(h.weakRatio == 0);
+  CHECK(fabs(h.sampleRate - 50) < 0.1);
+}
+
+//****************************************************************************************
+// 10 Hz of readings, a quarter of them a vehicle, the rest nothing in range (0), for the
+// given minutes.
+static uint64_t nowUS = 0;
+static void feed(LIDARHealth &health, int minutes, int16_t targetFlux, int weakEvery, int16_t temp = 30)
+{
+  for (int i = 0; i < minutes * 600; i++)
+  {
+    nowUS += 100000;
+    LIDARSample s = {(uint32_t)nowUS, 0, 40, temp, TFMP_READY};
+    if (i % 4 == 0)
+    {
+      s.dist = 250;
+      s.flux = targetFlux;
+    }
+    else if ((weakEvery > 0) && (i % weakEvery == 1))
+    {
+      s.dist = -1;
+      s.flux = 10;
+      s.status = TFMP_WEAK;
+    }
+    health.record(s);
+    health.update((uint32_t)nowUS);
+  }
+}
+
+static void testFouling()
+{
+  TFMiniParser parser;
+  LIDARHealth health(parser);
+  health.setExpectedRate(10);
+  health.update(0);
+
+  feed(health, 180, 1200, 20); // Three clean hours
+  LIDARHealthSummary h = health.summary((uint32_t)nowUS);
+  CHECK(fabs(h.baselineFlux - 1200) < 1);
+  CHECK(fabs(h.targetFlux - 1200) < 1);
+  CHECK_EQ(h.warnings, 0);
+
+  // The lens gets dirty over the next hour: less light back, more weak readings.
+  for (int step = 1; step <= 6; step++) feed(health, 10, (int16_t)(1200 - step * 130), 20 - 3 * step);
+  h = health.summary((uint32_t)nowUS);
+  fprintf(stderr, "Fouled: target flux %.0f (baseline %.0f), weak %.2f (baseline %.2f)\n", h.targetFlux,
+          h.baselineFlux, h.weakRatio, h.baselineWeak);
+  CHECK(h.warnings & HEALTH_LOW_FLUX);
+  CHECK(h.warnings & HEALTH_WEAK);
+  CHECK(!(h.warnings & HEALTH_SLOW));
+
+  // Cleaned: the warnings go once the window's clean again.
+  feed(health, 11, 1200, 20);
+  CHECK_EQ(health.summary((uint32_t)nowUS).warnings, 0);
+}
+
+static void testWarnings()
+{
+  TFMiniParser parser;
+  LIDARHealth health(parser);
+  health.setExpectedRate(20); // Getting 10
+  health.update((uint32_t)nowUS);
+  feed(health, 5, 1000, 0, 65);
+  LIDARHealthSummary h = health.summary((uint32_t)nowUS);
+  CHECK(h.warnings & HEALTH_SLOW);
+  CHECK(h.warnings & HEALTH_HOT);
+  CHECK(!(h.warnings & (HEALTH_SILENT | HEALTH_LOW_FLUX | HEALTH_CHECKSUM)));
+
+  // A noisy cable: 3% of the frames fail their checksum.
+  uint8_t frame[TFMP_FRAME_SIZE];
+  for (int i = 0; i < 1000; i++)
+  {
+    TFMPlus::hostEncodeFrame(frame, 300, 500, 30);
+    if (i % 33 == 0) frame[8]++;
+    parser.parse(frame, sizeof(frame), [](const uint8_t *) {});
+  }
+  h = health.summary((uint32_t)nowUS);
+  CHECK(fabs(h.checksumErrorRate - 31 / 1000.0) < 1e-4);
+  CHECK(h.warnings & HEALTH_CHECKSUM);
+
+  // Nothing for longer than the window.
+  nowUS += 11 * 60000000ULL;
+  h = health.summary((uint32_t)nowUS);
+  CHECK_EQ(h.frames, 0ul);
+  CHECK(h.warnings & HEALTH_SILENT);
+  CHECK(h.warnings & HEALTH_SLOW);
+  CHECK(!(h.warnings & HEALTH_HOT));
+}
+
+//****************************************************************************************
+static void testJSON()
+{
+  LIDARHealthSummary h;
+  h.seconds = 600;
+  h.frames = 29850;
+  h.sampleRate = 49.75f;
+  h.fluxMin = 12;
+  h.fluxMean = 340.5f;
+  h.fluxMax = 2100;
+  h.tempMin = 31;
+  h.tempMean = 33.2f;
+  h.tempMax = 35;
+  h.weakRatio = 0.05f;
+  h.checksumErrorRate = 0.0125f;
+  h.warnings = HEALTH_CHECKSUM | HEALTH_HOT;
+
+  StaticJsonDocument<1024> doc;
+  CHECK(!deserializeJson(doc, getLIDARHealthJSON(h).c_str()));
+  CHECK_EQ((long)doc["readings"], 29850);
+  CHECK_EQ((long)doc["flux"]["max"], 2100);
+  CHECK(fabs((double)doc["sampleRate"] - 49.8) < 0.01);
+  CHECK(fabs((double)doc["checksumErrorRate"] - 0.0125) < 1e-6);
+  CHECK(String((const char *)doc["warnings"][0]) == "checksum");
+  CHECK(String((const char *)doc["warnings"][1]) == "hot");
+
+  String terse = getLIDARHealthJSON(h, true);
+  CHECK(terse.length() < 100); // It goes in a LoRa heartbeat
+  CHECK(!deserializeJson(doc, terse.c_str()));
+  CHECK_EQ((long)doc["f"][2], 2100);
+  CHECK_EQ((long)doc["w"], HEALTH_CHECKSUM | HEALTH_HOT);
+}
+
+int main()
+{
+  Serial.hostSetEcho(false);
+  testPolled();
+  testFouling();
+  testWarnings();
+  testJSON();
+  return TEST_REPORT();
+}
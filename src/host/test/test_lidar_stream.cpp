@@ -0,0 +1,179 @@
+/* test_lidar_stream.cpp
+ *
+ *  Free-running ingestion: a fake TFMini-Plus streams frames into the UART
+ *  in real time at 1000 Hz while the reader task parses them into
+ *  lidarStream and a stand-in for the main loop drains it in batches every
+ *  20 ms. Every frame must come out, in order, with nothing dropped by the
+ *  UART buffer or the ring. A stalled consumer must show up in the drop
+ *  counter rather than disappear. Frames read in one chunk each get their
+ *  own time, a frame period apart.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameLIDAR.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "hostTest.h"
+
+using Clock = std::chrono::steady_clock;
+
+//****************************************************************************************
+// The sensor: one frame per millisecond. The frame number goes in the flux field so the
+// consumer can check order; every 50th frame is a weak return.
+static void streamFrames(int numFrames, std::atomic<bool> &done)
+{
+  Clock::time_point next = Clock::now();
+  for (int i = 0; i < numFrames; i++)
+  {
+    uint8_t frame[TFMP_FRAME_SIZE];
+    int16_t dist = (i % 50 == 0) ? -1 : (int16_t)(100 + (i % 800));
+    TFMPlus::hostEncodeFrame(frame, dist, (int16_t)(i & 0x7FFF), 35);
+    tfMiniUART.hostInject(frame, sizeof(frame));
+    next += std::chrono::microseconds(1000);
+    std::this_thread::sleep_until(next);
+  }
+  done = true;
+}
+
+//****************************************************************************************
+// Five frames and the start of a sixth in one read, at 100 Hz: each its own time, 10 ms
+// apart, the last of them when its bytes (not the sixth's) came in.
+static void testFrameTimes()
+{
+  CHECK(startLIDARStream(FRAME_100));
+  TaskHandle_t reader = lidarReaderTask;
+  std::this_thread::sleep_for(std::chrono::milliseconds(50)); // The reader task is waiting
+  hostAdvanceMicros(1000000);
+  uint32_t readUS = micros(); // The host clock stands still until we move it.
+
+  uint8_t bytes[6 * TFMP_FRAME_SIZE];
+  for (int i = 0; i < 6; i++) TFMPlus::hostEncodeFrame(bytes + i * TFMP_FRAME_SIZE, 200, (int16_t)i, 35);
+  tfMiniUART.hostInject(bytes, 5 * TFMP_FRAME_SIZE + 4);
+
+  LIDARSample batch[8];
+  int n = 0;
+  for (int tries = 0; (n < 5) && (tries < 100); tries++)
+  {
+    n += readLIDARSamples(batch + n, 8 - n);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  CHECK_EQ(n, 5);
+  uint32_t lastUS = readUS - 4 * tfMiniByteUS;
+  for (int i = 0; i < n; i++) CHECK_EQ(batch[i].timeUS, lastUS - (4 - i) * 10000);
+
+  // The rest of the sixth.
+  tfMiniUART.hostInject(bytes + 5 * TFMP_FRAME_SIZE + 4, TFMP_FRAME_SIZE - 4);
+  n = 0;
+  for (int tries = 0; (n < 1) && (tries < 100); tries++)
+  {
+    n += readLIDARSamples(batch, 8);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  CHECK_EQ(n, 1);
+  CHECK_EQ(batch[0].flux, 5);
+  CHECK_EQ(batch[0].timeUS, readUS);
+
+  stopLIDARStream();
+  hostJoinTask(reader);
+  lidarStreamFrames = 0;
+}
+
+//****************************************************************************************
+static void testNoDrops()
+{
+  const int numFrames = 3000; // Three seconds at 1000 Hz
+
+  CHECK(startLIDARStream(FRAME_1000));
+  CHECK_EQ(tfmP.hostFrameRate(), FRAME_1000);
+  TaskHandle_t reader = lidarReaderTask;
+
+  std::atomic<bool> done{false};
+  std::thread sensor(streamFrames, numFrames, std::ref(done));
+
+  LIDARSample batch[64];
+  int expected = 0;
+  int received = 0;
+  int outOfOrder = 0;
+  int weak = 0;
+  int maxBatch = 0;
+  int sameTime = 0;
+  uint32_t lastUS = 0;
+  Clock::time_point quiet = Clock::now();
+  while (!done || Clock::now() - quiet < std::chrono::milliseconds(100))
+  {
+    int n = readLIDARSamples(batch, 64);
+    if (n > 0) quiet = Clock::now();
+    if (n > maxBatch) maxBatch = n;
+    for (int i = 0; i < n; i++)
+    {
+      if (batch[i].flux != expected) outOfOrder++;
+      if ((received > 0) && (batch[i].timeUS == lastUS)) sameTime++;
+      lastUS = batch[i].timeUS;
+      expected = batch[i].flux + 1;
+      if (batch[i].status == TFMP_WEAK) weak++;
+      processLIDARSample3(getRuntimeConfig(), batch[i]);
+      received++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20)); // The main loop's pace
+  }
+  sensor.join();
+
+  stopLIDARStream();
+  hostJoinTask(reader);
+
+  CHECK_EQ(received, numFrames);
+  CHECK_EQ(outOfOrder, 0);
+  CHECK_EQ(sameTime, 0);
+  CHECK_EQ(weak, numFrames / 50);
+  CHECK_EQ(lidarStreamDrops, 0UL);
+  CHECK_EQ(lidarStreamFrames, (unsigned long)numFrames);
+  CHECK_EQ(tfMiniUART.hostRxOverruns(), 0UL);
+  CHECK_EQ(lidarParser.stats.checksumErrors, 0UL);
+  CHECK_EQ(lidarParser.stats.weak, (unsigned long)numFrames / 50);
+  CHECK(maxBatch > 1); // Batches, not one sample per loop.
+  fprintf(stderr, "1000 Hz: %d frames, largest batch %d\n", received, maxBatch);
+}
+
+//****************************************************************************************
+static void testStalledConsumer()
+{
+  const int numFrames = 1000;
+  lidarStreamDrops = 0;
+  lidarStreamFrames = 0;
+
+  CHECK(startLIDARStream(FRAME_1000));
+  TaskHandle_t reader = lidarReaderTask;
+
+  std::atomic<bool> done{false};
+  std::thread sensor(streamFrames, numFrames, std::ref(done));
+
+  // The loop gets stuck for half a second (an SD card write, say): more than the ring holds.
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  sensor.join();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  LIDARSample batch[64];
+  int received = 0;
+  int n;
+  while ((n = readLIDARSamples(batch, 64)) > 0) received += n;
+
+  stopLIDARStream();
+  hostJoinTask(reader);
+
+  CHECK(lidarStreamDrops > 0);
+  CHECK_EQ((unsigned long)received + lidarStreamDrops, (unsigned long)numFrames);
+  CHECK_EQ(received, lidarStreamSize);
+}
+
+int main()
+{
+  CHECK(initLIDAR(false));
+  testFrameTimes();
+  testNoDrops();
+  testStalledConsumer();
+  return TEST_REPORT();
+}
@@ -0,0 +1,94 @@
+/* test_lidar_zones.cpp
+ *
+ *  The running zone counts kept by pushLIDARSample() must give exactly the
+ *  zone1Strength / bufferInteg values the original full rescan of lidarBuffer
+ *  produced, including while the buffer is filling and after the zone limits
+ *  change.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameLIDAR.h>
+
+#include "hostTest.h"
+
+struct Limits
+{
+  int z1Min, z1Max, z2Min, z2Max;
+};
+
+// The original loops from processLIDARSignal2 and processLIDARSignal3.
+static void rescan(const Limits &l, long &zone1Strength, long &zone2Strength,
+                   float &bufferInteg1, float &bufferInteg2)
+{
+  zone1Strength = 0;
+  zone2Strength = 0;
+  bufferInteg1 = 0;
+  bufferInteg2 = 0;
+  for (int i = 0; i < lidarBuffer.size(); i++)
+  {
+    if ((lidarBuffer[i] < l.z1Max) && (lidarBuffer[i] > l.z1Min))
+    {
+      zone1Strength = zone1Strength + 1;
+      bufferInteg1 += 100 / lidarBuffer.size();
+    }
+    if ((lidarBuffer[i] < l.z2Max) && (lidarBuffer[i] > l.z2Min))
+    {
+      zone2Strength = zone2Strength + 1;
+      bufferInteg2 += 100 / lidarBuffer.size();
+    }
+  }
+  zone1Strength = (100 * zone1Strength / lidarBuffer.size());
+  zone2Strength = (100 * zone2Strength / lidarBuffer.size());
+}
+
+int main()
+{
+  Limits limits = {0, 300, 300, 700};
+  int mismatches = 0;
+
+  for (int i = 0; i < 20000; i++)
+  {
+    // Every so often somebody adjusts the lanes from the web page.
+    if (i % 997 == 0)
+    {
+      limits.z1Min = random(0, 200);
+      limits.z1Max = limits.z1Min + random(0, 400);
+      limits.z2Min = random(0, 600);
+      limits.z2Max = limits.z2Min + random(0, 500);
+    }
+
+    // Mostly road with bursts of traffic, plus edge values on the limits.
+    int d;
+    switch (random(0, 6))
+    {
+    case 0: d = limits.z1Min; break;
+    case 1: d = limits.z2Max; break;
+    case 2: d = 999; break;
+    default: d = random(1, 1000); break;
+    }
+
+    setLIDARZoneLimits(limits.z1Min, limits.z1Max, limits.z2Min, limits.z2Max);
+    pushLIDARSample(d);
+
+    long z1, z2;
+    float integ1, integ2;
+    rescan(limits, z1, z2, integ1, integ2);
+
+    long zone1Strength = (100 * (long)lidarZoneCounts.zone1 / lidarBuffer.size());
+    long zone2Strength = (100 * (long)lidarZoneCounts.zone2 / lidarBuffer.size());
+    float bufferInteg1 = lidarZoneCounts.zone1 * (100 / lidarBuffer.size());
+    float bufferInteg2 = lidarZoneCounts.zone2 * (100 / lidarBuffer.size());
+
+    if ((zone1Strength != z1) || (zone2Strength != z2) ||
+        (memcmp(&bufferInteg1, &integ1, sizeof(float)) != 0) ||
+        (memcmp(&bufferInteg2, &integ2, sizeof(float)) != 0))
+    {
+      mismatches++;
+    }
+  }
+  CHECK_EQ(mismatches, 0);
+  CHECK(lidarBuffer.isFull());
+
+  return TEST_REPORT();
+}
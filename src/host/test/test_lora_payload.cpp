@@ -0,0 +1,163 @@
+/* test_lora_payload.cpp
+ *
+ *  Binary vehicle events for LoRa: the encoding's size from the smallest
+ *  count to the largest, round trips through the bytes and the base64 that
+ *  AT+SEND carries, payloads the base station must refuse, and the terse
+ *  JSON fields it rebuilds. Then the time on the air of a vehicle event at
+ *  SF7 to SF12 (125 kHz, 4/5, PARAMS.TXT's preamble) as JSON, as base64 and
+ *  as the bytes themselves.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <ArduinoJson.h>
+#include <digameLoRaPayload.h>
+
+#include "hostTest.h"
+
+static LoRaEvent vehicle(uint32_t count)
+{
+  LoRaEvent e = {};
+  e.epoch = 1654092207; // 2022-06-01 14:03:27
+  e.count = count;
+  e.tempC10 = 235;
+  e.type = EVENT_VEHICLE;
+  e.lane = 1;
+  e.detector = 2; // d
+  e.retries = 0;
+  e.settingsHash = loraSettingsHash("{\"ui\":\"10\",\"sf\":\"0.6\"}");
+  e.firmware = 970;
+  return e;
+}
+
+static bool same(const LoRaEvent &a, const LoRaEvent &b)
+{
+  return (a.epoch == b.epoch) && (a.count == b.count) && (a.tempC10 == b.tempC10) && (a.type == b.type) &&
+         (a.lane == b.lane) && (a.detector == b.detector) && (a.retries == b.retries) &&
+         (a.settingsHash == b.settingsHash) && (a.firmware == b.firmware);
+}
+
+//****************************************************************************************
+static void testEncoding()
+{
+  const uint32_t counts[] = {0, 127, 128, 16383, 16384, 2097151, 2097152, 268435456, 0xFFFFFFFF};
+  const int sizes[] = {13, 13, 14, 14, 15, 15, 16, 17, 17};
+  for (int i = 0; i < 9; i++)
+  {
+    LoRaEvent e = vehicle(counts[i]), back;
+    uint8_t buf[loraPayloadMaxBytes];
+    int n = encodeLoRaEvent(e, buf);
+    CHECK_EQ(n, sizes[i]);
+    CHECK(decodeLoRaEvent(buf, n, back) && same(e, back));
+
+    String text = loraBytesToText(buf, n);
+    CHECK_EQ(text.length(), (n * 4 + 2) / 3);
+    CHECK(!isLoRaJSONPayload(text));
+    uint8_t again[loraPayloadMaxBytes];
+    CHECK_EQ(loraTextToBytes(text, again, sizeof(again)), n);
+    CHECK(memcmp(buf, again, n) == 0);
+  }
+
+  // Cold, lane 15, too many retries to count; a heartbeat.
+  LoRaEvent e = vehicle(5), back;
+  e.tempC10 = -187;
+  e.lane = 15;
+  e.retries = 40;
+  e.type = EVENT_HEARTBEAT;
+  e.detector = 3;
+  uint8_t buf[loraPayloadMaxBytes];
+  int n = encodeLoRaEvent(e, buf);
+  CHECK(decodeLoRaEvent(buf, n, back));
+  CHECK_EQ(back.tempC10, -187);
+  CHECK_EQ(back.lane, 15);
+  CHECK_EQ(back.retries, 15);
+  CHECK_EQ(back.type, EVENT_HEARTBEAT);
+  CHECK_EQ(back.detector, 3);
+
+  // Refused: short, long, another version, a varint that runs off the end.
+  e = vehicle(300);
+  n = encodeLoRaEvent(e, buf);
+  for (int len = 0; len < n; len++) CHECK(!decodeLoRaEvent(buf, len, back));
+  buf[n] = 0;
+  CHECK(!decodeLoRaEvent(buf, n + 1, back));
+  buf[0] = (2 << 4) | (buf[0] & 0x0F);
+  CHECK(!decodeLoRaEvent(buf, n, back));
+  uint8_t runaway[17] = {0x18, 1, 2, 3, 4, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0, 0, 0};
+  CHECK(!decodeLoRaEvent(runaway, sizeof(runaway), back));
+
+  // Base64 as everyone else does it (RFC 4648, unpadded), and not base64.
+  const uint8_t man[] = {'M', 'a', 'n'};
+  CHECK(loraBytesToText(man, 3) == "TWFu");
+  CHECK(loraBytesToText(man, 2) == "TWE");
+  CHECK(loraBytesToText(man, 1) == "TQ");
+  CHECK_EQ(loraTextToBytes("TWE", buf, sizeof(buf)), 2);
+  CHECK_EQ(loraTextToBytes("TW,E", buf, sizeof(buf)), -1);
+  CHECK_EQ(loraTextToBytes("TWFuTWFu", buf, 5), -1);
+  CHECK(isLoRaJSONPayload("{\"et\":\"hb\"}"));
+}
+
+//****************************************************************************************
+// What the base station gets from the bytes is what it got from the JSON.
+static void testTranscoding()
+{
+  const char *json = "{\"ts\":\"2022-06-01 14:03:27\",\"v\":\"0970\",\"et\":\"v\",\"c\":\"12345\","
+                     "\"t\":\"23.5\",\"r\":\"0\",\"da\":\"d\",\"l\":\"1\"}";
+  StaticJsonDocument<512> fromJSON, fromBytes;
+  CHECK(!deserializeJson(fromJSON, json));
+
+  uint8_t buf[loraPayloadMaxBytes];
+  LoRaEvent e;
+  int n = loraTextToBytes(loraBytesToText(buf, encodeLoRaEvent(vehicle(12345), buf)), buf, sizeof(buf));
+  CHECK(decodeLoRaEvent(buf, n, e));
+  loraEventToTerseJSON(e, fromBytes);
+
+  const char *keys[] = {"ts", "v", "et", "c", "t", "r", "da", "l"};
+  for (const char *key : keys)
+  {
+    String a = fromJSON[key], b = fromBytes[key];
+    if (a != b) fprintf(stderr, "  %s: \"%s\" from JSON, \"%s\" from bytes\n", key, a.c_str(), b.c_str());
+    CHECK(a == b);
+  }
+  CHECK(fromBytes["sh"].as<String>() == getSettingsHashString(vehicle(0).settingsHash));
+  CHECK_EQ(getSettingsHashString(0x0a1b).length(), 4u);
+  CHECK(loraSettingsHash("{\"ui\":\"10\"}") != loraSettingsHash("{\"ui\":\"20\"}"));
+}
+
+//****************************************************************************************
+static void testAirtime()
+{
+  // Known values (Semtech's calculator): 20 bytes at 125 kHz, 4/5, 8 symbol preamble.
+  CHECK(fabsf(loraAirtimeMS(20, 7, 125, 1, 8) - 56.6f) < 0.1f);
+  CHECK(fabsf(loraAirtimeMS(20, 12, 125, 1, 8) - 1318.9f) < 0.1f);
+
+  const char *json = "{\"ts\":\"2022-06-01 14:03:27\",\"v\":\"0970\",\"et\":\"v\",\"c\":\"12345\","
+                     "\"t\":\"23.5\",\"r\":\"0\",\"da\":\"d\",\"l\":\"1\"}";
+  uint8_t buf[loraPayloadMaxBytes];
+  int bytes = encodeLoRaEvent(vehicle(12345), buf);
+  int text = loraBytesToText(buf, bytes).length();
+  int jsonBytes = strlen(json);
+  const int preamble = 7; // PARAMS.TXT's default
+
+  fprintf(stderr, "A vehicle event on the air, 125 kHz, CR 4/5, %d symbol preamble:\n", preamble);
+  fprintf(stderr, "        JSON (%2d B)  base64 (%2d B)  bytes (%2d B)\n", jsonBytes, text, bytes);
+  for (int sf = 7; sf <= 12; sf++)
+  {
+    float a = loraAirtimeMS(jsonBytes, sf, 125, 1, preamble);
+    float b = loraAirtimeMS(text, sf, 125, 1, preamble);
+    float c = loraAirtimeMS(bytes, sf, 125, 1, preamble);
+    fprintf(stderr, "  SF%-2d %8.1f ms    %8.1f ms    %8.1f ms    (%2.0f%% of the JSON's, as sent)\n", sf, a, b,
+            c, 100 * b / a);
+    CHECK(b * 2 < a);
+    CHECK(c <= b);
+  }
+  CHECK(bytes < 16);
+  CHECK(text <= 20);
+}
+
+int main()
+{
+  testEncoding();
+  testTranscoding();
+  testAirtime();
+  return TEST_REPORT();
+}
@@ -0,0 +1,161 @@
+/* test_matched_filter.cpp
+ *
+ *  MatchedFilter must give the same coefficient as correlation() over the
+ *  same window, reading after reading: for the step and notch models, a
+ *  short model, and a smoothed model with no flat stretches. Traces are
+ *  roadside-like (empty road, cars, dropouts) and run for a million
+ *  readings so drift in the running sums would show. A flat window gives 0
+ *  where correlation() gives NaN.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameMatchedFilter.h>
+
+#include <random>
+#include <vector>
+
+#include "hostTest.h"
+
+//****************************************************************************************
+// Empty road at 999 cm with cars at 150-650 cm for 0.3-1.5 s, noise, and the odd
+// dropout (read as 0 or 1200, depending on the detector).
+static std::vector<int16_t> makeTrace(long n, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<int16_t> trace;
+  trace.reserve(n);
+  while ((long)trace.size() < n)
+  {
+    int quiet = 50 + (int)(rng() % 400);
+    for (int i = 0; i < quiet; i++) trace.push_back((int16_t)(999 + (int)(rng() % 5) - 2));
+    int car = 150 + (int)(rng() % 500);
+    int length = 30 + (int)(rng() % 120);
+    for (int i = 0; i < length; i++)
+    {
+      int d = car + (int)(rng() % 21) - 10;
+      if (rng() % 50 == 0) d = (rng() % 2) ? 0 : 1200;
+      trace.push_back((int16_t)d);
+    }
+  }
+  trace.resize(n);
+  return trace;
+}
+
+// correlation() in double, for judging the float versions.
+static double reference(const float *x, const float *y, int n)
+{
+  double mx = 0, my = 0;
+  for (int i = 0; i < n; i++)
+  {
+    mx += x[i];
+    my += y[i];
+  }
+  mx /= n;
+  my /= n;
+  double sx = 0, sy = 0, sxy = 0;
+  for (int i = 0; i < n; i++)
+  {
+    sx += (x[i] - mx) * (x[i] - mx);
+    sy += (y[i] - my) * (y[i] - my);
+    sxy += (x[i] - mx) * (y[i] - my);
+  }
+  return sxy / sqrt(sx * sy);
+}
+
+//****************************************************************************************
+// Push a trace through the filter and compare with correlation() over a copy of the
+// window after every reading (every 97th on long traces).
+template <int N>
+static void compare(const char *name, const float *model, const std::vector<int16_t> &trace,
+                    int every = 1)
+{
+  MatchedFilter<N> filter(model);
+  std::vector<int16_t> recent(N, 0); // What correlation() would be handed: oldest first
+  float x[N], y[N];
+  for (int i = 0; i < N; i++) x[i] = model[i];
+
+  double worstFloat = 0, worstStream = 0;
+  long compared = 0, flat = 0, wrongWindow = 0;
+  for (size_t t = 0; t < trace.size(); t++)
+  {
+    filter.push(trace[t]);
+    recent.erase(recent.begin());
+    recent.push_back(trace[t]);
+    if ((t % every) && (t != trace.size() - 1)) continue;
+
+    bool isFlat = true;
+    for (int i = 0; i < N; i++)
+    {
+      y[i] = recent[i];
+      isFlat &= (recent[i] == recent[0]);
+      if (filter[i] != recent[i]) wrongWindow++;
+    }
+    if (isFlat)
+    {
+      flat++;
+      if (filter.correlation() != 0) worstStream = 1;
+      continue;
+    }
+
+    double r = reference(x, y, N);
+    worstFloat = fmax(worstFloat, fabs(correlation(x, y, N) - r));
+    worstStream = fmax(worstStream, fabs(filter.correlation() - r));
+    compared++;
+  }
+
+  fprintf(stderr, "%-22s %2d stretches, %8ld windows: worst |error| %.2e (correlation() %.2e)\n",
+          name, filter.stretches(), compared, worstStream, worstFloat);
+  CHECK_EQ(wrongWindow, 0L);
+  CHECK(compared > 0);
+  CHECK(worstStream < 1e-5);
+  CHECK(worstStream <= worstFloat + 1e-6); // No worse than what we're replacing
+}
+
+//****************************************************************************************
+static void testFlat()
+{
+  MatchedFilter<modelSamples> filter(fallingEdgeModel);
+  CHECK(!filter.full());
+  for (int i = 0; i < modelSamples - 1; i++) filter.push(999);
+  CHECK(!filter.full());
+  filter.push(999);
+  CHECK(filter.full());
+  CHECK_EQ(filter.correlation(), 0.0f); // correlation() would divide by zero here
+  filter.push(200);
+  CHECK(filter.correlation() > 0); // A drop at the very end: the start of a falling edge
+
+  MatchedFilter<modelSamples> none;
+  none.push(5);
+  CHECK_EQ(none.correlation(), 0.0f);
+  CHECK_EQ(none.stretches(), 1);
+
+  // A window that's a perfect copy of the model (scaled, offset) correlates perfectly.
+  MatchedFilter<modelSamples> notch(notchModel);
+  for (int i = 0; i < modelSamples; i++) notch.push((int16_t)(300 + 600 * notchModel[i]));
+  CHECK(fabsf(notch.correlation() - 1.0f) < 1e-6f);
+  notch.reset();
+  CHECK(!notch.full());
+  CHECK_EQ(notch.correlation(), 0.0f);
+}
+
+int main()
+{
+  std::vector<int16_t> shortTrace = makeTrace(20000, 1);
+  std::vector<int16_t> longTrace = makeTrace(1000000, 2);
+
+  float tinyFallingEdgeModel[] = {1,1,1,1,1,1,1,1,1,1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1};
+  float smoothed[modelSamples]; // The falling edge through a 0.1 smoothing filter
+  float s = fallingEdgeModel[0];
+  for (int i = 0; i < modelSamples; i++) smoothed[i] = s = 0.9f * s + 0.1f * fallingEdgeModel[i];
+
+  compare<modelSamples>("falling edge", fallingEdgeModel, shortTrace);
+  compare<modelSamples>("rising edge", risingEdgeModel, shortTrace);
+  compare<modelSamples>("notch", notchModel, shortTrace);
+  compare<20>("tiny falling edge", tinyFallingEdgeModel, shortTrace);
+  compare<modelSamples>("smoothed falling edge", smoothed, shortTrace);
+  compare<modelSamples>("falling edge (1M)", fallingEdgeModel, longTrace, 97);
+
+  testFlat();
+  return TEST_REPORT();
+}
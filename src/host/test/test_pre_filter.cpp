@@ -0,0 +1,318 @@
+/* test_pre_filter.cpp
+ *
+ *  The rain pre-filter: the streaming median and Hampel filters give what
+ *  sorting each window from scratch gives, for every window size; the gate
+ *  passes exactly the runs long enough; the readings come out delay()
+ *  readings late with their own times. On synthetic traffic in rain -- short
+ *  returns a meter or two out -- the Decay detector alone counts the rain;
+ *  with a filter up to the rain it counts the vehicles, within 5%; and in
+ *  dry weather no filter loses any of them.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "../tools/digameTuner.h"
+
+#include <algorithm>
+#include <random>
+
+#include "hostTest.h"
+
+static RuntimeConfig settings(const char *filter, int window, float threshold, int minRun)
+{
+  Config c;
+  c.lidarPreFilter = filter;
+  c.lidarPreFilterWindow = String(window);
+  c.lidarHampelThreshold = String(threshold);
+  c.lidarMinRunLength = String(minRun);
+  return buildRuntimeConfig(c);
+}
+
+// Readings with vehicles, glimpses, weak returns and zeros.
+static std::vector<LIDARSample> makeReadings(int n, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<LIDARSample> s;
+  while ((int)s.size() < n)
+  {
+    int kind = rng() % 4;
+    int length = 1 + (int)(rng() % ((kind == 0) ? 4 : 30));
+    int d = (kind == 0) ? 100 + (int)(rng() % 200) : (kind == 1) ? 999 : 150 + (int)(rng() % 450);
+    for (int i = 0; i < length; i++)
+    {
+      LIDARSample r = replaySample((uint32_t)s.size() * replayIntervalUS, (int16_t)(d + (int)(rng() % 21) - 10));
+      if (rng() % 20 == 0) r.status = TFMP_WEAK;
+      if (rng() % 30 == 0) r.dist = 0;
+      if (rng() % 50 == 0) r.dist = 1200;
+      s.push_back(r);
+    }
+  }
+  s.resize(n);
+  return s;
+}
+
+//****************************************************************************************
+// The median of each window, sorted from scratch; Hampel by the book.
+static void testMedian(const std::vector<LIDARSample> &in)
+{
+  for (int window : {3, 5, 7, 15, 31})
+  {
+    for (const char *type : {"Median", "Hampel"})
+    {
+      const bool hampel = (type[0] == 'H');
+      LIDARPreFilter f;
+      f.configure(settings(type, window, 2.5f, 1));
+      const int h = window / 2;
+      CHECK_EQ(f.delay(), h);
+
+      bool all = true;
+      for (int i = 0; i < (int)in.size(); i++)
+      {
+        LIDARSample out = f.process(in[i]);
+        int j = i - h; // The one in the middle
+        std::vector<int> w;
+        for (int k = j - h; k <= j + h; k++) w.push_back((k < 0) ? 999 : clampLIDARDistance(in[k]));
+        std::vector<int> sorted = w;
+        std::sort(sorted.begin(), sorted.end());
+        int median = sorted[h];
+        int centre = w[h];
+        bool replace = (centre != median);
+        if (hampel)
+        {
+          std::vector<int> dev;
+          for (int x : w) dev.push_back(abs(x - median));
+          std::sort(dev.begin(), dev.end());
+          replace &= (abs(centre - median) > 2.5f * 1.4826f * dev[h]);
+        }
+
+        if (j < 0)
+        {
+          all &= (out.dist == 999); // Empty road before the start
+        }
+        else if (replace)
+        {
+          all &= (out.dist == median) && (out.status == TFMP_READY) && (out.timeUS == in[j].timeUS);
+        }
+        else
+        {
+          all &= (out.dist == in[j].dist) && (out.status == in[j].status) && (out.timeUS == in[j].timeUS);
+        }
+      }
+      CHECK(all);
+    }
+  }
+}
+
+//****************************************************************************************
+// Readings in a lane pass only in runs of minRun or more in that lane.
+static int lane(const LIDARSample &s)
+{
+  int d = clampLIDARDistance(s);
+  return ((d > 0) && (d < 300)) ? 1 : ((d > 400) && (d < 700)) ? 2 : 0; // The default lanes
+}
+
+static void testGate(const std::vector<LIDARSample> &in)
+{
+  for (int minRun : {2, 3, 8, 32})
+  {
+    // The length of the run each reading is in.
+    std::vector<int> runLength(in.size(), 0);
+    for (size_t i = 0; i < in.size();)
+    {
+      size_t end = i + 1;
+      while ((end < in.size()) && (lane(in[end]) == lane(in[i]))) end++;
+      for (size_t k = i; k < end; k++) runLength[k] = (int)(end - i);
+      i = end;
+    }
+
+    LIDARPreFilter f;
+    f.configure(settings("None", 5, 3, minRun));
+    CHECK(f.active());
+    CHECK_EQ(f.delay(), minRun - 1);
+    bool all = true;
+    int passed = 0, blocked = 0;
+    for (int i = 0; i < (int)in.size(); i++)
+    {
+      LIDARSample out = f.process(in[i]);
+      int j = i - (minRun - 1);
+      if (j < 0)
+      {
+        all &= (clampLIDARDistance(out) == 999);
+      }
+      else if ((lane(in[j]) > 0) && (runLength[j] < minRun))
+      {
+        all &= (out.dist == 999) && (out.status == TFMP_READY) && (out.timeUS == in[j].timeUS);
+        blocked++;
+      }
+      else
+      {
+        all &= (out.dist == in[j].dist) && (out.status == in[j].status) && (out.timeUS == in[j].timeUS);
+        passed += (lane(in[j]) > 0);
+      }
+    }
+    CHECK(all);
+    CHECK(blocked > 0);
+    CHECK(passed > 0);
+  }
+}
+
+//****************************************************************************************
+static void testSettings(const std::vector<LIDARSample> &in)
+{
+  LIDARPreFilter f;
+  f.configure(settings("None", 5, 3, 1));
+  CHECK(!f.active());
+  CHECK_EQ(f.delay(), 0);
+
+  // Both stages: the delays add up.
+  f.configure(settings("Median", 9, 3, 4));
+  CHECK_EQ(f.delay(), 4 + 3);
+  bool late = true;
+  for (int i = 0; i < 200; i++)
+  {
+    LIDARSample out = f.process(in[i]);
+    if (i >= 7) late &= (out.timeUS == in[i - 7].timeUS);
+  }
+  CHECK(late);
+
+  // Window sizes are odd and within limits; unknown filters are none.
+  f.configure(settings("median", 6, 3, 99));
+  CHECK_EQ(f.delay(), 3 + maxMinRunLength - 1);
+  f.configure(settings("Median", 1, 3, 0));
+  CHECK_EQ(f.delay(), 1);
+  f.configure(settings("Gaussian", 7, 3, 1));
+  CHECK(!f.active());
+
+  // The same settings again don't start it over; new ones do.
+  LIDARPreFilter a, b;
+  a.configure(settings("Median", 5, 3, 1));
+  b.configure(settings("Median", 5, 3, 1));
+  for (int i = 0; i < 100; i++)
+  {
+    a.process(in[i]);
+    b.process(in[i]);
+  }
+  a.configure(settings("Median", 5, 3, 1));
+  CHECK(a.process(in[100]).timeUS == b.process(in[100]).timeUS);
+  a.configure(settings("Median", 7, 3, 1));
+  CHECK_EQ(a.process(in[101]).timeUS, 0u); // Empty road again
+}
+
+//****************************************************************************************
+// Traffic in the rain: a vehicle every few seconds, in either lane, with the odd dropout.
+// Each reading starts a glimpse -- one or two returns at 1 to 3 m -- with the given
+// chance, on the empty road or in front of a vehicle.
+static LabeledTrace makeRainTrace(int vehicles, double rain, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> u(0, 1);
+  LabeledTrace t;
+  std::vector<int16_t> d(300, 999);
+  for (int v = 0; v < vehicles; v++)
+  {
+    for (int i = 0; i < 200 + (int)(rng() % 300); i++) d.push_back(999);
+    int car = (rng() % 2) ? 150 + (int)(rng() % 100) : 450 + (int)(rng() % 150);
+    int length = 40 + (int)(rng() % 100);
+    for (int i = 0; i < length; i++)
+    {
+      d.push_back((int16_t)(car + (int)(rng() % 11) - 5));
+      if ((i > 10) && (i < length - 10) && (rng() % 60 == 0)) d.push_back(0);
+    }
+    t.labels.push_back({(uint32_t)(d.size() - 1) * replayIntervalUS, (car < 400) ? 1 : 2});
+  }
+  d.insert(d.end(), 300, 999);
+
+  for (size_t i = 0; i < d.size(); i++)
+  {
+    if (u(rng) >= rain) continue;
+    int16_t drop = (int16_t)(100 + rng() % 200);
+    for (int k = 1 + (int)(rng() % 2); (k > 0) && (i < d.size()); k--) d[i++] = (int16_t)(drop + rng() % 5);
+  }
+
+  t.trace.name = "rain" + std::to_string(seed);
+  for (size_t i = 0; i < d.size(); i++) t.trace.samples.push_back(replaySample((uint32_t)i * replayIntervalUS, d[i]));
+  return t;
+}
+
+struct RainSetting
+{
+  const char *name;
+  const char *filter;
+  int window;
+  int minRun;
+  double copesWith; // The heaviest rain it counts through, within 5%
+};
+
+static void testRain()
+{
+  // A median window holds out while less than half of it is rain, so a wider window
+  // copes with more. Hampel lets a little more through: rain in front of a vehicle
+  // widens the spread it judges outliers by. The gate needs runs longer than the
+  // glimpses, and then doesn't mind how many there are.
+  const RainSetting settings[] = {{"None", "None", 5, 1, 0},
+                                  {"Median 5", "Median", 5, 1, 0.02},
+                                  {"Median 9", "Median", 9, 1, 0.05},
+                                  {"Hampel 9", "Hampel", 9, 1, 0.02},
+                                  {"Min. run 2", "None", 5, 2, 0},
+                                  {"Min. run 3", "None", 5, 3, 0.10}};
+  const double rates[] = {0, 0.02, 0.05, 0.10};
+  const int vehicles = 100;
+
+  fprintf(stderr, "%-22s", "Vehicles counted (F1)");
+  for (double rate : rates) fprintf(stderr, "   rain %3.0f%%   ", rate * 100);
+  fprintf(stderr, "\n");
+
+  for (const RainSetting &s : settings)
+  {
+    Config c = config;
+    c.lidarDetectionAlgorithm = "Decay";
+    c.lidarPreFilter = s.filter;
+    c.lidarPreFilterWindow = String(s.window);
+    c.lidarMinRunLength = String(s.minRun);
+
+    fprintf(stderr, "%-22s", s.name);
+    for (double rate : rates)
+    {
+      long counted = 0;
+      TuneScore score;
+      for (unsigned seed = 1; seed <= 3; seed++)
+      {
+        LabeledTrace t = makeRainTrace(vehicles, rate, seed);
+        ReplayResult r = replayTrace(t.trace, &c);
+        CHECK(r.ok);
+        counted += (long)r.events.size();
+        score.add(scoreTuneEvents(r.events, t.labels));
+      }
+      fprintf(stderr, "  %4ld (%.3f)  ", counted, score.f1());
+
+      if (rate == 0) // Nothing lost in the dry
+      {
+        CHECK_EQ(score.matched, 3 * vehicles);
+        CHECK_EQ(score.falseAlarms, 0);
+      }
+      else if (rate <= s.copesWith)
+      {
+        CHECK(labs(counted - 3 * vehicles) <= 3 * vehicles / 20);
+        CHECK(score.f1() > 0.95);
+      }
+      else if (s.copesWith == 0)
+      {
+        CHECK(score.falseAlarms > 30); // The rain counts
+      }
+    }
+    fprintf(stderr, "\n");
+  }
+}
+
+int main()
+{
+  Serial.hostSetEcho(false);
+  config.showDataStream = "false";
+
+  std::vector<LIDARSample> in = makeReadings(20000, 7);
+  testMedian(in);
+  testGate(in);
+  testSettings(in);
+  testRain();
+  return TEST_REPORT();
+}
@@ -0,0 +1,225 @@
+/* test_raw_log.cpp
+ *
+ *  Raw data capture: samples logged at 100 Hz (simulated) come back
+ *  bit-for-bit from the blocks on the card, across a wrap of the
+ *  microsecond clock, at a fraction of the size of text. With a card that
+ *  stalls on every write, logging a sample still never waits; the samples
+ *  that didn't fit are counted as drops and everything else decodes in
+ *  order. The polled LIDAR path logs what it reads when logRawData is on.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameLIDAR.h>
+
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "hostTest.h"
+
+struct Raw
+{
+  uint32_t timeUS;
+  int16_t dist, flux, temp;
+  bool operator==(const Raw &o) const
+  {
+    return timeUS == o.timeUS && dist == o.dist && flux == o.flux && temp == o.temp;
+  }
+};
+
+//****************************************************************************************
+// Read back every block of a log file.
+static std::vector<Raw> readLog(const char *fileName, size_t &fileSize, int &badBlocks)
+{
+  std::vector<Raw> out;
+  badBlocks = 0;
+  File file = SD.open(fileName, FILE_READ);
+  fileSize = file.size();
+
+  static uint8_t block[RAW_LOG_BLOCK_SIZE];
+  while (file.read(block, sizeof(block)) == sizeof(block))
+  {
+    RawLogBlockHeader header;
+    if (!decodeRawLogBlock(block, header, [&](uint32_t t, int16_t d, int16_t f, int16_t c) {
+          out.push_back({t, d, f, c});
+        }))
+    {
+      badBlocks++;
+    }
+  }
+  file.close();
+  return out;
+}
+
+//****************************************************************************************
+// A day at the roadside: empty road at 999 cm, cars passing, weak returns now and then.
+static std::vector<Raw> makeTrace(int n)
+{
+  std::mt19937 rng(5);
+  std::vector<Raw> trace(n);
+  uint32_t t = 0xFFFFFFFFu - 60000000u; // The clock wraps a minute in.
+  for (int i = 0; i < n; i++)
+  {
+    t += 10000 + rng() % 200 - 100;
+    int phase = i % 500;
+    Raw &r = trace[i];
+    r.timeUS = t;
+    r.dist = (phase > 200 && phase < 240) ? (int16_t)(300 + rng() % 20) : (int16_t)(999 + rng() % 3);
+    r.flux = (int16_t)(2000 + rng() % 300);
+    r.temp = (int16_t)(38 + (i / 20000));
+    if (rng() % 200 == 0)
+    {
+      r.dist = -1;
+      r.flux = 0;
+    }
+  }
+  return trace;
+}
+
+//****************************************************************************************
+static void testRoundTrip()
+{
+  const int numSamples = 20000; // A bit over three minutes at 100 Hz
+  std::vector<Raw> trace = makeTrace(numSamples);
+
+  SD.remove("/rawdata.bin");
+  CHECK(startRawLog("/rawdata.bin"));
+  TaskHandle_t writer = rawLogWriterTask;
+  for (int i = 0; i < numSamples; i++)
+  {
+    logRawSample(trace[i].timeUS, trace[i].dist, trace[i].flux, trace[i].temp);
+    // At 100 Hz a block takes seconds to fill; give the writer that chance.
+    if (i % 100 == 0) while (rawLogPending >= 0) std::this_thread::yield();
+  }
+  stopRawLog();
+  hostJoinTask(writer);
+
+  CHECK_EQ(rawLogDrops, 0UL);
+  CHECK_EQ(rawLogWriteErrors, 0UL);
+
+  size_t fileSize;
+  int badBlocks;
+  std::vector<Raw> back = readLog("/rawdata.bin", fileSize, badBlocks);
+  CHECK_EQ(badBlocks, 0);
+  CHECK(back == trace);
+  CHECK_EQ(fileSize % RAW_LOG_BLOCK_SIZE, (size_t)0);
+  CHECK_EQ(fileSize / RAW_LOG_BLOCK_SIZE, (size_t)rawLogBlocksWritten);
+
+  // The old text format ("millis,dist\n") was about 13 bytes a sample with less in it.
+  double bytesPerSample = (double)fileSize / numSamples;
+  CHECK(bytesPerSample < 7.0);
+  fprintf(stderr, "Round trip: %d samples, %.2f bytes/sample\n", numSamples, bytesPerSample);
+
+  // A second session appends; both decode.
+  CHECK(startRawLog("/rawdata.bin"));
+  writer = rawLogWriterTask;
+  logRawSample(123, 456, 789, 40);
+  stopRawLog();
+  hostJoinTask(writer);
+  back = readLog("/rawdata.bin", fileSize, badBlocks);
+  CHECK_EQ(back.size(), trace.size() + 1);
+  CHECK(back.back() == (Raw{123, 456, 789, 40}));
+
+  // A damaged block is rejected, not misread.
+  static uint8_t block[RAW_LOG_BLOCK_SIZE];
+  File file = SD.open("/rawdata.bin", FILE_READ);
+  file.read(block, sizeof(block));
+  file.close();
+  RawLogBlockHeader header;
+  int records = 0;
+  auto count = [&](uint32_t, int16_t, int16_t, int16_t) { records++; };
+  CHECK(decodeRawLogBlock(block, header, count));
+  block[0] ^= 1;
+  CHECK(!decodeRawLogBlock(block, header, count));
+  block[0] ^= 1;
+  header.used -= 1;
+  memcpy(block, &header, sizeof(header));
+  CHECK(!decodeRawLogBlock(block, header, count));
+}
+
+//****************************************************************************************
+static void testSlowCard()
+{
+  const int numSamples = 20000;
+  std::vector<Raw> trace = makeTrace(numSamples);
+  hostSetFlushLatency(50); // Every block write stalls for 50 ms.
+
+  SD.remove("/slow.bin");
+  CHECK(startRawLog("/slow.bin"));
+  TaskHandle_t writer = rawLogWriterTask;
+  unsigned long inFlight = 0; // Drops that came back with the writer still on its block
+  for (int i = 0; i < numSamples; i++)
+  {
+    unsigned long before = rawLogDrops;
+    logRawSample(trace[i].timeUS, trace[i].dist, trace[i].flux, trace[i].temp);
+    if ((rawLogDrops > before) && (rawLogPending >= 0)) inFlight++;
+  }
+  unsigned long drops = rawLogDrops;
+  stopRawLog();
+  hostJoinTask(writer);
+  hostSetFlushLatency(0);
+
+  CHECK(drops > 0);
+  CHECK(inFlight > 0); // Dropped and carried on rather than waiting for the card.
+
+  size_t fileSize;
+  int badBlocks;
+  std::vector<Raw> back = readLog("/slow.bin", fileSize, badBlocks);
+  CHECK_EQ(badBlocks, 0);
+  CHECK_EQ(back.size() + drops, (size_t)numSamples);
+
+  // What was kept is in order, with nothing made up.
+  size_t j = 0;
+  for (size_t i = 0; i < trace.size() && j < back.size(); i++)
+  {
+    if (trace[i] == back[j]) j++;
+  }
+  CHECK_EQ(j, back.size());
+  fprintf(stderr, "Slow card: %lu of %d samples dropped, %lu while a block was being written\n", drops,
+          numSamples, inFlight);
+}
+
+//****************************************************************************************
+static void testPolledLIDAR()
+{
+  SD.remove("/polled.bin");
+  CHECK(startRawLog("/polled.bin"));
+  TaskHandle_t writer = rawLogWriterTask;
+
+  uint8_t frame[TFMP_FRAME_SIZE];
+  for (int i = 0; i < 10; i++)
+  {
+    TFMPlus::hostEncodeFrame(frame, (int16_t)(500 + i), 1500, 35);
+    tfMiniUART.hostInject(frame, sizeof(frame));
+    readLIDARSample();
+    delay(10);
+  }
+  readLIDARSample(); // Nothing waiting: nothing logged.
+  stopRawLog();
+  hostJoinTask(writer);
+
+  size_t fileSize;
+  int badBlocks;
+  std::vector<Raw> back = readLog("/polled.bin", fileSize, badBlocks);
+  CHECK_EQ(back.size(), (size_t)10);
+  if (back.size() == 10)
+  {
+    CHECK_EQ(back[9].dist, 509);
+    CHECK_EQ(back[9].flux, 1500);
+    CHECK_EQ(back[9].timeUS - back[0].timeUS, 90000u);
+  }
+}
+
+int main()
+{
+  char dir[] = "/tmp/digame_rawXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  SD.hostSetRoot(dir);
+  initLIDAR(true);
+
+  testRoundTrip();
+  testSlowCard();
+  testPolledLIDAR();
+  return TEST_REPORT();
+}
@@ -0,0 +1,238 @@
+/* test_replay.cpp
+ *
+ *  The replay engine: traces load from every format the tool takes, with
+ *  the right readings and times; each one replays as if on a freshly booted
+ *  counter, whatever ran before it, so the results are the same for 1, 3 or
+ *  8 threads and the same as the detector gives when run directly. The pool
+ *  runs every task exactly once, with idle threads stealing from busy ones.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "../tools/digameReplay.h"
+
+#include <random>
+
+#include "hostTest.h"
+
+static std::string dir;
+
+// Empty road with a vehicle now and then, in either lane.
+static std::vector<int16_t> makeDistances(long n, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<int16_t> trace(300, 999);
+  while ((long)trace.size() < n)
+  {
+    int quiet = 200 + (int)(rng() % 300);
+    for (int i = 0; i < quiet; i++) trace.push_back((int16_t)(999 + (int)(rng() % 5) - 2));
+    int car = (rng() % 2) ? 150 + (int)(rng() % 100) : 450 + (int)(rng() % 150);
+    int length = 60 + (int)(rng() % 90);
+    for (int i = 0; i < length; i++) trace.push_back((int16_t)(car + (int)(rng() % 21) - 10));
+  }
+  trace.insert(trace.end(), 300, 999);
+  return trace;
+}
+
+static std::string path(const char *name) { return dir + "/" + name; }
+
+//****************************************************************************************
+// One trace in each format.
+static void writeTraces(const std::vector<int16_t> &d)
+{
+  FILE *fp = fopen(path("site.csv").c_str(), "w"); // As from rawlog2csv, 20 ms apart
+  fprintf(fp, "timeUS,dist,flux,temp\n");
+  for (size_t i = 0; i < d.size(); i++) fprintf(fp, "%llu,%d,%d,%d\n", 5000000000ULL + i * 20000, d[i], 900, 31);
+  fclose(fp);
+
+  fp = fopen(path("plain.csv").c_str(), "w");
+  for (size_t i = 0; i < 1000; i++) fprintf(fp, "%d\n", d[i]);
+  fclose(fp);
+
+  fp = fopen(path("benewake.txt").c_str(), "w");
+  fprintf(fp, "Dist    Strength    Reserved                \n");
+  for (size_t i = 0; i < 1000; i++) fprintf(fp, "%d    %d    0\n", d[i], 1200);
+  fclose(fp);
+
+  fp = fopen(path("messages.json").c_str(), "w"); // Vehicle messages with rawSignal
+  for (int m = 0; m < 3; m++)
+  {
+    fprintf(fp, "{\"deviceName\":\"Counter\",\"lane\":\"%d\",\"rawSignal\":[", m + 1);
+    for (int i = 0; i < 150; i++) fprintf(fp, "%s%d", i ? "," : "", d[m * 150 + i]);
+    fprintf(fp, "]}\n");
+  }
+  fclose(fp);
+
+  SD.hostSetRoot(dir.c_str());
+  CHECK(startRawLog("/rawdata.bin"));
+  for (size_t i = 0; i < 5000; i++)
+  {
+    while (rawLogPending >= 0) delay(1); // Let the writer keep up: no drops here.
+    logRawSample(4294000000u + i * 10000, d[i], 800, 29); // Across the wrap of micros()
+  }
+  stopRawLog();
+}
+
+static std::vector<ReplayTrace> load(const char *name)
+{
+  std::vector<ReplayTrace> traces;
+  std::string error;
+  CHECK(loadReplayTraces(path(name), traces, error));
+  return traces;
+}
+
+static void testLoad(const std::vector<int16_t> &d)
+{
+  std::vector<ReplayTrace> t = load("site.csv");
+  CHECK_EQ(t.size(), (size_t)1);
+  CHECK_EQ(t[0].samples.size(), d.size());
+  CHECK_EQ(t[0].samples[7].dist, d[7]);
+  CHECK_EQ(t[0].samples[7].flux, 900);
+  CHECK_EQ(t[0].samples[7].temp, 31);
+  CHECK_EQ((uint32_t)(t[0].samples[8].timeUS - t[0].samples[7].timeUS), 20000u);
+
+  t = load("plain.csv");
+  CHECK_EQ(t[0].samples.size(), (size_t)1000);
+  CHECK_EQ(t[0].samples[999].dist, d[999]);
+  CHECK_EQ(t[0].samples[999].timeUS, 999 * replayIntervalUS);
+
+  t = load("benewake.txt");
+  CHECK_EQ(t[0].samples.size(), (size_t)1000);
+  CHECK_EQ(t[0].samples[3].dist, d[3]);
+  CHECK_EQ(t[0].samples[3].flux, 1200);
+
+  t = load("messages.json");
+  CHECK_EQ(t.size(), (size_t)3);
+  CHECK(t[2].name == path("messages.json") + "#3");
+  CHECK_EQ(t[2].samples.size(), (size_t)150);
+  CHECK_EQ(t[2].samples[0].dist, d[300]);
+
+  t = load("rawdata.bin");
+  CHECK_EQ(t[0].samples.size(), (size_t)5000);
+  CHECK_EQ(t[0].samples[4999].dist, d[4999]);
+  CHECK_EQ(t[0].samples[4999].timeUS, 4294000000u + 4999u * 10000u);
+
+  std::vector<ReplayTrace> none;
+  std::string error;
+  CHECK(!loadReplayTraces(path("missing.csv"), none, error));
+  CHECK(error.find("missing.csv") != std::string::npos);
+}
+
+//****************************************************************************************
+static bool same(const ReplayResult &a, const ReplayResult &b)
+{
+  if (!a.ok || !b.ok || (a.events.size() != b.events.size())) return false;
+  for (size_t i = 0; i < a.events.size(); i++)
+  {
+    if ((a.events[i].reading != b.events[i].reading) || (a.events[i].lane != b.events[i].lane) ||
+        (a.events[i].timeUS != b.events[i].timeUS))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void testDeterminism(size_t siteReadings, std::vector<ReplayResult> &first)
+{
+  // The site trace three times, among the others: each run must start afresh.
+  std::vector<std::string> files;
+  for (const char *name : {"site.csv", "plain.csv", "site.csv", "benewake.txt", "messages.json",
+                           "rawdata.bin", "site.csv", "missing.csv"})
+  {
+    files.push_back(path(name));
+  }
+
+  ReplayPool pool;
+  for (const std::vector<ReplayResult> &file : replayFiles(files, 1, pool))
+  {
+    first.insert(first.end(), file.begin(), file.end());
+  }
+  CHECK_EQ(first.size(), (size_t)10); // The messages hold three traces
+  for (size_t i = 0; i + 1 < first.size(); i++) CHECK(first[i].ok);
+  CHECK(!first[9].ok); // Missing, and said so
+  CHECK(first[9].name == path("missing.csv"));
+  CHECK(first[6].name == path("messages.json") + "#3");
+  CHECK_EQ(first[0].readings, siteReadings);
+  CHECK_EQ(first[6].readings, (size_t)150);
+  CHECK(first[0].events.size() > 10);
+  CHECK(same(first[0], first[2]));
+  CHECK(same(first[0], first[8]));
+
+  for (int threads : {3, 8})
+  {
+    std::vector<ReplayResult> results;
+    for (const std::vector<ReplayResult> &file : replayFiles(files, threads, pool))
+    {
+      results.insert(results.end(), file.begin(), file.end());
+    }
+    bool all = (results.size() == first.size());
+    for (size_t i = 0; all && i + 1 < results.size(); i++) all = same(results[i], first[i]);
+    CHECK(all);
+  }
+}
+
+//****************************************************************************************
+// Run directly in this process, which hasn't run a detector yet: as the replay saw it.
+static void testMatchesDirect(const ReplayResult &replayed)
+{
+  ReplayTrace trace = load("site.csv")[0];
+  ReplayResult direct;
+  direct.ok = true;
+  uint64_t timeUS = micros();
+  for (uint32_t i = 0; i < trace.samples.size(); i++)
+  {
+    if (i > 0) timeUS += (uint32_t)(trace.samples[i].timeUS - trace.samples[i - 1].timeUS);
+    hostSetMicros(timeUS);
+    processLIDARSamples(getRuntimeConfig(), &trace.samples[i], 1,
+                        [&](int lane) { direct.events.push_back({i, lane, trace.samples[i].timeUS}); });
+  }
+  CHECK(same(direct, replayed));
+}
+
+//****************************************************************************************
+// Every task exactly once; the work of a slow thread is stolen by the others.
+static void testPool()
+{
+  ReplayPool pool;
+  const size_t n = 200;
+  std::vector<std::atomic<int>> runs(n);
+  pool.run(n, 4, [&](size_t i) {
+    runs[i]++;
+    if (i < n / 4) std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Thread 0's share
+  });
+
+  bool once = true;
+  for (size_t i = 0; i < n; i++) once &= (runs[i] == 1);
+  CHECK(once);
+
+  unsigned long tasks = 0, steals = 0;
+  for (const ReplayPool::WorkerStats &s : pool.workerStats())
+  {
+    tasks += s.tasks;
+    steals += s.steals;
+  }
+  CHECK_EQ(tasks, (unsigned long)n);
+  CHECK(steals > 0);
+  CHECK(pool.workerStats()[0].tasks < n / 4);
+}
+
+int main()
+{
+  char tmp[] = "/tmp/digame_replayXXXXXX";
+  CHECK(mkdtemp(tmp) != nullptr);
+  dir = tmp;
+  Serial.hostSetEcho(false);
+  publishRuntimeConfig(config);
+  selectLIDARDetectors(getRuntimeConfig());
+
+  std::vector<int16_t> d = makeDistances(20000, 1);
+  writeTraces(d);
+  testLoad(d);
+
+  std::vector<ReplayResult> results;
+  testDeterminism(d.size(), results);
+  testMatchesDirect(results[0]);
+  testPool();
+  return TEST_REPORT();
+}
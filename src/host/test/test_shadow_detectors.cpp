@@ -0,0 +1,219 @@
+/* test_shadow_detectors.cpp
+ *
+ *  Shadow mode: every pair of detectors, counting and shadow, on a roadside
+ *  trace. The counting one must report exactly what it reports alone, the
+ *  shadow must see as many vehicles as it does when it's counting, and the
+ *  disagreements must account for the difference. A single short blip that
+ *  the detectors see differently must be logged with the right detectors,
+ *  lane and readings; the log must stay bounded and the page must list it.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameDetectors.h>
+
+#include <random>
+#include <vector>
+
+#include "hostTest.h"
+
+struct Event
+{
+  long at;
+  int lane;
+};
+
+//****************************************************************************************
+// Empty road at 999 cm, one vehicle at a time in either lane for 0.6-1.5 s at 100 Hz,
+// with noise and the odd dropout.
+static std::vector<int16_t> makeTrace(long n, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<int16_t> trace(500, 999);
+  while ((long)trace.size() < n)
+  {
+    int quiet = 200 + (int)(rng() % 400);
+    for (int i = 0; i < quiet; i++) trace.push_back((int16_t)(999 + (int)(rng() % 5) - 2));
+    int car = (rng() % 2) ? 150 + (int)(rng() % 100) : 450 + (int)(rng() % 150);
+    int length = 60 + (int)(rng() % 90);
+    for (int i = 0; i < length; i++)
+    {
+      int d = car + (int)(rng() % 21) - 10;
+      if (rng() % 50 == 0) d = 0;
+      trace.push_back((int16_t)d);
+    }
+  }
+  trace.insert(trace.end(), 500, 999);
+  return trace;
+}
+
+// Counting with detectors (the first counts), in batches of 32 readings at 100 Hz.
+static std::vector<Event> run(const std::vector<int16_t> &trace, const char *detectors)
+{
+  Config c = config;
+  String names = detectors;
+  int comma = names.indexOf(',');
+  c.lidarDetectionAlgorithm = (comma < 0) ? names : names.substring(0, comma);
+  c.lidarShadowDetectors = (comma < 0) ? String("") : names.substring(comma + 1);
+  selectLIDARDetectors(buildRuntimeConfig(c));
+
+  std::vector<Event> events;
+  LIDARSample samples[32];
+  long b = 0;
+  for (size_t t = 0; t < trace.size(); t += 32, b++)
+  {
+    int n = 0;
+    for (; (n < 32) && (t + n < trace.size()); n++)
+    {
+      samples[n].dist = trace[t + n];
+      samples[n].flux = 1000;
+      samples[n].temp = 30;
+      samples[n].status = TFMP_READY;
+      samples[n].timeUS = micros();
+      delay(10);
+    }
+    processLIDARSamples(getRuntimeConfig(), samples, n, [&](int lane) { events.push_back({b, lane}); });
+  }
+  return events;
+}
+
+static bool same(const std::vector<Event> &a, const std::vector<Event> &b)
+{
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++)
+  {
+    if ((a[i].at != b[i].at) || (a[i].lane != b[i].lane)) return false;
+  }
+  return true;
+}
+
+//****************************************************************************************
+static void testPairs()
+{
+  std::vector<int16_t> trace = makeTrace(60000, 1);
+  std::vector<int16_t> settle(500, 999); // Empty road between runs, so each starts idle
+
+  std::vector<Event> alone[DETECT_ALGORITHMS];
+  for (int a = 0; a < DETECT_ALGORITHMS; a++)
+  {
+    run(settle, detectionAlgorithmNames[a]);
+    alone[a] = run(trace, detectionAlgorithmNames[a]);
+  }
+
+  for (int a = 0; a < DETECT_ALGORITHMS; a++)
+  {
+    for (int b = 0; b < DETECT_ALGORITHMS; b++)
+    {
+      if (a == b) continue;
+      String names = String(detectionAlgorithmNames[a]) + "," + detectionAlgorithmNames[b];
+      run(settle, names.c_str());
+      std::vector<Event> events = run(trace, names.c_str());
+
+      // What's matched on one side is matched on the other.
+      long matched = (long)lidarShadowLog.reported(0) - (long)lidarShadowLog.missed(1);
+      fprintf(stderr, "%-24s %4lu and %4lu vehicles, %4ld matched, %3lu logged\n", names.c_str(),
+              lidarShadowLog.reported(0), lidarShadowLog.reported(1), matched,
+              lidarShadowLog.total());
+      CHECK(same(events, alone[a]));
+      CHECK_EQ(lidarShadowLog.reported(0), (unsigned long)alone[a].size());
+      CHECK_EQ(lidarShadowLog.reported(1), (unsigned long)alone[b].size());
+      CHECK_EQ(matched, (long)lidarShadowLog.reported(1) - (long)lidarShadowLog.missed(0));
+      CHECK_EQ(lidarShadowLog.waiting(), 0);
+    }
+  }
+
+  // Three at once: the counting one still isn't disturbed.
+  run(settle, "Decay,Threshold,Correlation");
+  CHECK(same(run(trace, "Decay,Threshold,Correlation"), alone[DETECT_DECAY]));
+  CHECK_EQ(lidarShadowLog.reported(1), (unsigned long)alone[DETECT_THRESHOLD].size());
+  CHECK_EQ(lidarShadowLog.reported(2), (unsigned long)alone[DETECT_CORRELATION].size());
+}
+
+//****************************************************************************************
+// Four readings at 200 cm. The decay detector counts it in lane 1; the correlation one
+// sees nothing much in a 100 reading window.
+static void testBlip()
+{
+  std::vector<int16_t> trace(600, 999);
+  for (int i = 300; i < 304; i++) trace[i] = 200;
+  run(std::vector<int16_t>(500, 999), "Decay,Correlation");
+  std::vector<Event> events = run(trace, "Decay,Correlation");
+
+  CHECK_EQ(events.size(), (size_t)1);
+  CHECK_EQ(lidarShadowLog.total(), 1UL);
+  CHECK_EQ(lidarShadowLog.size(), 1);
+  const DetectorDisagreement &d = lidarShadowLog[0];
+  CHECK_EQ(d.counted, DETECT_DECAY);
+  CHECK_EQ(d.missed, DETECT_CORRELATION);
+  CHECK_EQ(d.lane, 1);
+  CHECK_EQ(d.historySize, shadowHistorySize);
+
+  // The blip is in the readings, just before the detector let go of it.
+  int blip = 0;
+  for (int k = 0; k < d.historySize; k++) blip += (d.history[k] == 200);
+  CHECK_EQ(blip, 4);
+  CHECK_EQ(d.history[d.historySize - 1], 999);
+
+  String page = lidarShadowLog.toString();
+  CHECK(page.indexOf("# Decay (counting): 1 vehicles, missed 0\n") >= 0);
+  CHECK(page.indexOf("# Correlation: 0 vehicles, missed 1\n") >= 0);
+  CHECK(page.indexOf(", Decay, Correlation, 1, 999") >= 0);
+}
+
+//****************************************************************************************
+// A shadow that disagrees all the time: the log keeps the latest, oldest first.
+static void testBounded()
+{
+  std::vector<int16_t> trace = makeTrace(60000, 2);
+  run(std::vector<int16_t>(500, 999), "Decay,Threshold");
+  run(trace, "Decay,Threshold");
+
+  CHECK(lidarShadowLog.total() > (unsigned long)shadowLogSize);
+  CHECK_EQ(lidarShadowLog.size(), shadowLogSize);
+  bool ordered = true;
+  for (int i = 1; i < lidarShadowLog.size(); i++)
+  {
+    ordered &= (lidarShadowLog[i].timeMS >= lidarShadowLog[i - 1].timeMS);
+  }
+  CHECK(ordered);
+
+  lidarShadowLog.clear();
+  CHECK_EQ(lidarShadowLog.size(), 0);
+  CHECK_EQ(lidarShadowLog.total(), 0UL);
+}
+
+//****************************************************************************************
+static void testConfig()
+{
+  Config c;
+  c.lidarDetectionAlgorithm = "Decay";
+  c.lidarShadowDetectors = " threshold , Decay,Bogus, CORRELATION, Voting";
+  RuntimeConfig rc = buildRuntimeConfig(c);
+  CHECK_EQ(rc.lidarShadowCount, 2); // Not the counting one, nothing unknown, two at most
+  CHECK_EQ(rc.lidarShadowDetectors[0], DETECT_THRESHOLD);
+  CHECK_EQ(rc.lidarShadowDetectors[1], DETECT_CORRELATION);
+  selectLIDARDetectors(rc);
+  CHECK_EQ(getShadowDetectorCount(), 2);
+
+  c.lidarShadowDetectors = "None";
+  selectLIDARDetectors(buildRuntimeConfig(c));
+  CHECK_EQ(getShadowDetectorCount(), 0);
+}
+
+int main()
+{
+  char dir[] = "/tmp/digame_shadowXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  SD.hostSetRoot(dir);
+  config.lidarZone1Min = "0";
+  config.lidarZone1Max = "300";
+  config.lidarZone2Min = "400";
+  config.lidarZone2Max = "700";
+  publishRuntimeConfig(config);
+
+  testConfig();
+  testPairs();
+  testBlip();
+  testBounded();
+  return TEST_REPORT();
+}
@@ -0,0 +1,235 @@
+/* test_tfmini_parser.cpp
+ *
+ *  Fuzzes TFMiniParser with a mix of good frames, line noise, frames with a
+ *  corrupted payload and frames cut short, fed in random-sized chunks. Every
+ *  good frame must come out, in order, and the counters must account for
+ *  the damage. Pure random bytes must give the same result however they
+ *  are chunked.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameTFMiniParser.h>
+
+#include <random>
+#include <vector>
+
+#include "hostTest.h"
+
+struct Reading
+{
+  int16_t dist, flux, temp;
+  uint8_t status;
+  bool operator==(const Reading &o) const
+  {
+    return dist == o.dist && flux == o.flux && temp == o.temp && status == o.status;
+  }
+};
+
+struct Result
+{
+  std::vector<Reading> readings;
+  TFMiniStats stats;
+};
+
+//****************************************************************************************
+// Parse the stream in chunks of 1..maxChunk bytes (or in one go if maxChunk is 0).
+static Result parseChunked(const std::vector<uint8_t> &stream, size_t maxChunk, std::mt19937 &rng)
+{
+  Result result;
+  TFMiniParser parser;
+  auto onFrame = [&](const uint8_t *frame) {
+    Reading r;
+    r.status = decodeTFMiniFrame(frame, r.dist, r.flux, r.temp);
+    result.readings.push_back(r);
+  };
+
+  size_t pos = 0;
+  while (pos < stream.size())
+  {
+    size_t n = (maxChunk == 0) ? stream.size() : 1 + rng() % maxChunk;
+    if (n > stream.size() - pos) n = stream.size() - pos;
+    parser.parse(stream.data() + pos, n, onFrame);
+    pos += n;
+  }
+  result.stats = parser.stats;
+  return result;
+}
+
+//****************************************************************************************
+static bool hasHeaderByte(const uint8_t *frame)
+{
+  for (int i = 2; i < TFMP_FRAME_SIZE; i++)
+  {
+    if (frame[i] == TFMINI_HEADER) return true;
+  }
+  return false;
+}
+
+//****************************************************************************************
+// A frame with no 0x59 after the header, so damage can't line up a false header and
+// every count below is exact.
+static void makeFrame(std::mt19937 &rng, uint8_t *frame, Reading &r)
+{
+  do
+  {
+    int16_t dist = (rng() % 25 == 0) ? -1 : (int16_t)(rng() % 1200);
+    int16_t flux = (int16_t)(rng() % 30000);
+    int16_t temp = (int16_t)(rng() % 60);
+    TFMPlus::hostEncodeFrame(frame, dist, flux, temp);
+  } while (hasHeaderByte(frame));
+  r.status = decodeTFMiniFrame(frame, r.dist, r.flux, r.temp);
+}
+
+//****************************************************************************************
+static void testMixedStream()
+{
+  std::mt19937 rng(1234);
+  std::vector<uint8_t> stream;
+  std::vector<Reading> expected;
+  unsigned long checksumErrors = 0, weak = 0;
+
+  for (int i = 0; i < 20000; i++)
+  {
+    uint8_t frame[TFMP_FRAME_SIZE];
+    Reading r;
+    makeFrame(rng, frame, r);
+
+    switch (rng() % 20)
+    {
+    case 0: // Line noise
+      for (int n = 1 + rng() % 12; n > 0; n--)
+      {
+        uint8_t b;
+        do b = (uint8_t)rng(); while (b == TFMINI_HEADER);
+        stream.push_back(b);
+      }
+      break;
+
+    case 1: // Corrupted payload: the header survives, the checksum fails
+    {
+      int at = 2 + rng() % (TFMP_FRAME_SIZE - 2);
+      uint8_t flip;
+      do flip = (uint8_t)(1 << (rng() % 8)); while ((frame[at] ^ flip) == TFMINI_HEADER);
+      frame[at] ^= flip;
+      stream.insert(stream.end(), frame, frame + TFMP_FRAME_SIZE);
+      checksumErrors++;
+      continue;
+    }
+
+    case 2: // Cut short: the next frame's header arrives mid-frame
+    {
+      // Now and then the 9 bytes from the cut frame's header happen to checksum
+      // (the sensor's 8-bit checksum can't catch everything). Pick another next
+      // frame when that happens so the expected output is exact.
+      std::vector<uint8_t> cut(frame, frame + 2 + rng() % (TFMP_FRAME_SIZE - 2));
+      Result check;
+      do
+      {
+        makeFrame(rng, frame, r);
+        std::vector<uint8_t> both(cut);
+        both.insert(both.end(), frame, frame + TFMP_FRAME_SIZE);
+        check = parseChunked(both, 0, rng);
+      } while (!(check.readings.size() == 1 && check.readings[0] == r));
+      stream.insert(stream.end(), cut.begin(), cut.end());
+      checksumErrors += check.stats.checksumErrors;
+      break;
+    }
+    }
+
+    stream.insert(stream.end(), frame, frame + TFMP_FRAME_SIZE);
+    expected.push_back(r);
+    if (r.dist == -1) weak++;
+  }
+
+  Result whole = parseChunked(stream, 0, rng);
+  CHECK(whole.readings == expected);
+  CHECK_EQ(whole.stats.frames, (unsigned long)expected.size());
+  CHECK_EQ(whole.stats.checksumErrors, checksumErrors);
+  CHECK_EQ(whole.stats.weak, weak);
+  CHECK(whole.stats.resyncs > 0);
+  CHECK(whole.stats.bytesDiscarded > 0);
+
+  const size_t chunkSizes[] = {1, 2, 8, 9, 10, 17, 64, 500};
+  for (size_t maxChunk : chunkSizes)
+  {
+    Result chunked = parseChunked(stream, maxChunk, rng);
+    CHECK(chunked.readings == expected);
+    CHECK_EQ(chunked.stats.checksumErrors, whole.stats.checksumErrors);
+    CHECK_EQ(chunked.stats.resyncs, whole.stats.resyncs);
+    CHECK_EQ(chunked.stats.bytesDiscarded, whole.stats.bytesDiscarded);
+  }
+}
+
+//****************************************************************************************
+// Joining mid-stream: the first partial frame is skipped, everything after it is found.
+static void testJoinMidStream()
+{
+  std::mt19937 rng(99);
+  for (int skip = 0; skip < TFMP_FRAME_SIZE; skip++)
+  {
+    std::vector<uint8_t> stream;
+    std::vector<Reading> expected;
+    for (int i = 0; i < 10; i++)
+    {
+      uint8_t frame[TFMP_FRAME_SIZE];
+      Reading r;
+      makeFrame(rng, frame, r);
+      stream.insert(stream.end(), frame, frame + TFMP_FRAME_SIZE);
+      if (i > 0 || skip == 0) expected.push_back(r);
+    }
+    stream.erase(stream.begin(), stream.begin() + skip);
+
+    Result result = parseChunked(stream, 3, rng);
+    CHECK(result.readings == expected);
+    CHECK_EQ(result.stats.bytesDiscarded, (unsigned long)(skip ? TFMP_FRAME_SIZE - skip : 0));
+  }
+}
+
+//****************************************************************************************
+// Garbage in: no crashes, and chunking makes no difference.
+static void testRandomBytes()
+{
+  std::mt19937 rng(42);
+  for (int round = 0; round < 50; round++)
+  {
+    std::vector<uint8_t> stream(4096);
+    for (uint8_t &b : stream)
+    {
+      b = (rng() % 4 == 0) ? TFMINI_HEADER : (uint8_t)rng(); // Plenty of false headers
+    }
+
+    Result whole = parseChunked(stream, 0, rng);
+    Result chunked = parseChunked(stream, 1 + rng() % 40, rng);
+    CHECK(chunked.readings == whole.readings);
+    CHECK_EQ(chunked.stats.frames, whole.stats.frames);
+    CHECK_EQ(chunked.stats.checksumErrors, whole.stats.checksumErrors);
+    CHECK_EQ(chunked.stats.bytesDiscarded, whole.stats.bytesDiscarded);
+  }
+}
+
+//****************************************************************************************
+static void testReset()
+{
+  uint8_t frame[TFMP_FRAME_SIZE];
+  TFMPlus::hostEncodeFrame(frame, 300, 1000, 30);
+
+  TFMiniParser parser;
+  int frames = 0;
+  auto onFrame = [&](const uint8_t *) { frames++; };
+
+  parser.parse(frame, 5, onFrame); // Half a frame, then the sensor is reset
+  parser.reset();
+  parser.parse(frame, sizeof(frame), onFrame);
+  CHECK_EQ(frames, 1);
+  CHECK_EQ(parser.stats.checksumErrors, 0UL);
+}
+
+int main()
+{
+  testMixedStream();
+  testJoinMidStream();
+  testRandomBytes();
+  testReset();
+  return TEST_REPORT();
+}
@@ -0,0 +1,202 @@
+/* autotune.cpp
+ *
+ *  Finds the detector parameters that count a site's labeled traces best
+ *  (see digameTuner.h for the labels and the scoring):
+ *
+ *    autotune [-d detector] [-p params.txt] [-t key=low:high:step]...
+ *             [-b evaluations] [-B batch] [-j threads] [-w window s]
+ *             [-L max latency s] [-o PARAMS.TXT] <labeled trace or directory>...
+ *
+ *  -d  The detector to tune (default: the one in params.txt, or Decay)
+ *  -p  The counter's PARAMS.TXT: zones and anything not being tuned
+ *  -t  A parameter to tune and its range; repeat for more. Without any,
+ *      the ones the detector uses, over their usual ranges.
+ *  -b  Bayesian search with this many evaluations (default: a grid search
+ *      of every step)
+ *  -B  Settings tried at once in the Bayesian search (default 8)
+ *  -w  How long after a vehicle has left it may be counted (default 2 s)
+ *  -L  Pick the most accurate setting that counts within this time
+ *  -o  Write the base parameters with the picked setting, as PARAMS.TXT
+ *
+ *  Traces are the files that have a .labels file alongside. Prints the
+ *  Pareto front of accuracy (F1) against latency, and the picked setting
+ *  as a lidar section for PARAMS.TXT.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "digameTuner.h"
+
+#include <filesystem>
+
+#include <stdlib.h>
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-d detector] [-p params.txt] [-t key=low:high:step]... [-b evaluations] [-B batch]\n"
+          "       [-j threads] [-w window s] [-L max latency s] [-o PARAMS.TXT] <labeled trace or directory>...\n",
+          name);
+}
+
+static bool hasLabels(const std::string &path)
+{
+  return std::filesystem::is_regular_file(path + ".labels");
+}
+
+int main(int argc, char **argv)
+{
+  const char *detector = nullptr;
+  const char *params = nullptr;
+  const char *output = nullptr;
+  std::vector<TuneDimension> dims;
+  int evaluations = 0, batch = 8;
+  int threads = (int)std::thread::hardware_concurrency();
+  double window = tuneWindowUS / 1e6, maxLatency = 1e9;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:p:t:b:B:j:w:L:o:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'd': detector = optarg; break;
+    case 'p': params = optarg; break;
+    case 'o': output = optarg; break;
+    case 'b': evaluations = atoi(optarg); break;
+    case 'B': batch = std::max(1, atoi(optarg)); break;
+    case 'j': threads = std::max(1, atoi(optarg)); break;
+    case 'w': window = atof(optarg); break;
+    case 'L': maxLatency = atof(optarg); break;
+    case 't':
+    {
+      TuneDimension dim;
+      std::string error;
+      if (!parseTuneDimension(optarg, dim, error))
+      {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+      }
+      dims.push_back(dim);
+      break;
+    }
+    default: usage(argv[0]); return 2;
+    }
+  }
+  if (optind >= argc)
+  {
+    usage(argv[0]);
+    return 2;
+  }
+  if (threads < 1) threads = 1;
+
+  Serial.hostSetEcho(false);
+
+  if (params)
+  {
+    std::filesystem::path p = std::filesystem::absolute(params);
+    if (!std::filesystem::is_regular_file(p))
+    {
+      fprintf(stderr, "%s: no such file\n", params);
+      return 1;
+    }
+    SD.hostSetRoot(p.parent_path().string().c_str());
+    loadConfiguration(("/" + p.filename().string()).c_str(), config);
+  }
+  if (detector) config.lidarDetectionAlgorithm = detector;
+  RuntimeConfig rc = buildRuntimeConfig(config);
+  config.lidarDetectionAlgorithm = detectionAlgorithmNames[rc.lidarDetectionAlgorithm]; // As it'll be saved
+  if (dims.empty()) dims = defaultTuneDimensions(rc.lidarDetectionAlgorithm);
+
+  Config base = config; // Quietly, on its own
+  base.lidarShadowDetectors = "";
+  base.showDataStream = "false";
+
+  // The labeled traces, in name order.
+  std::vector<std::string> files;
+  for (int i = optind; i < argc; i++)
+  {
+    std::error_code ec;
+    if (std::filesystem::is_directory(argv[i], ec))
+    {
+      for (const auto &entry : std::filesystem::recursive_directory_iterator(argv[i], ec))
+      {
+        std::string path = entry.path().string();
+        if (entry.is_regular_file() && (entry.path().extension() != ".labels") && hasLabels(path)) files.push_back(path);
+      }
+    }
+    else if (hasLabels(argv[i]))
+    {
+      files.push_back(argv[i]);
+    }
+    else
+    {
+      fprintf(stderr, "%s: no %s.labels, skipped\n", argv[i], argv[i]);
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  std::vector<LabeledTrace> traces;
+  long readings = 0, vehicles = 0;
+  for (const std::string &file : files)
+  {
+    std::vector<ReplayTrace> loaded;
+    std::vector<TuneLabel> labels;
+    std::string error;
+    if (!loadReplayTraces(file, loaded, error) || !loadTuneLabels(file + ".labels", labels, error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    if (loaded.size() != 1)
+    {
+      fprintf(stderr, "%s: holds %zu traces; label files with one trace each\n", file.c_str(), loaded.size());
+      continue;
+    }
+    readings += loaded[0].samples.size();
+    vehicles += labels.size();
+    traces.push_back({std::move(loaded[0]), std::move(labels)});
+  }
+  if (traces.empty())
+  {
+    fprintf(stderr, "No labeled traces.\n");
+    return 1;
+  }
+
+  fprintf(stderr, "Tuning %s on %zu traces, %ld readings, %ld labeled vehicles, %d threads\n",
+          base.lidarDetectionAlgorithm.c_str(), traces.size(), readings, vehicles, threads);
+  auto start = std::chrono::steady_clock::now();
+  DetectorTuner tuner(base, dims, traces, threads, (uint32_t)(window * 1e6));
+  if (evaluations > 0) tuner.bayesian(evaluations, batch);
+  else tuner.grid();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  fprintf(stderr, "%zu settings in %.1f s (%.0f readings/s)\n", tuner.results().size(), seconds,
+          tuner.results().size() * (double)readings / seconds);
+
+  // The front
+  printf("# Pareto front, quickest first\n#");
+  for (const TuneDimension &d : dims) printf(" %14s", d.key);
+  printf(" %8s %9s %7s %9s %8s %8s\n", "F1", "precision", "recall", "latency", "false", "missed");
+  for (const TunePoint &p : tuner.paretoFront())
+  {
+    printf(" ");
+    for (size_t i = 0; i < dims.size(); i++) printf(" %14s", DetectorTuner::format(dims[i], p.values[i]).c_str());
+    printf(" %8.4f %9.4f %7.4f %8.2fs %8ld %8ld\n", p.score.f1(), p.score.precision(), p.score.recall(),
+           p.score.latency(), p.score.falseAlarms, p.score.missed);
+  }
+
+  TunePoint best = tuner.best(maxLatency);
+  if (best.score.failures) fprintf(stderr, "%ld traces failed to replay\n", best.score.failures);
+  printf("\n# Picked: F1 %.4f, latency %.2f s. For PARAMS.TXT:\n%s\n", best.score.f1(), best.score.latency(),
+         tuner.fragment(best.values).c_str());
+
+  if (output)
+  {
+    std::filesystem::path p = std::filesystem::absolute(output);
+    Config tuned = config;
+    tuner.apply(tuned, best.values);
+    SD.hostSetRoot(p.parent_path().string().c_str());
+    saveConfiguration(("/" + p.filename().string()).c_str(), tuned);
+    fprintf(stderr, "Wrote %s\n", p.string().c_str());
+  }
+  return 0;
+}
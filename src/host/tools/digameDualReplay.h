@@ -0,0 +1,139 @@
+/* digameDualReplay.h
+ *
+ *  Traces from the two-sensor people counter, for the dualreplay tool and
+ *  its test. The counter's [T]race output prints the pairs of readings it
+ *  decides on, as CSV:
+ *
+ *    timeUS,dist1,dist2
+ *    1234567890,231,88
+ *    1234577890,-1,90     <- no reading from sensor 1 for that tick
+ *
+ *  Capture it from the Bluetooth or USB serial port to a file and the
+ *  passage engine (digameDualLIDARPassages.h) runs over it here exactly as
+ *  it did on the bus -- alongside DualLIDARDirection, for comparison.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_DUAL_REPLAY_H__
+#define __DIGAME_DUAL_REPLAY_H__
+
+#include <digameDualLIDARPassages.h>
+
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
+struct DualTrace
+{
+  std::string name;
+  std::vector<LIDARPair> pairs;
+};
+
+struct DualReplayResult
+{
+  std::vector<DualLIDARPassage> passages;
+  int counts[3] = {0, 0, 0};          // By direction (OUTBOUND, INBOUND)
+  int firstSeenCounts[3] = {0, 0, 0}; // What DualLIDARDirection made of it
+  unsigned long unmatched[2] = {0, 0};
+  unsigned long loitering = 0;
+};
+
+//****************************************************************************************
+// A line of getLIDARPairCSV() back into a pair.
+static bool parseDualTraceLine(const char *line, LIDARPair &p)
+{
+  unsigned long long timeUS;
+  int dist[2];
+  if (sscanf(line, "%llu,%d,%d", &timeUS, &dist[0], &dist[1]) != 3) return false;
+  p.timeUS = (uint32_t)timeUS;
+  for (int c = 0; c < 2; c++)
+  {
+    p.sample[c] = {p.timeUS, (int16_t)((dist[c] < 0) ? 0 : dist[c]), 0, 0,
+                   (uint8_t)((dist[c] < 0) ? TFMP_HEADER : TFMP_READY)};
+  }
+  return true;
+}
+
+//****************************************************************************************
+// Load a trace. Lines that aren't a pair (the header, menu output) are passed over.
+// Returns false (with error) if the file can't be read or has no pairs.
+bool loadDualTrace(const std::string &path, DualTrace &trace, std::string &error)
+{
+  FILE *fp = fopen(path.c_str(), "r");
+  if (!fp)
+  {
+    error = path + ": can't open";
+    return false;
+  }
+  trace.name = path;
+  trace.pairs.clear();
+  char line[256];
+  LIDARPair p;
+  while (fgets(line, sizeof(line), fp))
+  {
+    if (parseDualTraceLine(line, p)) trace.pairs.push_back(p);
+  }
+  fclose(fp);
+  if (trace.pairs.empty())
+  {
+    error = path + ": no readings";
+    return false;
+  }
+  return true;
+}
+
+bool saveDualTrace(const std::string &path, const DualTrace &trace)
+{
+  FILE *fp = fopen(path.c_str(), "w");
+  if (!fp) return false;
+  fprintf(fp, "timeUS,dist1,dist2\n");
+  for (const LIDARPair &p : trace.pairs) fprintf(fp, "%s\n", getLIDARPairCSV(p).c_str());
+  return fclose(fp) == 0;
+}
+
+//****************************************************************************************
+// The passage engine, and DualLIDARDirection with the counter's smoothing factor, over a
+// trace. Runs on as long as it takes the last passage to be decided.
+DualReplayResult replayDualTrace(const DualTrace &trace, const DualLIDARPassageSettings &settings,
+                                 float smoothingFactor = 0.95)
+{
+  DualReplayResult result;
+  DualLIDARPassages engine;
+  engine.settings = settings;
+  DualLIDARDirection firstSeen;
+  firstSeen.distanceThreshold = settings.distanceThreshold;
+  firstSeen.smoothingFactor = smoothingFactor;
+
+  DualLIDARPassage passages[4];
+  auto feed = [&](const LIDARPair &p) {
+    result.firstSeenCounts[firstSeen.update(p)]++;
+    int n = engine.update(p, passages, 4);
+    for (int i = 0; i < n; i++)
+    {
+      result.passages.push_back(passages[i]);
+      result.counts[passages[i].direction]++;
+    }
+  };
+  for (const LIDARPair &p : trace.pairs) feed(p);
+
+  // Empty road after the end, for the runs still waiting.
+  if (!trace.pairs.empty())
+  {
+    LIDARPair p = trace.pairs.back();
+    for (int i = 0; i < 2 * settings.maxLagMS / 10 + settings.maxRunSamples; i++)
+    {
+      p.timeUS += dualLIDARPeriodUS;
+      for (int c = 0; c < 2; c++) p.sample[c] = {p.timeUS, 999, 0, 0, TFMP_READY};
+      feed(p);
+    }
+  }
+  result.counts[TARGET_NONE] = 0;
+  result.firstSeenCounts[TARGET_NONE] = 0;
+  for (int c = 0; c < 2; c++) result.unmatched[c] = engine.unmatched[c];
+  result.loitering = engine.loitering;
+  return result;
+}
+
+#endif // __DIGAME_DUAL_REPLAY_H__
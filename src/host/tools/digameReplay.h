@@ -0,0 +1,578 @@
+/* digameReplay.h
+ *
+ *  Runs the firmware's vehicle detectors over recorded traces in bulk, for
+ *  the replay tool (replay.cpp) and its test.
+ *
+ *  Traces load from:
+ *    - raw LIDAR captures (digameRawLog.h, /rawdata.bin);
+ *    - CSV with a header naming the columns (timeUS, dist, flux, temp --
+ *      rawlog2csv's output), or without one: dist, or timeUS,dist;
+ *    - the Benewake demo software's logs (Dist Strength ..., whitespace
+ *      separated);
+ *    - vehicle messages, one JSON per line: the rawSignal of each one is a
+ *      trace of its own ("file#line").
+ *  Readings without times are taken as 10 ms apart, as the counter reads.
+ *
+ *  The detectors keep their state in statics and in the globals of
+ *  digameLIDAR.h, and none of it can be reset. So each trace runs in a
+ *  fork()ed copy of a process that hasn't run one: every trace starts from
+ *  the same state, whichever thread picks it up and whatever ran before it,
+ *  and the results don't depend on the number of threads. The threads of a
+ *  ReplayPool hand the files out, each from its own queue, stealing half of
+ *  another's when it runs out.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_REPLAY_H__
+#define __DIGAME_REPLAY_H__
+
+#include <digameDetectors.h>
+#include <digameRawLog.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const uint32_t replayIntervalUS = 10000; // Between readings without times (100 Hz)
+
+struct ReplayTrace
+{
+  std::string name;
+  std::vector<LIDARSample> samples;
+};
+
+struct ReplayEvent
+{
+  uint32_t reading; // Index of the reading that completed the vehicle
+  int32_t lane;
+  uint32_t timeUS;  //   and its time
+};
+
+struct ReplayResult
+{
+  std::string name;                // The trace's
+  size_t readings = 0;
+  bool ok = false;                 // false: couldn't load, or the child crashed (see error)
+  std::string error;
+  std::vector<ReplayEvent> events;
+  double detectorSeconds = 0;      // Time in the detector alone, in the child
+};
+
+//****************************************************************************************
+// Loading
+//****************************************************************************************
+
+static LIDARSample replaySample(uint32_t timeUS, int dist, int flux = 1000, int temp = 30)
+{
+  LIDARSample sample;
+  sample.timeUS = timeUS;
+  sample.dist = (int16_t)dist;
+  sample.flux = (int16_t)flux;
+  sample.temp = (int16_t)temp;
+  sample.status = TFMP_READY;
+  return sample;
+}
+
+// The numbers on a line, split on anything but digits, signs and points.
+static int replayNumbers(const char *line, double *values, int max)
+{
+  int n = 0;
+  const char *p = line;
+  while (*p && (n < max))
+  {
+    if (isdigit((unsigned char)*p) || (((*p == '-') || (*p == '.')) && isdigit((unsigned char)p[1])))
+    {
+      char *end;
+      values[n++] = strtod(p, &end);
+      p = end;
+    }
+    else
+    {
+      p++;
+    }
+  }
+  return n;
+}
+
+// Which column of a header line holds a value: the first whose name starts with one of
+// names (ignoring case). -1 if none.
+static int replayColumn(const std::vector<std::string> &header, const char *const *names)
+{
+  for (size_t c = 0; c < header.size(); c++)
+  {
+    for (const char *const *n = names; *n; n++)
+    {
+      if (strncasecmp(header[c].c_str(), *n, strlen(*n)) == 0) return (int)c;
+    }
+  }
+  return -1;
+}
+
+static bool loadRawLogTrace(FILE *fp, ReplayTrace &trace)
+{
+  static thread_local uint8_t block[RAW_LOG_BLOCK_SIZE];
+  while (fread(block, 1, sizeof(block), fp) == sizeof(block))
+  {
+    RawLogBlockHeader header;
+    decodeRawLogBlock(block, header, [&](uint32_t t, int16_t dist, int16_t flux, int16_t temp) {
+      trace.samples.push_back(replaySample(t, dist, flux, temp));
+    }); // Damaged blocks are skipped, as rawlog2csv does.
+  }
+  return true;
+}
+
+// rawSignal arrays from vehicle messages, a trace per line.
+static void loadMessageTraces(FILE *fp, const std::string &name, std::vector<ReplayTrace> &traces)
+{
+  static thread_local char line[65536];
+  int lineNumber = 0;
+  while (fgets(line, sizeof(line), fp))
+  {
+    lineNumber++;
+    const char *p = strstr(line, "\"rawSignal\"");
+    p = p ? strchr(p, '[') : ((line[0] == '[') ? line : nullptr);
+    if (!p) continue;
+
+    ReplayTrace trace;
+    trace.name = name + "#" + std::to_string(lineNumber);
+    const char *end = strchr(p, ']');
+    std::string list(p + 1, end ? end : p + strlen(p));
+    static thread_local double values[4096];
+    int n = replayNumbers(list.c_str(), values, 4096);
+    for (int i = 0; i < n; i++) trace.samples.push_back(replaySample(i * replayIntervalUS, (int)values[i]));
+    traces.push_back(std::move(trace));
+  }
+}
+
+// Columns of numbers, with or without a header.
+static void loadTextTrace(FILE *fp, ReplayTrace &trace)
+{
+  static const char *const timeNames[] = {"timeUS", "time", nullptr};
+  static const char *const distNames[] = {"dist", nullptr};
+  static const char *const fluxNames[] = {"flux", "strength", nullptr};
+  static const char *const tempNames[] = {"temp", nullptr};
+
+  int timeCol = -1, distCol = -1, fluxCol = -1, tempCol = -1;
+  bool haveHeader = false;
+  uint32_t index = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), fp))
+  {
+    double v[16];
+    int n = replayNumbers(line, v, 16);
+    bool text = false;
+    for (const char *p = line; *p; p++) text |= (isalpha((unsigned char)*p) != 0);
+
+    if (text)
+    {
+      if (haveHeader || trace.samples.size()) continue; // Only a header before the data
+      std::vector<std::string> header;
+      for (char *tok = strtok(line, ", \t;\r\n"); tok; tok = strtok(nullptr, ", \t;\r\n")) header.push_back(tok);
+      timeCol = replayColumn(header, timeNames);
+      distCol = replayColumn(header, distNames);
+      fluxCol = replayColumn(header, fluxNames);
+      tempCol = replayColumn(header, tempNames);
+      haveHeader = (distCol >= 0);
+      continue;
+    }
+    if (n == 0) continue;
+
+    if (!haveHeader) // dist, or timeUS,dist (as lanefinder reads)
+    {
+      timeCol = (n >= 2) ? 0 : -1;
+      distCol = (n >= 2) ? 1 : 0;
+    }
+    if (distCol >= n) continue;
+    uint32_t t = (timeCol >= 0 && timeCol < n) ? (uint32_t)(uint64_t)v[timeCol] : index * replayIntervalUS;
+    trace.samples.push_back(replaySample(t, (int)v[distCol],
+                                         (fluxCol >= 0 && fluxCol < n) ? (int)v[fluxCol] : 1000,
+                                         (tempCol >= 0 && tempCol < n) ? (int)v[tempCol] : 30));
+    index++;
+  }
+}
+
+//****************************************************************************************
+// Load the trace(s) in a file onto traces. Returns false (with error) if it can't be read.
+bool loadReplayTraces(const std::string &path, std::vector<ReplayTrace> &traces, std::string &error)
+{
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (!fp)
+  {
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+
+  uint32_t magic = 0;
+  size_t got = fread(&magic, 1, sizeof(magic), fp);
+  rewind(fp);
+
+  char first[4096] = "";
+  if (!fgets(first, sizeof(first), fp)) first[0] = 0;
+  rewind(fp);
+
+  if ((got == sizeof(magic)) && (magic == RAW_LOG_MAGIC))
+  {
+    ReplayTrace trace;
+    trace.name = path;
+    loadRawLogTrace(fp, trace);
+    traces.push_back(std::move(trace));
+  }
+  else if (strstr(first, "\"rawSignal\"") || (first[0] == '['))
+  {
+    loadMessageTraces(fp, path, traces);
+  }
+  else
+  {
+    ReplayTrace trace;
+    trace.name = path;
+    loadTextTrace(fp, trace);
+    traces.push_back(std::move(trace));
+  }
+  fclose(fp);
+  return true;
+}
+
+//****************************************************************************************
+// Running in a child
+//****************************************************************************************
+
+// Results cross the pipe from the child as a flat record per trace.
+static void replayPut(std::string &out, const void *data, size_t size) { out.append((const char *)data, size); }
+
+template <typename T>
+static void replayPut(std::string &out, T value) { replayPut(out, &value, sizeof(value)); }
+
+static void replayPut(std::string &out, const std::string &s)
+{
+  replayPut(out, (uint32_t)s.size());
+  out += s;
+}
+
+static void replayPut(std::string &out, const ReplayResult &r)
+{
+  replayPut(out, r.name);
+  replayPut(out, (uint64_t)r.readings);
+  replayPut(out, (uint8_t)r.ok);
+  replayPut(out, r.error);
+  replayPut(out, r.detectorSeconds);
+  replayPut(out, (uint64_t)r.events.size());
+  replayPut(out, r.events.data(), r.events.size() * sizeof(ReplayEvent));
+}
+
+static bool replayGet(const std::string &in, size_t &pos, void *data, size_t size)
+{
+  if (pos + size > in.size()) return false;
+  memcpy(data, in.data() + pos, size);
+  pos += size;
+  return true;
+}
+
+static bool replayGet(const std::string &in, size_t &pos, std::string &s)
+{
+  uint32_t size;
+  if (!replayGet(in, pos, &size, sizeof(size)) || (pos + size > in.size())) return false;
+  s.assign(in, pos, size);
+  pos += size;
+  return true;
+}
+
+static bool replayGet(const std::string &in, size_t &pos, ReplayResult &r)
+{
+  uint64_t readings, events;
+  uint8_t ok;
+  if (!replayGet(in, pos, r.name) || !replayGet(in, pos, &readings, sizeof(readings)) ||
+      !replayGet(in, pos, &ok, sizeof(ok)) || !replayGet(in, pos, r.error) ||
+      !replayGet(in, pos, &r.detectorSeconds, sizeof(r.detectorSeconds)) ||
+      !replayGet(in, pos, &events, sizeof(events)) || (events > (in.size() - pos) / sizeof(ReplayEvent)))
+  {
+    return false;
+  }
+  r.readings = readings;
+  r.ok = ok;
+  r.events.resize(events);
+  return replayGet(in, pos, r.events.data(), events * sizeof(ReplayEvent));
+}
+
+//****************************************************************************************
+// Run work() in a fork()ed copy of this process, and return what it put in its string.
+// false (with error) if the child didn't finish.
+template <typename Work>
+static bool replayInChild(Work work, std::string &out, std::string &error)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+  {
+    error = std::string("pipe: ") + strerror(errno);
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0)
+  {
+    close(fds[0]);
+    close(fds[1]);
+    error = std::string("fork: ") + strerror(errno);
+    return false;
+  }
+  if (pid == 0)
+  {
+    close(fds[0]);
+    std::string result;
+    work(result);
+    const char *p = result.data();
+    size_t size = result.size();
+    while (size > 0)
+    {
+      ssize_t n = write(fds[1], p, size);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) _exit(1);
+      p += n;
+      size -= (size_t)n;
+    }
+    _exit(0);
+  }
+  close(fds[1]);
+
+  out.clear();
+  char buffer[65536];
+  for (;;)
+  {
+    ssize_t n = read(fds[0], buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    out.append(buffer, (size_t)n);
+  }
+  close(fds[0]);
+
+  int status = 0;
+  while ((waitpid(pid, &status, 0) < 0) && (errno == EINTR)) {}
+  if (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) return true;
+  error = WIFSIGNALED(status) ? "killed by signal " + std::to_string(WTERMSIG(status))
+                              : "exit status " + std::to_string(WEXITSTATUS(status));
+  return false;
+}
+
+// The selected detector over a trace, the host clock following the readings. Changes the
+// detectors' state for good: run it in a child.
+static ReplayResult replayHere(const ReplayTrace &trace)
+{
+  ReplayResult result;
+  result.name = trace.name;
+  result.readings = trace.samples.size();
+  RuntimeConfig rc = getRuntimeConfig();
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t timeUS = micros(); // Unwrapped
+  uint32_t last = trace.samples.empty() ? 0 : trace.samples[0].timeUS;
+  for (uint32_t i = 0; i < trace.samples.size(); i++)
+  {
+    const LIDARSample &sample = trace.samples[i];
+    timeUS += (uint32_t)(sample.timeUS - last);
+    last = sample.timeUS;
+    hostSetMicros(timeUS);
+    processLIDARSamples(rc, &sample, 1, [&](int lane) { result.events.push_back({i, lane, sample.timeUS}); });
+  }
+  result.detectorSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  result.ok = true;
+  return result;
+}
+
+//****************************************************************************************
+// Run the selected detector (selectLIDARDetectors()) over a trace, from the state the
+// process is in now, which this leaves as it was. With withConfig, the child publishes it
+// and selects its detector first.
+ReplayResult replayTrace(const ReplayTrace &trace, const Config *withConfig = nullptr)
+{
+  ReplayResult result;
+  std::string out, error;
+  size_t pos = 0;
+  auto work = [&](std::string &o) {
+    if (withConfig)
+    {
+      publishRuntimeConfig(*withConfig);
+      selectLIDARDetectors(getRuntimeConfig());
+    }
+    replayPut(o, replayHere(trace));
+  };
+  if (!replayInChild(work, out, error) ||
+      !replayGet(out, pos, result))
+  {
+    result = ReplayResult();
+    result.name = trace.name;
+    result.readings = trace.samples.size();
+    result.error = error.empty() ? "no result" : error;
+  }
+  return result;
+}
+
+//****************************************************************************************
+// The same for each trace in a file. The file is loaded in a child, which then runs each
+// trace in a child of its own: fork() takes longer the more memory a process has, so the
+// process that does the fork()ing for a trace shouldn't hold the others.
+std::vector<ReplayResult> replayFile(const std::string &path)
+{
+  std::string out, error;
+  bool finished = replayInChild([&](std::string &o) {
+    std::vector<ReplayTrace> traces;
+    std::string loadError;
+    if (!loadReplayTraces(path, traces, loadError))
+    {
+      ReplayResult failed;
+      failed.name = path;
+      failed.error = loadError;
+      replayPut(o, failed);
+    }
+    for (const ReplayTrace &trace : traces) replayPut(o, replayTrace(trace));
+  }, out, error);
+
+  std::vector<ReplayResult> results;
+  size_t pos = 0;
+  while (finished && (pos < out.size()))
+  {
+    results.emplace_back();
+    if (!replayGet(out, pos, results.back()))
+    {
+      finished = false;
+      error = "bad result";
+    }
+  }
+  if (!finished)
+  {
+    results.clear();
+    results.emplace_back();
+    results.back().name = path;
+    results.back().error = error;
+  }
+  return results;
+}
+
+//****************************************************************************************
+// The pool
+//****************************************************************************************
+
+class ReplayPool
+{
+public:
+  struct WorkerStats
+  {
+    unsigned long tasks = 0;  // Run by this thread
+    unsigned long steals = 0; // Times it took work from another thread's queue
+    unsigned long stolen = 0; //   and the tasks it took
+  };
+
+  //****************************************************************************************
+  // Run task(i) for i in [0, n) on threads threads. Each thread starts with a contiguous
+  // share of the indices, takes them from the front and, when it runs out, steals the back
+  // half of the fullest queue it can find. Returns when all have run.
+  template <typename Task>
+  void run(size_t n, int threads, Task task)
+  {
+    if (threads < 1) threads = 1;
+    queues = std::vector<Queue>(threads);
+    stats = std::vector<WorkerStats>(threads);
+    for (int w = 0; w < threads; w++)
+    {
+      for (size_t i = n * w / threads; i < n * (w + 1) / threads; i++) queues[w].items.push_back(i);
+    }
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < threads; w++)
+    {
+      workers.emplace_back([this, w, &task]() {
+        size_t i;
+        while (take(w, i) || steal(w, i))
+        {
+          task(i);
+          stats[w].tasks++;
+        }
+      });
+    }
+    for (std::thread &t : workers) t.join();
+  }
+
+  const std::vector<WorkerStats> &workerStats() const { return stats; }
+
+private:
+  struct Queue
+  {
+    std::mutex lock;
+    std::deque<size_t> items;
+  };
+
+  bool take(int w, size_t &i)
+  {
+    std::lock_guard<std::mutex> guard(queues[w].lock);
+    if (queues[w].items.empty()) return false;
+    i = queues[w].items.front();
+    queues[w].items.pop_front();
+    return true;
+  }
+
+  // Nothing is ever added once run() starts, so when every queue is empty, we're done.
+  bool steal(int w, size_t &i)
+  {
+    for (;;)
+    {
+      int victim = -1;
+      size_t most = 0;
+      for (int v = 0; v < (int)queues.size(); v++)
+      {
+        if (v == w) continue;
+        std::lock_guard<std::mutex> guard(queues[v].lock);
+        if (queues[v].items.size() > most)
+        {
+          most = queues[v].items.size();
+          victim = v;
+        }
+      }
+      if (victim < 0) return false;
+
+      std::deque<size_t> loot;
+      {
+        std::lock_guard<std::mutex> guard(queues[victim].lock);
+        size_t half = (queues[victim].items.size() + 1) / 2;
+        for (size_t k = 0; k < half; k++)
+        {
+          loot.push_front(queues[victim].items.back());
+          queues[victim].items.pop_back();
+        }
+      }
+      if (loot.empty()) continue; // Emptied while we looked: look again.
+
+      stats[w].steals++;
+      stats[w].stolen += loot.size();
+      i = loot.front();
+      loot.pop_front();
+      std::lock_guard<std::mutex> guard(queues[w].lock);
+      queues[w].items.insert(queues[w].items.end(), loot.begin(), loot.end());
+      return true;
+    }
+  }
+
+  std::vector<Queue> queues;
+  std::vector<WorkerStats> stats;
+};
+
+//****************************************************************************************
+// Replay every file on threads threads. results[i] is for files[i].
+std::vector<std::vector<ReplayResult>> replayFiles(const std::vector<std::string> &files, int threads,
+                                                   ReplayPool &pool)
+{
+  std::vector<std::vector<ReplayResult>> results(files.size());
+  pool.run(files.size(), threads, [&](size_t i) { results[i] = replayFile(files[i]); });
+  return results;
+}
+
+#endif // __DIGAME_REPLAY_H__
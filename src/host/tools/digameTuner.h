@@ -0,0 +1,600 @@
+/* digameTuner.h
+ *
+ *  Searches the detectors' parameters (lidar.* in PARAMS.TXT) for the ones
+ *  that count a site's labeled traces best, for the autotune tool
+ *  (autotune.cpp) and its test.
+ *
+ *  Labels: for a trace file X (anything digameReplay.h loads), X.labels
+ *  lists the vehicles that really passed, a line each: timeUS,lane -- the
+ *  time of the last reading with the vehicle in the beam. replay's output,
+ *  checked by hand against the data, will do.
+ *
+ *  A detection matches a label in the same lane from shortly before the
+ *  vehicle left until windowUS after. Each setting is scored on accuracy
+ *  (F1 of the matches: precision and recall in one number) and on latency
+ *  (how long after the vehicle left it was counted, on average). Neither is
+ *  worth giving up entirely for the other, so the result is the Pareto
+ *  front: the settings no other beats on both.
+ *
+ *  Two searches: a grid over every step of every parameter, or a Bayesian
+ *  one that fits a Gaussian process to the settings tried so far and tries
+ *  next where it expects most improvement (on a randomly weighted mix of
+ *  the two scores each time, ParEGO style, to spread along the front).
+ *  Settings are tried a batch at a time, each trace of each setting a task
+ *  for the ReplayPool. Both are deterministic: same traces, same result,
+ *  whatever the number of threads.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_TUNER_H__
+#define __DIGAME_TUNER_H__
+
+#include "digameReplay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <set>
+
+const uint32_t tuneEarlyUS = 500000;   // A detection may come this long before the label
+const uint32_t tuneWindowUS = 2000000; //   or up to this long after.
+
+struct TuneLabel
+{
+  uint32_t timeUS;
+  int lane;
+};
+
+struct LabeledTrace
+{
+  ReplayTrace trace;
+  std::vector<TuneLabel> labels;
+};
+
+//****************************************************************************************
+// Scoring
+//****************************************************************************************
+
+struct TuneScore
+{
+  long matched = 0;        // Detections that match a label
+  long falseAlarms = 0;    // Detections that don't
+  long missed = 0;         // Labels nothing matched
+  double latencySum = 0;   // Seconds, over the matches
+  long failures = 0;       // Traces that couldn't be replayed (their labels count as missed)
+
+  void add(const TuneScore &s)
+  {
+    matched += s.matched;
+    falseAlarms += s.falseAlarms;
+    missed += s.missed;
+    latencySum += s.latencySum;
+    failures += s.failures;
+  }
+  double precision() const { return (matched + falseAlarms) ? (double)matched / (matched + falseAlarms) : 0; }
+  double recall() const { return (matched + missed) ? (double)matched / (matched + missed) : 0; }
+  double f1() const
+  {
+    double p = precision(), r = recall();
+    return (p + r > 0) ? 2 * p * r / (p + r) : 0;
+  }
+  double latency() const { return matched ? latencySum / matched : 0; }
+};
+
+//****************************************************************************************
+// Match detections to labels (both in time order), each to one at most: for each label,
+// the first unmatched detection in its lane and window.
+TuneScore scoreTuneEvents(const std::vector<ReplayEvent> &events, const std::vector<TuneLabel> &labels,
+                          uint32_t windowUS = tuneWindowUS)
+{
+  TuneScore score;
+  std::vector<bool> used(events.size(), false);
+  size_t first = 0; // Events before this are too early for any label still to come
+  for (const TuneLabel &label : labels)
+  {
+    while ((first < events.size()) && ((int32_t)(events[first].timeUS - label.timeUS) < -(int32_t)tuneEarlyUS))
+    {
+      first++;
+    }
+    bool found = false;
+    for (size_t e = first; e < events.size(); e++)
+    {
+      int32_t delta = (int32_t)(events[e].timeUS - label.timeUS);
+      if (delta > (int32_t)windowUS) break;
+      if (used[e] || (events[e].lane != label.lane)) continue;
+      used[e] = true;
+      found = true;
+      score.matched++;
+      score.latencySum += (delta > 0) ? delta / 1e6 : 0;
+      break;
+    }
+    if (!found) score.missed++;
+  }
+  score.falseAlarms = (long)events.size() - score.matched;
+  return score;
+}
+
+//****************************************************************************************
+// A label file: timeUS,lane a line. Comments (#) and a header are skipped.
+bool loadTuneLabels(const std::string &path, std::vector<TuneLabel> &labels, std::string &error)
+{
+  FILE *fp = fopen(path.c_str(), "r");
+  if (!fp)
+  {
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), fp))
+  {
+    unsigned long long timeUS;
+    int lane;
+    if (line[0] == '#') continue;
+    if (sscanf(line, "%llu,%d", &timeUS, &lane) != 2) continue;
+    labels.push_back({(uint32_t)timeUS, lane});
+  }
+  fclose(fp);
+  std::stable_sort(labels.begin(), labels.end(), [](const TuneLabel &a, const TuneLabel &b) {
+    return a.timeUS < b.timeUS;
+  });
+  return true;
+}
+
+//****************************************************************************************
+// Parameters
+//****************************************************************************************
+
+struct TuneDimension
+{
+  const char *key;     // In PARAMS.TXT's lidar section
+  String Config::*field;
+  bool integer;
+  double lo, hi, step; // step > 0
+};
+
+// What can be tuned.
+const TuneDimension tunableParameters[] = {
+    {"smoothingFactor", &Config::lidarSmoothingFactor, false, 0, 0, 0},
+    {"residenceTime", &Config::lidarResidenceTime, true, 0, 0, 0},
+    {"decay", &Config::lidarDecay, false, 0, 0, 0},
+    {"presenceCutoff", &Config::lidarPresenceCutoff, true, 0, 0, 0},
+    {"zone1Min", &Config::lidarZone1Min, true, 0, 0, 0},
+    {"zone1Max", &Config::lidarZone1Max, true, 0, 0, 0},
+    {"zone2Min", &Config::lidarZone2Min, true, 0, 0, 0},
+    {"zone2Max", &Config::lidarZone2Max, true, 0, 0, 0},
+    {"preFilterWindow", &Config::lidarPreFilterWindow, true, 0, 0, 0}, // The filter itself from -p
+    {"hampelThreshold", &Config::lidarHampelThreshold, false, 0, 0, 0},
+    {"minRunLength", &Config::lidarMinRunLength, true, 0, 0, 0},
+};
+
+//****************************************************************************************
+// "key=lo:hi:step" into dim. false (with error) if it doesn't parse.
+bool parseTuneDimension(const char *spec, TuneDimension &dim, std::string &error)
+{
+  const char *eq = strchr(spec, '=');
+  std::string key(spec, eq ? eq - spec : strlen(spec));
+  for (const TuneDimension &t : tunableParameters)
+  {
+    if (strcasecmp(key.c_str(), t.key) != 0) continue;
+    dim = t;
+    if (!eq || (sscanf(eq + 1, "%lf:%lf:%lf", &dim.lo, &dim.hi, &dim.step) != 3) || (dim.step <= 0) ||
+        (dim.hi < dim.lo))
+    {
+      error = std::string(spec) + ": expected " + t.key + "=low:high:step";
+      return false;
+    }
+    return true;
+  }
+  error = "Can't tune " + key + ". Try:";
+  for (const TuneDimension &t : tunableParameters) error += std::string(" ") + t.key;
+  return false;
+}
+
+// What each detector uses, over sensible ranges.
+std::vector<TuneDimension> defaultTuneDimensions(DetectionAlgorithm detector)
+{
+  std::vector<std::string> specs;
+  switch (detector)
+  {
+  case DETECT_THRESHOLD:   specs = {"smoothingFactor=0.1:0.95:0.05", "residenceTime=0:500:25"}; break;
+  case DETECT_VOTING:      specs = {"residenceTime=1:100:3"}; break;
+  case DETECT_CORRELATION: specs = {"zone1Max=200:400:10", "zone2Max=500:800:10"}; break;
+  default:                 specs = {"residenceTime=1:60:3", "decay=0.01:0.3:0.01", "presenceCutoff=2:60:4"}; break;
+  }
+  std::vector<TuneDimension> dims;
+  for (const std::string &spec : specs)
+  {
+    TuneDimension dim;
+    std::string error;
+    parseTuneDimension(spec.c_str(), dim, error);
+    dims.push_back(dim);
+  }
+  return dims;
+}
+
+//****************************************************************************************
+// The search
+//****************************************************************************************
+
+struct TunePoint
+{
+  std::vector<double> values; // One per dimension
+  TuneScore score;
+};
+
+class DetectorTuner
+{
+public:
+  DetectorTuner(const Config &base, const std::vector<TuneDimension> &dims,
+                const std::vector<LabeledTrace> &traces, int threads, uint32_t windowUS = tuneWindowUS)
+      : base(base), dims(dims), traces(traces), threads(threads), windowUS(windowUS)
+  {
+  }
+
+  //****************************************************************************************
+  // Every combination of steps.
+  void grid()
+  {
+    std::vector<std::vector<double>> batch;
+    std::vector<double> values(dims.size());
+    gridFrom(0, values, batch);
+    evaluate(batch);
+  }
+
+  //****************************************************************************************
+  // Up to evaluations settings, batch at a time. The first few are random.
+  void bayesian(int evaluations, int batch = 8, unsigned seed = 1)
+  {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    const int d = (int)dims.size();
+
+    std::vector<std::vector<double>> first;
+    for (int tries = 0; ((int)first.size() < std::min(evaluations, std::max(2 * d + 2, batch))) && (tries < 1000); tries++)
+    {
+      std::vector<double> u(d);
+      for (double &x : u) x = uniform(rng);
+      std::vector<double> v = fromUnit(u);
+      if (!tried(v) && !contains(first, v)) first.push_back(v);
+    }
+    evaluate(first);
+
+    while ((int)points.size() < evaluations)
+    {
+      std::vector<std::vector<double>> next;
+      int want = std::min(batch, evaluations - (int)points.size());
+      fitGP();
+      for (int k = 0; k < want; k++)
+      {
+        std::vector<double> v;
+        if (!proposeGP(uniform(rng), rng, next, v)) break;
+        next.push_back(v);
+      }
+      if (next.empty()) break; // Every setting on the grid has been tried.
+      evaluate(next);
+    }
+  }
+
+  const std::vector<TunePoint> &results() const { return points; }
+  const std::vector<TuneDimension> &dimensions() const { return dims; }
+
+  //****************************************************************************************
+  // The settings nothing beats on both accuracy and latency, quickest first. (Settings that
+  // matched nothing have no latency, and no place on it.)
+  std::vector<TunePoint> paretoFront() const
+  {
+    std::vector<TunePoint> sorted;
+    for (const TunePoint &p : points)
+    {
+      if (p.score.matched > 0) sorted.push_back(p);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const TunePoint &a, const TunePoint &b) {
+      if (a.score.latency() != b.score.latency()) return a.score.latency() < b.score.latency();
+      return a.score.f1() > b.score.f1();
+    });
+    std::vector<TunePoint> front;
+    for (const TunePoint &p : sorted)
+    {
+      if (front.empty() || (p.score.f1() > front.back().score.f1())) front.push_back(p);
+    }
+    return front;
+  }
+
+  //****************************************************************************************
+  // The most accurate setting that counts within maxLatency seconds (the quickest of those
+  // that tie). Any setting, if none is that quick.
+  TunePoint best(double maxLatency = 1e9) const
+  {
+    const TunePoint *choice = nullptr;
+    for (int pass = 0; (pass < 2) && !choice; pass++)
+    {
+      for (const TunePoint &p : points)
+      {
+        if ((pass == 0) && (p.score.latency() > maxLatency)) continue;
+        if (!choice || (p.score.f1() > choice->score.f1()) ||
+            ((p.score.f1() == choice->score.f1()) && (p.score.latency() < choice->score.latency())))
+        {
+          choice = &p;
+        }
+      }
+    }
+    return choice ? *choice : TunePoint();
+  }
+
+  // A setting applied to c, or to the base config.
+  void apply(Config &c, const std::vector<double> &values) const
+  {
+    c.lidarDetectionAlgorithm = base.lidarDetectionAlgorithm;
+    for (size_t i = 0; i < dims.size(); i++) c.*(dims[i].field) = format(dims[i], values[i]);
+  }
+
+  Config configFor(const std::vector<double> &values) const
+  {
+    Config c = base;
+    apply(c, values);
+    return c;
+  }
+
+  //****************************************************************************************
+  // The setting as PARAMS.TXT's lidar section, ready to paste in.
+  String fragment(const std::vector<double> &values) const
+  {
+    String s = "\"lidar\": {\n  \"detector\": \"" + base.lidarDetectionAlgorithm + "\"";
+    for (size_t i = 0; i < dims.size(); i++)
+    {
+      s += ",\n  \"" + String(dims[i].key) + "\": \"" + format(dims[i], values[i]) + "\"";
+    }
+    s += "\n}";
+    return s;
+  }
+
+  static String format(const TuneDimension &dim, double value)
+  {
+    if (dim.integer) return String((long)lround(value));
+    String s = String(value, 3);
+    while (s.endsWith("0") && (s.indexOf('.') >= 0) && !s.endsWith(".0")) s = s.substring(0, s.length() - 1);
+    return s;
+  }
+
+private:
+  //****************************************************************************************
+  // Replay every trace with every setting in batch: a task per trace per setting.
+  void evaluate(const std::vector<std::vector<double>> &batch)
+  {
+    if (batch.empty()) return;
+    std::vector<Config> configs;
+    for (const std::vector<double> &v : batch) configs.push_back(configFor(v));
+
+    const size_t n = traces.size();
+    std::vector<TuneScore> scores(batch.size() * n);
+    pool.run(scores.size(), threads, [&](size_t task) {
+      const LabeledTrace &t = traces[task % n];
+      ReplayResult r = replayTrace(t.trace, &configs[task / n]);
+      if (r.ok)
+      {
+        scores[task] = scoreTuneEvents(r.events, t.labels, windowUS);
+      }
+      else
+      {
+        scores[task].missed = (long)t.labels.size();
+        scores[task].failures = 1;
+      }
+    });
+
+    for (size_t c = 0; c < batch.size(); c++)
+    {
+      TunePoint p;
+      p.values = batch[c];
+      for (size_t t = 0; t < n; t++) p.score.add(scores[c * n + t]); // In order: same sums
+      points.push_back(p);
+      seen.insert(key(p.values));
+    }
+  }
+
+  void gridFrom(size_t i, std::vector<double> &values, std::vector<std::vector<double>> &out)
+  {
+    if (i == dims.size())
+    {
+      out.push_back(values);
+      return;
+    }
+    long steps = (long)floor((dims[i].hi - dims[i].lo) / dims[i].step + 1e-9);
+    for (long k = 0; k <= steps; k++)
+    {
+      values[i] = snap(dims[i], dims[i].lo + k * dims[i].step);
+      gridFrom(i + 1, values, out);
+    }
+  }
+
+  // Onto the grid of steps.
+  static double snap(const TuneDimension &dim, double v)
+  {
+    v = std::min(std::max(v, dim.lo), dim.hi);
+    v = dim.lo + std::round((v - dim.lo) / dim.step) * dim.step;
+    if (v > dim.hi + 1e-9) v -= dim.step;
+    if (dim.integer) v = std::round(v);
+    return std::round(v * 1e6) / 1e6;
+  }
+
+  std::vector<double> fromUnit(const std::vector<double> &u) const
+  {
+    std::vector<double> v(dims.size());
+    for (size_t i = 0; i < dims.size(); i++) v[i] = snap(dims[i], dims[i].lo + u[i] * (dims[i].hi - dims[i].lo));
+    return v;
+  }
+
+  std::vector<double> toUnit(const std::vector<double> &v) const
+  {
+    std::vector<double> u(dims.size());
+    for (size_t i = 0; i < dims.size(); i++)
+    {
+      double range = dims[i].hi - dims[i].lo;
+      u[i] = (range > 0) ? (v[i] - dims[i].lo) / range : 0;
+    }
+    return u;
+  }
+
+  std::string key(const std::vector<double> &v) const
+  {
+    std::string k;
+    for (size_t i = 0; i < v.size(); i++) k += std::string(format(dims[i], v[i]).c_str()) + ",";
+    return k;
+  }
+  bool tried(const std::vector<double> &v) const { return seen.count(key(v)) > 0; }
+  bool contains(const std::vector<std::vector<double>> &list, const std::vector<double> &v) const
+  {
+    for (const std::vector<double> &w : list)
+    {
+      if (key(w) == key(v)) return true;
+    }
+    return false;
+  }
+
+  //****************************************************************************************
+  // The Gaussian process: a squared exponential kernel on the unit cube. The kernel matrix
+  // depends only on where we've been, so it's factored once a batch.
+  static constexpr double lengthScale = 0.2;
+  static constexpr double noise = 1e-4;
+
+  static double kernel(const std::vector<double> &a, const std::vector<double> &b)
+  {
+    double d2 = 0;
+    for (size_t i = 0; i < a.size(); i++) d2 += (a[i] - b[i]) * (a[i] - b[i]);
+    return exp(-d2 / (2 * lengthScale * lengthScale));
+  }
+
+  void fitGP()
+  {
+    const size_t n = points.size();
+    unit.clear();
+    for (const TunePoint &p : points) unit.push_back(toUnit(p.values));
+
+    chol.assign(n * n, 0.0); // Lower triangular L, K = L L^T
+    for (size_t i = 0; i < n; i++)
+    {
+      for (size_t j = 0; j <= i; j++)
+      {
+        double s = kernel(unit[i], unit[j]) + ((i == j) ? noise : 0);
+        for (size_t k = 0; k < j; k++) s -= chol[i * n + k] * chol[j * n + k];
+        chol[i * n + j] = (i == j) ? sqrt(std::max(s, 1e-12)) : s / chol[j * n + j];
+      }
+    }
+
+    maxLatency = 1e-9;
+    for (const TunePoint &p : points) maxLatency = std::max(maxLatency, p.score.latency());
+  }
+
+  // Solve L x = b in place, then (with transpose) L^T x = b.
+  void forward(std::vector<double> &b) const
+  {
+    const size_t n = points.size();
+    for (size_t i = 0; i < n; i++)
+    {
+      for (size_t k = 0; k < i; k++) b[i] -= chol[i * n + k] * b[k];
+      b[i] /= chol[i * n + i];
+    }
+  }
+  void backward(std::vector<double> &b) const
+  {
+    const size_t n = points.size();
+    for (size_t i = n; i-- > 0;)
+    {
+      for (size_t k = i + 1; k < n; k++) b[i] -= chol[k * n + i] * b[k];
+      b[i] /= chol[i * n + i];
+    }
+  }
+
+  // Both scores in one, to minimize, for weight (0-1) on accuracy.
+  double scalarize(const TuneScore &s, double weight) const
+  {
+    double a = weight * (1 - s.f1());
+    double b = (1 - weight) * (s.matched ? s.latency() / maxLatency : 1);
+    return std::max(a, b) + 0.05 * (a + b);
+  }
+
+  //****************************************************************************************
+  // The untried setting with the most expected improvement in the weighted score, among
+  // random ones and ones near the best so far. false if there's none left.
+  bool proposeGP(double weight, std::mt19937 &rng, const std::vector<std::vector<double>> &chosen,
+                 std::vector<double> &out)
+  {
+    const size_t n = points.size();
+    std::vector<double> y(n);
+    double mean = 0, var = 0;
+    for (size_t i = 0; i < n; i++) mean += (y[i] = scalarize(points[i].score, weight));
+    mean /= n;
+    for (double v : y) var += (v - mean) * (v - mean);
+    double sd = sqrt(var / n) + 1e-9;
+    for (double &v : y) v = (v - mean) / sd;
+    double yBest = *std::min_element(y.begin(), y.end());
+
+    std::vector<double> alpha = y;
+    forward(alpha);
+    backward(alpha);
+
+    // Candidates
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> nudge(0, 0.05);
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return y[a] < y[b]; });
+
+    std::vector<std::vector<double>> candidates;
+    for (int c = 0; c < 1000; c++)
+    {
+      std::vector<double> u(dims.size());
+      for (double &x : u) x = uniform(rng);
+      candidates.push_back(u);
+    }
+    for (size_t b = 0; b < std::min<size_t>(5, n); b++)
+    {
+      for (int c = 0; c < 50; c++)
+      {
+        std::vector<double> u = unit[order[b]];
+        for (double &x : u) x = std::min(1.0, std::max(0.0, x + nudge(rng)));
+        candidates.push_back(u);
+      }
+    }
+
+    double bestEI = -1;
+    std::vector<double> k(n);
+    for (const std::vector<double> &u : candidates)
+    {
+      std::vector<double> v = fromUnit(u);
+      if (tried(v) || contains(chosen, v)) continue;
+      std::vector<double> at = toUnit(v);
+      for (size_t i = 0; i < n; i++) k[i] = kernel(at, unit[i]);
+      double mu = 0;
+      for (size_t i = 0; i < n; i++) mu += k[i] * alpha[i];
+      forward(k);
+      double s2 = 1 + noise;
+      for (size_t i = 0; i < n; i++) s2 -= k[i] * k[i];
+      double sigma = sqrt(std::max(s2, 1e-12));
+      double z = (yBest - mu) / sigma;
+      double ei = (yBest - mu) * 0.5 * erfc(-z / sqrt(2.0)) + sigma * exp(-0.5 * z * z) / sqrt(2 * M_PI);
+      if (ei > bestEI)
+      {
+        bestEI = ei;
+        out = v;
+      }
+    }
+    return bestEI >= 0;
+  }
+
+  Config base;
+  std::vector<TuneDimension> dims;
+  const std::vector<LabeledTrace> &traces;
+  int threads;
+  uint32_t windowUS;
+  ReplayPool pool;
+
+  std::vector<TunePoint> points;
+  std::set<std::string> seen;
+
+  std::vector<std::vector<double>> unit; // points, on the unit cube
+  std::vector<double> chol;
+  double maxLatency = 1;
+};
+
+#endif // __DIGAME_TUNER_H__
@@ -0,0 +1,65 @@
+/* lanefinder.cpp
+ *
+ *  Runs lane discovery (digameLaneFinder.h) over recorded traces, e.g.
+ *
+ *    rawlog2csv rawdata.bin > site.csv
+ *    lanefinder site.csv [half-life in hours]
+ *
+ *  The input is CSV with timeUS and dist in the first two columns (a header
+ *  line is skipped). Readings are binned the way processLIDARSignal3() does
+ *  and folded in once per minute of trace time. Prints the proposal as the
+ *  /lanes page would.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameLaneFinder.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv)
+{
+  if ((argc < 2) || (argc > 3))
+  {
+    fprintf(stderr, "usage: %s <trace.csv> [half-life in hours]\n", argv[0]);
+    return 2;
+  }
+
+  FILE *fp = fopen(argv[1], "r");
+  if (!fp)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  LaneFinder finder;
+  if (argc == 3) finder.setHalfLife(atof(argv[2]) * 60);
+
+  static unsigned long histogram[LaneFinder::bins];
+  unsigned long long timeUS, lastUpdateUS = 0;
+  long samples = 0;
+  int dist;
+  char line[256];
+  while (fgets(line, sizeof(line), fp))
+  {
+    if (sscanf(line, "%llu,%d", &timeUS, &dist) != 2) continue;
+    if ((dist <= 0) || (dist >= 1000)) dist = 999; // As the detector does
+    histogram[dist / LaneFinder::binCM]++;
+    samples++;
+
+    if (samples == 1) lastUpdateUS = timeUS;
+    if (timeUS - lastUpdateUS >= 60000000ULL)
+    {
+      finder.update(histogram);
+      lastUpdateUS = timeUS;
+    }
+  }
+  fclose(fp);
+  finder.update(histogram);
+
+  LaneProposal p = finder.propose();
+  fprintf(stderr, "%ld samples\n", samples);
+  printf("%s\n", getLaneProposalJSON(p, config).c_str());
+  return 0;
+}
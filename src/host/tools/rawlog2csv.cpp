@@ -0,0 +1,90 @@
+/* rawlog2csv.cpp
+ *
+ *  Turns a raw LIDAR capture (see digameRawLog.h) back into CSV:
+ *
+ *    rawlog2csv rawdata.bin > rawdata.csv
+ *
+ *  Columns are timeUS,dist,flux,temp. The sensor's 32-bit microsecond clock
+ *  wraps every 71 minutes; timeUS here keeps counting. Lost or damaged blocks
+ *  and samples dropped on the device are reported on stderr.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include <digameRawLog.h>
+
+#include <stdio.h>
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    fprintf(stderr, "usage: %s <raw log file>\n", argv[0]);
+    return 2;
+  }
+
+  FILE *fp = fopen(argv[1], "rb");
+  if (!fp)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  printf("timeUS,dist,flux,temp\n");
+
+  static uint8_t block[RAW_LOG_BLOCK_SIZE];
+  uint64_t timeUS = 0;     // Unwrapped
+  bool haveTime = false;
+  unsigned long samples = 0, badBlocks = 0, sessions = 0;
+  uint32_t nextSequence = 0, dropped = 0;
+  long offset = 0;
+
+  while (fread(block, 1, sizeof(block), fp) == sizeof(block))
+  {
+    RawLogBlockHeader header;
+    bool first = true;
+    bool ok = decodeRawLogBlock(block, header, [&](uint32_t t, int16_t dist, int16_t flux, int16_t temp) {
+      if (first && header.sequence == 0)
+      {
+        haveTime = false; // A new logging session (e.g. after a reboot): a new time base.
+      }
+      first = false;
+      timeUS = haveTime ? timeUS + (uint32_t)(t - (uint32_t)timeUS) : t;
+      haveTime = true;
+      printf("%llu,%d,%d,%d\n", (unsigned long long)timeUS, dist, flux, temp);
+      samples++;
+    });
+
+    if (!ok)
+    {
+      fprintf(stderr, "Bad block at offset %ld skipped.\n", offset);
+      badBlocks++;
+    }
+    else
+    {
+      if (header.sequence == 0)
+      {
+        sessions++;
+        nextSequence = 0;
+        dropped = 0;
+      }
+      if (header.sequence != nextSequence)
+      {
+        fprintf(stderr, "Blocks %lu to %lu missing.\n", (unsigned long)nextSequence,
+                (unsigned long)header.sequence - 1);
+      }
+      if (header.dropped != dropped)
+      {
+        fprintf(stderr, "%lu samples dropped on the device after block %lu.\n",
+                (unsigned long)(header.dropped - dropped), (unsigned long)header.sequence);
+      }
+      nextSequence = header.sequence + 1;
+      dropped = header.dropped;
+    }
+    offset += sizeof(block);
+  }
+
+  fclose(fp);
+  fprintf(stderr, "%lu samples, %lu session(s), %lu bad block(s).\n", samples, sessions, badBlocks);
+  return 0;
+}
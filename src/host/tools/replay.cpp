@@ -0,0 +1,165 @@
+/* replay.cpp
+ *
+ *  Runs a vehicle detector over recorded traces (see digameReplay.h for the
+ *  formats), in parallel:
+ *
+ *    replay [-d detector] [-p params.txt] [-j threads] [-s] <file or directory>...
+ *
+ *  -d  Threshold, Voting, Decay or Correlation (default: the one in
+ *      params.txt, or Decay)
+ *  -p  PARAMS.TXT from a counter, for its zones and smoothing
+ *  -j  Threads (default: one per core)
+ *  -s  A summary line per trace only, without the events
+ *
+ *  Directories are searched for *.bin, *.csv, *.txt and *.json files. On
+ *  stdout, for each trace in name order: a summary line (# name: readings,
+ *  vehicles in each lane), then a line per vehicle: trace,reading,timeUS,lane.
+ *  Every trace starts from a freshly booted detector, so the output is the
+ *  same for any -j. Throughput goes to stderr.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#include "digameReplay.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include <stdlib.h>
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-d detector] [-p params.txt] [-j threads] [-s] <file or directory>...\n",
+          name);
+}
+
+static bool isTrace(const std::filesystem::path &p)
+{
+  std::string ext = p.extension().string();
+  for (char &c : ext) c = (char)tolower((unsigned char)c);
+  return (ext == ".bin") || (ext == ".csv") || (ext == ".txt") || (ext == ".json");
+}
+
+int main(int argc, char **argv)
+{
+  const char *detector = nullptr;
+  const char *params = nullptr;
+  int threads = (int)std::thread::hardware_concurrency();
+  bool summaryOnly = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:p:j:s")) != -1)
+  {
+    switch (opt)
+    {
+    case 'd': detector = optarg; break;
+    case 'p': params = optarg; break;
+    case 'j': threads = atoi(optarg); break;
+    case 's': summaryOnly = true; break;
+    default: usage(argv[0]); return 2;
+    }
+  }
+  if (optind >= argc)
+  {
+    usage(argv[0]);
+    return 2;
+  }
+  if (threads < 1) threads = 1;
+
+  Serial.hostSetEcho(false); // The detectors' chatter would end up in the output.
+
+  if (params)
+  {
+    std::filesystem::path p = std::filesystem::absolute(params);
+    if (!std::filesystem::is_regular_file(p))
+    {
+      fprintf(stderr, "%s: no such file\n", params);
+      return 1;
+    }
+    SD.hostSetRoot(p.parent_path().string().c_str());
+    loadConfiguration(("/" + p.filename().string()).c_str(), config);
+  }
+  if (detector)
+  {
+    bool known = false;
+    for (int i = 0; i < DETECT_ALGORITHMS; i++) known |= (strcasecmp(detector, detectionAlgorithmNames[i]) == 0);
+    if (!known)
+    {
+      fprintf(stderr, "Unknown detector %s\n", detector);
+      return 2;
+    }
+    config.lidarDetectionAlgorithm = detector;
+  }
+  config.lidarShadowDetectors = "";
+  config.showDataStream = "false";
+  publishRuntimeConfig(config);
+  selectLIDARDetectors(getRuntimeConfig());
+
+  // The files, in name order.
+  std::vector<std::string> files;
+  for (int i = optind; i < argc; i++)
+  {
+    std::error_code ec;
+    if (std::filesystem::is_directory(argv[i], ec))
+    {
+      for (const auto &entry : std::filesystem::recursive_directory_iterator(argv[i], ec))
+      {
+        if (entry.is_regular_file() && isTrace(entry.path())) files.push_back(entry.path().string());
+      }
+    }
+    else
+    {
+      files.push_back(argv[i]);
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  // Each file is loaded where it's replayed, in a child (see replayFile()).
+  auto start = std::chrono::steady_clock::now();
+  ReplayPool pool;
+  std::vector<std::vector<ReplayResult>> results = replayFiles(files, threads, pool);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // The output, in trace order.
+  int status = 0;
+  unsigned long long traces = 0, readings = 0, vehicles = 0;
+  double detectorSeconds = 0;
+  printf("# %s, %s\n", getLIDARDetectorName(), params ? params : "default parameters");
+  if (!summaryOnly) printf("trace,reading,timeUS,lane\n");
+  for (const std::vector<ReplayResult> &file : results)
+  {
+    for (const ReplayResult &r : file)
+    {
+      traces++;
+      readings += r.readings;
+      if (!r.ok)
+      {
+        printf("# %s: failed: %s\n", r.name.c_str(), r.error.c_str());
+        status = 1;
+        continue;
+      }
+      int lanes[3] = {0, 0, 0};
+      for (const ReplayEvent &e : r.events) lanes[(e.lane == 1) ? 1 : 2]++;
+      vehicles += r.events.size();
+      detectorSeconds += r.detectorSeconds;
+      printf("# %s: %zu readings, %zu vehicles, lane 1 %d, lane 2 %d\n", r.name.c_str(), r.readings,
+             r.events.size(), lanes[1], lanes[2]);
+      if (summaryOnly) continue;
+      for (const ReplayEvent &e : r.events) printf("%s,%u,%u,%d\n", r.name.c_str(), e.reading, e.timeUS, e.lane);
+    }
+  }
+
+  fprintf(stderr, "%llu traces from %zu files, %llu readings, %llu vehicles, %d threads\n", traces,
+          files.size(), readings, vehicles, threads);
+  fprintf(stderr, "Replay    %8.3f s  %10.0f traces/s  %12.0f readings/s\n", seconds,
+          seconds > 0 ? traces / seconds : 0, seconds > 0 ? readings / seconds : 0);
+  fprintf(stderr, "Detector  %8.3f s  %34.0f readings/s per thread (without the fork)\n", detectorSeconds,
+          detectorSeconds > 0 ? readings / detectorSeconds : 0);
+  const std::vector<ReplayPool::WorkerStats> &stats = pool.workerStats();
+  for (size_t w = 0; w < stats.size(); w++)
+  {
+    fprintf(stderr, "  thread %2zu: %6lu files, %4lu steals (%lu files)\n", w, stats[w].tasks,
+            stats[w].steals, stats[w].stolen);
+  }
+  return status;
+}
@@ -0,0 +1,104 @@
+/* digameBatchPost.h
+ *
+ *  Sends the oldest events in the journal to the server several to a POST,
+ *  so a backlog built up while the network was down goes in a few round
+ *  trips instead of one per event, and the radio can go back off sooner.
+ *
+ *  The batch contract (network.postBatchSize > 1 in PARAMS.TXT turns it on):
+ *
+ *    POST <serverURL>
+ *    Content-Type: application/json
+ *    X-Digame-Batch: <n>
+ *
+ *    [ <event message>, <event message>, ... ]    n of them, oldest first
+ *
+ *  Each element is the message that would have been POSTed on its own. The
+ *  server stores them in order and answers 200 with {"acked":k}: the first
+ *  k are stored (k < n if it stopped part way). Those k come off the
+ *  journal and the rest go in the next batch. The server must take the same
+ *  event twice (after a power cut between its reply and our checkpoint) as
+ *  the single-event endpoint does. A 200 without "acked" is a server that
+ *  doesn't take batches: the caller goes back to one event per POST.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_BATCH_POST_H__
+#define __DIGAME_BATCH_POST_H__
+
+#include <ArduinoJson.h>
+#include <digameJournal.h>
+#include <digameNetwork.h>
+
+const size_t postBatchMaxBytes = 16384; // Of JSON in one POST (the first event always goes)
+
+#define BATCH_POST_FAILED -1      // No reply, or not a 200 (lastPostResponseCode says which)
+#define BATCH_POST_UNSUPPORTED -2 // The server doesn't take batches
+
+//****************************************************************************************
+// POST up to maxEvents of the oldest events in the journal (and at most postBatchMaxBytes)
+// as one JSON array. format(const CounterEvent &, const RawSignal *) returns an event's
+// message. Acks what the server says it stored and returns how many, or one of the
+// BATCH_POST_ codes.
+template <typename F>
+int postEventBatch(EventJournal &journal, int maxEvents, F format, Config config)
+{
+  RuntimeConfig rc = getRuntimeConfig();
+
+  if (WiFi.status() != WL_CONNECTED)
+  {
+    debugUART.println("WiFi not connected.");
+    if (enableWiFi(config) == false)
+    {
+      lastPostResponseCode = HTTPC_ERROR_NOT_CONNECTED;
+      return BATCH_POST_FAILED;
+    }
+  }
+
+  String payload;
+  payload.reserve(postBatchMaxBytes);
+  payload = "[";
+  int n = journal.peekBatch(maxEvents, [&](const CounterEvent &e, const RawSignal *raw) {
+    String msg = format(e, raw);
+    if ((payload.length() > 1) && (payload.length() + msg.length() + 2 > postBatchMaxBytes)) return false;
+    if (payload.length() > 1) payload += ",";
+    payload += msg;
+    return true;
+  });
+  if (n == 0) return 0;
+  payload += "]";
+
+  unsigned long t1 = millis();
+  String reply;
+  int httpResponseCode = postToServer(payload, config, &reply, "X-Digame-Batch", String(n));
+
+  if (!rc.showDataStream)
+  {
+    debugUART.print("Batch of " + String(n) + " (" + String(payload.length()) + " bytes) POST Time: ");
+    debugUART.println(millis() - t1);
+    debugUART.print("HTTP response code: ");
+    debugUART.println(httpResponseCode);
+    if (httpResponseCode != 200)
+    {
+      debugUART.println("*****ERROR*****");
+      debugUART.println(http.errorToString(httpResponseCode));
+    }
+    else
+    {
+      debugUART.println("Reply: " + reply);
+    }
+  }
+  if (httpResponseCode != 200) return BATCH_POST_FAILED;
+
+  StaticJsonDocument<128> doc;
+  if (deserializeJson(doc, reply) || doc["acked"].isNull()) return BATCH_POST_UNSUPPORTED;
+  int acked = doc["acked"].as<int>();
+  if (acked <= 0) return 0;
+  if (acked > n) acked = n;
+
+  msLastPostTime = millis(); // Log the time of the last successful post
+  journal.ack(acked);
+  return acked;
+}
+
+#endif // __DIGAME_BATCH_POST_H__
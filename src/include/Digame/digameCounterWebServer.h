@@ -34,6 +34,7 @@
 
 #include <digameJSONConfig.h>
 #include <digameLIDAR.h>
+#include <digameDetectors.h>
 #include <digameLoRa.h>
 #include <digameNetwork.h>
 #include <digameTime.h>
@@ -53,7 +54,8 @@ unsigned long msLastWebPageEventTime;
 
 
 //*******************************************************************************************************
-String processor(const String& var){
+// Hold configMutex.
+String configProcessor(const String& var){
   
   //debugUART.println("Hello from processor");
   //debugUART.println(var);
@@ -86,6 +88,16 @@ String processor(const String& var){
   if(var == "config.lidarZone1Max") return F(String(config.lidarZone1Max).c_str());
   if(var == "config.lidarZone2Min") return F(String(config.lidarZone2Min).c_str());
   if(var == "config.lidarZone2Max") return F(String(config.lidarZone2Max).c_str());
+  if(var == "config.lidarAutoLanes") return F(String(config.lidarAutoLanes).c_str());
+  if(var == "config.lidarShadowDetectors") return F(String(config.lidarShadowDetectors).c_str());
+  if(var.startsWith("ALGORITHM_")){ // The selected option of the detection algorithm list
+    if (config.lidarDetectionAlgorithm.equalsIgnoreCase(var.substring(10))) return F("selected");
+  }
+  if(var == "config.lidarPreFilterWindow") return F(String(config.lidarPreFilterWindow).c_str());
+  if(var == "config.lidarMinRunLength") return F(String(config.lidarMinRunLength).c_str());
+  if(var.startsWith("PREFILTER_")){ // Ditto, the pre-filter list
+    if (config.lidarPreFilter.equalsIgnoreCase(var.substring(10))) return F("selected");
+  }
 
   if(var == "config.logBootEvents") return F(String(config.logBootEvents).c_str());
   if(var == "config.logHeartBeatEvents") return F(String(config.logHeartBeatEvents).c_str());  
@@ -119,10 +131,20 @@ String processor(const String& var){
   
 }
 
+String processor(const String& var){
+  xSemaphoreTake(configMutex, portMAX_DELAY); // Lane discovery may be changing the zone limits
+  String retValue = configProcessor(var);
+  xSemaphoreGive(configMutex);
+  return retValue;
+}
+
 //*******************************************************************************************************
 void redirectHome(AsyncWebServerRequest* request){
     
-    saveConfiguration(filename,config); // Save any changes before redirecting home
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    publishRuntimeConfig(config);       // Hand any changes to the counting loop and...
+    saveConfiguration(filename,config); // save them before redirecting home
+    xSemaphoreGive(configMutex);
 
 
     String RedirectUrl = "http://";
@@ -201,22 +223,63 @@ void initWebServer() {
 
   server.on("/histograph", HTTP_GET, [](AsyncWebServerRequest *request){
     debugUART.println("GET /histograph");
-    request->send(200, "text/plain", getDistanceHistogramChartString(config));
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    String chart = getDistanceHistogramChartString(config);
+    xSemaphoreGive(configMutex);
+    request->send(200, "text/plain", chart);
   });
 
   server.on("/histo", HTTP_GET, [](AsyncWebServerRequest *request){
     debugUART.println("GET /histo");
     request->send(200, "text/plain", getDistanceHistogramString());
   });
+
+  // How long counted vehicles spent in each lane: since the last reset and over the last hour.
+  server.on("/dwell", HTTP_GET, [](AsyncWebServerRequest *request){
+    debugUART.println("GET /dwell");
+    request->send(200, "text/plain", getDwellHistogramString());
+  });
+
+  // Where the shadow detectors disagreed with the counting one, with the readings.
+  server.on("/shadow", HTTP_GET, [](AsyncWebServerRequest *request){
+    debugUART.println("GET /shadow");
+    request->send(200, "text/plain", lidarShadowLog.toString());
+  });
+
+  // How the sensor's doing: signal, temperature, errors and rate over the last few minutes.
+  server.on("/health", HTTP_GET, [](AsyncWebServerRequest *request){
+    debugUART.println("GET /health");
+    request->send(200, "application/json", getLIDARHealthJSON(lidarHealth.lastSummary()));
+  });
+
+  // The lane limits the histogram suggests. /lanes?apply=true puts them in the config.
+  // (The counting loop updates the finder, and may apply it, under the same lock.)
+  server.on("/lanes", HTTP_GET, [](AsyncWebServerRequest *request){
+    debugUART.println("GET /lanes");
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    LaneProposal proposal = lidarLaneFinder.propose();
+    if (request->hasParam("apply") && applyLaneProposal(proposal, config, 0)){
+      publishRuntimeConfig(config);
+      saveConfiguration(filename, config);
+    }
+    String json = getLaneProposalJSON(proposal, config);
+    xSemaphoreGive(configMutex);
+    request->send(200, "application/json", json);
+  });
   
   server.on("/counterreset",HTTP_GET, [](AsyncWebServerRequest *request){
     count = 0;
     clearLIDARDistanceHistogram();
+    clearLIDARDwellHistograms();
+    lidarShadowLog.clear();
+    xSemaphoreTake(configMutex, portMAX_DELAY);
     config.lidarZone1Count = "0"; 
+    xSemaphoreGive(configMutex);
     redirectHome(request);
   });
 
   server.on("/generalparams",HTTP_GET, [](AsyncWebServerRequest *request){
+    xSemaphoreTake(configMutex, portMAX_DELAY);
     processQueryParam(request, "devname", &config.deviceName);
     
     String strStream;
@@ -233,6 +296,7 @@ void initWebServer() {
     processQueryParam(request, "logheartbeatevents", &config.logHeartBeatEvents);
     processQueryParam(request, "logvehicleevents", &config.logVehicleEvents);
     processQueryParam(request, "lograwdata", &config.logRawData);
+    xSemaphoreGive(configMutex);
 
     String strReboot;
     processQueryParam(request, "reboot", &strReboot);
@@ -248,14 +312,17 @@ void initWebServer() {
   });
 
   server.on("/networkparams",HTTP_GET, [](AsyncWebServerRequest *request){
+    xSemaphoreTake(configMutex, portMAX_DELAY);
     processQueryParam(request, "heartbeatinterval", &config.heartbeatInterval);
     processQueryParam(request, "ssid", &config.ssid);
     processQueryParam(request, "password", &config.password);
     processQueryParam(request, "serverurl", &config.serverURL);  
+    xSemaphoreGive(configMutex);
     redirectHome(request);
   });
 
   server.on("/loraparams",HTTP_GET, [](AsyncWebServerRequest *request){
+    xSemaphoreTake(configMutex, portMAX_DELAY);
     processQueryParam(request, "address", &config.loraAddress);
     processQueryParam(request, "networkid", &config.loraNetworkID);
     processQueryParam(request, "band", &config.loraBand);
@@ -263,6 +330,7 @@ void initWebServer() {
     processQueryParam(request, "bandwidth", &config.loraBW);
     processQueryParam(request, "codingrate", &config.loraCR);
     processQueryParam(request, "preamble", &config.loraPreamble); 
+    xSemaphoreGive(configMutex);
 
     //initLoRa();
     //configureLoRa(config);
@@ -271,18 +339,28 @@ void initWebServer() {
 
   server.on("/lidarparams",HTTP_GET, [](AsyncWebServerRequest *request){
 
+    xSemaphoreTake(configMutex, portMAX_DELAY); // Lane discovery may be moving the zone limits
     processQueryParam(request, "counterid", &config.counterID);
     processQueryParam(request, "counterpopulation", &config.counterPopulation);
     processQueryParam(request, "residencetime", &config.lidarResidenceTime);
+    processQueryParam(request, "algorithm", &config.lidarDetectionAlgorithm); // At next boot
+    processQueryParam(request, "shadows", &config.lidarShadowDetectors);      //   ditto
+    processQueryParam(request, "prefilter", &config.lidarPreFilter);
+    processQueryParam(request, "prefilterwindow", &config.lidarPreFilterWindow);
+    processQueryParam(request, "minrunlength", &config.lidarMinRunLength);
     processQueryParam(request, "zone1min", &config.lidarZone1Min);
     processQueryParam(request, "zone1max", &config.lidarZone1Max);
     processQueryParam(request, "zone2min", &config.lidarZone2Min);
     processQueryParam(request, "zone2max", &config.lidarZone2Max);
+    config.lidarAutoLanes = "";
+    processQueryParam(request, "autolanes", &config.lidarAutoLanes);
+    xSemaphoreGive(configMutex);
     redirectHome(request);
   });
 
 
   server.on("/sensors",HTTP_GET, [](AsyncWebServerRequest *request){
+    xSemaphoreTake(configMutex, portMAX_DELAY);
     processQueryParam(request, "sens1name", &config.sens1Name);
     processQueryParam(request, "sens1addr", &config.sens1Addr);
     processQueryParam(request, "sens1mac",  &config.sens1MAC);
@@ -298,13 +376,16 @@ void initWebServer() {
     processQueryParam(request, "sens4name", &config.sens4Name);
     processQueryParam(request, "sens4addr", &config.sens4Addr);
     processQueryParam(request, "sens4mac",  &config.sens4MAC);
+    xSemaphoreGive(configMutex);
     
     redirectHome(request);
   });
 
   server.on("/distance", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(200, "text/plain", lastDistanceMeasured+","+\
-                                     String(config.lidarZone1Count));
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    String distance = String(lastDistanceMeasured)+","+String(config.lidarZone1Count);
+    xSemaphoreGive(configMutex);
+    request->send(200, "text/plain", distance);
     msLastWebPageEventTime = millis();
   });
 
@@ -7,6 +7,11 @@
 // Define where debug output will be printed.
 #define DEBUG_PRINTER Serial
 
+// The port the Digame headers print their messages to.
+#ifndef debugUART
+  #define debugUART Serial
+#endif
+
 // Setup debug printing macros.
 #ifdef SHOW_DEBUG
   #define DEBUG_PRINT(...) { DEBUG_PRINTER.print(__VA_ARGS__); }
@@ -0,0 +1,202 @@
+/* digameDeliveryScheduler.h
+ *
+ *  When to try sending the oldest message again, so a link that's down
+ *  doesn't keep the radio on and a message the server won't take doesn't
+ *  hold up the ones behind it.
+ *
+ *  The sender asks due() before each try and report()s how it went:
+ *
+ *    DELIVERY_OK         ACKed. The next message goes right away.
+ *    DELIVERY_REJECTED   the server answered, but didn't take it (an HTTP
+ *                        4xx). The link's fine: the message isn't.
+ *                        After maxRejections of those, report() says to
+ *                        give up on it -- the sender sets it aside in
+ *                        persistent storage -- and moves on.
+ *    DELIVERY_NO_REPLY   nothing back: no WiFi, no server, no LoRa ACK. A
+ *                        5xx counts here too: the server's in trouble, not
+ *                        the message (httpDeliveryOutcome()).
+ *
+ *  After a failure the same message is tried again after a backoff that
+ *  doubles from retryBaseMS up to retryMaxMS, each picked at random from
+ *  the upper half of the range so a base station's sensors don't all come
+ *  back at once. breakerThreshold failures in a row with no reply open the
+ *  circuit breaker: the link's down, and nothing is tried until a probe --
+ *  one try with the oldest message -- every probeBaseMS, doubling up to
+ *  probeMaxMS. A probe that gets a reply closes it again.
+ *
+ *  The sender also reports how long each try kept the radio on, for the
+ *  energy it costs per message delivered.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_DELIVERY_SCHEDULER_H__
+#define __DIGAME_DELIVERY_SCHEDULER_H__
+
+const unsigned long retryBaseMS = 1000;   // The first retry after a second or so,
+const unsigned long retryMaxMS = 300000;  //   doubling to five minutes at most.
+const int breakerThreshold = 5;           // Tries in a row with no reply: the link's down.
+const unsigned long probeBaseMS = 60000;  // Probe it after a minute,
+const unsigned long probeMaxMS = 900000;  //   doubling to every 15 minutes.
+const int maxRejections = 5;              // Refused this many times: set it aside.
+
+enum DeliveryOutcome
+{
+  DELIVERY_OK,
+  DELIVERY_REJECTED,
+  DELIVERY_NO_REPLY
+};
+
+enum BreakerState
+{
+  BREAKER_CLOSED,    // Sending
+  BREAKER_OPEN,      // The link's down: waiting to probe it
+  BREAKER_HALF_OPEN  // Probing: one try
+};
+
+class DeliveryScheduler
+{
+public:
+  // Since boot.
+  unsigned long tries = 0;
+  unsigned long delivered = 0;
+  unsigned long rejected = 0;
+  unsigned long noReply = 0;
+  unsigned long givenUp = 0;
+  unsigned long breakerOpens = 0;
+  unsigned long probes = 0;
+  unsigned long radioOnMS = 0;
+
+  int attempts = 0;   // Tries of the oldest message so far
+  int rejections = 0; //   and how many of those the server refused
+
+  BreakerState state() const { return breaker; }
+
+  // May we try now? (Moves an open breaker on to a probe when it's time.)
+  bool due(unsigned long nowMS)
+  {
+    if ((long)(nowMS - nextTryMS) < 0) return false;
+    if (breaker == BREAKER_OPEN) breaker = BREAKER_HALF_OPEN;
+    return true;
+  }
+
+  // How long until the next try, in ms (0: now).
+  unsigned long wait(unsigned long nowMS) const
+  {
+    return ((long)(nowMS - nextTryMS) >= 0) ? 0 : nextTryMS - nowMS;
+  }
+
+  // How the last try went, and how long the radio was on for it. Returns true if it's
+  // time to give up on the message: set it aside and take it off the queue.
+  bool report(DeliveryOutcome outcome, unsigned long nowMS, unsigned long radioMS)
+  {
+    tries++;
+    radioOnMS += radioMS;
+    if (breaker == BREAKER_HALF_OPEN) probes++;
+
+    if (outcome == DELIVERY_OK)
+    {
+      delivered++;
+      nextMessage(nowMS);
+      closeBreaker();
+      return false;
+    }
+
+    attempts++;
+    if (outcome == DELIVERY_REJECTED)
+    {
+      rejected++;
+      rejections++;
+      closeBreaker(); // It answered: the link's up.
+      if (rejections >= maxRejections)
+      {
+        givenUp++;
+        nextMessage(nowMS);
+        return true;
+      }
+      nextTryMS = nowMS + jitter(backoff(retryBaseMS, retryMaxMS, attempts - 1));
+      return false;
+    }
+
+    noReply++;
+    silent++;
+    if (breaker == BREAKER_HALF_OPEN)
+    {
+      openBreaker(nowMS, openings + 1);
+    }
+    else if ((breaker == BREAKER_CLOSED) && (silent >= breakerThreshold))
+    {
+      breakerOpens++;
+      openBreaker(nowMS, 1);
+    }
+    else
+    {
+      nextTryMS = nowMS + jitter(backoff(retryBaseMS, retryMaxMS, attempts - 1));
+    }
+    return false;
+  }
+
+  // Radio-on time per message delivered, ms.
+  float radioMSPerDelivery() const { return delivered ? (float)radioOnMS / delivered : 0; }
+
+private:
+  BreakerState breaker = BREAKER_CLOSED;
+  unsigned long nextTryMS = 0;
+  int silent = 0;   // Tries in a row with no reply
+  int openings = 0; // Probes failed since the breaker opened, plus one
+
+  static unsigned long backoff(unsigned long base, unsigned long max, int doublings)
+  {
+    unsigned long d = base;
+    for (int i = 0; (i < doublings) && (d < max); i++) d *= 2;
+    return (d < max) ? d : max;
+  }
+
+  // Somewhere in the upper half: d/2 to d.
+  static unsigned long jitter(unsigned long d) { return d / 2 + (unsigned long)random((long)(d / 2) + 1); }
+
+  void nextMessage(unsigned long nowMS)
+  {
+    attempts = rejections = 0;
+    nextTryMS = nowMS;
+  }
+
+  void openBreaker(unsigned long nowMS, int n)
+  {
+    breaker = BREAKER_OPEN;
+    openings = n;
+    nextTryMS = nowMS + jitter(backoff(probeBaseMS, probeMaxMS, n - 1));
+  }
+
+  void closeBreaker()
+  {
+    breaker = BREAKER_CLOSED;
+    silent = 0;
+    openings = 0;
+  }
+};
+
+//****************************************************************************************
+// How a POST went, for report(): acked, or the response code (HTTPC_ERROR_ < 0: no reply).
+// Only a 4xx is the message's fault. Anything else must not set the backlog aside.
+inline DeliveryOutcome httpDeliveryOutcome(bool acked, int responseCode)
+{
+  if (acked) return DELIVERY_OK;
+  if ((responseCode >= 400) && (responseCode < 500)) return DELIVERY_REJECTED;
+  return DELIVERY_NO_REPLY;
+}
+
+//****************************************************************************************
+// The counts as JSON, for the heartbeats.
+String getDeliveryJSON(const DeliveryScheduler &s)
+{
+  const char *const states[] = {"closed", "open", "probing"};
+  return "{\"tries\":" + String(s.tries) + ",\"delivered\":" + String(s.delivered) +
+         ",\"rejected\":" + String(s.rejected) + ",\"noReply\":" + String(s.noReply) +
+         ",\"setAside\":" + String(s.givenUp) + ",\"breakerOpens\":" + String(s.breakerOpens) +
+         ",\"probes\":" + String(s.probes) + ",\"breaker\":\"" + states[s.state()] + "\"" +
+         ",\"radioOnMS\":" + String(s.radioOnMS) +
+         ",\"radioMSPerDelivery\":" + String(s.radioMSPerDelivery(), 1) + "}";
+}
+
+#endif // __DIGAME_DELIVERY_SCHEDULER_H__
@@ -0,0 +1,231 @@
+/* digameDetectors.h
+ *
+ *  The vehicle detectors in digameLIDAR.h behind one interface, so the
+ *  counter runs whichever lidar.detector names in PARAMS.TXT.
+ *
+ *  Each detector is a struct with its DetectionAlgorithm and a static
+ *  process() for one reading. The choice is made once, at boot
+ *  (selectLIDARDetector()): the detectors keep their state in statics, so
+ *  switching while counting would confuse them. Changes from the web page
+ *  are saved and take effect at the next restart.
+ *
+ *  processLIDARSamples() switches on the detector once per batch and runs a
+ *  loop specialized for it, so there's no indirect call per reading.
+ *
+ *  Shadow mode runs up to two more detectors in the same loop, on the same
+ *  readings, to try them out in the field. Only the first one counts; the
+ *  shadows leave lidarBuffer, the histograms and the rest to it (the Shadow
+ *  template parameter of the detectors) and keep their own state, so the
+ *  counting one behaves exactly as it would alone. Where they disagree goes
+ *  in lidarShadowLog (digameShadowLog.h).
+ *
+ *  With a pre-filter set (lidar.preFilter or lidar.minRunLength), every
+ *  detector sees the readings as lidarPreFilter (digamePreFilter.h) leaves
+ *  them, a few readings late.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_DETECTORS_H__
+#define __DIGAME_DETECTORS_H__
+
+#include <digameLIDAR.h>
+#include <digamePreFilter.h>
+#include <digameShadowLog.h>
+
+struct ThresholdDetector
+{
+  static const DetectionAlgorithm algorithm = DETECT_THRESHOLD;
+  template <bool Shadow>
+  static int process(const RuntimeConfig &rc, const LIDARSample &sample)
+  {
+    return processLIDARSample<LIDAR_KERNELS, Shadow>(rc, sample);
+  }
+};
+
+struct VotingDetector
+{
+  static const DetectionAlgorithm algorithm = DETECT_VOTING;
+  template <bool Shadow>
+  static int process(const RuntimeConfig &rc, const LIDARSample &sample)
+  {
+    return processLIDARSample2<Shadow>(rc, sample);
+  }
+};
+
+struct DecayDetector
+{
+  static const DetectionAlgorithm algorithm = DETECT_DECAY;
+  template <bool Shadow>
+  static int process(const RuntimeConfig &rc, const LIDARSample &sample)
+  {
+    return processLIDARSample3<LIDAR_KERNELS, Shadow>(rc, sample);
+  }
+};
+
+struct CorrelationDetector
+{
+  static const DetectionAlgorithm algorithm = DETECT_CORRELATION;
+  template <bool Shadow>
+  static int process(const RuntimeConfig &rc, const LIDARSample &sample)
+  {
+    return processLIDARSampleCorrelation<LIDAR_KERNELS, Shadow>(rc, sample);
+  }
+};
+
+// An empty place in the shadow list.
+struct NoDetector
+{
+  static const DetectionAlgorithm algorithm = DETECT_ALGORITHMS;
+  template <bool Shadow>
+  static int process(const RuntimeConfig &, const LIDARSample &) { return 0; }
+};
+
+DetectionAlgorithm activeLIDARDetector = DETECT_DECAY;
+DetectionAlgorithm shadowLIDARDetectors[2] = {DETECT_ALGORITHMS, DETECT_ALGORITHMS};
+DetectorShadowLog lidarShadowLog;
+
+void selectLIDARDetector(DetectionAlgorithm algorithm);
+void selectLIDARDetectors(const RuntimeConfig &rc);
+int getShadowDetectorCount();
+DetectionAlgorithm getLIDARDetector();
+const char *getLIDARDetectorName();
+String getLIDARDetectorCode();
+
+
+//****************************************************************************************
+// Choose the detector. Call once, at boot, with rc.lidarDetectionAlgorithm.
+void selectLIDARDetector(DetectionAlgorithm algorithm)
+{
+  if ((algorithm < 0) || (algorithm >= DETECT_ALGORITHMS)) algorithm = DETECT_DECAY;
+  activeLIDARDetector = algorithm;
+  shadowLIDARDetectors[0] = shadowLIDARDetectors[1] = DETECT_ALGORITHMS;
+}
+
+//****************************************************************************************
+// The same, with the shadows in rc.lidarShadowDetectors. Clears lidarShadowLog.
+void selectLIDARDetectors(const RuntimeConfig &rc)
+{
+  selectLIDARDetector(rc.lidarDetectionAlgorithm);
+
+  DetectionAlgorithm compared[3] = {activeLIDARDetector};
+  int n = 1;
+  for (int i = 0; i < rc.lidarShadowCount && i < 2; i++)
+  {
+    if (rc.lidarShadowDetectors[i] == activeLIDARDetector) continue;
+    shadowLIDARDetectors[n - 1] = rc.lidarShadowDetectors[i];
+    compared[n++] = rc.lidarShadowDetectors[i];
+  }
+  lidarShadowLog.begin(compared, n);
+}
+
+int getShadowDetectorCount()
+{
+  return (shadowLIDARDetectors[0] != DETECT_ALGORITHMS) + (shadowLIDARDetectors[1] != DETECT_ALGORITHMS);
+}
+
+DetectionAlgorithm getLIDARDetector()
+{
+  return activeLIDARDetector;
+}
+
+//****************************************************************************************
+// The detector's name for the WiFi messages ("Decay"), and the one letter code the LoRa
+// messages use ("d"). The base station maps the codes back to names.
+const char *getLIDARDetectorName()
+{
+  return detectionAlgorithmNames[activeLIDARDetector];
+}
+
+String getLIDARDetectorCode()
+{
+  String code = String(detectionAlgorithmNames[activeLIDARDetector][0]);
+  code.toLowerCase();
+  return code;
+}
+
+//****************************************************************************************
+// Run detector D, and shadows S1 and S2, over a batch of readings. onEvent(lane) is called
+// after each reading that completes a vehicle for D, in order, before the next reading is
+// processed -- so it sees lidarBuffer and lidarHistoryBuffer as they were at the event.
+template <typename D, typename S1, typename S2, typename EventHandler>
+void runLIDARDetector(const RuntimeConfig &rc, const LIDARSample *samples, int n,
+                      EventHandler &onEvent)
+{
+  const bool shadows = (S1::algorithm != DETECT_ALGORITHMS); // Known at compile time
+  const bool filtering = lidarPreFilter.active();
+  uint32_t timeUS = 0;
+  for (int i = 0; i < n; i++)
+  {
+    const LIDARSample sample = filtering ? lidarPreFilter.process(samples[i]) : samples[i];
+    timeUS = sample.timeUS;
+    int lane = D::template process<false>(rc, sample);
+    if (shadows)
+    {
+      int lane1 = S1::template process<true>(rc, sample);
+      int lane2 = S2::template process<true>(rc, sample);
+      if (lane > 0) lidarShadowLog.report(0, lane, sample.timeUS);
+      if (lane1 > 0) lidarShadowLog.report(1, lane1, sample.timeUS);
+      if (lane2 > 0) lidarShadowLog.report(2, lane2, sample.timeUS);
+    }
+    if (lane > 0) onEvent(lane);
+  }
+  if (shadows && (n > 0)) lidarShadowLog.expire(timeUS);
+}
+
+// Pick the type for each place in the list: one switch per batch for each.
+template <typename D, typename S1, typename EventHandler>
+void runWithSecondShadow(const RuntimeConfig &rc, const LIDARSample *samples, int n,
+                         EventHandler &onEvent)
+{
+  switch (shadowLIDARDetectors[1])
+  {
+  case DETECT_THRESHOLD:   runLIDARDetector<D, S1, ThresholdDetector>(rc, samples, n, onEvent); break;
+  case DETECT_VOTING:      runLIDARDetector<D, S1, VotingDetector>(rc, samples, n, onEvent); break;
+  case DETECT_DECAY:       runLIDARDetector<D, S1, DecayDetector>(rc, samples, n, onEvent); break;
+  case DETECT_CORRELATION: runLIDARDetector<D, S1, CorrelationDetector>(rc, samples, n, onEvent); break;
+  default:                 runLIDARDetector<D, S1, NoDetector>(rc, samples, n, onEvent); break;
+  }
+}
+
+template <typename D, typename EventHandler>
+void runWithShadows(const RuntimeConfig &rc, const LIDARSample *samples, int n,
+                    EventHandler &onEvent)
+{
+  switch (shadowLIDARDetectors[0])
+  {
+  case DETECT_THRESHOLD:   runWithSecondShadow<D, ThresholdDetector>(rc, samples, n, onEvent); break;
+  case DETECT_VOTING:      runWithSecondShadow<D, VotingDetector>(rc, samples, n, onEvent); break;
+  case DETECT_DECAY:       runWithSecondShadow<D, DecayDetector>(rc, samples, n, onEvent); break;
+  case DETECT_CORRELATION: runWithSecondShadow<D, CorrelationDetector>(rc, samples, n, onEvent); break;
+  default:                 runLIDARDetector<D, NoDetector, NoDetector>(rc, samples, n, onEvent); break;
+  }
+}
+
+//****************************************************************************************
+// Run the selected detector (and any shadows) over a batch of readings (from
+// readLIDARSamples(), or a single readLIDARSample()). See runLIDARDetector() for onEvent.
+template <typename EventHandler>
+void processLIDARSamples(const RuntimeConfig &rc, const LIDARSample *samples, int n,
+                         EventHandler onEvent)
+{
+  lidarPreFilter.configure(rc); // Starts over only when the settings change
+
+  switch (activeLIDARDetector)
+  {
+  case DETECT_THRESHOLD:
+    runWithShadows<ThresholdDetector>(rc, samples, n, onEvent);
+    break;
+  case DETECT_VOTING:
+    runWithShadows<VotingDetector>(rc, samples, n, onEvent);
+    break;
+  case DETECT_CORRELATION:
+    runWithShadows<CorrelationDetector>(rc, samples, n, onEvent);
+    break;
+  default:
+    runWithShadows<DecayDetector>(rc, samples, n, onEvent);
+    break;
+  }
+}
+
+#endif // __DIGAME_DETECTORS_H__
@@ -0,0 +1,288 @@
+/* digameDualLIDAR.h
+ *
+ *  Two TFMini-Plus sensors read at the same time, for the people counter.
+ *  Which way someone is going comes from which sensor sees them first, so
+ *  the two readings it compares have to be from the same moment:
+ *
+ *    LIDARChannel       One per sensor. A reader task waits on the sensor's
+ *                       UART and moves each frame into the channel's ring
+ *                       with the time it arrived.
+ *    DualLIDARFusion    Takes the readings out of both rings and pairs them
+ *                       up on a 100 Hz clock: for each tick, each sensor's
+ *                       reading nearest to it.
+ *    DualLIDARDirection Decides on the pairs: a target seen by one sensor
+ *                       that reaches the other is going that way.
+ *
+ *  The ESP32's UARTs don't time stamp what they receive, so the reader takes
+ *  micros() when it reads and puts each frame back by the bytes that came in
+ *  after it, at the line rate (87 us a byte at 115200). A frame that waited
+ *  in the UART buffer for the reader still gets the time it arrived, within a
+ *  byte or so, and both sensors' times are on the same clock.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_DUAL_LIDAR_H__
+#define __DIGAME_DUAL_LIDAR_H__
+
+#include <TFMPlus.h>
+#include <digameRingBuffer.h>
+#include <digameTFMiniParser.h>
+#include <digameLIDARSample.h>
+
+const int lidarChannelStreamSize = 64;      // 640 ms worth at 100 Hz
+const uint32_t dualLIDARPeriodUS = 10000;   // Pairs at the sensors' 100 Hz
+const uint32_t dualLIDARMaxSkewUS = 10000;  // Furthest a reading can be from its tick: a
+                                            //   dropped frame is covered by the next one
+const uint32_t dualLIDARLatencyUS = 30000;  // Longest we wait for a late sensor
+const uint32_t dualLIDARCatchUpUS = 1000000; // Further behind than this, skip ahead
+
+//****************************************************************************************
+// One sensor: its UART, parser, reader task and the ring the reader fills.
+class LIDARChannel
+{
+public:
+  SPSCRingBuffer<LIDARSample, lidarChannelStreamSize> stream;
+  TFMiniParser parser;                 // This sensor's link errors
+  volatile unsigned long frames = 0;   // Frames parsed by the reader task
+  volatile unsigned long drops = 0;    // Frames lost because the ring was full
+  TaskHandle_t readerTask = NULL;
+
+  LIDARChannel(HardwareSerial &uart, unsigned long baud = 115200)
+      : uart(uart), byteNS(10000000000ULL / baud) // 10 bits a byte, with start and stop
+  {
+  }
+
+  // Start the reader task. The sensor should already be streaming (SET_FRAME_RATE).
+  bool start(const char *name, BaseType_t core = 0)
+  {
+    if (running) return true;
+    parser.reset();
+    running = true;
+    if (xTaskCreatePinnedToCore(reader, name, 4096, this, 2, &readerTask, core) != pdPASS)
+    {
+      running = false;
+      return false;
+    }
+    return true;
+  }
+
+  // Ask the reader task to finish. (It exits within a tick.)
+  void stop() { running = false; }
+
+  bool isRunning() const { return running; }
+
+  // What the reader task does each time round: read what the UART has, parse it and
+  // push the frames with the times they arrived, as of nowUS. Returns the bytes read.
+  int pump(uint32_t nowUS)
+  {
+    uint8_t chunk[128];
+    int n = uart.available();
+    if (n <= 0) return 0;
+    if (n > (int)sizeof(chunk)) n = sizeof(chunk);
+    n = uart.readBytes(chunk, n);
+    int behind = uart.available(); // Came in after this chunk
+
+    LIDARSample samples[sizeof(chunk) / TFMP_FRAME_SIZE + 1];
+    int count = 0;
+    parser.parse(chunk, n, [&](const uint8_t *frame) {
+      LIDARSample &s = samples[count++];
+      s.status = decodeTFMiniFrame(frame, s.dist, s.flux, s.temp);
+    });
+
+    // The last frame ended where the part frame the parser held on to begins.
+    uint32_t after = (uint32_t)(behind + parser.pending());
+    for (int i = count - 1; i >= 0; i--)
+    {
+      samples[i].timeUS = nowUS - (uint32_t)((after * byteNS) / 1000);
+      after += TFMP_FRAME_SIZE;
+    }
+    for (int i = 0; i < count; i++)
+    {
+      frames++;
+      if (!stream.push(samples[i])) drops++;
+    }
+    return n;
+  }
+
+private:
+  HardwareSerial &uart;
+  uint64_t byteNS;
+  volatile bool running = false;
+
+  static void reader(void *parameter)
+  {
+    LIDARChannel *channel = (LIDARChannel *)parameter;
+    while (channel->running)
+    {
+      // At 100 Hz a frame is 10 ms apart: a tick's wait costs nothing in time accuracy.
+      if (channel->pump(micros()) == 0) vTaskDelay(1);
+    }
+    channel->readerTask = NULL;
+    vTaskDelete(NULL);
+  }
+};
+
+//****************************************************************************************
+// A tick and each sensor's reading nearest to it. A sensor with nothing within
+// dualLIDARMaxSkewUS of the tick reads TFMP_HEADER (no frame).
+struct LIDARPair
+{
+  uint32_t timeUS;
+  LIDARSample sample[2];
+};
+
+// A pair as a line of CSV: timeUS,dist1,dist2, with -1 for a sensor with no reading.
+// The people counter's [T]race output; the dualreplay tool reads it.
+inline String getLIDARPairCSV(const LIDARPair &p)
+{
+  return String(p.timeUS) + "," + String((p.sample[0].status == TFMP_READY) ? p.sample[0].dist : -1) + "," +
+         String((p.sample[1].status == TFMP_READY) ? p.sample[1].dist : -1);
+}
+
+class DualLIDARFusion
+{
+public:
+  unsigned long pairs = 0;         // Ticks paired so far
+  unsigned long missing[2] = {0};  // ...without a reading from each sensor
+
+  DualLIDARFusion(LIDARChannel &channel1, LIDARChannel &channel2) : channel{&channel1, &channel2} {}
+
+  // Start over: the next read() starts the clock again.
+  void reset()
+  {
+    started = false;
+    for (int c = 0; c < 2; c++)
+    {
+      track[c].haveBefore = false;
+      track[c].haveAfter = false;
+    }
+  }
+
+  // Pair up the ticks that are ready by nowUS -- both sensors have a reading after the
+  // tick, or one's been waited for dualLIDARLatencyUS -- oldest first, up to maxPairs.
+  // Returns the number of pairs.
+  int read(LIDARPair *out, int maxPairs, uint32_t nowUS)
+  {
+    if (!started || ((int32_t)(nowUS - tickUS) > (int32_t)dualLIDARCatchUpUS))
+    {
+      tickUS = nowUS - dualLIDARLatencyUS; // (Readings before this are passed over.)
+      started = true;
+    }
+
+    int n = 0;
+    while (n < maxPairs)
+    {
+      bool waiting = (int32_t)(nowUS - tickUS) < (int32_t)dualLIDARLatencyUS;
+      bool ready = true;
+      for (int c = 0; c < 2; c++)
+      {
+        advance(c);
+        if (!track[c].haveAfter && waiting) ready = false;
+      }
+      if (!ready) break;
+
+      LIDARPair &p = out[n++];
+      p.timeUS = tickUS;
+      for (int c = 0; c < 2; c++)
+      {
+        p.sample[c] = nearest(c);
+        if (p.sample[c].status == TFMP_HEADER) missing[c]++;
+      }
+      pairs++;
+      tickUS += dualLIDARPeriodUS;
+    }
+    return n;
+  }
+
+private:
+  LIDARChannel *channel[2];
+  uint32_t tickUS = 0;
+  bool started = false;
+
+  // Each sensor's last reading at or before the tick and its first one after.
+  struct Track
+  {
+    LIDARSample before;
+    LIDARSample after;
+    bool haveBefore = false;
+    bool haveAfter = false;
+  } track[2];
+
+  void advance(int c)
+  {
+    Track &t = track[c];
+    for (;;)
+    {
+      if (t.haveAfter && ((int32_t)(t.after.timeUS - tickUS) <= 0))
+      {
+        t.before = t.after;
+        t.haveBefore = true;
+        t.haveAfter = false;
+      }
+      if (t.haveAfter) return;
+      if (!channel[c]->stream.pop(t.after)) return;
+      t.haveAfter = true;
+    }
+  }
+
+  LIDARSample nearest(int c) const
+  {
+    const Track &t = track[c];
+    uint32_t before = t.haveBefore ? tickUS - t.before.timeUS : UINT32_MAX;
+    uint32_t after = t.haveAfter ? t.after.timeUS - tickUS : UINT32_MAX;
+    if ((before <= after) && (before <= dualLIDARMaxSkewUS)) return t.before;
+    if (after <= dualLIDARMaxSkewUS) return t.after;
+    LIDARSample none = {tickUS, 0, 0, 0, TFMP_HEADER};
+    return none;
+  }
+};
+
+//****************************************************************************************
+// Where the target is, from the smoothed distances: nowhere, under one sensor or both.
+enum DualLIDARState
+{
+  TARGET_NONE = 0,
+  OUTBOUND = 1, // Only sensor 1 sees it
+  INBOUND = 2,  // Only sensor 2 sees it
+  BOTH = 3
+};
+
+// Each sensor's distance, smoothed to get rid of noise and give a bit of a decay time, is
+// compared with distanceThreshold. Valid events go from only visible on one sensor to
+// being visible on both; direction is determined by which sensor saw the target first.
+class DualLIDARDirection
+{
+public:
+  float distanceThreshold = 160;
+  float smoothingFactor = 0.95;
+  float smoothed[2] = {0, 0};
+  int state = TARGET_NONE;
+  int previousState = TARGET_NONE;
+
+  // One pair in. Returns OUTBOUND or INBOUND on an event, TARGET_NONE otherwise. A pair
+  // missing a reading is passed over.
+  int update(const LIDARPair &p)
+  {
+    if ((p.sample[0].status != TFMP_READY) || (p.sample[1].status != TFMP_READY)) return TARGET_NONE;
+
+    state = TARGET_NONE;
+    for (int c = 0; c < 2; c++)
+    {
+      smoothed[c] = smoothed[c] * smoothingFactor + (float)p.sample[c].dist * (1 - smoothingFactor);
+      if (smoothed[c] < distanceThreshold) state += c + 1;
+    }
+
+    int event = TARGET_NONE;
+    if ((state == BOTH) && ((previousState == OUTBOUND) || (previousState == INBOUND)))
+    {
+      event = previousState;
+    }
+    previousState = state;
+    return event;
+  }
+
+  bool visible(int c) const { return smoothed[c] < distanceThreshold; }
+};
+
+#endif // __DIGAME_DUAL_LIDAR_H__
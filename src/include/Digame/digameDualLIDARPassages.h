@@ -0,0 +1,292 @@
+/* digameDualLIDARPassages.h
+ *
+ *  Direction and walking speed from the time lag between the two sensors of
+ *  the people counter. DualLIDARDirection (digameDualLIDAR.h) only asks which
+ *  sensor saw the target first, so with two people close together -- the
+ *  second under sensor 1 while the first is still under sensor 2 -- it counts
+ *  the second one the wrong way, or not at all. Here each passage is worked
+ *  out on its own:
+ *
+ *    1. Each sensor's distances are lightly smoothed (traceSmoothing) and
+ *       turned into a trace of how far above distanceThreshold something is:
+ *       0 with nothing there.
+ *    2. Each sensor's trace is cut into runs, one per target. A gap of
+ *       gapSamples or more ends a run, so people one behind the other give a
+ *       run each.
+ *    3. A run on one sensor is paired with the other sensor's run nearest to
+ *       it in time, within maxLagMS. A run with no partner (someone leaning in
+ *       the door) isn't counted.
+ *    4. The two traces are cross-correlated over the pair's window (by FFT,
+ *       digameFFT.h). The peak gives the lag, to a fraction of a sample:
+ *       sensor 2 behind sensor 1 is outbound. The sensor spacing over the lag
+ *       gives the speed.
+ *
+ *  A passage is decided maxLagMS after its runs end. It costs a 512-point FFT
+ *  correlation, once per passage; a reading costs a few comparisons. A run
+ *  longer than maxRunSamples (someone standing under a sensor) is dropped
+ *  and counted as loitering.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_DUAL_LIDAR_PASSAGES_H__
+#define __DIGAME_DUAL_LIDAR_PASSAGES_H__
+
+#include <digameDualLIDAR.h>
+#include <digameFFT.h>
+
+const int passageHistory = 512;     // Trace samples kept: 5 s at 100 Hz
+const int passageFFTSize = 512;     // Correlation windows up to 256 samples
+const int maxPendingRuns = 8;       // Runs per sensor waiting for a partner
+const int passageWindowPad = 16;    // Trace either side of the runs that's correlated
+
+//****************************************************************************************
+// One target past both sensors.
+struct DualLIDARPassage
+{
+  uint32_t timeUS;   // When it was between the sensors
+  int direction;     // OUTBOUND (sensor 1 first) or INBOUND
+  float lagMS;       // How far sensor 2's trace is behind sensor 1's. Negative inbound.
+  float speed;       // m/s
+  float correlation; // Peak of the cross-correlation, up to 1
+};
+
+struct DualLIDARPassageSettings
+{
+  float distanceThreshold = 160; // cm. Closer than this is a target
+  float sensorSpacing = 20;      // cm between the two sensors' spots
+  float traceSmoothing = 0.5;    // Of each reading, 1 - this goes into the trace
+  float maxLagMS = 600;          // Slower than spacing / this isn't walking
+  int gapSamples = 4;            // Nothing this long ends a run
+  int minRunSamples = 4;         // Shorter runs are noise
+  int maxRunSamples = 160;       // Longer ones are someone standing there
+};
+
+class DualLIDARPassages
+{
+public:
+  DualLIDARPassageSettings settings;
+  float smoothed[2] = {999, 999};  // Each sensor's smoothed distance
+  unsigned long passages = 0;
+  unsigned long unmatched[2] = {0}; // Runs on each sensor with no partner on the other
+  unsigned long loitering = 0;      // Runs too long to be someone walking through
+
+  DualLIDARPassages() { reset(); }
+
+  void reset()
+  {
+    sampleCount = 0;
+    for (int c = 0; c < 2; c++)
+    {
+      smoothed[c] = 999;
+      primed[c] = false;
+      runCount[c] = 0;
+      for (int i = 0; i < passageHistory; i++) trace[c][i] = 0;
+    }
+  }
+
+  // Is sensor c's smoothed distance under the threshold?
+  bool visible(int c) const { return smoothed[c] < settings.distanceThreshold; }
+
+  // One pair of readings in (every tick, missing readings and all). Passages decided
+  // go in out, up to maxOut; returns how many.
+  int update(const LIDARPair &p, DualLIDARPassage *out, int maxOut)
+  {
+    const uint32_t n = sampleCount;
+    lastTimeUS = p.timeUS;
+    for (int c = 0; c < 2; c++)
+    {
+      const LIDARSample &s = p.sample[c];
+      if (s.status == TFMP_READY) // Otherwise the trace holds its last value
+      {
+        int d = ((s.dist <= 0) || (s.dist >= 1000)) ? 999 : s.dist;
+        smoothed[c] = primed[c] ? smoothed[c] * settings.traceSmoothing + d * (1 - settings.traceSmoothing) : d;
+        primed[c] = true;
+      }
+      float above = settings.distanceThreshold - smoothed[c];
+      int16_t v = (above > 0) ? (int16_t)(above + 0.5f) : 0;
+      trace[c][n & (passageHistory - 1)] = v;
+      track(c, n, v);
+    }
+    sampleCount++;
+    return decide(out, maxOut);
+  }
+
+private:
+  struct Run
+  {
+    uint32_t start, end; // Samples [start, end)
+    uint32_t lastSeen;   // Last sample with the target
+    float weight, moment; // For the centroid
+    bool open;
+  };
+
+  int16_t trace[2][passageHistory];
+  Run runs[2][maxPendingRuns]; // Oldest first
+  int runCount[2];
+  bool primed[2];
+  uint32_t sampleCount;
+  uint32_t lastTimeUS = 0;
+  FFTCorrelator<passageFFTSize> correlator;
+  float model[passageFFTSize / 2], window[passageFFTSize / 2], r[passageFFTSize];
+
+  float centroid(const Run &run) const { return run.start + run.moment / run.weight; }
+  uint32_t maxLagSamples() const { return (uint32_t)(settings.maxLagMS * 1000 / dualLIDARPeriodUS); }
+
+  void track(int c, uint32_t n, int16_t v)
+  {
+    Run *last = (runCount[c] > 0) ? &runs[c][runCount[c] - 1] : nullptr;
+    if (v > 0)
+    {
+      if (!(last && last->open))
+      {
+        if (runCount[c] == maxPendingRuns) // Waited long enough
+        {
+          remove(c, 0);
+          unmatched[c]++;
+        }
+        last = &runs[c][runCount[c]++];
+        *last = {n, n + 1, n, 0, 0, true};
+      }
+      last->lastSeen = n;
+      last->end = n + 1;
+      last->weight += v;
+      last->moment += (float)v * (n - last->start);
+      return;
+    }
+
+    if (last && last->open && (n - last->lastSeen >= (uint32_t)settings.gapSamples))
+    {
+      last->open = false;
+      uint32_t length = last->end - last->start;
+      if (length < (uint32_t)settings.minRunSamples)
+      {
+        runCount[c]--; // Noise
+      }
+      else if (length > (uint32_t)settings.maxRunSamples)
+      {
+        remove(c, runCount[c] - 1);
+        loitering++;
+      }
+    }
+  }
+
+  void remove(int c, int i)
+  {
+    for (int k = i; k + 1 < runCount[c]; k++) runs[c][k] = runs[c][k + 1];
+    runCount[c]--;
+  }
+
+  // Pair off the runs that have waited maxLagMS since they ended, oldest first.
+  int decide(DualLIDARPassage *out, int maxOut)
+  {
+    const uint32_t now = sampleCount;
+    const uint32_t maxLag = maxLagSamples();
+    int count = 0;
+    while (count < maxOut)
+    {
+      // The run that ended first, of those closed on either sensor.
+      int c = -1;
+      for (int k = 0; k < 2; k++)
+      {
+        if ((runCount[k] > 0) && !runs[k][0].open && ((c < 0) || (runs[k][0].end < runs[c][0].end))) c = k;
+      }
+      if (c < 0) break;
+      const Run &run = runs[c][0];
+      if (now < run.end + maxLag) break;
+
+      // Its partner is on the other sensor and can't still be open: one still going that
+      // started in time would be, so wait for it (unless it's gone on too long).
+      const int o = 1 - c;
+      float mid = centroid(run);
+      int best = -1;
+      float bestGap = maxLag;
+      bool waiting = false;
+      for (int i = 0; i < runCount[o]; i++)
+      {
+        const Run &other = runs[o][i];
+        if (other.start > run.end + maxLag) break;
+        if (other.open)
+        {
+          waiting = (other.end - other.start <= (uint32_t)settings.maxRunSamples);
+          break;
+        }
+        float gap = fabsf(centroid(other) - mid);
+        if (gap <= bestGap)
+        {
+          best = i;
+          bestGap = gap;
+        }
+      }
+      if (waiting) break;
+
+      if (best < 0)
+      {
+        remove(c, 0);
+        unmatched[c]++;
+        continue;
+      }
+
+      const Run &r1 = (c == 0) ? runs[0][0] : runs[0][best];
+      const Run &r2 = (c == 0) ? runs[1][best] : runs[1][0];
+      out[count++] = measure(r1, r2);
+      passages++;
+
+      // Runs on the other sensor before the partner have no partner of their own: it'd
+      // be this run's or a later one's, and people don't overtake between the sensors.
+      remove(c, 0);
+      for (int i = 0; i < best; i++) remove(o, 0);
+      remove(o, 0);
+      unmatched[o] += best;
+    }
+    return count;
+  }
+
+  // Cross-correlate the two traces around a pair of runs.
+  DualLIDARPassage measure(const Run &r1, const Run &r2)
+  {
+    const int maxWindow = passageFFTSize / 2;
+    uint32_t lo = ((r1.start < r2.start) ? r1.start : r2.start);
+    uint32_t hi = ((r1.end > r2.end) ? r1.end : r2.end) + passageWindowPad;
+    lo = (lo > passageWindowPad) ? lo - passageWindowPad : 0;
+    if (sampleCount - lo > (uint32_t)passageHistory) lo = sampleCount - passageHistory;
+    if (hi > sampleCount) hi = sampleCount;
+    if (hi - lo > (uint32_t)maxWindow) hi = lo + maxWindow;
+    const int n = (int)(hi - lo);
+
+    for (int i = 0; i < n; i++)
+    {
+      model[i] = trace[0][(lo + i) & (passageHistory - 1)];
+      window[i] = trace[1][(lo + i) & (passageHistory - 1)];
+    }
+    correlator.setModel(model, n);
+    correlator.correlate(window, r); // r[lag + n - 1]: sensor 2 lag samples behind
+
+    int maxLag = (int)maxLagSamples();
+    if (maxLag > n - 1) maxLag = n - 1;
+    int peak = 0;
+    for (int lag = -maxLag; lag <= maxLag; lag++)
+    {
+      if (r[lag + n - 1] > r[peak + n - 1]) peak = lag;
+    }
+    float lag = (float)peak;
+    if ((peak > -maxLag) && (peak < maxLag)) // Between samples: the top of a parabola
+    {
+      float a = r[peak + n - 2], b = r[peak + n - 1], c = r[peak + n];
+      float d = a - 2 * b + c;
+      if (d < 0) lag += 0.5f * (a - c) / d;
+    }
+    if (lag == 0) lag = centroid(r2) - centroid(r1); // No help from the correlation
+
+    DualLIDARPassage p;
+    p.lagMS = lag * dualLIDARPeriodUS / 1000.0f;
+    p.direction = (lag >= 0) ? OUTBOUND : INBOUND;
+    p.speed = (lag != 0) ? settings.sensorSpacing * 10 / fabsf(p.lagMS) : 0; // cm/ms = 10 m/s
+    p.correlation = r[peak + n - 1];
+    float mid = 0.5f * (centroid(r1) + centroid(r2));
+    p.timeUS = lastTimeUS - (uint32_t)((sampleCount - 1 - mid) * dualLIDARPeriodUS);
+    return p;
+  }
+};
+
+#endif // __DIGAME_DUAL_LIDAR_PASSAGES_H__
@@ -0,0 +1,152 @@
+/* digameEventQueue.h
+ *
+ *  The counter's outgoing messages, queued from the detection loop (core 1)
+ *  to the message manager (core 0) as small fixed-size records instead of
+ *  JSON Strings on the heap. A record has what the message needs that can't
+ *  be looked up when it's sent: the event type, lane, count, time and
+ *  temperature, and (for vehicles, over WiFi) a reference to a copy of the
+ *  raw LIDAR signal. The JSON is built from it when it's sent.
+ *
+ *  Records go through an SPSCRingBuffer (digameRingBuffer.h); raw signals
+ *  have a ring of their own, filled in place, in the same order. Nothing is
+ *  allocated after boot. A full queue refuses the new event and counts it
+ *  (dropped), rather than overwriting (and leaking) the oldest; a vehicle
+ *  with no raw signal slot free goes without one (rawDropped).
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_EVENT_QUEUE_H__
+#define __DIGAME_EVENT_QUEUE_H__
+
+#include <digameRingBuffer.h>
+
+#include <time.h>
+
+enum CounterEventType : uint8_t
+{
+  EVENT_BOOT = 0,
+  EVENT_HEARTBEAT = 1,
+  EVENT_VEHICLE = 2
+};
+
+const int eventRawSignalLength = 150; // As lidarHistoryBuffer
+const int8_t noRawSignal = -1;
+
+//****************************************************************************************
+// 16 bytes.
+struct CounterEvent
+{
+  uint32_t epoch;       // Seconds since 1970, UTC
+  uint32_t count;       // Total counts when it happened
+  int16_t tempC10;      // Temperature, tenths of a degree C
+  uint8_t type;         // CounterEventType
+  uint8_t lane;         // Vehicle events: 1 or 2
+  int8_t rawSlot;       // Raw signal slot, or noRawSignal
+  uint8_t reserved[3];
+};
+
+struct RawSignal
+{
+  uint16_t length;
+  int16_t samples[eventRawSignalLength];
+};
+
+//****************************************************************************************
+// N events and R raw signals in flight. Both powers of two.
+template <size_t N, size_t R>
+class EventQueue
+{
+  static_assert(R <= 128, "EventQueue raw slots must fit an int8_t");
+  static_assert((R & (R - 1)) == 0, "EventQueue raw slots must be a power of two");
+
+public:
+  static const size_t capacity = N;
+  static const size_t rawCapacity = R;
+
+  volatile unsigned long pushed = 0;     // Producer side counts
+  volatile unsigned long dropped = 0;
+  volatile unsigned long rawDropped = 0;
+
+  //****************************************************************************************
+  // Producer side. The raw signal slot the next push() can take, to be filled in place, or
+  // nullptr if they're all in use. Until the push it's the producer's.
+  RawSignal *rawSlot()
+  {
+    uint32_t head = rawHead.load(std::memory_order_relaxed);
+    if ((uint32_t)(head - rawTail.load(std::memory_order_acquire)) >= R) return nullptr;
+    return &raw[head & (R - 1)];
+  }
+
+  // Producer side. Queue e, with the slot from rawSlot() if withRaw. Returns false (and
+  // counts a drop) if the queue is full.
+  bool push(CounterEvent e, bool withRaw = false)
+  {
+    if (events.size() >= N)
+    {
+      dropped++;
+      return false;
+    }
+    e.rawSlot = noRawSignal;
+    if (withRaw)
+    {
+      if (rawSlot())
+      {
+        uint32_t head = rawHead.load(std::memory_order_relaxed);
+        e.rawSlot = (int8_t)(head & (R - 1));
+        rawHead.store(head + 1, std::memory_order_release);
+      }
+      else
+      {
+        rawDropped++;
+      }
+    }
+    events.push(e); // Only this side fills it: can't fail now
+    pushed++;
+    return true;
+  }
+
+  //****************************************************************************************
+  // Consumer side. The oldest event, left in the queue until pop(). False if it's empty.
+  bool peek(CounterEvent &e) const { return events.peek(e); }
+
+  // Consumer side. The raw signal of a peeked event, or nullptr.
+  const RawSignal *rawSignal(const CounterEvent &e) const
+  {
+    return (e.rawSlot == noRawSignal) ? nullptr : &raw[(size_t)e.rawSlot];
+  }
+
+  // Consumer side. Done with the oldest event (and its raw signal).
+  void pop()
+  {
+    CounterEvent e;
+    if (!events.peek(e)) return;
+    events.discard();
+    if (e.rawSlot != noRawSignal) rawTail.store(rawTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // Either side. (A snapshot.)
+  size_t size() const { return events.size(); }
+
+private:
+  SPSCRingBuffer<CounterEvent, N> events;
+  RawSignal raw[R];
+  std::atomic<uint32_t> rawHead{0}; // Written by the producer only
+  std::atomic<uint32_t> rawTail{0}; // Written by the consumer only
+};
+
+//****************************************************************************************
+// An event's time as the messages carry it: YYYY-MM-DD HH:MM:SS (UTC).
+inline String getEventTimeString(uint32_t epoch)
+{
+  time_t t = (time_t)epoch;
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char str[32];
+  // gmtime_r keeps the fields in range; the % lets the compiler see they fit, too.
+  snprintf(str, sizeof(str), "%04d-%02d-%02d %02d:%02d:%02d", (tm.tm_year + 1900) % 10000, (tm.tm_mon + 1) % 100,
+           tm.tm_mday % 100, tm.tm_hour % 100, tm.tm_min % 100, tm.tm_sec % 100);
+  return String(str);
+}
+
+#endif // __DIGAME_EVENT_QUEUE_H__
@@ -0,0 +1,490 @@
+/* digameFFT.h
+ *
+ *  Cross-correlation of a LIDAR window against a model at every lag, by FFT.
+ *
+ *  The correlation test sketch's crossCorrelation() works out each lag with
+ *  its own pass over the data: O(N * lags) multiply-adds, some 80,000 for
+ *  100 samples. Here the model and the window (each less its mean) are
+ *  zero-padded to M points, transformed, multiplied and transformed back,
+ *  which gives every lag from -(N-1) to N-1 at once in O(M log M). The
+ *  model's transform is worked out once, in setModel().
+ *
+ *  The transform is a real radix-2 FFT: the M real points are packed into
+ *  M/2 complex ones, run through a complex FFT of half the size and then
+ *  split apart. Twiddle and bit-reversal tables and all scratch space are
+ *  allocated with the object; nothing is allocated per call.
+ *
+ *  FFTCorrelator works in float. FFTCorrelatorQ15 works in 16-bit fixed
+ *  point (block floating point, so nothing overflows and small signals keep
+ *  their precision) for when the CPU is slowed down and float costs more.
+ *  Its results are within about 0.003 of the float ones.
+ *
+ *  M must be a power of two, at least 2N - 1. src/host/bench/bench_fft_correlation
+ *  shows where the FFT starts to beat the direct sum.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_FFT_H__
+#define __DIGAME_FFT_H__
+
+#include <digameMath.h>
+#include <math.h>
+#include <stdint.h>
+
+//****************************************************************************************
+// What the float and Q15 versions share: the bit-reversal table for the M/2 point
+// complex FFT.
+template <int M>
+class FFTBase
+{
+  static_assert((M >= 4) && ((M & (M - 1)) == 0), "FFT size must be a power of two");
+
+public:
+  static const int size = M;
+  static const int half = M / 2;
+  static const int maxSamples = (M + 1) / 2; // The longest window (and model) that fits
+
+protected:
+  uint16_t bitReversed[M / 2];
+
+  FFTBase()
+  {
+    int bits = 0;
+    while ((1 << bits) < half) bits++;
+    for (int i = 0; i < half; i++)
+    {
+      int r = 0;
+      for (int b = 0; b < bits; b++)
+      {
+        if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+      }
+      bitReversed[i] = r;
+    }
+  }
+
+  template <typename T>
+  void reorder(T *re, T *im) const
+  {
+    for (int i = 0; i < half; i++)
+    {
+      int j = bitReversed[i];
+      if (j > i)
+      {
+        T t = re[i]; re[i] = re[j]; re[j] = t;
+        t = im[i]; im[i] = im[j]; im[j] = t;
+      }
+    }
+  }
+};
+
+//****************************************************************************************
+template <int M>
+class FFTCorrelator : public FFTBase<M>
+{
+  using FFTBase<M>::half;
+
+public:
+  FFTCorrelator()
+  {
+    for (int k = 0; k < half; k++)
+    {
+      cosTable[k] = cos(2 * M_PI * k / M);
+      sinTable[k] = sin(2 * M_PI * k / M);
+    }
+    samples = 0;
+  }
+
+  //****************************************************************************************
+  // The model to correlate against, n points (at most maxSamples). Returns false if it
+  // doesn't fit.
+  bool setModel(const float *model, int n)
+  {
+    if ((n < 1) || (n > FFTBase<M>::maxSamples)) return false;
+    samples = n;
+    modelNorm = removeMean(model, n, padded);
+    forward(padded, modelRe, modelIm);
+    return true;
+  }
+
+  //****************************************************************************************
+  // Correlate a window (as many points as the model) with the model at every lag.
+  // r[0] is lag -(n-1) (the window n-1 points behind the model) up to r[2n-2], lag n-1;
+  // r[n-1] is what correlation() gives. Same normalization as the sketch's
+  // crossCorrelation(). Returns the number of lags, 2n-1; all zero if either is flat.
+  int correlate(const float *window, float *r)
+  {
+    int n = samples;
+    float norm = removeMean(window, n, padded) * modelNorm;
+    if (norm <= 0)
+    {
+      for (int i = 0; i < 2 * n - 1; i++) r[i] = 0;
+      return 2 * n - 1;
+    }
+
+    forward(padded, spectrumRe, spectrumIm);
+    for (int k = 0; k <= half; k++)
+    { // conj(model) * window
+      float re = modelRe[k] * spectrumRe[k] + modelIm[k] * spectrumIm[k];
+      float im = modelRe[k] * spectrumIm[k] - modelIm[k] * spectrumRe[k];
+      spectrumRe[k] = re;
+      spectrumIm[k] = im;
+    }
+    inverse(spectrumRe, spectrumIm, padded);
+
+    for (int lag = -(n - 1); lag < n; lag++)
+    {
+      r[lag + n - 1] = padded[(lag < 0) ? lag + M : lag] / norm;
+    }
+    return 2 * n - 1;
+  }
+
+  //****************************************************************************************
+  // Real FFT of x[M] into X[0..M/2] (the rest is the mirror image).
+  void forward(const float *x, float *Xre, float *Xim)
+  {
+    for (int i = 0; i < half; i++)
+    {
+      re[i] = x[2 * i];
+      im[i] = x[2 * i + 1];
+    }
+    fft(re, im, false);
+
+    Xre[0] = re[0] + im[0];
+    Xim[0] = 0;
+    Xre[half] = re[0] - im[0];
+    Xim[half] = 0;
+    for (int k = 1; k < half; k++)
+    {
+      // The transforms of the even and odd points, then one more butterfly.
+      float er = 0.5f * (re[k] + re[half - k]), ei = 0.5f * (im[k] - im[half - k]);
+      float or_ = 0.5f * (im[k] + im[half - k]), oi = -0.5f * (re[k] - re[half - k]);
+      float wr = cosTable[k], wi = -sinTable[k];
+      Xre[k] = er + wr * or_ - wi * oi;
+      Xim[k] = ei + wr * oi + wi * or_;
+    }
+  }
+
+  //****************************************************************************************
+  // The inverse: X[0..M/2] back to x[M].
+  void inverse(const float *Xre, const float *Xim, float *x)
+  {
+    for (int k = 0; k < half; k++)
+    {
+      float er = 0.5f * (Xre[k] + Xre[half - k]), ei = 0.5f * (Xim[k] - Xim[half - k]);
+      float dr = 0.5f * (Xre[k] - Xre[half - k]), di = 0.5f * (Xim[k] + Xim[half - k]);
+      float wr = cosTable[k], wi = sinTable[k];
+      float or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+      re[k] = er - oi;
+      im[k] = ei + or_;
+    }
+    fft(re, im, true);
+
+    float scale = 1.0f / half;
+    for (int i = 0; i < half; i++)
+    {
+      x[2 * i] = re[i] * scale;
+      x[2 * i + 1] = im[i] * scale;
+    }
+  }
+
+private:
+  float cosTable[M / 2], sinTable[M / 2]; // cos, sin(2 pi k / M)
+  float re[M / 2], im[M / 2];             // The half-size complex FFT
+  float padded[M];
+  float modelRe[M / 2 + 1], modelIm[M / 2 + 1];
+  float spectrumRe[M / 2 + 1], spectrumIm[M / 2 + 1];
+  float modelNorm;
+  int samples;
+
+  // Copies in less its mean, zero-pads to M. Returns sqrt(sum of squares).
+  static float removeMean(const float *in, int n, float *out)
+  {
+    float m = 0;
+    for (int i = 0; i < n; i++) m += in[i];
+    m /= n;
+    float ss = 0;
+    for (int i = 0; i < n; i++)
+    {
+      out[i] = in[i] - m;
+      ss += out[i] * out[i];
+    }
+    for (int i = n; i < M; i++) out[i] = 0;
+    return sqrt(ss);
+  }
+
+  void fft(float *xr, float *xi, bool inv) const
+  {
+    this->reorder(xr, xi);
+    for (int len = 2; len <= half; len <<= 1)
+    {
+      int step = M / len;
+      for (int j = 0; j < len / 2; j++)
+      {
+        float wr = cosTable[j * step];
+        float wi = inv ? sinTable[j * step] : -sinTable[j * step];
+        for (int i = j; i < half; i += len)
+        {
+          int k = i + len / 2;
+          float vr = xr[k] * wr - xi[k] * wi;
+          float vi = xr[k] * wi + xi[k] * wr;
+          xr[k] = xr[i] - vr;
+          xi[k] = xi[i] - vi;
+          xr[i] += vr;
+          xi[i] += vi;
+        }
+      }
+    }
+  }
+};
+
+//****************************************************************************************
+// The same in Q15. Windows are LIDAR distances (cm); results are Q15 (32767 = 1.0).
+//
+// Block floating point: the data is kept between 1/4 and 1/2 of full scale going into
+// each stage, halving the whole block (and counting it) only when it has grown, so small
+// signals keep their bits and big ones can't overflow.
+template <int M>
+class FFTCorrelatorQ15 : public FFTBase<M>
+{
+  using FFTBase<M>::half;
+
+public:
+  FFTCorrelatorQ15()
+  {
+    for (int k = 0; k < half; k++)
+    {
+      cosTable[k] = (int16_t)lround(32767 * cos(2 * M_PI * k / M));
+      sinTable[k] = (int16_t)lround(32767 * sin(2 * M_PI * k / M));
+    }
+    samples = 0;
+  }
+
+  //****************************************************************************************
+  bool setModel(const float *model, int n)
+  {
+    if ((n < 1) || (n > FFTBase<M>::maxSamples)) return false;
+    samples = n;
+
+    float m = 0, peak = 0;
+    for (int i = 0; i < n; i++) m += model[i];
+    m /= n;
+    for (int i = 0; i < n; i++) peak = fmax(peak, fabs(model[i] - m));
+
+    int32_t scaled[M / 2];
+    float scale = (peak > 0) ? 32767 / peak : 0;
+    for (int i = 0; i < n; i++) scaled[i] = lround((model[i] - m) * scale);
+    modelNorm = pad(scaled, n);
+    modelExponent = forward(padded, modelRe, modelIm);
+    return true;
+  }
+
+  //****************************************************************************************
+  // As FFTCorrelator::correlate(), with r in Q15.
+  int correlate(const int16_t *window, int16_t *r)
+  {
+    int n = samples;
+
+    // Less its mean (exactly: n times each reading less the sum, so a fraction of a cm
+    // left over doesn't show up at every lag), scaled by a power of two to use the 16 bits.
+    int32_t sum = 0;
+    for (int i = 0; i < n; i++) sum += window[i];
+    int32_t scaled[M / 2], peak = 0;
+    for (int i = 0; i < n; i++)
+    {
+      scaled[i] = (int32_t)window[i] * n - sum;
+      if (abs(scaled[i]) > peak) peak = abs(scaled[i]);
+    }
+    int shift = 0;
+    while ((peak >> -shift) > 32767) shift--;
+    while ((shift >= 0) && (peak > 0) && ((peak << (shift + 1)) < 32768)) shift++;
+    for (int i = 0; i < n; i++)
+    {
+      scaled[i] = (shift >= 0) ? scaled[i] << shift : (int32_t)roundShift(scaled[i], -shift);
+    }
+
+    uint32_t windowNorm = pad(scaled, n);
+    if ((windowNorm == 0) || (modelNorm == 0))
+    {
+      for (int i = 0; i < 2 * n - 1; i++) r[i] = 0;
+      return 2 * n - 1;
+    }
+
+    // conj(model) * window, brought back into 16 bits.
+    int exponent = modelExponent + forward(padded, spectrumRe, spectrumIm);
+    int64_t productRe[M / 2 + 1], productIm[M / 2 + 1];
+    int64_t biggest = 0;
+    for (int k = 0; k <= half; k++)
+    {
+      productRe[k] = (int64_t)modelRe[k] * spectrumRe[k] + (int64_t)modelIm[k] * spectrumIm[k];
+      productIm[k] = (int64_t)modelRe[k] * spectrumIm[k] - (int64_t)modelIm[k] * spectrumRe[k];
+      if (productRe[k] > biggest) biggest = productRe[k];
+      if (-productRe[k] > biggest) biggest = -productRe[k];
+      if (productIm[k] > biggest) biggest = productIm[k];
+      if (-productIm[k] > biggest) biggest = -productIm[k];
+    }
+    int productShift = 0;
+    while ((biggest >> productShift) >= blockLimit) productShift++;
+    for (int k = 0; k <= half; k++)
+    {
+      spectrumRe[k] = (int16_t)roundShift(productRe[k], productShift);
+      spectrumIm[k] = (int16_t)roundShift(productIm[k], productShift);
+    }
+    exponent += productShift + inverse(spectrumRe, spectrumIm, padded);
+
+    // The correlation of the scaled inputs is out * 2^exponent / (M/2); divided by their
+    // norms, in Q15. Kept in integers: 2^62 / the divisor, then the rest as a shift.
+    int64_t divisor = (int64_t)half * modelNorm * windowNorm;
+    int64_t factor = ((int64_t)1 << 62) / divisor;
+    int resultShift = 62 - 15 - exponent;
+    for (int lag = -(n - 1); lag < n; lag++)
+    {
+      int64_t v = (int64_t)padded[(lag < 0) ? lag + M : lag] * factor;
+      v = (resultShift >= 0) ? roundShift(v, resultShift) : v << -resultShift;
+      r[lag + n - 1] = (int16_t)((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+    }
+    return 2 * n - 1;
+  }
+
+  //****************************************************************************************
+  // Real FFT of x[M] into X[0..M/2]. Returns e: the transform is X * 2^e.
+  int forward(const int16_t *x, int16_t *Xre, int16_t *Xim)
+  {
+    int32_t peak = 0;
+    for (int i = 0; i < half; i++)
+    {
+      re[i] = x[2 * i];
+      im[i] = x[2 * i + 1];
+      peak = max(peak, max((int32_t)abs(re[i]), (int32_t)abs(im[i])));
+    }
+    int e = fft(re, im, false, peak);
+    e += normalize(re, im, half, peak);
+
+    Xre[0] = (int16_t)((int32_t)re[0] + im[0]);
+    Xim[0] = 0;
+    Xre[half] = (int16_t)((int32_t)re[0] - im[0]);
+    Xim[half] = 0;
+    for (int k = 1; k < half; k++)
+    {
+      int32_t er = ((int32_t)re[k] + re[half - k]) >> 1, ei = ((int32_t)im[k] - im[half - k]) >> 1;
+      int32_t or_ = ((int32_t)im[k] + im[half - k]) >> 1, oi = -(((int32_t)re[k] - re[half - k]) >> 1);
+      int32_t wr = cosTable[k], wi = -sinTable[k];
+      Xre[k] = (int16_t)(er + ((wr * or_ - wi * oi + (1 << 14)) >> 15));
+      Xim[k] = (int16_t)(ei + ((wr * oi + wi * or_ + (1 << 14)) >> 15));
+    }
+    return e;
+  }
+
+  //****************************************************************************************
+  // The inverse, X[0..M/2] to x[M], without the 1/(M/2). Returns e: the result is
+  // x * (M/2) * 2^-e.
+  int inverse(const int16_t *Xre, const int16_t *Xim, int16_t *x)
+  {
+    int32_t peak = 0;
+    for (int k = 0; k <= half; k++) peak = max(peak, max((int32_t)abs(Xre[k]), (int32_t)abs(Xim[k])));
+    int16_t inRe[M / 2 + 1], inIm[M / 2 + 1];
+    memcpy(inRe, Xre, sizeof(inRe));
+    memcpy(inIm, Xim, sizeof(inIm));
+    int e = normalize(inRe, inIm, half + 1, peak);
+
+    peak = 0;
+    for (int k = 0; k < half; k++)
+    {
+      int32_t er = ((int32_t)inRe[k] + inRe[half - k]) >> 1, ei = ((int32_t)inIm[k] - inIm[half - k]) >> 1;
+      int32_t dr = ((int32_t)inRe[k] - inRe[half - k]) >> 1, di = ((int32_t)inIm[k] + inIm[half - k]) >> 1;
+      int32_t wr = cosTable[k], wi = sinTable[k];
+      int32_t or_ = (dr * wr - di * wi + (1 << 14)) >> 15, oi = (dr * wi + di * wr + (1 << 14)) >> 15;
+      re[k] = (int16_t)(er - oi);
+      im[k] = (int16_t)(ei + or_);
+      peak = max(peak, max((int32_t)abs(re[k]), (int32_t)abs(im[k])));
+    }
+    e += fft(re, im, true, peak);
+
+    for (int i = 0; i < half; i++)
+    {
+      x[2 * i] = re[i];
+      x[2 * i + 1] = im[i];
+    }
+    return e;
+  }
+
+private:
+  static const int32_t blockLimit = 8192; // Worst-case growth through a butterfly is 1 + sqrt(2)
+
+  int16_t cosTable[M / 2], sinTable[M / 2];
+  int16_t re[M / 2], im[M / 2];
+  int16_t padded[M];
+  int16_t modelRe[M / 2 + 1], modelIm[M / 2 + 1];
+  int16_t spectrumRe[M / 2 + 1], spectrumIm[M / 2 + 1];
+  uint32_t modelNorm;
+  int modelExponent;
+  int samples;
+
+  static int64_t roundShift(int64_t v, int shift)
+  {
+    return (shift > 0) ? (v + ((int64_t)1 << (shift - 1))) >> shift : v;
+  }
+
+  // Halve the block until it's under blockLimit. Returns how many times.
+  static int normalize(int16_t *xr, int16_t *xi, int count, int32_t &peak)
+  {
+    int shift = 0;
+    while ((peak >> shift) >= blockLimit) shift++;
+    if (shift == 0) return 0;
+    for (int i = 0; i < count; i++)
+    {
+      xr[i] = (int16_t)roundShift(xr[i], shift);
+      xi[i] = (int16_t)roundShift(xi[i], shift);
+    }
+    peak >>= shift;
+    return shift;
+  }
+
+  // Copies in, zero-pads to M. Returns sqrt(sum of squares).
+  uint32_t pad(const int32_t *in, int n)
+  {
+    uint64_t ss = 0;
+    for (int i = 0; i < n; i++)
+    {
+      padded[i] = (int16_t)((in[i] > 32767) ? 32767 : ((in[i] < -32768) ? -32768 : in[i]));
+      ss += (int64_t)padded[i] * padded[i];
+    }
+    for (int i = n; i < M; i++) padded[i] = 0;
+    return isqrt64(ss);
+  }
+
+  // The half-size complex FFT, unscaled, in block floating point. peak is the largest
+  // magnitude going in. Returns how many times the block was halved.
+  int fft(int16_t *xr, int16_t *xi, bool inv, int32_t &peak) const
+  {
+    int e = 0;
+    this->reorder(xr, xi);
+    for (int len = 2; len <= half; len <<= 1)
+    {
+      e += normalize(xr, xi, half, peak);
+      peak = 0;
+      int step = M / len;
+      for (int j = 0; j < len / 2; j++)
+      {
+        int32_t wr = cosTable[j * step];
+        int32_t wi = inv ? sinTable[j * step] : -sinTable[j * step];
+        for (int i = j; i < half; i += len)
+        {
+          int k = i + len / 2;
+          int32_t vr = (xr[k] * wr - xi[k] * wi + (1 << 14)) >> 15;
+          int32_t vi = (xr[k] * wi + xi[k] * wr + (1 << 14)) >> 15;
+          int32_t ur = xr[i], ui = xi[i];
+          int32_t ar = ur + vr, ai = ui + vi, br = ur - vr, bi = ui - vi;
+          xr[i] = (int16_t)ar;
+          xi[i] = (int16_t)ai;
+          xr[k] = (int16_t)br;
+          xi[k] = (int16_t)bi;
+          peak = max(peak, max(max(abs(ar), abs(ai)), max(abs(br), abs(bi))));
+        }
+      }
+    }
+    return e;
+  }
+};
+
+#endif // __DIGAME_FFT_H__
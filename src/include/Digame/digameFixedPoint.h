@@ -0,0 +1,269 @@
+/* digameFixedPoint.h
+ *
+ *  The arithmetic the detectors do -- exponential smoothing, decay, mean and
+ *  variance, correlation -- in three flavours, chosen at compile time by the
+ *  detector's template parameter:
+ *
+ *    FloatKernels  What the detectors have always done, bit for bit.
+ *    Q15Kernels    16-bit values and Q15 coefficients, 32-bit products.
+ *    Q31Kernels    32-bit values and Q31 coefficients, 64-bit products.
+ *
+ *  In low-power mode the CPU runs at 40 MHz, and the float versions are
+ *  expensive there, mostly because of the double-precision constants
+ *  (1.0 - factor, 0.05), which the ESP32 does in software. The fixed-point
+ *  versions use integer instructions only.
+ *
+ *  A Value is a distance in cm, or a zone strength (0-100):
+ *    Q15: int16_t, 4 fractional bits   (to 2047.9375, steps of 1/16)
+ *    Q31: int32_t, 20 fractional bits  (to 2047.999999)
+ *  Values can be compared directly with each other and with fromInt().
+ *  A Coeff is a smoothing or decay factor in [0, 1). Convert them once, not
+ *  on every sample: coeff() is float (or double) arithmetic.
+ *
+ *  src/host/bench/bench_fixed_point compares cycle counts; test_fixed_point
+ *  checks the fixed-point detectors count the same vehicles as the float ones.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_FIXED_POINT_H__
+#define __DIGAME_FIXED_POINT_H__
+
+#include <digameMath.h>
+#include <math.h>
+#include <stdint.h>
+
+//****************************************************************************************
+// Correlation coefficient from sums taken n times over (so they're exact integers):
+// sxy = n sum(xy) - sum(x) sum(y), etc. Returns r * 2^bits, or 0 if either side is flat.
+inline int64_t fixedCorrelation(int64_t sxy, int64_t sxx, int64_t syy, int bits)
+{
+  if ((sxx <= 0) || (syy <= 0)) return 0;
+
+  // sqrt(sxx) and sqrt(syy), each with as many bits as will fit: the root of v << 2k is
+  // sqrt(v) << k.
+  int kx = 0, ky = 0;
+  while ((sxx >> 60) == 0) { sxx <<= 2; kx++; }
+  while ((syy >> 60) == 0) { syy <<= 2; ky++; }
+  int64_t denom = (int64_t)isqrt64(sxx) * isqrt64(syy); // < 2^62
+
+  // r * 2^bits = sxy * 2^(kx + ky + bits) / denom. Shift sxy up as far as it goes and
+  // denom down the rest of the way.
+  int shift = kx + ky + bits;
+  int up = 0;
+  int64_t num = (sxy < 0) ? -sxy : sxy;
+  while ((up < shift) && ((num >> 61) == 0)) { num <<= 1; up++; }
+  if (shift - up > 62) return 0;
+  denom >>= (shift - up);
+  if (denom == 0) return 0;
+  int64_t r = (num + denom / 2) / denom;
+  return (sxy < 0) ? -r : r;
+}
+
+//****************************************************************************************
+struct FloatKernels
+{
+  typedef float Value;
+  typedef float Wide;    // Variances
+  typedef double Coeff;  // Double, as the detectors' constants always were
+  typedef float Ratio;   // Correlation coefficients
+  typedef float Model;   // Correlation models
+
+  static const char *name() { return "float"; }
+  static Value fromInt(int cm) { return (float)cm; }
+  static Coeff coeff(double f) { return f; }
+  static int toInt(Value v) { return (int)v; }
+  static float toFloat(Value v) { return v; }
+  static float ratioToFloat(Ratio r) { return r; }
+
+  // s * a + x * (1 - a)
+  static Value smooth(Value s, int x, Coeff a)
+  {
+    return s * (float)a + (float)x * (1.0 - (float)a);
+  }
+
+  // s - s * k
+  static Value decay(Value s, Coeff k) { return s - s * k; }
+
+  static void meanVariance(const int16_t *x, int n, Value &m, Wide &variance)
+  {
+    m = 0;
+    for (int i = 0; i < n; i++) m += x[i];
+    m /= n;
+    variance = 0;
+    for (int i = 0; i < n; i++) variance += (x[i] - m) * (x[i] - m);
+    variance /= n;
+  }
+
+  static void makeModel(const float *model, int n, Model *out)
+  {
+    for (int i = 0; i < n; i++) out[i] = model[i];
+  }
+
+  // The same steps as correlation() in digameMath.h
+  static Ratio correlation(const Model *model, const int16_t *y, int n)
+  {
+    float mx = 0, my = 0;
+    for (int i = 0; i < n; i++)
+    {
+      mx += model[i];
+      my += y[i];
+    }
+    mx /= n;
+    my /= n;
+    float sx = 0, sy = 0, sxy = 0;
+    for (int i = 0; i < n; i++)
+    {
+      sx += (model[i] - mx) * (model[i] - mx);
+      sy += (y[i] - my) * (y[i] - my);
+    }
+    float denom = sqrt(sx * sy);
+    for (int i = 0; i < n; i++) sxy += (model[i] - mx) * (y[i] - my);
+    return sxy / denom;
+  }
+};
+
+//****************************************************************************************
+struct Q15Kernels
+{
+  typedef int16_t Value; // 4 fractional bits
+  typedef int32_t Wide;  // 4 fractional bits
+  typedef int16_t Coeff; // Q15
+  typedef int16_t Ratio; // Q15
+  typedef int16_t Model; // Q15, less its mean, scaled to full range
+
+  static const int fraction = 4;
+
+  static const char *name() { return "Q15"; }
+  static Value fromInt(int cm)
+  {
+    int32_t v = (int32_t)cm << fraction;
+    return (Value)((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+  }
+  static Coeff coeff(double f)
+  {
+    long q = lround(f * 32768);
+    return (Coeff)((q > 32767) ? 32767 : ((q < 0) ? 0 : q));
+  }
+  static int toInt(Value v) { return (v >= 0) ? (v >> fraction) : -((-v) >> fraction); }
+  static float toFloat(Value v) { return v / (float)(1 << fraction); }
+  static float ratioToFloat(Ratio r) { return r / 32768.0f; }
+
+  static Value smooth(Value s, int x, Coeff a)
+  {
+    int32_t d = (int32_t)fromInt(x) - s;
+    return (Value)(s + ((d * (32768 - a) + (1 << 14)) >> 15));
+  }
+
+  static Value decay(Value s, Coeff k)
+  {
+    return (Value)(s - (((int32_t)s * k + (1 << 14)) >> 15));
+  }
+
+  static void meanVariance(const int16_t *x, int n, Value &m, Wide &variance)
+  {
+    int32_t sum = 0;
+    int64_t squares = 0;
+    for (int i = 0; i < n; i++)
+    {
+      sum += x[i];
+      squares += (int32_t)x[i] * x[i];
+    }
+    m = (Value)(((sum << fraction) + n / 2) / n);
+    variance = (Wide)((((int64_t)n * squares - (int64_t)sum * sum) << fraction) / ((int64_t)n * n));
+  }
+
+  static void makeModel(const float *model, int n, Model *out)
+  {
+    float mx = 0, peak = 0;
+    for (int i = 0; i < n; i++) mx += model[i];
+    mx /= n;
+    for (int i = 0; i < n; i++) peak = fmax(peak, fabs(model[i] - mx));
+    for (int i = 0; i < n; i++) out[i] = (peak > 0) ? (Model)lround((model[i] - mx) * 32767 / peak) : 0;
+  }
+
+  static Ratio correlation(const Model *model, const int16_t *y, int n)
+  {
+    int64_t sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    for (int i = 0; i < n; i++)
+    {
+      sx += model[i];
+      sy += y[i];
+      sxx += (int32_t)model[i] * model[i];
+      syy += (int32_t)y[i] * y[i];
+      sxy += (int32_t)model[i] * y[i];
+    }
+    int64_t r = fixedCorrelation(n * sxy - sx * sy, n * sxx - sx * sx, n * syy - sy * sy, 15);
+    return (Ratio)((r > 32767) ? 32767 : ((r < -32768) ? -32768 : r));
+  }
+};
+
+//****************************************************************************************
+struct Q31Kernels
+{
+  typedef int32_t Value; // 20 fractional bits
+  typedef int64_t Wide;  // 20 fractional bits
+  typedef int32_t Coeff; // Q31
+  typedef int32_t Ratio; // Q31
+  typedef int16_t Model; // As Q15Kernels; the sums are what need the bits.
+
+  static const int fraction = 20;
+
+  static const char *name() { return "Q31"; }
+  static Value fromInt(int cm)
+  {
+    int64_t v = (int64_t)cm << fraction;
+    return (Value)((v > INT32_MAX) ? INT32_MAX : ((v < INT32_MIN) ? INT32_MIN : v));
+  }
+  static Coeff coeff(double f)
+  {
+    double q = floor(f * 2147483648.0 + 0.5);
+    return (Coeff)((q > 2147483647.0) ? 2147483647 : ((q < 0) ? 0 : q));
+  }
+  static int toInt(Value v) { return (v >= 0) ? (v >> fraction) : -((-v) >> fraction); }
+  static float toFloat(Value v) { return v / (float)(1 << fraction); }
+  static float ratioToFloat(Ratio r) { return r / 2147483648.0f; }
+
+  static Value smooth(Value s, int x, Coeff a)
+  {
+    int64_t d = (int64_t)fromInt(x) - s;
+    return (Value)(s + ((d * ((int64_t)2147483648LL - a) + (1LL << 30)) >> 31));
+  }
+
+  static Value decay(Value s, Coeff k)
+  {
+    return (Value)(s - (((int64_t)s * k + (1LL << 30)) >> 31));
+  }
+
+  static void meanVariance(const int16_t *x, int n, Value &m, Wide &variance)
+  {
+    int32_t sum = 0;
+    int64_t squares = 0;
+    for (int i = 0; i < n; i++)
+    {
+      sum += x[i];
+      squares += (int32_t)x[i] * x[i];
+    }
+    m = (Value)((((int64_t)sum << fraction) + n / 2) / n);
+    variance = (((int64_t)n * squares - (int64_t)sum * sum) << fraction) / ((int64_t)n * n);
+  }
+
+  static void makeModel(const float *model, int n, Model *out) { Q15Kernels::makeModel(model, n, out); }
+
+  static Ratio correlation(const Model *model, const int16_t *y, int n)
+  {
+    int64_t sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    for (int i = 0; i < n; i++)
+    {
+      sx += model[i];
+      sy += y[i];
+      sxx += (int32_t)model[i] * model[i];
+      syy += (int32_t)y[i] * y[i];
+      sxy += (int32_t)model[i] * y[i];
+    }
+    int64_t r = fixedCorrelation(n * sxy - sx * sy, n * sxx - sx * sx, n * syy - sy * sy, 31);
+    return (Ratio)((r > INT32_MAX) ? INT32_MAX : ((r < INT32_MIN) ? INT32_MIN : r));
+  }
+};
+
+#endif // __DIGAME_FIXED_POINT_H__
@@ -0,0 +1,200 @@
+/* digameHTTPSession.h
+ *
+ *  One connection to the server, kept open (Connection: keep-alive) from
+ *  one POST to the next, so a message costs a round trip rather than a DNS
+ *  lookup, a TCP handshake and a round trip. The server's address is looked
+ *  up once and kept. If the server has closed the connection while it sat
+ *  idle, the POST goes again on a new one; if the address stops answering,
+ *  it's looked up again next time. Nothing is opened until there's
+ *  something to send.
+ *
+ *  Each POST's latency goes into histograms the heartbeat reports:
+ *
+ *    connect   looking up the address (the first time) and the TCP
+ *              handshake, for POSTs that needed a new connection
+ *    ttfb      from sending the request to the reply's headers
+ *    total     the whole POST, reply body and all
+ *
+ *  http:// URLs only: https needs a WiFiClientSecure and certificates
+ *  (see digameNetwork_v2.h).
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_HTTP_SESSION_H__
+#define __DIGAME_HTTP_SESSION_H__
+
+#include <WiFi.h>       // WiFi stack
+#include <HTTPClient.h> // To post to the ParkData Server
+
+const int latencyBuckets = 14; // Under 1, 2, 4, ... 4096 ms, and longer
+
+//****************************************************************************************
+// Latencies in power-of-two millisecond buckets: small, and fine enough to tell a good
+// link from a bad one.
+struct LatencyHistogram
+{
+  unsigned long counts[latencyBuckets] = {};
+  unsigned long n = 0;
+  unsigned long maxMS = 0;
+  unsigned long long sumMS = 0;
+
+  void add(unsigned long ms)
+  {
+    int b = 0;
+    while ((b < latencyBuckets - 1) && (ms >= (1UL << b))) b++;
+    counts[b]++;
+    n++;
+    sumMS += ms;
+    if (ms > maxMS) maxMS = ms;
+  }
+
+  // The upper edge of the bucket holding the p'th percentile (0..1), in ms. (The max
+  // for the last bucket.)
+  unsigned long percentile(float p) const
+  {
+    if (n == 0) return 0;
+    unsigned long want = (unsigned long)(p * n + 0.5f);
+    if (want < 1) want = 1;
+    unsigned long seen = 0;
+    for (int b = 0; b < latencyBuckets - 1; b++)
+    {
+      seen += counts[b];
+      if (seen >= want) return (1UL << b) < maxMS ? (1UL << b) : maxMS;
+    }
+    return maxMS;
+  }
+
+  float mean() const { return n ? (float)sumMS / n : 0; }
+};
+
+//****************************************************************************************
+class HTTPSession
+{
+public:
+  LatencyHistogram connectMS, ttfbMS, totalMS;
+  unsigned long posts = 0;      // POSTs tried
+  unsigned long failures = 0;   // ...that got no reply at all
+  unsigned long connects = 0;   // TCP connections opened
+  unsigned long lookups = 0;    // DNS lookups
+  unsigned long retries = 0;    // POSTs sent again on a new connection
+
+  // Where to POST. False if it isn't an http:// URL. Changing the host or port drops the
+  // connection and the address.
+  bool begin(const String &serverURL)
+  {
+    if (serverURL == url) return valid;
+    url = serverURL;
+    valid = false;
+    if (!url.startsWith("http://")) return false;
+    String hostPort = url.substring(7);
+    int slash = hostPort.indexOf('/');
+    if (slash >= 0) hostPort = hostPort.substring(0, slash);
+    int colon = hostPort.indexOf(':');
+    String newHost = (colon < 0) ? hostPort : hostPort.substring(0, colon);
+    uint16_t newPort = (colon < 0) ? 80 : (uint16_t)hostPort.substring(colon + 1).toInt();
+    if ((newHost != host) || (newPort != port))
+    {
+      close();
+      addressKnown = false;
+    }
+    host = newHost;
+    port = newPort;
+    valid = (host.length() > 0);
+    return valid;
+  }
+
+  // POST a JSON payload, with one more header if headerName isn't null. Returns the HTTP
+  // response code, or an HTTPC_ERROR_ code. The reply's body is in reply().
+  int post(const String &payload, const char *headerName = nullptr, const String &headerValue = "")
+  {
+    replyBody = "";
+    if (!valid) return HTTPC_ERROR_NOT_CONNECTED;
+    posts++;
+    unsigned long t0 = micros();
+
+    int code = HTTPC_ERROR_CONNECTION_REFUSED;
+    unsigned long tSent = t0;
+    bool fresh = false;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+      fresh = !client.connected();
+      if (fresh)
+      {
+        unsigned long tConnect = micros();
+        if (!connect()) break;
+        connectMS.add((micros() - tConnect) / 1000);
+      }
+      tSent = micros();
+      http.begin(client, url);
+      http.addHeader("Content-Type", "application/json");
+      if (headerName) http.addHeader(headerName, headerValue);
+      code = http.POST(payload);
+      if ((code > 0) || fresh || (code == HTTPC_ERROR_READ_TIMEOUT)) break;
+      // An idle connection the server had closed: once more, on a new one.
+      retries++;
+      client.stop();
+    }
+
+    if (code > 0)
+    {
+      ttfbMS.add((micros() - tSent) / 1000);
+      replyBody = http.getString();
+    }
+    else
+    {
+      failures++;
+    }
+    http.end();
+    if (code > 0) totalMS.add((micros() - t0) / 1000);
+    return code;
+  }
+
+  String reply() const { return replyBody; }
+  bool connected() { return client.connected(); }
+
+  // Drop the connection (e.g. before WiFi goes off). The address is kept.
+  void close() { client.stop(); }
+
+private:
+  WiFiClient client; // Before http: ~HTTPClient() stops the client, so it must outlive it.
+  HTTPClient http;
+  String url, host;
+  uint16_t port = 80;
+  bool valid = false;
+  IPAddress address;
+  bool addressKnown = false;
+  String replyBody;
+
+  bool connect()
+  {
+    if (!addressKnown)
+    {
+      lookups++;
+      if (!WiFi.hostByName(host.c_str(), address)) return false;
+      addressKnown = true;
+    }
+    connects++;
+    if (client.connect(address, port)) return true;
+    addressKnown = false; // Maybe it moved: look it up again next time
+    return false;
+  }
+};
+
+//****************************************************************************************
+// The counts and latencies as JSON, for the heartbeats.
+String getHTTPSessionJSON(const HTTPSession &s)
+{
+  auto histogram = [](const LatencyHistogram &h) {
+    return "{\"n\":" + String(h.n) + ",\"mean\":" + String(h.mean(), 1) +
+           ",\"p50\":" + String(h.percentile(0.5f)) + ",\"p90\":" + String(h.percentile(0.9f)) +
+           ",\"max\":" + String(h.maxMS) + "}";
+  };
+  return "{\"posts\":" + String(s.posts) + ",\"failures\":" + String(s.failures) +
+         ",\"connects\":" + String(s.connects) + ",\"lookups\":" + String(s.lookups) +
+         ",\"retries\":" + String(s.retries) +
+         ",\"connectMS\":" + histogram(s.connectMS) + ",\"ttfbMS\":" + histogram(s.ttfbMS) +
+         ",\"totalMS\":" + histogram(s.totalMS) + "}";
+}
+
+#endif // __DIGAME_HTTP_SESSION_H__
@@ -14,6 +14,7 @@
 #endif
 
 #include <ArduinoJson.h>
+#include <atomic>
 
 
 // Counter values for each counter TODO:add to config.
@@ -42,6 +43,7 @@ struct Config
 
   //String serverURL           = "https://trailwaze.info/zion/lidar_sensor_import.php"; // The ParkData server URL
   String serverURL = "http://199.21.201.53/trailwaze/zion/lidar_sensor_import.php"; // http server. Faster!
+  String postBatchSize = "1"; // Events to a POST. More than 1 needs a server that takes batches (digameBatchPost.h)
 
   //Debugging
   String showDataStream = "false";
@@ -68,16 +70,24 @@ struct Config
   String loraPreamble = "7";
 
   // LIDAR Parameters:
-  String lidarDetectionAlgorithm = "Threshold";
+  String lidarDetectionAlgorithm = "Decay"; // lidar.detector. See detectionAlgorithmNames
   String lidarUpdateInterval = "10";
   String lidarSmoothingFactor = "0.6";
   String lidarResidenceTime = "5";
+  String lidarDecay = "0.05";         // Decay detector: lane strength lost per reading past the lane
+  String lidarPresenceCutoff = "10";  //   and the strength (%) below which the vehicle has gone
   String lidarZone1Min = "0";
   String lidarZone1Max = "300";
   String lidarZone2Min = "400";
   String lidarZone2Max = "700";
   String lidarZone1Count = "0";
   String lidarZone2Count = "0";
+  String lidarAutoLanes = ""; // "checked": apply the lane limits digameLaneFinder.h proposes.
+  String lidarShadowDetectors = ""; // Up to two more to run alongside, e.g. "Threshold,Correlation"
+  String lidarPreFilter = "None";     // Rain and snow: see preFilterNames and digamePreFilter.h
+  String lidarPreFilterWindow = "5";  //   readings in the median window (odd, 3 to 31)
+  String lidarHampelThreshold = "3";  //   Hampel: MADs from the median before a reading is replaced
+  String lidarMinRunLength = "1";     //   readings in a row before anything is seen (1: off, max 32)
 
   
 
@@ -103,6 +113,85 @@ struct Config
 
 Config config;
 
+// Vehicle detection algorithms. (lidar.detector in PARAMS.TXT)
+enum DetectionAlgorithm
+{
+  DETECT_THRESHOLD,   // processLIDARSample: smoothed distance, time in zone
+  DETECT_VOTING,      // processLIDARSample2: readings in zone over the last lidarSamples
+  DETECT_DECAY,       // processLIDARSample3: voting with an exponential decay
+  DETECT_CORRELATION, // processLIDARSampleCorrelation: a matched filter for the car leaving
+  DETECT_ALGORITHMS
+};
+
+// What PARAMS.TXT, the web page and the event messages call them, in enum order.
+const char *const detectionAlgorithmNames[DETECT_ALGORITHMS] = {"Threshold", "Voting", "Decay",
+                                                                "Correlation"};
+
+// Pre-filters run on the readings before the detector. (lidar.preFilter in PARAMS.TXT)
+enum LIDARPreFilterType
+{
+  PREFILTER_NONE,   // Readings go straight to the detector
+  PREFILTER_MEDIAN, // The median of the last lidarPreFilterWindow readings
+  PREFILTER_HAMPEL, // The reading, unless it's an outlier from that median
+  PREFILTER_TYPES
+};
+
+const char *const preFilterNames[PREFILTER_TYPES] = {"None", "Median", "Hampel"};
+
+// A typed copy of the Config values used while counting. Config holds everything as
+// Strings, which is handy for the file and the web pages but too slow to parse on every
+// LIDAR sample. This is built from Config once at load and rebuilt when the web server
+// changes a value. Field names match the Config fields they come from.
+struct RuntimeConfig
+{
+  bool showDataStream;
+
+  bool logBootEvents;
+  bool logHeartBeatEvents;
+  bool logVehicleEvents;
+  bool logRawData;
+
+  unsigned long heartbeatInterval; // Seconds
+  int postBatchSize;
+  int counterPopulation;
+  int counterID;
+
+  DetectionAlgorithm lidarDetectionAlgorithm;
+  int lidarUpdateInterval;
+  float lidarSmoothingFactor;
+  int lidarResidenceTime;
+  double lidarDecay;         // Double, like the 0.05 the decay detector always used
+  int lidarPresenceCutoff;
+  int lidarZone1Min;
+  int lidarZone1Max;
+  int lidarZone2Min;
+  int lidarZone2Max;
+  bool lidarAutoLanes;
+  DetectionAlgorithm lidarShadowDetectors[2]; // Not the counting one, no repeats
+  int lidarShadowCount;
+  LIDARPreFilterType lidarPreFilter;
+  int lidarPreFilterWindow;
+  float lidarHampelThreshold;
+  int lidarMinRunLength;
+};
+
+RuntimeConfig buildRuntimeConfig(const Config &config);
+void publishRuntimeConfig(const Config &config);
+RuntimeConfig getRuntimeConfig();
+
+// Two copies: the current one and the one the next update is written to. The sequence
+// counts updates, twice each: odd while one is being written. Slot (sequence / 2) % 2
+// is current. Updates come from the web server and the counting loop a few times a
+// minute at most; readers take a copy (getRuntimeConfig()) and keep it for a pass
+// through their loop, however long that takes.
+RuntimeConfig runtimeConfigSlots[2] = {buildRuntimeConfig(config), buildRuntimeConfig(config)};
+std::atomic<uint32_t> runtimeConfigSequence{0};
+
+// config's Strings are changed by the web server and, with lidar.autoLanes, by the
+// counting loop. Hold this to change them, or to read them from another task after
+// setup(). (The counting loop reads getRuntimeConfig() instead.)
+SemaphoreHandle_t configMutex = xSemaphoreCreateMutex();
+
 const char *filename = "/params.txt"; // <- SD library uses 8.3 filenames
 const char *histoFilename = "/histo.csv";
 
@@ -143,12 +232,114 @@ bool initSDCard()
     Serial.println("UNKNOWN");
   }
   uint64_t cardSize = SD.cardSize() / (1024 * 1024);
-  Serial.printf("    SD Card Size: %lluMB\n", cardSize);
+  Serial.printf("    SD Card Size: %lluMB\n", (unsigned long long)cardSize);
   return true;
 
 }
 
 
+//****************************************************************************************
+// Parse the values the detection code needs out of the Config strings.
+RuntimeConfig buildRuntimeConfig(const Config &config)
+{
+  RuntimeConfig rc;
+
+  rc.showDataStream = (config.showDataStream == "true");
+
+  rc.logBootEvents      = (config.logBootEvents == "checked");
+  rc.logHeartBeatEvents = (config.logHeartBeatEvents == "checked");
+  rc.logVehicleEvents   = (config.logVehicleEvents == "checked");
+  rc.logRawData         = (config.logRawData == "checked");
+
+  rc.heartbeatInterval = (unsigned long)config.heartbeatInterval.toInt();
+  rc.postBatchSize     = config.postBatchSize.toInt();
+  rc.counterPopulation = config.counterPopulation.toInt();
+  rc.counterID         = config.counterID.toInt();
+
+  rc.lidarDetectionAlgorithm = DETECT_DECAY; // The default for unknown values, too.
+  for (int i = 0; i < DETECT_ALGORITHMS; i++)
+  {
+    if (config.lidarDetectionAlgorithm.equalsIgnoreCase(detectionAlgorithmNames[i]))
+    {
+      rc.lidarDetectionAlgorithm = (DetectionAlgorithm)i;
+    }
+  }
+
+  rc.lidarUpdateInterval  = config.lidarUpdateInterval.toInt();
+  rc.lidarSmoothingFactor = config.lidarSmoothingFactor.toFloat();
+  rc.lidarResidenceTime   = config.lidarResidenceTime.toInt();
+  rc.lidarDecay           = config.lidarDecay.toDouble();
+  rc.lidarPresenceCutoff  = config.lidarPresenceCutoff.toInt();
+  rc.lidarZone1Min        = config.lidarZone1Min.toInt();
+  rc.lidarZone1Max        = config.lidarZone1Max.toInt();
+  rc.lidarZone2Min        = config.lidarZone2Min.toInt();
+  rc.lidarZone2Max        = config.lidarZone2Max.toInt();
+  rc.lidarAutoLanes       = (config.lidarAutoLanes == "checked");
+
+  // A comma separated list of names. Unknown names and repeats are skipped.
+  rc.lidarShadowCount = 0;
+  String names = config.lidarShadowDetectors;
+  while ((names.length() > 0) && (rc.lidarShadowCount < 2))
+  {
+    int comma = names.indexOf(',');
+    String name = (comma < 0) ? names : names.substring(0, comma);
+    names = (comma < 0) ? String("") : names.substring(comma + 1);
+    name.trim();
+    for (int i = 0; i < DETECT_ALGORITHMS; i++)
+    {
+      if (!name.equalsIgnoreCase(detectionAlgorithmNames[i])) continue;
+      bool repeat = (i == rc.lidarDetectionAlgorithm);
+      for (int j = 0; j < rc.lidarShadowCount; j++) repeat |= (i == rc.lidarShadowDetectors[j]);
+      if (!repeat) rc.lidarShadowDetectors[rc.lidarShadowCount++] = (DetectionAlgorithm)i;
+    }
+  }
+
+  rc.lidarPreFilter = PREFILTER_NONE; // The default for unknown values, too.
+  for (int i = 0; i < PREFILTER_TYPES; i++)
+  {
+    if (config.lidarPreFilter.equalsIgnoreCase(preFilterNames[i])) rc.lidarPreFilter = (LIDARPreFilterType)i;
+  }
+  rc.lidarPreFilterWindow = config.lidarPreFilterWindow.toInt();
+  rc.lidarHampelThreshold = config.lidarHampelThreshold.toFloat();
+  rc.lidarMinRunLength    = config.lidarMinRunLength.toInt();
+
+  return rc;
+}
+
+//****************************************************************************************
+// Rebuild the runtime copy from config and swap it in. Call after changing config. Any
+// task may: a second update waits for the first to be written.
+void publishRuntimeConfig(const Config &config)
+{
+  RuntimeConfig rc = buildRuntimeConfig(config); // (The Strings, outside the update)
+
+  uint32_t seq = runtimeConfigSequence.load(std::memory_order_relaxed) & ~1u;
+  while (!runtimeConfigSequence.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire))
+  {
+    if (seq & 1) vTaskDelay(1); // Another update is being written
+    seq &= ~1u;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  runtimeConfigSlots[((seq >> 1) + 1) & 1] = rc;
+  runtimeConfigSequence.store(seq + 2, std::memory_order_release);
+}
+
+//****************************************************************************************
+// A copy of the current runtime configuration. Take it once per pass through a loop and
+// use it throughout so all the values come from the same update. The copy is retried if
+// the slot it came from was rewritten while it was being made (two updates in the time
+// it takes to copy a hundred bytes: rare).
+RuntimeConfig getRuntimeConfig()
+{
+  for (;;)
+  {
+    uint32_t seq = runtimeConfigSequence.load(std::memory_order_acquire) & ~1u;
+    RuntimeConfig rc = runtimeConfigSlots[(seq >> 1) & 1];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (runtimeConfigSequence.load(std::memory_order_relaxed) - seq <= 2) return rc;
+  }
+}
+
 //****************************************************************************************
 // If we add parameters to the config struct, the params.txt may not have an entry for new
 // fields. - In those cases, just use the default values from the config struct.
@@ -213,6 +404,7 @@ void loadConfiguration(const char *filename, Config &config)
   initConfigEntry(&config.ssid , (const char *)doc["network"]["ssid"]);
   initConfigEntry(&config.password , (const char *)doc["network"]["password"]);
   initConfigEntry(&config.serverURL , (const char *)doc["network"]["serverURL"]);
+  initConfigEntry(&config.postBatchSize , (const char *)doc["network"]["postBatchSize"]);
 
   initConfigEntry(&config.loraAddress , (const char *)doc["lora"]["address"]);
   initConfigEntry(&config.loraNetworkID , (const char *)doc["lora"]["networkID"]);
@@ -223,14 +415,24 @@ void loadConfiguration(const char *filename, Config &config)
   initConfigEntry(&config.loraCR , (const char *)doc["lora"]["codingRate"]);
   initConfigEntry(&config.loraPreamble , (const char *)doc["lora"]["preamble"]);
 
-  initConfigEntry(&config.lidarDetectionAlgorithm , (const char *)doc["lidar"]["detectionAlgorithm"]);
+  // Older PARAMS.TXT files all say "detectionAlgorithm": "Threshold", but that firmware
+  // ran Decay whatever it said. Only "detector", which this firmware writes, is a choice.
+  initConfigEntry(&config.lidarDetectionAlgorithm , (const char *)doc["lidar"]["detector"]);
   initConfigEntry(&config.lidarUpdateInterval , (const char *)doc["lidar"]["updateInterval"]);
   initConfigEntry(&config.lidarSmoothingFactor , (const char *)doc["lidar"]["smoothingFactor"]);
   initConfigEntry(&config.lidarResidenceTime , (const char *)doc["lidar"]["residenceTime"]);
+  initConfigEntry(&config.lidarDecay , (const char *)doc["lidar"]["decay"]);
+  initConfigEntry(&config.lidarPresenceCutoff , (const char *)doc["lidar"]["presenceCutoff"]);
   initConfigEntry(&config.lidarZone1Min , (const char *)doc["lidar"]["zone1Min"]);
   initConfigEntry(&config.lidarZone1Max , (const char *)doc["lidar"]["zone1Max"]);
   initConfigEntry(&config.lidarZone2Min , (const char *)doc["lidar"]["zone2Min"]);
   initConfigEntry(&config.lidarZone2Max , (const char *)doc["lidar"]["zone2Max"]);
+  initConfigEntry(&config.lidarAutoLanes , (const char *)doc["lidar"]["autoLanes"]);
+  initConfigEntry(&config.lidarShadowDetectors , (const char *)doc["lidar"]["shadowDetectors"]);
+  initConfigEntry(&config.lidarPreFilter , (const char *)doc["lidar"]["preFilter"]);
+  initConfigEntry(&config.lidarPreFilterWindow , (const char *)doc["lidar"]["preFilterWindow"]);
+  initConfigEntry(&config.lidarHampelThreshold , (const char *)doc["lidar"]["hampelThreshold"]);
+  initConfigEntry(&config.lidarMinRunLength , (const char *)doc["lidar"]["minRunLength"]);
 
   initConfigEntry(&config.lidarZone1Count , "0"); //(const char *)doc["lidar"]["zone1Count"]);
   initConfigEntry(&config.lidarZone2Count , "0"); //(const char *)doc["lidar"]["zone2Count"]);
@@ -310,6 +512,7 @@ void saveConfiguration(const char *filename, Config &config)
   doc["network"]["ssid"] = config.ssid;
   doc["network"]["password"] = config.password;
   doc["network"]["serverURL"] = config.serverURL;
+  doc["network"]["postBatchSize"] = config.postBatchSize;
 
   doc["lora"]["address"] = config.loraAddress;
   doc["lora"]["networkID"] = config.loraNetworkID;
@@ -319,14 +522,22 @@ void saveConfiguration(const char *filename, Config &config)
   doc["lora"]["codingRate"] = config.loraCR;
   doc["lora"]["preamble"] = config.loraPreamble;
 
-  doc["lidar"]["detectionAlgorithm"] = config.lidarDetectionAlgorithm;
+  doc["lidar"]["detector"] = config.lidarDetectionAlgorithm;
   doc["lidar"]["updateInterval"] = config.lidarUpdateInterval;
   doc["lidar"]["smoothingFactor"] = config.lidarSmoothingFactor;
   doc["lidar"]["residenceTime"] = config.lidarResidenceTime;
+  doc["lidar"]["decay"] = config.lidarDecay;
+  doc["lidar"]["presenceCutoff"] = config.lidarPresenceCutoff;
   doc["lidar"]["zone1Min"] = config.lidarZone1Min;
   doc["lidar"]["zone1Max"] = config.lidarZone1Max;
   doc["lidar"]["zone2Min"] = config.lidarZone2Min;
   doc["lidar"]["zone2Max"] = config.lidarZone2Max;
+  doc["lidar"]["autoLanes"] = config.lidarAutoLanes;
+  doc["lidar"]["shadowDetectors"] = config.lidarShadowDetectors;
+  doc["lidar"]["preFilter"] = config.lidarPreFilter;
+  doc["lidar"]["preFilterWindow"] = config.lidarPreFilterWindow;
+  doc["lidar"]["hampelThreshold"] = config.lidarHampelThreshold;
+  doc["lidar"]["minRunLength"] = config.lidarMinRunLength;
   doc["lidar"]["zone1Count"] = config.lidarZone1Count;
   doc["lidar"]["zone2Count"] = config.lidarZone2Count;
 
@@ -416,7 +627,8 @@ void appendTextFile(const char *filename, String contents)
 {
 
   //debugUART.println(initSDCard());
-  if (config.showDataStream == "false"){       
+  RuntimeConfig rc = getRuntimeConfig();
+  if (!rc.showDataStream){       
     debugUART.print("Saving data to: ");
     debugUART.print(filename);
     debugUART.print("... ");
@@ -436,7 +648,7 @@ void appendTextFile(const char *filename, String contents)
   file.println(contents);
 
   // Close the file
-  if (config.showDataStream == "false"){  
+  if (!rc.showDataStream){  
     debugUART.println("  Done.");
   }
   file.close();
@@ -478,11 +690,13 @@ bool initJSONConfig(const char *filename, Config &config)
   {
     debugUART.println("  Module found. (Reading parameters from SD Card.)");
     loadConfiguration(filename, config);
+    publishRuntimeConfig(config);
     return true;
   }
   else
   {
     debugUART.println("  ERROR! Module NOT found. (Parameters set to default values.)");
+    publishRuntimeConfig(config);
     return false;
   }
 }
@@ -0,0 +1,503 @@
+/* digameJournal.h
+ *
+ *  A write-ahead journal of the counter's outgoing events on the SD card
+ *  (or SPIFFS), so counts not yet sent survive a brown-out, a reboot or an
+ *  OTA update, and a long network outage fills the card instead of
+ *  overwriting the queue.
+ *
+ *  Events (digameEventQueue.h), with their raw signals, are appended to a
+ *  batch in RAM. commit() writes the batch to the current segment file in
+ *  one go: a burst of vehicles costs one write to the card, not one each.
+ *  Segment files (<dir>/00000001.seg, ...) are started every
+ *  journalSegmentBytes, and at every boot, so nothing is ever appended
+ *  after a torn write. Every record has a sequence number and a CRC-32.
+ *
+ *  The sender peek()s at the oldest record not yet sent (or peekBatch()es
+ *  at several) and ack()s once the server has them. The checkpoint, the
+ *  sequence number of the next record to send, is written with the next
+ *  commit(), so a run of ACKs costs one write too. It goes to one of two
+ *  small files in turn, so a write torn by a power cut leaves the other one
+ *  good. Segments wholly before the checkpoint are removed.
+ *
+ *  At boot, begin() reads the checkpoint and the segments and picks up at
+ *  the first record after it. A torn record (and anything after it in its
+ *  segment) is skipped. Delivery is at least once: a power cut before the
+ *  checkpoint is written sends the events acked since the last one again
+ *  (at most commitIntervalMS of ACKs). What was still in the batch is lost:
+ *  at most commitIntervalMS of events.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_JOURNAL_H__
+#define __DIGAME_JOURNAL_H__
+
+#include <FS.h>
+#include <digameEventQueue.h>
+
+const uint32_t JOURNAL_RECORD_MAGIC = 0x524A4744;     // "DGJR"
+const uint32_t JOURNAL_CHECKPOINT_MAGIC = 0x434A4744; // "DGJC"
+const size_t journalSegmentBytes = 65536;
+const uint32_t journalMaxSegments = 256;              // 16 MB. Past that the oldest goes.
+const size_t journalBatchBytes = 4096;
+const int journalMaxBatch = 32;                       // Records to a peekBatch()
+
+// Every record: this, the CounterEvent, then rawLength samples. Little-endian.
+struct JournalRecordHeader
+{
+  uint32_t magic;     // JOURNAL_RECORD_MAGIC
+  uint32_t sequence;  // One up from the record before
+  uint16_t rawLength; // Raw signal samples after the event
+  uint16_t reserved;
+  uint32_t crc;       // CRC-32 of the record, with this field 0
+};
+
+struct JournalCheckpoint
+{
+  uint32_t magic;      // JOURNAL_CHECKPOINT_MAGIC
+  uint32_t generation; // Written to file generation & 1
+  uint32_t next;       // Sequence number of the next record to send
+  uint32_t crc;        // Of the above
+};
+
+//****************************************************************************************
+// CRC-32 (IEEE), a nibble at a time.
+inline uint32_t journalCRC32(uint32_t crc, const void *data, size_t n)
+{
+  static const uint32_t table[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+                                     0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+                                     0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  const uint8_t *p = (const uint8_t *)data;
+  crc = ~crc;
+  for (size_t i = 0; i < n; i++)
+  {
+    crc = table[(crc ^ p[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (p[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+//****************************************************************************************
+class EventJournal
+{
+public:
+  unsigned long commitIntervalMS = 500; // Longest an event waits in the batch
+
+  unsigned long pending = 0;   // Records on the card not yet sent
+  unsigned long replayed = 0;  // Of those, the ones found at boot
+  unsigned long writes = 0;    // Batches written
+  unsigned long writeErrors = 0;
+  unsigned long dropped = 0;   // Events refused: the batch was full and wouldn't write
+  unsigned long corrupt = 0;   // Segments cut short by a torn or damaged record
+  unsigned long lost = 0;      // Records not sent, removed to make room
+
+  EventJournal(fs::FS &fs, const char *dir = "/journal") : fs(fs), dir(dir) {}
+
+  //****************************************************************************************
+  // Read the checkpoint and the segments on the card. Returns false if the directory
+  // can't be made; the journal stays closed (and everything else returns false).
+  bool begin()
+  {
+    opened = false;
+    batchLen = batchRecords = 0;
+    checkpointDirty = false;
+    peeked = 0;
+    pending = replayed = corrupt = 0;
+    if (!fs.exists(dir) && !fs.mkdir(dir)) return false;
+
+    readCheckpoint();
+
+    // The segments there are, oldest to newest.
+    uint32_t first = 0, last = 0;
+    File d = fs.open(dir);
+    if (!d || !d.isDirectory()) return false;
+    for (File f = d.openNextFile(); f; f = d.openNextFile())
+    {
+      uint32_t n;
+      if (parseSegmentName(f.name(), n))
+      {
+        if ((first == 0) || (n < first)) first = n;
+        if (n > last) last = n;
+      }
+    }
+    d.close();
+
+    // Find the first record after the checkpoint and count the ones to send.
+    nextSequence = checkpoint;
+    cursorSegment = 0;
+    if (first > 0)
+    {
+      for (uint32_t s = first; s <= last; s++)
+      {
+        scanSegment(s, [&](uint32_t sequence, uint32_t offset) {
+          if (sequence < nextSequence) return; // Sent, or a repeat after a torn write
+          if (cursorSegment == 0)
+          {
+            cursorSegment = s;
+            cursorOffset = offset;
+          }
+          pending++;
+          nextSequence = sequence + 1;
+        });
+      }
+    }
+    replayed = pending;
+
+    // New writes start a new segment.
+    writeSegment = last + 1;
+    writeSize = 0;
+    firstSegment = (first > 0) ? first : writeSegment;
+    if (cursorSegment == 0)
+    {
+      cursorSegment = writeSegment;
+      cursorOffset = 0;
+    }
+    opened = true;
+    removeSentSegments();
+    return true;
+  }
+
+  bool isOpen() const { return opened; }
+
+  //****************************************************************************************
+  // Add an event (and its raw signal, if any) to the batch. If the batch is full it's
+  // committed first; if that fails the event is refused and counted in dropped.
+  bool append(const CounterEvent &e, const RawSignal *raw)
+  {
+    if (!opened) return false;
+    size_t rawLength = raw ? raw->length : 0;
+    size_t size = sizeof(JournalRecordHeader) + sizeof(CounterEvent) + 2 * rawLength;
+    if ((batchLen + size > journalBatchBytes) && !commitBatch())
+    {
+      dropped++;
+      return false;
+    }
+
+    uint8_t *p = batch + batchLen;
+    JournalRecordHeader h = {JOURNAL_RECORD_MAGIC, nextSequence++, (uint16_t)rawLength, 0, 0};
+    memcpy(p + sizeof(h), &e, sizeof(e));
+    if (rawLength) memcpy(p + sizeof(h) + sizeof(e), raw->samples, 2 * rawLength);
+    memcpy(p, &h, sizeof(h));
+    h.crc = journalCRC32(0, p, size);
+    memcpy(p, &h, sizeof(h));
+
+    if (batchRecords == 0) batchStartMS = millis();
+    batchLen += size;
+    batchRecords++;
+    return true;
+  }
+
+  // Is there a batch, or an ACK not on the card, that's waited commitIntervalMS?
+  bool commitDue(unsigned long nowMS) const
+  {
+    return ((batchRecords > 0) && (nowMS - batchStartMS >= commitIntervalMS)) ||
+           (checkpointDirty && (nowMS - checkpointSinceMS >= commitIntervalMS));
+  }
+
+  //****************************************************************************************
+  // Write the batch, and the checkpoint if anything's been acked, to the card. If the
+  // batch write fails (or is cut short) the batch is kept for the next try, which goes
+  // to a new segment; a checkpoint that fails is tried again next time.
+  bool commit()
+  {
+    if (!opened) return false;
+    bool ok = commitBatch();
+    if (checkpointDirty)
+    {
+      if (writeCheckpoint())
+      {
+        checkpointDirty = false;
+        removeSentSegments();
+      }
+      else ok = false;
+    }
+    return ok;
+  }
+
+  //****************************************************************************************
+  // The oldest record not yet sent (on the card: a batch not committed doesn't count).
+  // raw points at its raw signal, or is nullptr, until the next call.
+  bool peek(CounterEvent &e, const RawSignal *&raw)
+  {
+    return peekBatch(1, [&](const CounterEvent &event, const RawSignal *r) {
+             e = event;
+             raw = r;
+             return true;
+           }) == 1;
+  }
+
+  // The oldest records not yet sent, up to maxRecords (and journalMaxBatch): calls
+  // onRecord(const CounterEvent &, const RawSignal *) for each, oldest first, until it
+  // returns false. (The raw signal is only good during the call.) Returns how many it took.
+  template <typename F>
+  int peekBatch(int maxRecords, F onRecord)
+  {
+    peeked = 0;
+    if (!opened) return 0;
+    if (maxRecords > journalMaxBatch) maxRecords = journalMaxBatch;
+
+    Position at = {cursorSegment, cursorOffset, checkpoint};
+    File f;
+    uint32_t openSegment = 0;
+    while (peeked < maxRecords)
+    {
+      int size = nextRecord(f, openSegment, at, peeked == 0);
+      if (size <= 0) break;
+      if (peeked == 0) // Whatever was passed over on the way stays passed over
+      {
+        cursorSegment = at.segment;
+        cursorOffset = at.offset;
+      }
+      if (!onRecord((const CounterEvent &)currentEvent, (currentRaw.length > 0) ? &currentRaw : nullptr)) break;
+      at.offset += size;
+      at.sequence = currentSequence + 1;
+      peekedEnd[peeked++] = at;
+    }
+    if (f) f.close();
+    return peeked;
+  }
+
+  // The server has the first n records of the last peek: move the checkpoint past them.
+  // It's written by the next commit(); till then a reboot sends them again.
+  bool ack(int n = 1)
+  {
+    if ((n <= 0) || (n > peeked)) return false;
+    const Position &end = peekedEnd[n - 1];
+    peeked = 0;
+    cursorSegment = end.segment;
+    cursorOffset = end.offset;
+    checkpoint = end.sequence;
+    pending = (pending > (unsigned long)n) ? pending - n : 0;
+    if (!checkpointDirty) checkpointSinceMS = millis();
+    checkpointDirty = true;
+    return true;
+  }
+
+private:
+  fs::FS &fs;
+  const char *dir;
+  bool opened = false;
+
+  uint8_t batch[journalBatchBytes];
+  size_t batchLen = 0;
+  unsigned long batchRecords = 0;
+  unsigned long batchStartMS = 0;
+  uint32_t nextSequence = 0;
+
+  uint32_t firstSegment = 1, writeSegment = 1; // Oldest on the card; the one being written
+  size_t writeSize = 0;
+  uint32_t cursorSegment = 1;                  // Where the next record to send is
+  uint32_t cursorOffset = 0;
+
+  uint32_t checkpoint = 0;                     // Next sequence number to send
+  uint32_t checkpointGeneration = 0;
+  bool checkpointDirty = false;                // Acked past what's on the card
+  unsigned long checkpointSinceMS = 0;
+
+  struct Position
+  {
+    uint32_t segment, offset;
+    uint32_t sequence;                         // No record before this one is sent
+  };
+  Position peekedEnd[journalMaxBatch];         // Just after each record of the last peek
+  int peeked = 0;
+
+  uint32_t currentSequence = 0;                // The last record read
+  CounterEvent currentEvent;
+  RawSignal currentRaw;
+
+  void segmentPath(uint32_t n, char *path) const { snprintf(path, 64, "%s/%08lu.seg", dir, (unsigned long)n); }
+  void checkpointPath(int which, char *path) const { snprintf(path, 64, "%s/checkpoint%d", dir, which); }
+
+  static bool parseSegmentName(const char *name, uint32_t &n)
+  {
+    if (!name) return false;
+    const char *slash = strrchr(name, '/'); // Some cores give the whole path
+    if (slash) name = slash + 1;
+    char *end;
+    n = (uint32_t)strtoul(name, &end, 10);
+    return (end == name + 8) && (strcmp(end, ".seg") == 0) && (n > 0);
+  }
+
+  void startSegment()
+  {
+    writeSegment++;
+    writeSize = 0;
+    if (writeSegment - firstSegment >= journalMaxSegments) // Full: the oldest goes
+    {
+      if (cursorSegment == firstSegment)
+      {
+        scanSegment(firstSegment, [&](uint32_t sequence, uint32_t offset) {
+          if ((offset >= cursorOffset) && (sequence >= checkpoint))
+          {
+            lost++;
+            if (pending > 0) pending--;
+          }
+        });
+        cursorSegment++;
+        cursorOffset = 0;
+        peeked = 0;
+      }
+      char path[64];
+      segmentPath(firstSegment++, path);
+      fs.remove(path);
+    }
+  }
+
+  void removeSentSegments()
+  {
+    while (firstSegment < cursorSegment)
+    {
+      char path[64];
+      segmentPath(firstSegment, path);
+      if (fs.exists(path) && !fs.remove(path)) break;
+      firstSegment++;
+    }
+  }
+
+  //****************************************************************************************
+  // From at on to the next good record not yet sent (at.sequence or later), read into
+  // current*. Leaves at on it and returns its size, or 0 if there's none yet. f is kept open
+  // on segment openSegment between calls.
+  int nextRecord(File &f, uint32_t &openSegment, Position &at, bool atHead)
+  {
+    for (;;)
+    {
+      if ((at.segment > writeSegment) || ((at.segment == writeSegment) && (at.offset >= writeSize))) return 0;
+      if (!f || (openSegment != at.segment))
+      {
+        if (f) f.close();
+        char path[64];
+        segmentPath(at.segment, path);
+        f = fs.open(path, FILE_READ);
+        openSegment = at.segment;
+      }
+      int size = f ? readRecord(f, at.offset) : 0;
+      if (size <= 0) // The end of the segment (or a torn tail): on to the next
+      {
+        if (at.segment == writeSegment) return 0;
+        if ((size < 0) && atHead) corrupt++;
+        at.segment++;
+        at.offset = 0;
+        continue;
+      }
+      if (currentSequence < at.sequence) // Already sent, or a repeat after a torn write
+      {
+        at.offset += size;
+        continue;
+      }
+      return size;
+    }
+  }
+
+  //****************************************************************************************
+  // Read the record at offset into current*. Returns its size, 0 at the end of the file,
+  // or -1 if it's torn or damaged.
+  int readRecord(File &f, uint32_t offset)
+  {
+    if (!f.seek(offset)) return 0;
+    JournalRecordHeader h;
+    size_t n = f.read((uint8_t *)&h, sizeof(h));
+    if (n == 0) return 0;
+    if ((n != sizeof(h)) || (h.magic != JOURNAL_RECORD_MAGIC) || (h.rawLength > eventRawSignalLength)) return -1;
+    if (f.read((uint8_t *)&currentEvent, sizeof(currentEvent)) != sizeof(currentEvent)) return -1;
+    size_t rawBytes = 2 * (size_t)h.rawLength;
+    if (rawBytes && (f.read((uint8_t *)currentRaw.samples, rawBytes) != rawBytes)) return -1;
+
+    uint32_t crc = h.crc;
+    h.crc = 0;
+    uint32_t check = journalCRC32(0, &h, sizeof(h));
+    check = journalCRC32(check, &currentEvent, sizeof(currentEvent));
+    check = journalCRC32(check, currentRaw.samples, rawBytes);
+    if (check != crc) return -1;
+
+    currentRaw.length = h.rawLength;
+    currentSequence = h.sequence;
+    return (int)(sizeof(h) + sizeof(currentEvent) + rawBytes);
+  }
+
+  // Call onRecord(sequence, offset) for each good record in segment s, up to the first
+  // bad one.
+  template <typename F>
+  void scanSegment(uint32_t s, F onRecord)
+  {
+    char path[64];
+    segmentPath(s, path);
+    File f = fs.open(path, FILE_READ);
+    if (!f) return;
+    uint32_t offset = 0;
+    int size;
+    while ((size = readRecord(f, offset)) > 0)
+    {
+      onRecord(currentSequence, offset);
+      offset += size;
+    }
+    f.close();
+  }
+
+  //****************************************************************************************
+  void readCheckpoint()
+  {
+    checkpoint = 0;
+    checkpointGeneration = 0;
+    bool found = false;
+    for (int which = 0; which < 2; which++)
+    {
+      char path[64];
+      checkpointPath(which, path);
+      File f = fs.open(path, FILE_READ);
+      if (!f) continue;
+      JournalCheckpoint c;
+      bool ok = (f.read((uint8_t *)&c, sizeof(c)) == sizeof(c));
+      f.close();
+      if (!ok || (c.magic != JOURNAL_CHECKPOINT_MAGIC) || (journalCRC32(0, &c, 12) != c.crc)) continue;
+      if (!found || (c.generation > checkpointGeneration))
+      {
+        checkpoint = c.next;
+        checkpointGeneration = c.generation;
+        found = true;
+      }
+    }
+  }
+
+  // The batch to the current segment (a new one if it won't fit).
+  bool commitBatch()
+  {
+    if (batchRecords == 0) return true;
+
+    if ((writeSize > 0) && (writeSize + batchLen > journalSegmentBytes)) startSegment();
+    char path[64];
+    segmentPath(writeSegment, path);
+    File f = fs.open(path, FILE_APPEND);
+    size_t n = f ? f.write(batch, batchLen) : 0;
+    if (f) f.close();
+    writes++;
+    if (n != batchLen)
+    {
+      writeErrors++;
+      if (n > 0) startSegment(); // Never write after a torn record
+      return false;
+    }
+
+    writeSize += batchLen;
+    pending += batchRecords;
+    batchLen = batchRecords = 0;
+    return true;
+  }
+
+  bool writeCheckpoint()
+  {
+    JournalCheckpoint c = {JOURNAL_CHECKPOINT_MAGIC, checkpointGeneration + 1, checkpoint, 0};
+    c.crc = journalCRC32(0, &c, 12);
+    char path[64];
+    checkpointPath(c.generation & 1, path);
+    File f = fs.open(path, FILE_WRITE);
+    if (!f) return false;
+    bool ok = (f.write((const uint8_t *)&c, sizeof(c)) == sizeof(c));
+    f.close();
+    if (ok) checkpointGeneration = c.generation;
+    return ok;
+  }
+};
+
+#endif // __DIGAME_JOURNAL_H__
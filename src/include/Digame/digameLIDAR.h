@@ -4,40 +4,132 @@
 #define debugUART Serial
 #define tfMiniUART Serial2
 
-#define LOG_RAW_DATA_TO_SD false // Log the Raw data to the SD Card for analysis.
-
-
 #include <digameJSONConfig.h> // Program parameters from config file on SD card
 #include <digamePowerMgt.h>
 #include <TFMPlus.h>          // Include TFMini Plus LIDAR Library v1.4.0
 TFMPlus tfmP;                 // Create a TFMini Plus object
 
 #include <CircularBuffer.h> // Adafruit library. Pretty small!
+#include <digameRingBuffer.h>
+#include <digameTFMiniParser.h>
+#include <digameLIDARSample.h>
+#include <digameLIDARHealth.h>
+#include <digameRawLog.h> // Raw data capture when config.logRawData is set
+#include <digameLaneFinder.h>
+#include <digameFixedPoint.h>
+#include <digameMatchedFilter.h>
+
+// The arithmetic the detectors use (see digameFixedPoint.h). Define LIDAR_KERNELS as
+// Q15Kernels or Q31Kernels before including this file to run them in fixed point, or
+// pick per call: processLIDARSample3<Q15Kernels>(rc, sample).
+#ifndef LIDAR_KERNELS
+#define LIDAR_KERNELS FloatKernels
+#endif
 
 int16_t initLIDARDist = 999; // The initial distance measured by the lidar when it wakes up.
 
 const int lidarSamples = 25;
-String lastDistanceMeasured = "0";
+volatile int16_t lastDistanceMeasured = 0; // For the web page. (Not a String: it's updated on 
+                                           //   every sample.)
+
+
+// Free-running mode: the sensor streams frames at its own rate and a reader task on core
+// 0 parses them into this ring. The detection loop takes them out in batches.
+const int lidarStreamSize = 256; // 256 ms worth at 1000 Hz
+SPSCRingBuffer<LIDARSample, lidarStreamSize> lidarStream;
+volatile unsigned long lidarStreamDrops = 0;  // Samples lost because the ring was full
+volatile unsigned long lidarStreamFrames = 0; // Frames parsed by the reader task
+volatile bool lidarStreamRunning = false;
+TaskHandle_t lidarReaderTask = NULL;
+unsigned long lidarStreamPeriodUS = 1000;     // Between frames, at the rate asked for
+const unsigned long tfMiniByteUS = 87;        // One byte at 115200 baud
+
+TFMiniParser lidarParser; // Parses the sensor's frames in both modes. Its stats (checksum 
+                          //   errors, resyncs, weak readings...) tell us how the link is doing.
+LIDARHealth lidarHealth(lidarParser); // ...and this, how the sensor is.
 
 CircularBuffer<int, lidarSamples> lidarBuffer; // We're going to hang onto the last 100 raw data
                                                //   points to visualize what the sensor sees
+                                               //   (the threshold detector: its smoothed distance x 10)
+CircularBuffer<int16_t, lidarSamples> lidarZoneBuffer; // The same readings, clamped, for the zone
+                                                       //   counts (whichever detector is counting).
 
 CircularBuffer<int, 150> lidarHistoryBuffer; // A longer buffer for visualization of the history
                                              // before the algorithm makes a decision.
 
+// Running counts of the samples in lidarZoneBuffer that fall inside each lane's zone. Kept up
+// to date as samples enter and leave the buffer so the detectors don't have to rescan the
+// whole buffer on every reading. Counts are rebuilt if the zone limits change.
+struct LIDARZoneCounts
+{
+  int zone1Min = 0;
+  int zone1Max = 0;
+  int zone2Min = 0;
+  int zone2Max = 0;
+  int zone1 = 0; // Number of samples in lidarZoneBuffer with zone1Min < d < zone1Max
+  int zone2 = 0;
+};
+LIDARZoneCounts lidarZoneCounts;
+
 const int histogramSize = 121; // Playing with a histogram of distances to see if we can learn
                                //   how to determine lane posistions on our own. 10 cm bins
 unsigned long lidarDistanceHistogram[histogramSize];
 
-unsigned long lidarTimeHistogram[histogramSize]; // 0-12 seconds in tenth of a second bins
-String logFileName;        // Log data to a file of this name when LOG_RAW_DATA_TO_SD is true.
-File logFile;
+// How long each counted vehicle was seen in its lane (dwell time), per lane. 0-12 seconds
+// in tenth of a second bins; the last bin holds everything longer. Kept since boot (or the
+// last reset) and, for spotting congestion, over a rolling window made of fixed slots.
+const int lidarLanes = 2;
+const int dwellSlots = 6;                  // The rolling window is the last hour...
+const unsigned long dwellSlotMS = 600000UL; //   in 10 minute slots.
+unsigned long lidarTimeHistogram[lidarLanes][histogramSize];
+uint16_t lidarRecentTimeHistogram[dwellSlots][lidarLanes][histogramSize];
+int dwellSlot = 0;                   // The slot being filled
+unsigned long dwellSlotStartMS = 0;
+SemaphoreHandle_t dwellMutex = xSemaphoreCreateMutex(); // The counting task and the web server
+                                                        //   both use the dwell histograms.
+
+// Where each lane's current vehicle started and was last seen.
+const uint32_t dwellGapUS = 1000000; // Longer than this with nothing in the zone: a new vehicle.
+struct LaneDwell
+{
+  uint32_t firstUS = 0;
+  uint32_t lastUS = 0;
+  bool seen = false;
+};
+LaneDwell laneDwell[lidarLanes];
+
+LaneFinder lidarLaneFinder; // Proposes zone limits from lidarDistanceHistogram
+static_assert(LaneFinder::bins == histogramSize, "LaneFinder must match the histogram");
 
 
 bool initLIDAR(bool);
+bool startLIDARStream(uint16_t frameRate);
+void stopLIDARStream();
+int readLIDARSamples(LIDARSample *samples, int maxSamples);
+LIDARSample readLIDARSample();
+// Shadow = true runs a detector alongside the one that's counting (see digameDetectors.h):
+// it leaves the shared bookkeeping (recordLIDARSample) to that one.
+template <typename K = LIDAR_KERNELS, bool Shadow = false>
+int processLIDARSample(const RuntimeConfig &rc, const LIDARSample &sample);
+template <bool Shadow = false>
+int processLIDARSample2(const RuntimeConfig &rc, const LIDARSample &sample);
+template <typename K = LIDAR_KERNELS, bool Shadow = false>
+int processLIDARSample3(const RuntimeConfig &rc, const LIDARSample &sample);
+template <typename K = LIDAR_KERNELS, bool Shadow = false>
+int processLIDARSampleCorrelation(const RuntimeConfig &rc, const LIDARSample &sample);
+void setLIDARZoneLimits(int zone1Min, int zone1Max, int zone2Min, int zone2Max);
+void pushLIDARSample(int dist);
+void pushLIDARSample(int16_t dist, int buffered);
+int16_t clampLIDARDistance(const LIDARSample &sample);
+void recordLIDARSample(const RuntimeConfig &rc, int16_t dist, uint32_t timeUS);
+void recordLIDARSample(const RuntimeConfig &rc, int16_t dist, uint32_t timeUS, int buffered);
 void showLIDARDistanceHistogram();
 void clearLIDARDistanceHistogram();
 String getDistanceHistogramString();
+void trackLaneDwell(const RuntimeConfig &rc, int dist, uint32_t timeUS);
+void recordLaneDwell(int lane);
+void clearLIDARDwellHistograms();
+String getDwellHistogramString();
 
 
 
@@ -52,6 +144,7 @@ String getDistanceHistogramString();
 bool initLIDAR(bool triggeredMode = false)
 {
 
+  tfMiniUART.setRxBufferSize(1024); // Room for ~100 ms of frames in free-running mode.
   tfMiniUART.begin(115200); // Initialize TFMPLus device serial port.
   delay(1000);              // Give port time to initalize
   tfmP.begin(&tfMiniUART);  // Initialize device library object and...
@@ -112,6 +205,234 @@ bool initLIDAR(bool triggeredMode = false)
   }
 }
 
+//*****************************************************************************
+// The reader task for free-running mode. Waits on the UART and moves every
+// complete frame into lidarStream with a time stamp of its own: a chunk holds
+// several frames, so they're spaced back a frame period at a time from when
+// the last of them came in (the read, less the bytes of the next frame that
+// followed it). Never earlier than the frame before.
+void lidarReader(void * /* parameter */)
+{
+  uint8_t chunk[128];
+  LIDARSample samples[(sizeof(chunk) + TFMP_FRAME_SIZE) / TFMP_FRAME_SIZE]; // One chunk's worth
+  uint32_t lastUS = micros();
+
+  while (lidarStreamRunning)
+  {
+    int n = tfMiniUART.available();
+    if (n <= 0)
+    {
+      vTaskDelay(1); // At 1000 Hz that's 9 bytes. The UART buffer holds 100+ frames.
+      continue;
+    }
+    if (n > (int)sizeof(chunk)) n = sizeof(chunk);
+    n = tfMiniUART.readBytes(chunk, n);
+    uint32_t readUS = micros();
+
+    int k = 0;
+    lidarParser.parse(chunk, n, [&](const uint8_t *frame) {
+      LIDARSample &sample = samples[k++];
+      sample.status = decodeTFMiniFrame(frame, sample.dist, sample.flux, sample.temp);
+    });
+
+    uint32_t endUS = readUS - lidarParser.pending() * tfMiniByteUS;
+    for (int i = 0; i < k; i++)
+    {
+      uint32_t t = endUS - (k - 1 - i) * lidarStreamPeriodUS;
+      if ((int32_t)(t - lastUS) <= 0) t = lastUS + 1;
+      samples[i].timeUS = lastUS = t;
+      lidarStreamFrames++;
+      if (!lidarStream.push(samples[i])) lidarStreamDrops++;
+    }
+  }
+
+  lidarReaderTask = NULL;
+  vTaskDelete(NULL);
+}
+
+//*****************************************************************************
+// Switch the sensor to free-running mode at frameRate (FRAME_100 ... FRAME_1000)
+// and start the reader task. Call after initLIDAR(). Samples are then picked up
+// with readLIDARSamples() instead of processLIDARSignalN().
+bool startLIDARStream(uint16_t frameRate)
+{
+  if (lidarStreamRunning) return true;
+
+  if (!tfmP.sendCommand(SET_FRAME_RATE, frameRate))
+  {
+    debugUART.println("ERROR! Could not set the LIDAR frame rate.");
+    return false;
+  }
+
+  lidarParser.reset();
+  lidarStreamPeriodUS = frameRate ? 1000000UL / frameRate : 1000;
+  lidarStreamRunning = true;
+  xTaskCreatePinnedToCore(
+    lidarReader,       /* Task function. */
+    "LIDAR Reader",    /* name of task. */
+    4096,              /* Stack size of task */
+    NULL,              /* parameter of the task */
+    2,                 /* priority of the task. Above the message and display tasks. */
+    &lidarReaderTask,  /* Task handle to keep track of created task */
+    0);                /* pin task to core 0 */
+  return true;
+}
+
+//*****************************************************************************
+// Ask the reader task to finish. (It exits within a tick.)
+void stopLIDARStream()
+{
+  lidarStreamRunning = false;
+}
+
+//*****************************************************************************
+// Take up to maxSamples readings out of the free-running stream, oldest
+// first. Returns the number of samples copied.
+int readLIDARSamples(LIDARSample *samples, int maxSamples)
+{
+  int n = (int)lidarStream.popBatch(samples, (size_t)maxSamples);
+  for (int i = 0; i < n; i++) lidarHealth.record(samples[i]);
+  lidarHealth.update(micros());
+  if (rawLogRunning)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      logRawSample(samples[i].timeUS, samples[i].dist, samples[i].flux, samples[i].temp);
+    }
+  }
+  return n;
+}
+
+//*****************************************************************************
+// Polled mode: read the latest frame from the sensor. Like TFMPlus::getData()
+// older frames in the UART buffer are passed over, but every byte goes through
+// lidarParser so errors get counted. The status is TFMP_HEADER if no complete
+// frame has arrived and TFMP_CHECKSUM if the only one was corrupt.
+LIDARSample readLIDARSample()
+{
+  LIDARSample sample;
+  sample.dist = 0;
+  sample.flux = 0;
+  sample.temp = 0;
+  sample.status = TFMP_HEADER;
+
+  unsigned long checksumErrors = lidarParser.stats.checksumErrors;
+  uint8_t chunk[64];
+  int n;
+  while ((n = tfMiniUART.available()) > 0)
+  {
+    if (n > (int)sizeof(chunk)) n = sizeof(chunk);
+    n = tfMiniUART.readBytes(chunk, n);
+    lidarParser.parse(chunk, n, [&](const uint8_t *frame) {
+      sample.status = decodeTFMiniFrame(frame, sample.dist, sample.flux, sample.temp);
+    });
+  }
+  if ((sample.status == TFMP_HEADER) && (lidarParser.stats.checksumErrors != checksumErrors))
+  {
+    sample.status = TFMP_CHECKSUM;
+  }
+
+  sample.timeUS = micros();
+  lidarHealth.record(sample);
+  lidarHealth.update(sample.timeUS);
+  if (rawLogRunning && (sample.status != TFMP_HEADER) && (sample.status != TFMP_CHECKSUM))
+  {
+    logRawSample(sample.timeUS, sample.dist, sample.flux, sample.temp);
+  }
+  return sample;
+}
+
+//*****************************************************************************
+// Set the zone limits used by lidarZoneCounts. Only rescans the buffer when the
+// limits actually change (e.g. after an update from the web interface).
+void setLIDARZoneLimits(int zone1Min, int zone1Max, int zone2Min, int zone2Max)
+{
+  LIDARZoneCounts &c = lidarZoneCounts;
+
+  if ((zone1Min == c.zone1Min) && (zone1Max == c.zone1Max) &&
+      (zone2Min == c.zone2Min) && (zone2Max == c.zone2Max))
+  {
+    return;
+  }
+
+  c.zone1Min = zone1Min;
+  c.zone1Max = zone1Max;
+  c.zone2Min = zone2Min;
+  c.zone2Max = zone2Max;
+  c.zone1 = 0;
+  c.zone2 = 0;
+
+  for (int i = 0; i < lidarZoneBuffer.size(); i++)
+  {
+    int d = lidarZoneBuffer[i];
+    if ((d < c.zone1Max) && (d > c.zone1Min)) c.zone1++;
+    if ((d < c.zone2Max) && (d > c.zone2Min)) c.zone2++;
+  }
+}
+
+//*****************************************************************************
+// Add a sample to lidarBuffer, updating the zone counts for the sample coming
+// in and the one falling off the end.
+void pushLIDARSample(int dist)
+{
+  pushLIDARSample((int16_t)dist, dist);
+}
+
+// The same, with something other than the reading for lidarBuffer.
+void pushLIDARSample(int16_t dist, int buffered)
+{
+  LIDARZoneCounts &c = lidarZoneCounts;
+
+  if (lidarZoneBuffer.isFull())
+  {
+    int evicted = lidarZoneBuffer.first();
+    if ((evicted < c.zone1Max) && (evicted > c.zone1Min)) c.zone1--;
+    if ((evicted < c.zone2Max) && (evicted > c.zone2Min)) c.zone2--;
+  }
+
+  lidarBuffer.push(buffered);
+  lidarZoneBuffer.push(dist);
+
+  if ((dist < c.zone1Max) && (dist > c.zone1Min)) c.zone1++;
+  if ((dist < c.zone2Max) && (dist > c.zone2Min)) c.zone2++;
+}
+
+//*****************************************************************************
+// A reading as the voting detectors see it: weak returns, zero (nothing in range)
+// and long-range targets all read 999.
+int16_t clampLIDARDistance(const LIDARSample &sample)
+{
+  int16_t d = sample.dist;
+  if ((sample.status != TFMP_READY) || (d <= 0) || (d >= 1000)) d = 999;
+  return d;
+}
+
+//*****************************************************************************
+// The bookkeeping that goes with each reading, whichever detector is counting: the
+// distance histogram, lidarBuffer and its zone counts, the history for display and
+// the dwell times. dist is clamped (clampLIDARDistance).
+void recordLIDARSample(const RuntimeConfig &rc, int16_t dist, uint32_t timeUS)
+{
+  recordLIDARSample(rc, dist, timeUS, dist);
+}
+
+// The same, keeping buffered in lidarBuffer instead of dist.
+void recordLIDARSample(const RuntimeConfig &rc, int16_t dist, uint32_t timeUS, int buffered)
+{
+  lastDistanceMeasured = dist;
+
+  lidarDistanceHistogram[(unsigned int)(dist / 10)]++; // Grabbing a histogram of distances
+                                                       // to explore automatic lane determination...
+                                                       // (dist < 1000 keeps us inside it.)
+
+  setLIDARZoneLimits(rc.lidarZone1Min, rc.lidarZone1Max,
+                     rc.lidarZone2Min, rc.lidarZone2Max);
+
+  pushLIDARSample(dist, buffered); // The circular buffer of LIDAR data for analysis
+  lidarHistoryBuffer.push(dist); // A longer history for display.
+  trackLaneDwell(rc, dist, timeUS);
+}
+
 //*****************************************************************************
 void showLIDARDistanceHistogram()
 {
@@ -139,6 +460,156 @@ String getDistanceHistogramString()
   return retValue;
 }
 
+//*****************************************************************************
+// Move the rolling window along to now, emptying the slots that fall out of it.
+// Hold dwellMutex.
+void advanceDwellSlots()
+{
+  unsigned long now = millis();
+  for (int n = 0; (now - dwellSlotStartMS >= dwellSlotMS); n++)
+  {
+    if (n == dwellSlots)
+    { // Been idle longer than the whole window.
+      dwellSlotStartMS = now;
+      break;
+    }
+    dwellSlot = (dwellSlot + 1) % dwellSlots;
+    for (int lane = 0; lane < lidarLanes; lane++)
+    {
+      for (int i = 0; i < histogramSize; i++) lidarRecentTimeHistogram[dwellSlot][lane][i] = 0;
+    }
+    dwellSlotStartMS += dwellSlotMS;
+  }
+}
+
+//*****************************************************************************
+// Call with every good reading. Notes when whatever is in each zone arrived and
+// when it was last seen there.
+void trackLaneDwell(const RuntimeConfig &rc, int dist, uint32_t timeUS)
+{
+  bool inZone[lidarLanes] = {(dist > rc.lidarZone1Min) && (dist < rc.lidarZone1Max),
+                             (dist > rc.lidarZone2Min) && (dist < rc.lidarZone2Max)};
+  for (int lane = 0; lane < lidarLanes; lane++)
+  {
+    if (!inZone[lane]) continue;
+    LaneDwell &d = laneDwell[lane];
+    if (!d.seen || (timeUS - d.lastUS > dwellGapUS))
+    {
+      d.firstUS = timeUS;
+      d.seen = true;
+    }
+    d.lastUS = timeUS;
+  }
+}
+
+//*****************************************************************************
+// Call when a vehicle is counted in lane (1, 2). Adds its dwell time to the
+// histograms.
+void recordLaneDwell(int lane)
+{
+  if ((lane < 1) || (lane > lidarLanes)) return;
+  LaneDwell &d = laneDwell[lane - 1];
+  if (!d.seen) return;
+  d.seen = false;
+
+  unsigned long bin = (d.lastUS - d.firstUS) / 100000UL; // Tenths of a second
+  if (bin >= (unsigned long)histogramSize) bin = histogramSize - 1;
+
+  xSemaphoreTake(dwellMutex, portMAX_DELAY);
+  advanceDwellSlots();
+  lidarTimeHistogram[lane - 1][bin]++;
+  if (lidarRecentTimeHistogram[dwellSlot][lane - 1][bin] < 0xFFFF)
+  {
+    lidarRecentTimeHistogram[dwellSlot][lane - 1][bin]++;
+  }
+  xSemaphoreGive(dwellMutex);
+}
+
+//*****************************************************************************
+void clearLIDARDwellHistograms()
+{
+  xSemaphoreTake(dwellMutex, portMAX_DELAY);
+  memset(lidarTimeHistogram, 0, sizeof(lidarTimeHistogram));
+  memset(lidarRecentTimeHistogram, 0, sizeof(lidarRecentTimeHistogram));
+  dwellSlotStartMS = millis();
+  xSemaphoreGive(dwellMutex);
+}
+
+//*****************************************************************************
+// The dwell histogram of one lane (1, 2) into counts[histogramSize]: since
+// boot, or over the last hour. Returns the number of vehicles.
+unsigned long getDwellHistogram(int lane, bool recent, unsigned long *counts)
+{
+  unsigned long total = 0;
+  xSemaphoreTake(dwellMutex, portMAX_DELAY);
+  if (recent) advanceDwellSlots();
+  for (int i = 0; i < histogramSize; i++)
+  {
+    if (recent)
+    {
+      counts[i] = 0;
+      for (int slot = 0; slot < dwellSlots; slot++)
+      {
+        counts[i] += lidarRecentTimeHistogram[slot][lane - 1][i];
+      }
+    }
+    else
+    {
+      counts[i] = lidarTimeHistogram[lane - 1][i];
+    }
+    total += counts[i];
+  }
+  xSemaphoreGive(dwellMutex);
+  return total;
+}
+
+//*****************************************************************************
+// The dwell time (seconds) that percent of the vehicles were under. The top of
+// the bin it falls in. Zero if there are no vehicles.
+float getDwellPercentile(const unsigned long *counts, unsigned long total, int percent)
+{
+  if (total == 0) return 0;
+  unsigned long target = (total * percent + 99) / 100;
+  unsigned long sum = 0;
+  for (int i = 0; i < histogramSize; i++)
+  {
+    sum += counts[i];
+    if (sum >= target) return (i + 1) / 10.0;
+  }
+  return histogramSize / 10.0;
+}
+
+//*****************************************************************************
+// The dwell histograms as a table, with a summary for each lane up top. Called
+// from the web server's task, which has little stack: the counts are static.
+String getDwellHistogramString()
+{
+  static unsigned long counts[2 * lidarLanes][histogramSize];
+  unsigned long totals[2 * lidarLanes];
+  String retValue = "";
+  for (int lane = 1; lane <= lidarLanes; lane++)
+  {
+    for (int recent = 0; recent < 2; recent++)
+    {
+      int col = (lane - 1) * 2 + recent;
+      totals[col] = getDwellHistogram(lane, recent, counts[col]);
+      retValue = retValue + "# Lane " + String(lane) + (recent ? " (last hour)" : " (total)") +
+                 ": " + String(totals[col]) + " vehicles, median " +
+                 String(getDwellPercentile(counts[col], totals[col], 50), 1) + " s, 90% " +
+                 String(getDwellPercentile(counts[col], totals[col], 90), 1) + " s\n";
+    }
+  }
+
+  retValue = retValue + "T (s), Lane 1, Lane 1 (last hour), Lane 2, Lane 2 (last hour)\n";
+  for (int i = 0; i < histogramSize; i++)
+  {
+    retValue = retValue + String(i / 10.0, 1);
+    for (int col = 0; col < 2 * lidarLanes; col++) retValue = retValue + ", " + String(counts[col][i]);
+    retValue = retValue + "\n";
+  }
+  return retValue;
+}
+
 
 
 String getDistanceHistogramChartString(Config config)
@@ -170,7 +641,7 @@ String getDistanceHistogramChartString(Config config)
       }
 
       // Our charting routine. Welcome back to 1972!
-      for (int j = 0; j < ((100 * lidarDistanceHistogram[i]) / maxValue); j++){
+      for (unsigned long j = 0; j < ((100 * lidarDistanceHistogram[i]) / maxValue); j++){
         retValue = retValue + "*"; 
       }  
       retValue = retValue + "\n";
@@ -193,14 +664,29 @@ String getDistanceHistogramChartString(Config config)
 // in a zone for a period of time to count as 'present'. When it leaves the zone
 // an event is generated. 
 
-int processLIDARSignal(Config config)
+int processLIDARSignal(const RuntimeConfig &rc)
+{
+  unsigned int lidarUpdateRate = 15; // Time in ms between readings
+
+  tfmP.sendCommand(TRIGGER_DETECTION, 0); // Trigger a LIDAR measurment
+  delay(lidarUpdateRate);                 //
+
+  return processLIDARSample(rc, readLIDARSample());
+}
+
+//*****************************************************************************
+// The detection step of processLIDARSignal for one reading. Use it directly on
+// samples from readLIDARSamples() in free-running mode.
+template <typename K, bool Shadow>
+int processLIDARSample(const RuntimeConfig &rc, const LIDARSample &sample)
 {
   // LIDAR signal analysis parameters
 
-  int16_t tfDist = 0;          // Distance to object in centimeters
-  int16_t tfFlux = 0;          // Strength or quality of return signal
-  int16_t tfTemp = 0;          // Internal temperature of Lidar sensor chip
-  static float smoothed = 0.0; // A smoothed version of the raw distance data
+  int16_t tfDist = sample.dist; // Distance to object in centimeters
+  static typename K::Value smoothed = K::fromInt(0); // A smoothed version of the raw distance data
+
+  static float smoothingFactor = -1;           // rc.lidarSmoothingFactor, converted for K
+  static typename K::Coeff smoothing;          //   when it changes.
 
   static bool carPresentLane1 = false;         // Do we see a car now?
   static bool previousCarPresentLane1 = false; // Had we seen a car last time?
@@ -208,8 +694,8 @@ int processLIDARSignal(Config config)
   static bool carPresentLane2 = false;         // Do we see a car now?
   static bool previousCarPresentLane2 = false; // Had we seen a car last time?
 
-  static unsigned long firstInRangeMS1 = 0; // The time in ms, the car first got
-  static unsigned long firstInRangeMS2 = 0; // close enough to count as 'present'
+  static uint32_t firstInRangeUS1 = 0; // The time (the reading's, in us), the car first got
+  static uint32_t firstInRangeUS2 = 0; // close enough to count as 'present'
 
   static unsigned long timeInRange1 = 0; // How long has the car close enough to be 'present'
   static unsigned long timeInRange2 = 0;
@@ -217,26 +703,12 @@ int processLIDARSignal(Config config)
   unsigned int carEvent1 = 0;                                                       // A variable for the serial plotter.
   unsigned int carEvent2 = 0;                                                       // A variable for the serial plotter.
   
-  unsigned int lidarUpdateRate = 15;                                               // Time in ms between readings
-  unsigned long minTimeInRange = (unsigned long)config.lidarResidenceTime.toInt(); // Minimum time to count as fully 'present'.
+  unsigned long minTimeInRange = (unsigned long)rc.lidarResidenceTime; // Minimum time to count as fully 'present'.
 
   int retValue = 0; // Return value. Do we have a vehicle event?
-  bool lidarResult = false;
-
-  tfmP.sendCommand(TRIGGER_DETECTION, 0); // Trigger a LIDAR measurment
-  delay(lidarUpdateRate);                 //
-
-  lidarResult = tfmP.getData(tfDist, tfFlux, tfTemp);
-  /*
-    debugUART.print(lidarResult);
-    debugUART.print(" ");
-    debugUART.print(tfmP.status);
-    debugUART.print(" ");
-    debugUART.println(tfDist);
-  */
 
   // Read the LIDAR Sensor
-  if ((lidarResult) || (tfmP.status == TFMP_WEAK)) // Process good measurements and treat weak ones as 'infinity'
+  if ((sample.status == TFMP_READY) || (sample.status == TFMP_WEAK)) // Process good measurements and treat weak ones as 'infinity'
   {
     // When very close, or looking off into empty space, the sensor reports zero or a negative value.
     // The short range isn't an issue for us.
@@ -248,21 +720,22 @@ int processLIDARSignal(Config config)
     }
 
     //Filter the measured distance
-    smoothed = smoothed * (config.lidarSmoothingFactor.toFloat()) +
-               (float)tfDist * (1.0 - config.lidarSmoothingFactor.toFloat());
-
-    int intSmoothed = (int)smoothed * 10;
+    if (rc.lidarSmoothingFactor != smoothingFactor)
+    {
+      smoothingFactor = rc.lidarSmoothingFactor;
+      smoothing = K::coeff(smoothingFactor);
+    }
+    smoothed = K::smooth(smoothed, tfDist, smoothing); // smoothed * factor + tfDist * (1 - factor)
 
-    lidarDistanceHistogram[(unsigned int)(tfDist / 10)]++; // Grabbing a histogram of distances
-                                                           // to explore automatic lane determination...
+    // lidarBuffer gets the smoothed distance (x 10), as it always has from this detector.
+    // The zone counts still get the reading, so any of the others can run alongside.
+    if (!Shadow) recordLIDARSample(rc, clampLIDARDistance(sample), sample.timeUS, K::toInt(smoothed) * 10);
 
-    lidarBuffer.push(intSmoothed); // Keep the last 100 points of smoothed data history for analysis
-    
 
-    if ((smoothed < config.lidarZone1Max.toFloat()) &&
-        (smoothed > config.lidarZone1Min.toFloat()))
+    if ((smoothed < K::fromInt(rc.lidarZone1Max)) &&
+        (smoothed > K::fromInt(rc.lidarZone1Min)))
     {
-      timeInRange1 = millis() - firstInRangeMS1; // How long has our visitor been in range?
+      timeInRange1 = (sample.timeUS - firstInRangeUS1) / 1000; // How long (ms) has our visitor been in range?
 
       if (timeInRange1 > minTimeInRange)
       { // Is that long enough to count as present?
@@ -272,14 +745,14 @@ int processLIDARSignal(Config config)
     else
     { // No one is close enough to count as present.
       timeInRange1 = 0;
-      firstInRangeMS1 = millis();
+      firstInRangeUS1 = sample.timeUS;
       carPresentLane1 = false;
     }
 
-    if ((smoothed < config.lidarZone2Max.toFloat()) &&
-        (smoothed > config.lidarZone2Min.toFloat()))
+    if ((smoothed < K::fromInt(rc.lidarZone2Max)) &&
+        (smoothed > K::fromInt(rc.lidarZone2Min)))
     {
-      timeInRange2 = millis() - firstInRangeMS2; // How long has our visitor been in range?
+      timeInRange2 = (sample.timeUS - firstInRangeUS2) / 1000; // How long (ms) has our visitor been in range?
 
       if (timeInRange2 > minTimeInRange)
       { // Is that long enough to count as present?
@@ -289,7 +762,7 @@ int processLIDARSignal(Config config)
     else
     { // No one is close enough to count as present.
       timeInRange2 = 0;
-      firstInRangeMS2 = millis();
+      firstInRangeUS2 = sample.timeUS;
       carPresentLane2 = false;
     }
 
@@ -313,18 +786,18 @@ int processLIDARSignal(Config config)
       carEvent2 = 0;
     }
 
-if (config.showDataStream == "true"){
+if (!Shadow && rc.showDataStream){
     debugUART.print(tfDist);
     debugUART.print(",");
-    debugUART.print(smoothed);
+    debugUART.print(K::toFloat(smoothed));
     debugUART.print(",");
-    debugUART.print(config.lidarZone1Max.toFloat());
+    debugUART.print((float)rc.lidarZone1Max);
     debugUART.print(",");
-    debugUART.print(config.lidarZone1Min.toFloat());
+    debugUART.print((float)rc.lidarZone1Min);
     debugUART.print(",");
-    debugUART.print(config.lidarZone2Max.toFloat());
+    debugUART.print((float)rc.lidarZone2Max);
     debugUART.print(",");
-    debugUART.print(config.lidarZone2Min.toFloat());
+    debugUART.print((float)rc.lidarZone2Min);
     debugUART.print(",");
     debugUART.print(carEvent1);
     debugUART.print(",");
@@ -341,27 +814,9 @@ if (config.showDataStream == "true"){
     // tfmP.printStatus();
   }
 
-  return retValue;
-}
-
-void logToSDCard(){
-    #if LOG_RAW_DATA_TO_SD
-
-      if (!logFile)
-        {
-          debugUART.println(F("    Failed to create file!"));
-        } else {
-          //debugUART.println("    Writing file...");
-          logFile.print(String(millis()));
-          logFile.print(",");
-          logFile.println(String(tfDist));
-          // Close the file
-          //debugUART.println(String(millis())+","+String(tfDist));
-          logFile.flush(); // Opening the file in setup and flushing for speed. 
-        }
-    #endif
-
+  if (!Shadow) recordLaneDwell(retValue); // How long that vehicle was in its lane
 
+  return retValue;
 }
 
 /****************************************************************************************
@@ -373,12 +828,23 @@ void logToSDCard(){
  
  This might be better for some kinds of noisy data like we're seeing from black cars.
  ****************************************************************************************/
-int processLIDARSignal2(Config config){
+int processLIDARSignal2(const RuntimeConfig &rc){
+  unsigned int lidarUpdateRate = 10; // Time in ms between readings
+
+  tfmP.sendCommand(TRIGGER_DETECTION, 0); // Trigger a LIDAR measurment
+  delay(lidarUpdateRate);                 // Wait a bit...
+
+  return processLIDARSample2(rc, readLIDARSample());
+}
+
+//*****************************************************************************
+// The detection step of processLIDARSignal2 for one reading. Use it directly on
+// samples from readLIDARSamples() in free-running mode.
+template <bool Shadow>
+int processLIDARSample2(const RuntimeConfig &rc, const LIDARSample &sample){
   // LIDAR signal analysis parameters
 
-  int16_t tfDist = 0;          // Distance to object in centimeters
-  int16_t tfFlux = 0;          // Strength or quality of return signal
-  int16_t tfTemp = 0;          // Internal temperature of Lidar sensor chip
+  int16_t tfDist = sample.dist; // Distance to object in centimeters
   
   static bool carPresentLane1 = false;         // Do we see a car now?
   static bool previousCarPresentLane1 = false; // Had we seen a car last time?
@@ -389,26 +855,17 @@ int processLIDARSignal2(Config config){
   unsigned int carEvent1 = 0;                  // A variable for the serial plotter.
   unsigned int carEvent2 = 0;                  // A variable for the serial plotter.
   
-  unsigned int lidarUpdateRate = 10;           // Time in ms between readings
-  
   int retValue = 0;          // Return value. Do we have a vehicle event?
-  bool lidarResult = false;  // return value from reading the LIDAR sensor
 
-  tfmP.sendCommand(TRIGGER_DETECTION, 0); // Trigger a LIDAR measurment
-  delay(lidarUpdateRate);                 // Wait a bit...
-
-  lidarResult = tfmP.getData(tfDist, tfFlux, tfTemp); // Grab the results
-
-
-  if ( (lidarResult) || (tfmP.status == TFMP_WEAK) ) // Process good measurements 
-                                                   // or weak ones 
+  if ( (sample.status == TFMP_READY) || (sample.status == TFMP_WEAK) ) // Process good measurements 
+                                                                       // or weak ones 
   {
     // Check the status code if not "ready" one of several errors has occured.
-    // Looking at the source in TFMPlus.cpp, lidarResult should only be true
+    // Looking at the source in TFMPlus.cpp, getData() should only return true
     // if everything is ok. Processing weak signals to avoid lockup looking off
     // into infinity. 
 
-    if (tfmP.status !=TFMP_READY) {tfDist = 1001;} // "something" is weird.
+    if (sample.status !=TFMP_READY) {tfDist = 1001;} // "something" is weird.
 
     // When very close, or looking off into empty space, the sensor reports zero or a negative value.
     // The short range isn't an issue for us.
@@ -418,40 +875,16 @@ int processLIDARSignal2(Config config){
       tfDist = 999;
     }
     
-    lastDistanceMeasured = String(tfDist);
-
-    lidarDistanceHistogram[(unsigned int)(tfDist / 10)]++; // Grabbing a histogram of distances
-                                                           // to explore automatic lane determination...
-                                                           // The check for >= 1000 above is to avoid
-                                                           // exceeding the limits of the histogram array.
-
-    lidarBuffer.push(tfDist); // The circular buffer of LIDAR data for analysis
-    lidarHistoryBuffer.push((tfDist)); // A longer history for display.
-
-    long zone1Strength = 0;  // A measure of how 'present' a car is in each lane over an interval of time
-    long zone2Strength = 0;
-
-    for (int i = 0; i < lidarBuffer.size(); i++)
-    {
-      if ((lidarBuffer[i] < config.lidarZone1Max.toInt()) &&
-          (lidarBuffer[i] > config.lidarZone1Min.toInt()))
-      {
-        zone1Strength = zone1Strength + 1; // Add 'car-ness' to Zone 1
-      }
+    if (!Shadow) recordLIDARSample(rc, tfDist, sample.timeUS); // Histogram, lidarBuffer...
 
-      if ((lidarBuffer[i] < config.lidarZone2Max.toInt()) &&
-          (lidarBuffer[i] > config.lidarZone2Min.toInt()))
-      {
-        zone2Strength = zone2Strength + 1; // Add 'car-ness' to Zone 2       
-      }
-        
-    }
+    long zone1Strength = lidarZoneCounts.zone1; // A measure of how 'present' a car is in each 
+    long zone2Strength = lidarZoneCounts.zone2; //   lane over an interval of time
 
     // Normalize to 100%
     zone1Strength = (100 * zone1Strength / lidarBuffer.size());
     zone2Strength = (100 * zone2Strength / lidarBuffer.size());
 
-    int threshold = config.lidarResidenceTime.toInt(); // Minimum 'car-ness' to count as 'car' TODO: Make tweakable
+    int threshold = rc.lidarResidenceTime; // Minimum 'car-ness' to count as 'car' TODO: Make tweakable
 
     previousCarPresentLane1 = carPresentLane1;
     previousCarPresentLane2 = carPresentLane2;
@@ -480,16 +913,16 @@ int processLIDARSignal2(Config config){
     }
 
 // For the serial plotter.
-     if (config.showDataStream == "true"){
+     if (!Shadow && rc.showDataStream){
         debugUART.print(tfDist);
         debugUART.print(",");
-        debugUART.print(config.lidarZone1Max.toFloat());
+        debugUART.print((float)rc.lidarZone1Max);
         debugUART.print(",");
-        debugUART.print(config.lidarZone1Min.toFloat());
+        debugUART.print((float)rc.lidarZone1Min);
         debugUART.print(",");
-        //debugUART.print(config.lidarZone2Max.toFloat());
+        //debugUART.print((float)rc.lidarZone2Max);
         //debugUART.print(",");
-        //debugUART.print(config.lidarZone2Min.toFloat());
+        //debugUART.print((float)rc.lidarZone2Min);
         //debugUART.print(",");
         debugUART.print(carEvent1);
         debugUART.print(",");
@@ -510,6 +943,8 @@ int processLIDARSignal2(Config config){
     // TODO: Investigate.
   }
 
+  if (!Shadow) recordLaneDwell(retValue); // How long that vehicle was in its lane
+
   return retValue;
 
 }
@@ -527,15 +962,31 @@ int processLIDARSignal2(Config config){
  don't generate false events in farther lanes as they pass. 
  
  ****************************************************************************************/
-int processLIDARSignal3(Config config){
+int processLIDARSignal3(const RuntimeConfig &rc){
+  int retValue;
+
+// Trying an experiment. Let the LIDAR run free and poll it occassionally.
+  //tfmP.sendCommand(TRIGGER_DETECTION, 0); // Trigger a LIDAR measurment
+  //delay(lidarUpdateRate);                 // Wait a bit...
+  //lightSleepMSec(lidarUpdateRate);
+
+  retValue = processLIDARSample3(rc, readLIDARSample());
+
+  tfmP.sendCommand(TRIGGER_DETECTION, 0); // Trigger a LIDAR measurment
+  return retValue;
+}
+
+//*****************************************************************************
+// The detection step of processLIDARSignal3 for one reading. Use it directly on
+// samples from readLIDARSamples() in free-running mode.
+template <typename K, bool Shadow>
+int processLIDARSample3(const RuntimeConfig &rc, const LIDARSample &sample){
   // LIDAR signal analysis parameters
 
-  int16_t tfDist = 0;          // Distance to object in centimeters
-  int16_t tfFlux = 0;          // Strength or quality of return signal
-  int16_t tfTemp = 0;          // Internal temperature of Lidar sensor chip
+  int16_t tfDist = sample.dist; // Distance to object in centimeters
   
-  static float zone1Strength = 0;  // A measure of how 'present' a car is in each lane over an interval of time
-  static float zone2Strength = 0;  // Now static and doesn't reset on every call
+  static typename K::Value zone1Strength = K::fromInt(0);  // A measure of how 'present' a car is in each lane over an interval of time
+  static typename K::Value zone2Strength = K::fromInt(0);  // Now static and doesn't reset on every call
 
   static bool carPresentLane1 = false;         // Do we see a car now?
   static bool previousCarPresentLane1 = false; // Had we seen a car last time?
@@ -543,34 +994,26 @@ int processLIDARSignal3(Config config){
   static bool carPresentLane2 = false;         // Do we see a car now?
   static bool previousCarPresentLane2 = false; // Had we seen a car last time?
 
+  static double decayRate = -1;                // rc.lidarDecay, converted for K
+  static typename K::Coeff decay;              //   when it changes.
+
   unsigned int carEvent1 = 0;                  // A variable for the serial plotter.
   unsigned int carEvent2 = 0;                  // A variable for the serial plotter.
   
-  unsigned int lidarUpdateRate = 10;           // Time in ms between readings
-  
   int retValue = 0;          // Return value for the routine. Do we have a vehicle event? 
                              //  Which lane?
 
-  bool lidarResult = false;  // Return value from reading the LIDAR sensor
+  int threshold = rc.lidarResidenceTime; // Level of signal to count as present.
 
-  int threshold = config.lidarResidenceTime.toInt(); // Level of signal to count as present.
-
-// Trying an experiment. Let the LIDAR run free and poll it occassionally.
-  //tfmP.sendCommand(TRIGGER_DETECTION, 0); // Trigger a LIDAR measurment
-  //delay(lidarUpdateRate);                 // Wait a bit...
-  //lightSleepMSec(lidarUpdateRate);
-
-  lidarResult = tfmP.getData(tfDist, tfFlux, tfTemp); // Grab the results
-
-  if ( (lidarResult) || (tfmP.status == TFMP_WEAK) ) // Process good measurements 
-                                                     // or weak ones 
+  if ( (sample.status == TFMP_READY) || (sample.status == TFMP_WEAK) ) // Process good measurements 
+                                                                       // or weak ones 
   {
     // Check the status code. If not "ready" one of several errors has occurred.
-    // Looking at the source in TFMPlus.cpp, lidarResult should only be true
+    // Looking at the source in TFMPlus.cpp, getData() should only return true
     // if everything is OK. Processing weak signals to avoid lockup looking off
     // into infinity. 
 
-    if (tfmP.status !=TFMP_READY) {tfDist = 1001;} // "something" is weird.
+    if (sample.status !=TFMP_READY) {tfDist = 1001;} // "something" is weird.
 
     // When very close, or looking off into empty space, the sensor reports zero or a 
     // negative value. The short range isn't an issue for us.
@@ -581,62 +1024,46 @@ int processLIDARSignal3(Config config){
       tfDist = 999; // Limiting to 999 saves a digit in the messages to the server.
     }
     
-    lastDistanceMeasured = String(tfDist);
-
-    lidarDistanceHistogram[(unsigned int)(tfDist / 10)]++; // Grabbing a histogram of distances
-                                                           // to explore automatic lane determination...
-                                                           // The check for >= 1000 above is to avoid
-                                                           // exceeding the limits of the histogram array.
+    if (!Shadow) recordLIDARSample(rc, tfDist, sample.timeUS); // Histogram, lidarBuffer...
 
-    lidarBuffer.push(tfDist); // The circular buffer of LIDAR data for analysis
-    lidarHistoryBuffer.push((tfDist)); // A longer history for display.
-
-    // TODO: Trying out a pre-filter here to look at the lidar history buffer 
-    // and do a disposition of whether we should take this data seriously...
-    // There is a difference between 'glimpsing' something and 'seeing' it. I'm 
-    // thinking of how snow can cause short little events around 1-2 meters...
+    // There is a difference between 'glimpsing' something and 'seeing' it. Snow and
+    // rain cause short little events around 1-2 meters: lidar.preFilter and
+    // lidar.minRunLength take them out before they get here (digamePreFilter.h).
 
     // PRE-FILTER: Do we have enough signal to count as car-ness?
-    float bufferInteg1 = 0; // Integral of in-zone data in the buffer
-    float bufferInteg2 = 0;
-    
-    for (int i = 0; i < lidarBuffer.size(); i++)
-    {
-      if ((lidarBuffer[i] < config.lidarZone1Max.toInt()) &&
-          (lidarBuffer[i] > config.lidarZone1Min.toInt()))
-      {
-        bufferInteg1 += 100 / lidarBuffer.size();  // Scale to buffer size
-      }
-      if ((lidarBuffer[i] < config.lidarZone2Max.toInt()) &&
-          (lidarBuffer[i] > config.lidarZone2Min.toInt()))
-      {
-        bufferInteg2 += 100 / lidarBuffer.size();
-      }
-    }
+    // Integral of in-zone data in the buffer, scaled to buffer size. (Integer division 
+    // on purpose: it's what the original per-sample sum added up.)
+    int bufferInteg1 = lidarZoneCounts.zone1 * (100 / lidarBuffer.size());
+    int bufferInteg2 = lidarZoneCounts.zone2 * (100 / lidarBuffer.size());
 
     // Test for car-ness
-    if ( bufferInteg1 > threshold) { zone1Strength = 100; } // We have Car!
-    if ( bufferInteg2 > threshold) { zone2Strength = 100; }
+    if ( bufferInteg1 > threshold) { zone1Strength = K::fromInt(100); } // We have Car!
+    if ( bufferInteg2 > threshold) { zone2Strength = K::fromInt(100); }
 
     // Cars at longer distances than the zoneMax take away zoneStrength
-    // Experimenting with an exponential decay. 
-    // Hardcoded decay constant. TODO: If this works well, make adjustable.
-    if (tfDist > config.lidarZone1Max.toInt())
+    // with an exponential decay (lidar.decay in PARAMS.TXT, 0.05 by default).
+    if (rc.lidarDecay != decayRate)
     {
-      zone1Strength = zone1Strength -  zone1Strength * 0.05; // Subtract 'car-ness' from Zone 1
+      decayRate = rc.lidarDecay;
+      decay = K::coeff(decayRate);
+    }
+    if (tfDist > rc.lidarZone1Max)
+    {
+      zone1Strength = K::decay(zone1Strength, decay); // Subtract 'car-ness' from Zone 1
     }
 
-    if (tfDist > config.lidarZone2Max.toInt()) 
+    if (tfDist > rc.lidarZone2Max) 
     {
-      zone2Strength = zone2Strength - zone2Strength *0.05; // Subtract 'car-ness' from Zone 2
+      zone2Strength = K::decay(zone2Strength, decay); // Subtract 'car-ness' from Zone 2
     }
     
     previousCarPresentLane1 = carPresentLane1;
     previousCarPresentLane2 = carPresentLane2;
 
-    // Hardcoded cutoff for the exponential decay. Report once car-ness decays to 10%
-    carPresentLane1 = (zone1Strength > 10);
-    carPresentLane2 = (zone2Strength > 10);
+    // Report once car-ness decays to lidar.presenceCutoff (10% by default)
+    const typename K::Value cutoff = K::fromInt(rc.lidarPresenceCutoff);
+    carPresentLane1 = (zone1Strength > cutoff);
+    carPresentLane2 = (zone2Strength > cutoff);
 
     if ((previousCarPresentLane1 == true) && (carPresentLane1 == false)) 
     { // The car was here and now has left the field of view.
@@ -659,24 +1086,24 @@ int processLIDARSignal3(Config config){
     }
 
 // For the serial plotter.
-     if (config.showDataStream == "true"){
+     if (!Shadow && rc.showDataStream){
         debugUART.print(tfDist);
         debugUART.print(",");
-        debugUART.print(config.lidarZone1Max.toFloat());
+        debugUART.print((float)rc.lidarZone1Max);
         debugUART.print(",");
-        debugUART.print(config.lidarZone1Min.toFloat());
+        debugUART.print((float)rc.lidarZone1Min);
         debugUART.print(",");
-        debugUART.print(config.lidarZone2Max.toFloat());
+        debugUART.print((float)rc.lidarZone2Max);
         debugUART.print(",");
-        debugUART.print(config.lidarZone2Min.toFloat());
+        debugUART.print((float)rc.lidarZone2Min);
         debugUART.print(",");
         debugUART.print(carEvent1);
         debugUART.print(",");
         debugUART.print(carEvent2);
         debugUART.print(",");
-        debugUART.print(zone1Strength);
+        debugUART.print(K::toFloat(zone1Strength));
         debugUART.print(",");
-        debugUART.println(zone2Strength);
+        debugUART.println(K::toFloat(zone2Strength));
      }
 
   }
@@ -689,10 +1116,88 @@ int processLIDARSignal3(Config config){
     // TODO: Investigate.
   }
 
+  if (!Shadow) recordLaneDwell(retValue); // How long that vehicle was in its lane
 
-  tfmP.sendCommand(TRIGGER_DETECTION, 0); // Trigger a LIDAR measurment
   return retValue;
 
 }
 
+/****************************************************************************************
+ The correlation scheme from the older counters (processLIDARSignalCorrel), on a
+ MatchedFilter so it keeps up with the sensor. The last modelSamples readings are
+ correlated with a falling edge: strongly negative means the distance jumped back up
+ half a window ago, i.e. a vehicle has just left. The coefficient is smoothed, and an
+ event is reported when it first drops below the threshold. The lane is the zone most of
+ the readings before the edge fell in.
+ ****************************************************************************************/
+template <typename K, bool Shadow>
+int processLIDARSampleCorrelation(const RuntimeConfig &rc, const LIDARSample &sample){
+
+  int16_t tfDist = sample.dist; // Distance to object in centimeters
+
+  static MatchedFilter<modelSamples> edgeFilter(fallingEdgeModel);
+
+  // Correlation in -100 to 100 (perfect anti to perfect correlation), less 10 as the old
+  // counters had it. We don't need perfect for detection.
+  const int lowThreshold = -30;  // Report a vehicle below this...
+  const int rearmThreshold = -10; //   and wait until we're back above this for the next.
+
+  static typename K::Value smoothed = K::fromInt(0);
+  static const typename K::Coeff smoothing = K::coeff(0.8);
+  static bool armed = true;
+
+  int retValue = 0;
+
+  if ( (sample.status == TFMP_READY) || (sample.status == TFMP_WEAK) )
+  {
+    // As processLIDARSample3: weak readings and empty space read as the far limit.
+    if (sample.status != TFMP_READY) {tfDist = 1001;}
+    if ((tfDist <= 0) || (tfDist >= 1000))
+    {
+      tfDist = 999;
+    }
+
+    if (!Shadow) recordLIDARSample(rc, tfDist, sample.timeUS); // Histogram, lidarBuffer...
+
+    edgeFilter.push(tfDist);
+    int correl = (int)(edgeFilter.correlation() * 100) - 10;
+    smoothed = K::smooth(smoothed, correl, smoothing);
+
+    if (armed && edgeFilter.full() && (smoothed < K::fromInt(lowThreshold)))
+    {
+      armed = false;
+
+      // Which lane was the vehicle in? Look at the half of the window before the edge.
+      int inZone1 = 0, inZone2 = 0;
+      for (int i = 0; i < modelSamples / 2; i++)
+      {
+        int d = edgeFilter[i];
+        if ((d > rc.lidarZone1Min) && (d < rc.lidarZone1Max)) inZone1++;
+        if ((d > rc.lidarZone2Min) && (d < rc.lidarZone2Max)) inZone2++;
+      }
+      if ((inZone1 > 0) || (inZone2 > 0))
+      {
+        retValue = (inZone2 > inZone1) ? 2 : 1;
+      }
+    }
+    else if (smoothed > K::fromInt(rearmThreshold))
+    {
+      armed = true;
+    }
+
+    // For the serial plotter.
+    if (!Shadow && rc.showDataStream){
+      debugUART.print(tfDist);
+      debugUART.print(",");
+      debugUART.print(K::toFloat(smoothed));
+      debugUART.print(",");
+      debugUART.println(retValue * 300);
+    }
+  }
+
+  if (!Shadow) recordLaneDwell(retValue); // How long that vehicle was in its lane
+
+  return retValue;
+}
+
 #endif // __DIGAME_LIDAR_H__
\ No newline at end of file
@@ -0,0 +1,344 @@
+/* digameLIDARHealth.h
+ *
+ *  How a LIDAR sensor is doing, from what comes with every reading -- the
+ *  signal strength (flux), the chip temperature and the status -- and from
+ *  its parser's error counts. Kept over a rolling window of the last
+ *  healthSlots minutes:
+ *
+ *    flux       min / mean / max over the frames with a flux (not saturated)
+ *    temp       min / mean / max chip temperature, C
+ *    weak       the share of frames too weak to give a distance
+ *    checksum   the share of frames from the sensor that were corrupt
+ *    rate       readings per second that made it to the detectors, against
+ *               the rate we asked for
+ *
+ *  A dirty lens or a tired sensor sends back less light long before it stops
+ *  seeing vehicles: the mean flux of returns from something in range, and the
+ *  weak share, are compared with slow baselines that follow the last day.
+ *  Falling well away from them raises a warning (see LIDARHealthWarning), as
+ *  do a noisy cable, a slow or silent sensor and a hot chip. The summary goes
+ *  out with the heartbeats and the web server serves it at /health.
+ *
+ *  One LIDARHealth per sensor, with that sensor's parser. readLIDARSample()
+ *  and readLIDARSamples() keep lidarHealth up to date.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_LIDAR_HEALTH_H__
+#define __DIGAME_LIDAR_HEALTH_H__
+
+#include <digameTFMiniParser.h>
+#include <digameLIDARSample.h>
+
+const int healthSlots = 10;                 // The rolling window is the last 10 minutes...
+const uint32_t healthSlotUS = 60000000UL;   //   in one minute slots.
+const int healthBaselineSlots = 1440;       // The baselines follow the last day...
+const int healthBaselineReady = 60;         //   once they've had an hour.
+const int healthBaselineMinTargets = 50;    // Returns from something in range a slot needs to count
+
+// Thresholds for the warnings.
+const float healthLowFluxShare = 0.5;       // Target flux below half its baseline
+const float healthWeakRise = 0.2;           // Weak share this much over its baseline
+const float healthChecksumRate = 0.01;      // More than 1% of frames corrupt
+const float healthSlowShare = 0.9;          // Under 90% of the expected rate
+const int16_t healthHotC = 60;              // The TFMini Plus is rated to 60 C
+
+enum LIDARHealthWarning
+{
+  HEALTH_LOW_FLUX = 0x01, // Less light back from targets than usual: lens, alignment, laser
+  HEALTH_WEAK = 0x02,     // More weak readings than usual
+  HEALTH_CHECKSUM = 0x04, // Corrupt frames: cable, connector, interference
+  HEALTH_SLOW = 0x08,     // Fewer readings than expected
+  HEALTH_HOT = 0x10,      // Chip temperature over the rating
+  HEALTH_SILENT = 0x20,   // No readings at all
+  HEALTH_WARNINGS = 6
+};
+
+const char *const healthWarningNames[HEALTH_WARNINGS] = {"lowFlux", "weak", "checksum",
+                                                         "slow", "hot", "silent"};
+
+// One slot's worth.
+struct LIDARHealthSlot
+{
+  unsigned long frames = 0;      // Readings passed on to the detectors
+  unsigned long weak = 0;
+  unsigned long noFrame = 0;     // Polls with nothing new from the sensor
+  unsigned long fluxFrames = 0;
+  uint64_t fluxSum = 0;
+  uint16_t fluxMin = 65535;
+  uint16_t fluxMax = 0;
+  unsigned long targets = 0;     // Good readings of something in range...
+  uint64_t targetFluxSum = 0;    //   and their flux.
+  int32_t tempSum = 0;
+  int16_t tempMin = 32767;
+  int16_t tempMax = -32768;
+  unsigned long parsed = 0;      // From the parser: good frames...
+  unsigned long corrupt = 0;     //   and checksum errors.
+};
+
+struct LIDARHealthSummary
+{
+  float seconds = 0;         // The window
+  unsigned long frames = 0;
+  float sampleRate = 0;      // Hz
+  float expectedRate = 0;
+  uint16_t fluxMin = 0;
+  float fluxMean = 0;
+  uint16_t fluxMax = 0;
+  int16_t tempMin = 0;
+  float tempMean = 0;
+  int16_t tempMax = 0;
+  float weakRatio = 0;
+  float checksumErrorRate = 0;
+  float targetFlux = 0;      // Mean flux of good readings of something in range...
+  float baselineFlux = 0;    //   and what it usually is (0 until known).
+  float baselineWeak = 0;
+  uint8_t warnings = 0;      // LIDARHealthWarning bits
+};
+
+class LIDARHealth
+{
+public:
+  explicit LIDARHealth(const TFMiniParser &p) : parser(p) {}
+
+  // Readings per second we should get. Without it there's no HEALTH_SLOW.
+  void setExpectedRate(float hz) { expectedRate = hz; }
+
+  //****************************************************************************************
+  // One reading, as it goes to the detectors. (TFMP_HEADER: a poll that found nothing.)
+  void record(const LIDARSample &sample)
+  {
+    LIDARHealthSlot &s = slots[head];
+    if ((sample.status == TFMP_HEADER) || (sample.status == TFMP_CHECKSUM))
+    {
+      s.noFrame++;
+      return;
+    }
+    s.frames++;
+    if (sample.status == TFMP_WEAK) s.weak++;
+    if (sample.status != TFMP_STRONG) // Saturated: no flux to speak of
+    {
+      uint16_t flux = (uint16_t)sample.flux;
+      s.fluxFrames++;
+      s.fluxSum += flux;
+      if (flux < s.fluxMin) s.fluxMin = flux;
+      if (flux > s.fluxMax) s.fluxMax = flux;
+      if ((sample.status == TFMP_READY) && (sample.dist > 0) && (sample.dist < 1000))
+      {
+        s.targets++;
+        s.targetFluxSum += flux;
+      }
+    }
+    s.tempSum += sample.temp;
+    if (sample.temp < s.tempMin) s.tempMin = sample.temp;
+    if (sample.temp > s.tempMax) s.tempMax = sample.temp;
+  }
+
+  //****************************************************************************************
+  // Move the window along to nowUS (micros()). Call often; it's cheap between slots.
+  void update(uint32_t nowUS)
+  {
+    if (!started)
+    {
+      started = true;
+      slotStartUS = nowUS;
+      lastParsed = parser.stats.frames;
+      lastCorrupt = parser.stats.checksumErrors;
+      return;
+    }
+    int closed = 0;
+    while ((uint32_t)(nowUS - slotStartUS) >= healthSlotUS)
+    {
+      closeSlot();
+      slotStartUS += healthSlotUS;
+      if (++closed > healthSlots) slotStartUS = nowUS; // Long gone: start afresh from now.
+    }
+    if (closed > 0) published = summarize(nowUS);
+  }
+
+  //****************************************************************************************
+  // The window up to nowUS, with the warnings.
+  LIDARHealthSummary summary(uint32_t nowUS)
+  {
+    update(nowUS);
+    published = summarize(nowUS);
+    return published;
+  }
+
+  // The last summary taken, at most a slot old, for readers on other tasks (the web server).
+  const LIDARHealthSummary &lastSummary() const { return published; }
+
+  // Start over, baselines and all (a new sensor, or a cleaned lens).
+  void clear()
+  {
+    for (int i = 0; i < healthSlots; i++) slots[i] = LIDARHealthSlot();
+    head = 0;
+    used = 1;
+    started = false;
+    baselineSlots = 0;
+    baselineFlux = baselineWeak = 0;
+    published = LIDARHealthSummary();
+  }
+
+private:
+  const TFMiniParser &parser;
+  float expectedRate = 0;
+
+  LIDARHealthSlot slots[healthSlots];
+  int head = 0;        // The slot being filled
+  int used = 1;        // Slots holding data, that one included
+  bool started = false;
+  uint32_t slotStartUS = 0;
+  unsigned long lastParsed = 0;  // The parser's counts when this slot began
+  unsigned long lastCorrupt = 0;
+
+  int baselineSlots = 0; // Slots the baselines have had
+  float baselineFlux = 0;
+  float baselineWeak = 0;
+
+  LIDARHealthSummary published;
+
+  LIDARHealthSummary summarize(uint32_t nowUS) const
+  {
+    LIDARHealthSlot total;
+    for (int i = 0; i < healthSlots; i++) add(total, slots[i]);
+    LIDARHealthSlot current;
+    takeParserCounts(current); // What the parser's seen since the slot began
+    total.parsed += current.parsed;
+    total.corrupt += current.corrupt;
+
+    LIDARHealthSummary r;
+    r.seconds = (used - 1) * (healthSlotUS / 1e6f) + (uint32_t)(nowUS - slotStartUS) / 1e6f;
+    r.frames = total.frames;
+    r.sampleRate = (r.seconds > 0) ? total.frames / r.seconds : 0;
+    r.expectedRate = expectedRate;
+    if (total.fluxFrames > 0)
+    {
+      r.fluxMin = total.fluxMin;
+      r.fluxMax = total.fluxMax;
+      r.fluxMean = (float)((double)total.fluxSum / total.fluxFrames);
+    }
+    if (total.frames > 0)
+    {
+      r.tempMin = total.tempMin;
+      r.tempMax = total.tempMax;
+      r.tempMean = (float)total.tempSum / total.frames;
+      r.weakRatio = (float)total.weak / total.frames;
+    }
+    if (total.parsed + total.corrupt > 0) r.checksumErrorRate = (float)total.corrupt / (total.parsed + total.corrupt);
+    if (total.targets > 0) r.targetFlux = (float)((double)total.targetFluxSum / total.targets);
+    if (baselineSlots >= healthBaselineReady)
+    {
+      r.baselineFlux = baselineFlux;
+      r.baselineWeak = baselineWeak;
+    }
+
+    if (r.seconds >= 10) // Enough to go on
+    {
+      if (total.frames == 0) r.warnings |= HEALTH_SILENT;
+      if ((expectedRate > 0) && (r.sampleRate < healthSlowShare * expectedRate)) r.warnings |= HEALTH_SLOW;
+    }
+    if ((r.baselineFlux > 0) && (total.targets >= (unsigned long)healthBaselineMinTargets) &&
+        (r.targetFlux < healthLowFluxShare * r.baselineFlux))
+    {
+      r.warnings |= HEALTH_LOW_FLUX;
+    }
+    if ((r.baselineFlux > 0) && (total.frames > 0) && (r.weakRatio > r.baselineWeak + healthWeakRise))
+    {
+      r.warnings |= HEALTH_WEAK;
+    }
+    if ((total.corrupt > 0) && (r.checksumErrorRate > healthChecksumRate)) r.warnings |= HEALTH_CHECKSUM;
+    if ((total.frames > 0) && (r.tempMax > healthHotC)) r.warnings |= HEALTH_HOT;
+    return r;
+  }
+
+  // The parser's counts since lastParsed / lastCorrupt. (They can be reset under us.)
+  void takeParserCounts(LIDARHealthSlot &s) const
+  {
+    unsigned long parsed = parser.stats.frames, corrupt = parser.stats.checksumErrors;
+    s.parsed = (parsed >= lastParsed) ? parsed - lastParsed : parsed;
+    s.corrupt = (corrupt >= lastCorrupt) ? corrupt - lastCorrupt : corrupt;
+  }
+
+  static void add(LIDARHealthSlot &a, const LIDARHealthSlot &b)
+  {
+    a.frames += b.frames;
+    a.weak += b.weak;
+    a.noFrame += b.noFrame;
+    a.fluxFrames += b.fluxFrames;
+    a.fluxSum += b.fluxSum;
+    if (b.fluxMin < a.fluxMin) a.fluxMin = b.fluxMin;
+    if (b.fluxMax > a.fluxMax) a.fluxMax = b.fluxMax;
+    a.targets += b.targets;
+    a.targetFluxSum += b.targetFluxSum;
+    a.tempSum += b.tempSum;
+    if (b.tempMin < a.tempMin) a.tempMin = b.tempMin;
+    if (b.tempMax > a.tempMax) a.tempMax = b.tempMax;
+    a.parsed += b.parsed;
+    a.corrupt += b.corrupt;
+  }
+
+  void closeSlot()
+  {
+    LIDARHealthSlot &s = slots[head];
+    takeParserCounts(s);
+    lastParsed = parser.stats.frames;
+    lastCorrupt = parser.stats.checksumErrors;
+
+    // Only slots with plenty of targets say anything about the optics.
+    if (s.targets >= (unsigned long)healthBaselineMinTargets)
+    {
+      float flux = (float)((double)s.targetFluxSum / s.targets);
+      float weak = (float)s.weak / s.frames;
+      int n = (baselineSlots < healthBaselineSlots) ? baselineSlots + 1 : healthBaselineSlots;
+      baselineFlux += (flux - baselineFlux) / n; // A plain mean to start with, then
+      baselineWeak += (weak - baselineWeak) / n; //   exponential, over the last day.
+      if (baselineSlots < healthBaselineSlots) baselineSlots++;
+    }
+
+    head = (head + 1) % healthSlots;
+    slots[head] = LIDARHealthSlot();
+    if (used < healthSlots) used++;
+  }
+};
+
+//****************************************************************************************
+// The summary as JSON. terse: short keys for LoRa heartbeats.
+String getLIDARHealthJSON(const LIDARHealthSummary &h, bool terse = false)
+{
+  String warnings = "";
+  for (int i = 0; i < HEALTH_WARNINGS; i++)
+  {
+    if (!(h.warnings & (1 << i))) continue;
+    if (warnings.length() > 0) warnings += ",";
+    warnings += "\"" + String(healthWarningNames[i]) + "\"";
+  }
+
+  if (terse)
+  {
+    return "{\"sr\":" + String(h.sampleRate, 1) +
+           ",\"f\":[" + String(h.fluxMin) + "," + String(h.fluxMean, 0) + "," + String(h.fluxMax) + "]" +
+           ",\"tc\":[" + String(h.tempMin) + "," + String(h.tempMean, 0) + "," + String(h.tempMax) + "]" +
+           ",\"wr\":" + String(h.weakRatio, 3) +
+           ",\"ce\":" + String(h.checksumErrorRate, 4) +
+           ",\"w\":" + String(h.warnings) + "}";
+  }
+
+  return "{\"seconds\":" + String(h.seconds, 0) +
+         ",\"readings\":" + String(h.frames) +
+         ",\"sampleRate\":" + String(h.sampleRate, 1) +
+         ",\"expectedRate\":" + String(h.expectedRate, 1) +
+         ",\"flux\":{\"min\":" + String(h.fluxMin) + ",\"mean\":" + String(h.fluxMean, 1) +
+         ",\"max\":" + String(h.fluxMax) + "}" +
+         ",\"temp\":{\"min\":" + String(h.tempMin) + ",\"mean\":" + String(h.tempMean, 1) +
+         ",\"max\":" + String(h.tempMax) + "}" +
+         ",\"weakRatio\":" + String(h.weakRatio, 4) +
+         ",\"checksumErrorRate\":" + String(h.checksumErrorRate, 5) +
+         ",\"targetFlux\":" + String(h.targetFlux, 1) +
+         ",\"baselineFlux\":" + String(h.baselineFlux, 1) +
+         ",\"baselineWeakRatio\":" + String(h.baselineWeak, 4) +
+         ",\"warnings\":[" + warnings + "]}";
+}
+
+#endif // __DIGAME_LIDAR_HEALTH_H__
@@ -0,0 +1,22 @@
+/* digameLIDARSample.h
+ *
+ *  One reading from a TFMini-Plus, as the reader tasks hand it on.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_LIDAR_SAMPLE_H__
+#define __DIGAME_LIDAR_SAMPLE_H__
+
+#include <stdint.h>
+
+struct LIDARSample
+{
+  uint32_t timeUS; // micros() when the frame came in
+  int16_t dist;    // cm
+  int16_t flux;    // Signal strength
+  int16_t temp;    // Chip temperature, C
+  uint8_t status;  // TFMP_READY, TFMP_WEAK, etc.
+};
+
+#endif // __DIGAME_LIDAR_SAMPLE_H__
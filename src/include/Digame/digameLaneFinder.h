@@ -0,0 +1,276 @@
+/* digameLaneFinder.h
+ *
+ *  Works out where the lanes are from the LIDAR distance histogram, so the
+ *  zone limits don't have to be hand-tuned at every install.
+ *
+ *  Most of the time the sensor sees the empty road (the far curb, a wall, or
+ *  nothing at all). That's the biggest peak in the histogram. Every vehicle
+ *  adds counts at its distance, so each lane shows up as a smaller peak in
+ *  front of it, with a valley between lanes. The finder keeps a copy of the
+ *  histogram that fades with time (so it follows a shifted lane, a parked
+ *  trailer that leaves, snow banks...), picks out the peaks and proposes a
+ *  min/max for each lane.
+ *
+ *  Call update() every minute or so with lidarDistanceHistogram and
+ *  propose() whenever you want an answer. The /lanes page of the web server
+ *  shows the proposal; with lidar.autoLanes set it's applied to the config.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_LANE_FINDER_H__
+#define __DIGAME_LANE_FINDER_H__
+
+#include <digameJSONConfig.h>
+#include <math.h>
+
+const int LANE_FINDER_MAX_LANES = 4;
+
+struct LaneEstimate
+{
+  int minCM;   // Zone limits to use for this lane
+  int peakCM;  // Where most vehicles in this lane are seen
+  int maxCM;
+  float share; // Fraction of all samples that were vehicles in this lane
+};
+
+struct LaneProposal
+{
+  int lanes;
+  LaneEstimate lane[LANE_FINDER_MAX_LANES]; // Nearest lane first
+  int backgroundCM; // What the sensor sees when the road is empty
+  float samples;    // (Faded) number of samples behind the proposal
+  bool ready;       // Enough traffic in every lane found to trust it
+};
+
+//****************************************************************************************
+class LaneFinder
+{
+public:
+  static const int bins = 121; // Same binning as lidarDistanceHistogram
+  static const int binCM = 10;
+
+  float peakEdge = 0.1;     // A lane extends out to where the counts drop to this fraction of its peak.
+  float minProminence = 0.3; // A peak must stand this far (as a fraction of its height) above
+                             //   the valley that separates it from a bigger one.
+  float minLaneShare = 0.05; // ...and hold this fraction of all the vehicle samples.
+  float minLaneSamples = 500; // Before a lane is trusted. (At 100 Hz that's a few dozen vehicles.)
+
+  LaneFinder() { reset(); }
+
+  //****************************************************************************************
+  // How quickly old data fades: after this many calls to update(), it counts half as much.
+  void setHalfLife(float updates)
+  {
+    decay = (updates > 0) ? pow(0.5, 1.0 / updates) : 1.0;
+  }
+
+  //****************************************************************************************
+  void reset()
+  {
+    for (int i = 0; i < bins; i++)
+    {
+      faded[i] = 0;
+      previous[i] = 0;
+    }
+  }
+
+  //****************************************************************************************
+  // Fold in what's been added to histogram since the last call. (If it has been cleared in
+  // the meantime, everything in it is new.)
+  void update(const unsigned long *histogram)
+  {
+    for (int i = 0; i < bins; i++)
+    {
+      unsigned long added = (histogram[i] >= previous[i]) ? histogram[i] - previous[i] : histogram[i];
+      faded[i] = faded[i] * decay + (float)added;
+      previous[i] = histogram[i];
+    }
+  }
+
+  float weight(int bin) const { return faded[bin]; }
+
+  //****************************************************************************************
+  LaneProposal propose(int maxLanes = 2) const
+  {
+    LaneProposal p;
+    p.lanes = 0;
+    p.ready = false;
+    p.samples = 0;
+    if (maxLanes > LANE_FINDER_MAX_LANES) maxLanes = LANE_FINDER_MAX_LANES;
+
+    // A little smoothing so one noisy bin doesn't make two peaks.
+    float s[bins];
+    for (int i = 0; i < bins; i++)
+    {
+      float left = faded[(i > 0) ? i - 1 : i];
+      float right = faded[(i < bins - 1) ? i + 1 : i];
+      s[i] = 0.25 * left + 0.5 * faded[i] + 0.25 * right;
+      p.samples += faded[i];
+    }
+
+    // The empty road: the biggest peak, and the near edge of it.
+    int background = 0;
+    for (int i = 1; i < bins; i++)
+    {
+      if (s[i] > s[background]) background = i;
+    }
+    p.backgroundCM = background * binCM;
+    if (s[background] <= 0) return p;
+
+    int roadEdge = background;
+    while ((roadEdge > 0) && (s[roadEdge - 1] < s[roadEdge])) roadEdge--;
+
+    float vehicleSamples = 0;
+    for (int i = 0; i < roadEdge; i++) vehicleSamples += faded[i];
+    if (vehicleSamples <= 0) return p;
+
+    // Candidate lanes: peaks in front of the road that stand out from their surroundings.
+    int peaks[bins];
+    float mass[bins];
+    int numPeaks = 0;
+    for (int i = 0; i < roadEdge; i++)
+    {
+      bool risesFromLeft = (i == 0) || (s[i] > s[i - 1]);
+      bool fallsToRight = (s[i] > s[i + 1]) || ((s[i] == s[i + 1]) && (i + 1 == roadEdge));
+      if ((s[i] <= 0) || !risesFromLeft || !fallsToRight) continue;
+
+      // Prominence: how far down we have to go before reaching higher ground (or the end).
+      float leftMin = (i == 0) ? 0 : s[i];
+      float rightMin = s[i];
+      for (int j = i - 1; (j >= 0) && (s[j] <= s[i]); j--) leftMin = fmin(leftMin, s[j]);
+      for (int j = i + 1; (j <= roadEdge) && (s[j] <= s[i]); j++) rightMin = fmin(rightMin, s[j]);
+      float prominence = s[i] - fmax(leftMin, rightMin);
+      if (prominence < minProminence * s[i]) continue;
+
+      peaks[numPeaks] = i;
+      numPeaks++;
+    }
+
+    // Each candidate's share of the vehicle samples, out to the valleys either side.
+    for (int k = 0; k < numPeaks; k++)
+    {
+      int from = (k == 0) ? 0 : valley(s, peaks[k - 1], peaks[k]);
+      int to = (k == numPeaks - 1) ? roadEdge : valley(s, peaks[k], peaks[k + 1]);
+      mass[k] = 0;
+      for (int i = from; i < to; i++) mass[k] += faded[i];
+    }
+
+    // Keep the busiest ones, then put them back in order of distance.
+    bool keep[bins];
+    for (int k = 0; k < numPeaks; k++) keep[k] = false;
+    for (int n = 0; n < maxLanes; n++)
+    {
+      int best = -1;
+      for (int k = 0; k < numPeaks; k++)
+      {
+        if (keep[k] || (mass[k] < minLaneShare * vehicleSamples)) continue;
+        if ((best < 0) || (mass[k] > mass[best])) best = k;
+      }
+      if (best < 0) break;
+      keep[best] = true;
+    }
+
+    int kept[LANE_FINDER_MAX_LANES];
+    float keptMass[LANE_FINDER_MAX_LANES];
+    for (int k = 0; k < numPeaks; k++)
+    {
+      if (!keep[k]) continue;
+      kept[p.lanes] = peaks[k];
+      keptMass[p.lanes] = mass[k];
+      p.lanes++;
+    }
+
+    // Zone limits: out from the peak to the edge, but not past a valley shared with
+    // the next lane or into the road.
+    p.ready = (p.lanes > 0);
+    for (int k = 0; k < p.lanes; k++)
+    {
+      int peak = kept[k];
+      int from = (k == 0) ? 0 : valley(s, kept[k - 1], peak);
+      int to = (k == p.lanes - 1) ? roadEdge : valley(s, peak, kept[k + 1]);
+      float edge = peakEdge * s[peak];
+
+      int lo = peak;
+      while ((lo > from) && (s[lo - 1] >= edge)) lo--;
+      int hi = peak;
+      while ((hi + 1 < to) && (s[hi + 1] >= edge)) hi++;
+
+      LaneEstimate &lane = p.lane[k];
+      lane.minCM = lo * binCM;
+      lane.peakCM = peak * binCM + binCM / 2;
+      lane.maxCM = (hi + 1) * binCM;
+      lane.share = (p.samples > 0) ? keptMass[k] / p.samples : 0;
+      if (keptMass[k] < minLaneSamples) p.ready = false;
+    }
+
+    return p;
+  }
+
+private:
+  float faded[bins];
+  unsigned long previous[bins];
+  float decay = 1.0;
+
+  // The lowest bin between two peaks.
+  static int valley(const float *s, int from, int to)
+  {
+    int v = from;
+    for (int i = from; i <= to; i++)
+    {
+      if (s[i] < s[v]) v = i;
+    }
+    return v;
+  }
+};
+
+//****************************************************************************************
+// Copy a proposal into the zone limits. Lane 1 is the nearest lane found, lane 2 the
+// next; a lane that wasn't found is left alone. Returns true if anything moved by more
+// than tolerance cm (so small wobbles don't rewrite the card every time).
+bool applyLaneProposal(const LaneProposal &p, Config &config, int tolerance = 20)
+{
+  if (!p.ready) return false;
+
+  String *limits[2][2] = {{&config.lidarZone1Min, &config.lidarZone1Max},
+                          {&config.lidarZone2Min, &config.lidarZone2Max}};
+  bool changed = false;
+  for (int k = 0; (k < p.lanes) && (k < 2); k++)
+  {
+    if ((abs(limits[k][0]->toInt() - p.lane[k].minCM) > tolerance) ||
+        (abs(limits[k][1]->toInt() - p.lane[k].maxCM) > tolerance))
+    {
+      *limits[k][0] = String(p.lane[k].minCM);
+      *limits[k][1] = String(p.lane[k].maxCM);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+//****************************************************************************************
+// The proposal and the zone limits in use, as JSON (for the /lanes page).
+String getLaneProposalJSON(const LaneProposal &p, const Config &config)
+{
+  String retValue = "{\"ready\":" + String(p.ready ? "true" : "false") +
+                    ",\"samples\":" + String((unsigned long)p.samples) +
+                    ",\"backgroundCM\":" + String(p.backgroundCM) +
+                    ",\"lanes\":[";
+  for (int k = 0; k < p.lanes; k++)
+  {
+    if (k > 0) retValue += ",";
+    retValue += "{\"minCM\":" + String(p.lane[k].minCM) +
+                ",\"peakCM\":" + String(p.lane[k].peakCM) +
+                ",\"maxCM\":" + String(p.lane[k].maxCM) +
+                ",\"share\":" + String(p.lane[k].share, 4) + "}";
+  }
+  retValue += "],\"current\":[{\"minCM\":" + config.lidarZone1Min +
+              ",\"maxCM\":" + config.lidarZone1Max +
+              "},{\"minCM\":" + config.lidarZone2Min +
+              ",\"maxCM\":" + config.lidarZone2Max +
+              "}],\"autoApply\":" + String((config.lidarAutoLanes == "checked") ? "true" : "false") +
+              "}";
+  return retValue;
+}
+
+#endif // __DIGAME_LANE_FINDER_H__
@@ -91,6 +91,7 @@ bool sendReceiveLoRa(String msg)
   long timeout = 2500; // TODO: Make this part of the Config struct -- better yet,
                        // calculate from the LoRa RF parameters and payload...
   bool replyPending = true;
+  RuntimeConfig rc = getRuntimeConfig();
  
   String strRetryCount;
   long t2, t1;
@@ -103,44 +104,49 @@ bool sendReceiveLoRa(String msg)
   strRetryCount = String(LoRaRetryCount);
   strRetryCount.trim();
 
-  // Allocate a temporary JsonDocument
-  // Don't forget to change the capacity to match your requirements.
-  // Use https://arduinojson.org/v6/assistant to compute the capacity.
-  StaticJsonDocument<512> doc;
-  char json[512] = {};
+  // JSON messages get the retry count added. (Binary ones, from digameLoRaPayload.h, carry
+  // it already.)
+  if (msg.startsWith("{"))
+  {
+    // Allocate a temporary JsonDocument
+    // Don't forget to change the capacity to match your requirements.
+    // Use https://arduinojson.org/v6/assistant to compute the capacity.
+    StaticJsonDocument<512> doc;
+    char json[512] = {};
 
-  // The message contains a JSON payload extract to the char array json
-  msg.toCharArray(json, msg.length() + 1);
+    // The message contains a JSON payload extract to the char array json
+    msg.toCharArray(json, msg.length() + 1);
 
-  // Deserialize the JSON document
-  DeserializationError error = deserializeJson(doc, json);
+    // Deserialize the JSON document
+    DeserializationError error = deserializeJson(doc, json);
 
-  // Test if parsing succeeded.
-  if (error)
-  {
-    debugUART.print(F("deserializeJson() failed: "));
-    debugUART.println(error.f_str());
-    debugUART.println(msg);
-    sleepReyax();
-    return false;
-  }
+    // Test if parsing succeeded.
+    if (error)
+    {
+      debugUART.print(F("deserializeJson() failed: "));
+      debugUART.println(error.f_str());
+      debugUART.println(msg);
+      sleepReyax();
+      return false;
+    }
 
-  doc["r"] = strRetryCount; // Add the retry count to the JSON doc
+    doc["r"] = strRetryCount; // Add the retry count to the JSON doc
 
-  msg = "";
+    msg = "";
 
-  // Serialize JSON
-  if (serializeJson(doc, msg) == 0)
-  {
-    Serial.println(F("Failed to write to string"));
-    sleepReyax();
-    return false;
+    // Serialize JSON
+    if (serializeJson(doc, msg) == 0)
+    {
+      Serial.println(F("Failed to write to string"));
+      sleepReyax();
+      return false;
+    }
   }
 
   // Send the message. - Base stations use address 1.
   String reyaxMsg = "AT+SEND=1," + String(msg.length()) + "," + msg;
 
-if (config.showDataStream == "false"){
+if (!rc.showDataStream){
   debugUART.print("Message Length: ");
   debugUART.println(reyaxMsg.length());
   
@@ -170,7 +176,7 @@ if (config.showDataStream == "false"){
         if (inString.indexOf("ACK") >= 0)
         {
           replyPending = false;
-          if (config.showDataStream == "false"){
+          if (!rc.showDataStream){
             debugUART.println("ACK Received: " + inString);
           }
           LoRaRetryCount = 0; // Reset for the next message.
@@ -190,7 +196,7 @@ if (config.showDataStream == "false"){
 
   if ((t2 - t1) >= timeout)
   {
-    if (config.showDataStream == "false"){
+    if (!rc.showDataStream){
         debugUART.println("Timeout!");
         debugUART.println();
     }
@@ -0,0 +1,207 @@
+/* digameLoRaPayload.h
+ *
+ *  Vehicle events over LoRa as a few bytes instead of terse JSON, so they
+ *  spend less time on the air (and less energy) at high spreading factors.
+ *  The base station turns them back into the terse JSON fields it already
+ *  knows (loraEventToTerseJSON()), and so into the same message for the
+ *  server. Boot and heartbeat messages stay JSON: they're hourly, and carry
+ *  settings and health that change shape from release to release.
+ *
+ *  Version 1, little-endian:
+ *
+ *    byte 0      version << 4 | event type << 2 | detector (t, v, d, c)
+ *    bytes 1-4   epoch seconds, UTC
+ *    varint      count (7 bits a byte, low first: 1 byte under 128,
+ *                2 under 16384, 3 under 2097152)
+ *    1 byte      lane << 4 | retries (at most 15)
+ *    2 bytes     temperature, tenths of a degree C (signed)
+ *    2 bytes     settings hash: loraSettingsHash() of the boot/heartbeat
+ *                settings object, which carry it too ("sh")
+ *    2 bytes     firmware version, as TERSE_SW_VERSION (970 for "0970")
+ *
+ *  13 to 15 bytes for counts under two million; 17 at most. The Reyax
+ *  module's AT+SEND takes text, so the bytes go base64 (no padding): up to
+ *  20 characters for 15 bytes, against about 95 for the JSON. A JSON
+ *  message always starts with '{', which base64 of version 1 never does.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_LORA_PAYLOAD_H__
+#define __DIGAME_LORA_PAYLOAD_H__
+
+#include <ArduinoJson.h>
+#include <digameEventQueue.h> // CounterEventType, getEventTimeString()
+
+#include <math.h>
+
+const uint8_t loraPayloadVersion = 1;
+const int loraPayloadMaxBytes = 17;
+const char loraDetectorCodes[] = "tvdc"; // As the terse JSON's "da"
+
+struct LoRaEvent
+{
+  uint32_t epoch;        // Seconds since 1970, UTC
+  uint32_t count;        // Total counts when it happened
+  int16_t tempC10;       // Temperature, tenths of a degree C
+  uint8_t type;          // CounterEventType
+  uint8_t lane;          // 0..15
+  uint8_t detector;      // Index in loraDetectorCodes
+  uint8_t retries;       // Tries before this one (15 means 15 or more)
+  uint16_t settingsHash; // loraSettingsHash()
+  uint16_t firmware;     // TERSE_SW_VERSION as a number
+};
+
+//****************************************************************************************
+// The event as bytes. Returns how many (at most loraPayloadMaxBytes).
+int encodeLoRaEvent(const LoRaEvent &e, uint8_t *buf)
+{
+  int n = 0;
+  buf[n++] = (loraPayloadVersion << 4) | ((e.type & 3) << 2) | (e.detector & 3);
+  for (int i = 0; i < 4; i++) buf[n++] = (uint8_t)(e.epoch >> (8 * i));
+  uint32_t c = e.count;
+  do
+  {
+    buf[n++] = (uint8_t)((c & 0x7F) | ((c > 0x7F) ? 0x80 : 0));
+    c >>= 7;
+  } while (c);
+  buf[n++] = (uint8_t)((e.lane << 4) | ((e.retries < 15) ? e.retries : 15));
+  buf[n++] = (uint8_t)e.tempC10;
+  buf[n++] = (uint8_t)((uint16_t)e.tempC10 >> 8);
+  buf[n++] = (uint8_t)e.settingsHash;
+  buf[n++] = (uint8_t)(e.settingsHash >> 8);
+  buf[n++] = (uint8_t)e.firmware;
+  buf[n++] = (uint8_t)(e.firmware >> 8);
+  return n;
+}
+
+//****************************************************************************************
+// Back again. False if it's short, long, or not version 1.
+bool decodeLoRaEvent(const uint8_t *buf, int len, LoRaEvent &e)
+{
+  if ((len < 1) || ((buf[0] >> 4) != loraPayloadVersion)) return false;
+  int n = 1;
+  if (len < n + 4) return false;
+  e.type = (buf[0] >> 2) & 3;
+  e.detector = buf[0] & 3;
+  e.epoch = 0;
+  for (int i = 0; i < 4; i++) e.epoch |= (uint32_t)buf[n++] << (8 * i);
+  e.count = 0;
+  for (int shift = 0;; shift += 7)
+  {
+    if ((n >= len) || (shift > 28)) return false;
+    uint8_t b = buf[n++];
+    e.count |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) break;
+  }
+  if (len != n + 7) return false;
+  e.lane = buf[n] >> 4;
+  e.retries = buf[n++] & 0x0F;
+  e.tempC10 = (int16_t)(buf[n] | (buf[n + 1] << 8));
+  n += 2;
+  e.settingsHash = (uint16_t)(buf[n] | (buf[n + 1] << 8));
+  n += 2;
+  e.firmware = (uint16_t)(buf[n] | (buf[n + 1] << 8));
+  return true;
+}
+
+//****************************************************************************************
+// Bytes as text for AT+SEND, and back: base64, no padding. Decoding returns the number of
+// bytes, or -1 if it isn't base64 or there's more than max.
+const char loraBase64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+String loraBytesToText(const uint8_t *buf, int len)
+{
+  String text;
+  text.reserve((len * 4 + 2) / 3);
+  for (int i = 0; i < len; i += 3)
+  {
+    uint32_t v = (uint32_t)buf[i] << 16;
+    if (i + 1 < len) v |= (uint32_t)buf[i + 1] << 8;
+    if (i + 2 < len) v |= buf[i + 2];
+    int chars = (len - i >= 3) ? 4 : (len - i) + 1;
+    for (int j = 0; j < chars; j++) text += loraBase64[(v >> (18 - 6 * j)) & 0x3F];
+  }
+  return text;
+}
+
+int loraTextToBytes(const String &text, uint8_t *buf, int max)
+{
+  int n = 0, bits = 0;
+  uint32_t v = 0;
+  for (unsigned int i = 0; i < text.length(); i++)
+  {
+    const char *p = strchr(loraBase64, text[i]);
+    if (!p || !*p) return -1;
+    v = (v << 6) | (uint32_t)(p - loraBase64);
+    bits += 6;
+    if (bits >= 8)
+    {
+      bits -= 8;
+      if (n >= max) return -1;
+      buf[n++] = (uint8_t)(v >> bits);
+    }
+  }
+  return n;
+}
+
+//****************************************************************************************
+// A JSON message, or a binary one?
+bool isLoRaJSONPayload(const String &payload)
+{
+  return payload.startsWith("{");
+}
+
+//****************************************************************************************
+// FNV-1a, folded to 16 bits: enough to tell one set of settings from another.
+uint16_t loraSettingsHash(const String &settings)
+{
+  uint32_t h = 2166136261u;
+  for (unsigned int i = 0; i < settings.length(); i++)
+  {
+    h ^= (uint8_t)settings[i];
+    h *= 16777619u;
+  }
+  return (uint16_t)(h ^ (h >> 16));
+}
+
+String getSettingsHashString(uint16_t hash)
+{
+  char str[8];
+  snprintf(str, sizeof(str), "%04x", hash);
+  return String(str);
+}
+
+//****************************************************************************************
+// The event as the terse JSON fields the counters used to send, so the base station builds
+// the server's message the same way from either.
+void loraEventToTerseJSON(const LoRaEvent &e, JsonDocument &doc)
+{
+  char firmware[8];
+  snprintf(firmware, sizeof(firmware), "%04u", (unsigned int)e.firmware);
+  doc["ts"] = getEventTimeString(e.epoch);
+  doc["v"] = firmware;
+  doc["et"] = (e.type == EVENT_BOOT) ? "b" : (e.type == EVENT_HEARTBEAT) ? "hb" : "v";
+  doc["c"] = String(e.count);
+  doc["t"] = String(e.tempC10 / 10.0, 1);
+  doc["r"] = String(e.retries);
+  doc["da"] = String(loraDetectorCodes[e.detector & 3]);
+  doc["l"] = String(e.lane);
+  doc["sh"] = getSettingsHashString(e.settingsHash);
+}
+
+//****************************************************************************************
+// Time on the air for a payload, ms (Semtech AN1200.13): explicit header, CRC on, low data
+// rate optimization when a symbol is over 16 ms. cr is 1..4 for 4/5..4/8.
+float loraAirtimeMS(int payloadBytes, int sf, float bwKHz, int cr, int preambleSymbols)
+{
+  float symbolMS = (float)(1L << sf) / bwKHz;
+  int lowDataRate = (symbolMS > 16) ? 1 : 0;
+  float preambleMS = (preambleSymbols + 4.25f) * symbolMS;
+  float bits = 8.0f * payloadBytes - 4 * sf + 28 + 16;
+  float symbols = ceilf(bits / (4.0f * (sf - 2 * lowDataRate))) * (cr + 4);
+  if (symbols < 0) symbols = 0;
+  return preambleMS + (8 + symbols) * symbolMS;
+}
+
+#endif // __DIGAME_LORA_PAYLOAD_H__
@@ -0,0 +1,156 @@
+/* digameMatchedFilter.h
+ *
+ *  Streaming correlation of the latest N LIDAR readings against a fixed
+ *  model (template), for running the correlation detector at the full
+ *  sample rate.
+ *
+ *  correlation() in digameMath.h recomputes both means, both variances and
+ *  the cross term over the whole window for every new reading. Here the
+ *  model's mean and norm are worked out once, and the window is described by
+ *  running sums that are updated as each reading comes in and the oldest one
+ *  drops out:
+ *
+ *    - the sum and sum of squares of the window (its mean and variance), and
+ *    - the sum of the window over each stretch where the model is constant.
+ *
+ *  Because sum((x - mx)(y - my)) = sum((x - mx) y), the cross term is just
+ *  those stretch sums weighted by the model's value, less the model's mean
+ *  times the window's sum. The step and notch models have two or three
+ *  stretches, so each reading costs a handful of integer adds however long
+ *  the window is. (A model with no flat stretches -- the smoothed ones --
+ *  still works, at one stretch per point.) The sums are kept as integers, so
+ *  they never drift.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_MATCHED_FILTER_H__
+#define __DIGAME_MATCHED_FILTER_H__
+
+#include <digameMath.h>
+#include <math.h>
+#include <stdint.h>
+
+// 100 point models from the correlation test sketch.
+const float fallingEdgeModel[] = {0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+const float risingEdgeModel[] = {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1};
+const float notchModel[] = {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1};
+const int modelSamples = 100;
+
+//****************************************************************************************
+// N is the window (and model) length.
+template <int N>
+class MatchedFilter
+{
+public:
+  MatchedFilter() { setModel(NULL); }
+  MatchedFilter(const float *model) { setModel(model); }
+
+  //****************************************************************************************
+  // Use a new model (N points, oldest first, as correlation() lines them up). Clears the
+  // window. NULL gives a flat model, which correlates with nothing.
+  void setModel(const float *model)
+  {
+    double mx = 0;
+    for (int i = 0; i < N; i++) mx += model ? model[i] : 0;
+    mx /= N;
+
+    double sxx = 0;
+    float previous = 0;
+    runs = 0;
+    for (int i = 0; i < N; i++)
+    {
+      float x = model ? model[i] : 0;
+      sxx += (x - mx) * (x - mx);
+      if ((i == 0) || (x != previous))
+      {
+        runStart[runs] = i;
+        runValue[runs] = x;
+        runs++;
+      }
+      previous = x;
+    }
+    runStart[runs] = N;
+    modelMean = mx;
+    modelNorm = sqrt(sxx);
+    reset();
+  }
+
+  //****************************************************************************************
+  // Forget the readings. The window starts out full of zeros.
+  void reset()
+  {
+    for (int i = 0; i < N; i++) window[i] = 0;
+    for (int k = 0; k < runs; k++) runSum[k] = 0;
+    head = 0;
+    pushed = 0;
+    sumY = 0;
+    sumY2 = 0;
+  }
+
+  //****************************************************************************************
+  // Add a reading; the oldest one drops out. Constant time for a given model.
+  void push(int16_t y)
+  {
+    // Each stretch loses the reading at its start and gains the one just past its end
+    // (the newest reading, for the last stretch).
+    for (int k = 0; k < runs; k++)
+    {
+      int from = head + runStart[k];
+      if (from >= N) from -= N;
+      int16_t in = y;
+      if (runStart[k + 1] < N)
+      {
+        int to = head + runStart[k + 1];
+        if (to >= N) to -= N;
+        in = window[to];
+      }
+      runSum[k] += in - window[from];
+    }
+
+    int16_t out = window[head];
+    sumY += y - out;
+    sumY2 += (int32_t)y * y - (int32_t)out * out;
+    window[head] = y;
+    head = (head + 1 < N) ? head + 1 : 0;
+    if (pushed < N) pushed++;
+  }
+
+  //****************************************************************************************
+  // The correlation coefficient of the window with the model, as correlation(model,
+  // window, N) would give it. Zero if either is flat (where correlation() gives NaN).
+  float correlation() const
+  {
+    double syy = ((double)N * sumY2 - (double)sumY * sumY) / N; // Both terms are exact in a double
+    if ((syy <= 0) || (modelNorm <= 0)) return 0;
+
+    double sxy = -modelMean * sumY;
+    for (int k = 0; k < runs; k++) sxy += (double)runValue[k] * runSum[k];
+    return (float)(sxy / (modelNorm * sqrt(syy)));
+  }
+
+  // True once N readings have been pushed since the last reset.
+  bool full() const { return pushed >= N; }
+
+  // How many flat stretches the model has (the cost of a push).
+  int stretches() const { return runs; }
+
+  // The i-th reading in the window, oldest first.
+  int16_t operator[](int i) const { return window[(head + i) % N]; }
+
+private:
+  int16_t window[N]; // Circular; window[head] is the oldest reading
+  int head;
+  int pushed;
+  int32_t sumY;
+  int64_t sumY2;
+
+  int runs;
+  uint16_t runStart[N + 1]; // Where each flat stretch of the model starts
+  float runValue[N];        // The model's value along it
+  int32_t runSum[N];        // The window's sum over it
+  double modelMean;
+  double modelNorm;         // sqrt(sum((x - mx)^2))
+};
+
+#endif // __DIGAME_MATCHED_FILTER_H__
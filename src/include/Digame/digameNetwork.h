@@ -11,6 +11,7 @@
 
 #include <WiFi.h>             // WiFi stack
 #include <HTTPClient.h>       // To post to the ParkData Server
+#include <digameHTTPSession.h> // ...on a connection kept open between messages
 #include <digameJSONConfig.h> // for Config struct that holds network credentials
 
 #define debugUART Serial
@@ -18,8 +19,10 @@
 // Globals
 bool wifiConnected = false;
 unsigned long msLastConnectionAttempt; // Timer value of the last time we tried to connect to the wifi.
-HTTPClient http;                       // The class we use to POST messages
+HTTPClient http;                       // The class we use to POST messages (https)
+HTTPSession httpSession;               //   and for http, with the connection kept open
 unsigned long msLastPostTime;          // Timer value of the last time we did an http POST.
+int lastPostResponseCode = 0;          // The last POST's HTTP response code, or HTTPC_ERROR_ (< 0): no reply
 
 //*****************************************************************************
 // Return the device's MAC address as a String
@@ -133,6 +136,7 @@ bool initWiFi(Config config)
 //*****************************************************************************
 void disableWiFi()
 {
+    httpSession.close();
     WiFi.setSleep(true);
     WiFi.disconnect(true);  // Disconnect from the network
     WiFi.mode(WIFI_OFF);    // Switch WiFi off
@@ -142,13 +146,44 @@ void disableWiFi()
     wifiConnected = false;
 }
 
+//*****************************************************************************
+// POST a JSON payload to the server: on httpSession's kept-open connection for http
+// URLs. headerName, if not null, adds a header. Returns the HTTP response code (or an
+// HTTPC_ERROR_ code); the server's reply goes in reply, if given.
+int postToServer(const String &jsonPayload, Config config, String *reply = nullptr,
+                 const char *headerName = nullptr, const String &headerValue = "")
+{
+    int httpResponseCode;
+    if (httpSession.begin(config.serverURL))
+    {
+        httpResponseCode = httpSession.post(jsonPayload, headerName, headerValue);
+        if (reply) *reply = httpSession.reply();
+        lastPostResponseCode = httpResponseCode;
+        return httpResponseCode;
+    }
+
+    http.begin(config.serverURL);
+
+    // If you need an HTTP request with a content type: application/json, use the following:
+    http.addHeader("Content-Type", "application/json");
+    if (headerName) http.addHeader(headerName, headerValue);
+    httpResponseCode = http.POST(jsonPayload);
+    if (reply) *reply = (httpResponseCode > 0) ? http.getString() : String("");
+
+    // Free resources
+    http.end();
+    lastPostResponseCode = httpResponseCode;
+    return httpResponseCode;
+}
+
 //*****************************************************************************
 // Save a single JSON message to the server. TODO: Deal with retries, etc.
 // in a smart way.
 bool postJSON(String jsonPayload, Config config)
 {
+    RuntimeConfig rc = getRuntimeConfig();
 
-    if (config.showDataStream == "false")
+    if (!rc.showDataStream)
     {
         debugUART.print("postJSON Running on Core #: ");
         debugUART.println(xPortGetCoreID());
@@ -161,32 +196,22 @@ bool postJSON(String jsonPayload, Config config)
         debugUART.println("WiFi not connected.");
         if (enableWiFi(config) == false)
         {
+            lastPostResponseCode = HTTPC_ERROR_NOT_CONNECTED;
             return false;
         };
     }
 
     unsigned long t1 = millis();
+    int httpResponseCode = postToServer(jsonPayload, config);
 
-    http.begin(config.serverURL);
-
-    if (config.showDataStream == "false")
+    if (!rc.showDataStream)
     {
         debugUART.print("JSON payload length: ");
         debugUART.println(jsonPayload.length());
-        debugUART.print("HTTP begin Time: ");
-        debugUART.println(millis() - t1);
-    }
-
-    // If you need an HTTP request with a content type: application/json, use the following:
-    http.addHeader("Content-Type", "application/json");
-
-    t1 = millis();
-    int httpResponseCode = http.POST(jsonPayload);
-
-    if (config.showDataStream == "false")
-    {
         debugUART.print("POST Time: ");
         debugUART.println(millis() - t1);
+        debugUART.print("Connections: ");
+        debugUART.println(httpSession.connects);
         debugUART.println("POSTing to Server:");
         debugUART.println(jsonPayload);
         debugUART.print("HTTP response code: ");
@@ -198,8 +223,6 @@ bool postJSON(String jsonPayload, Config config)
         }
         debugUART.println();
     }
-    // Free resources
-    http.end();
 
     if (httpResponseCode == 200)
     {
@@ -12,6 +12,7 @@
 #include <digamePowerMgt.h> 
 #include <WiFi.h>       // WiFi stack
 #include <HTTPClient.h> // To post to the ParkData Server
+#include <digameHTTPSession.h> // ...on a connection kept open between messages
 
 struct NetworkConfig
 {
@@ -28,7 +29,8 @@ struct NetworkConfig
 // Globals
 bool wifiConnected = false;
 long msLastConnectionAttempt; // Timer value of the last time we tried to connect to the wifi.
-HTTPClient http;              // The class we use to POST messages
+HTTPClient http;              // The class we use to POST messages (https)
+HTTPSession httpSession;      //   and for http, with the connection kept open
 
 //*****************************************************************************
 // Return the device's MAC address as a String
@@ -131,6 +133,7 @@ bool initWiFi(NetworkConfig config)
 //*****************************************************************************
 void disableWiFi()
 {
+    httpSession.close();
     WiFi.disconnect(true); // Disconnect from the network
     WiFi.mode(WIFI_OFF);   // Switch WiFi off
     btStop();
@@ -163,24 +166,30 @@ bool postJSON(String jsonPayload, NetworkConfig config)
     }
 
     unsigned long t1 = millis();
+    int httpResponseCode;
 
-    // Your Domain name with URL path or IP address with path
-    http.begin(config.serverURL);
-    // http.begin("http://199.21.201.53/trailwaze/zion/lidar_sensor_import.php");
+    if (httpSession.begin(config.serverURL))
+    {
+        httpResponseCode = httpSession.post(jsonPayload);
+    }
+    else
+    {
+        http.begin(config.serverURL);
 
-    DEBUG_PRINT("JSON payload length: ");
-    DEBUG_PRINTLN(jsonPayload.length());
-    DEBUG_PRINT("HTTP begin Time: ");
-    DEBUG_PRINTLN(millis() - t1);
+        // If you need an HTTP request with a content type: application/json, use the following:
+        http.addHeader("Content-Type", "application/json");
+        httpResponseCode = http.POST(jsonPayload);
 
-    // If you need an HTTP request with a content type: application/json, use the following:
-    http.addHeader("Content-Type", "application/json");
-    
-    t1 = millis();
-    int httpResponseCode = http.POST(jsonPayload);
+        // Free resources
+        http.end();
+    }
 
+    DEBUG_PRINT("JSON payload length: ");
+    DEBUG_PRINTLN(jsonPayload.length());
     DEBUG_PRINT("POST Time: ");
     DEBUG_PRINTLN(millis() - t1);
+    DEBUG_PRINT("Connections: ");
+    DEBUG_PRINTLN(httpSession.connects);
     DEBUG_PRINTLN("POSTing to Server:");
     DEBUG_PRINTLN(jsonPayload);
     DEBUG_PRINT("HTTP response code: ");
@@ -193,9 +202,6 @@ bool postJSON(String jsonPayload, NetworkConfig config)
 
     DEBUG_PRINTLN();
 
-    // Free resources
-    http.end();
-
 
     if (
         (httpResponseCode == 200) || 
@@ -0,0 +1,229 @@
+/* digamePreFilter.h
+ *
+ *  Cleans up the readings before the detectors see them. Rain and snow give
+ *  short returns a meter or two out, a reading or two long, between long
+ *  runs of empty road -- glimpses, where a vehicle is seen. Two stages, set
+ *  in PARAMS.TXT (lidar.preFilter, preFilterWindow, hampelThreshold and
+ *  minRunLength):
+ *
+ *    Median  Each reading becomes the median of the window around it, so a
+ *            glimpse shorter than half the window is gone.
+ *    Hampel  Each reading is kept unless it's further from that median than
+ *            hampelThreshold scaled MADs (median absolute deviations), so
+ *            vehicles keep their shape and only the outliers change.
+ *
+ *    then, with minRunLength > 1, a gate: readings in a lane are passed on
+ *    only if there are at least minRunLength of them in a row in that lane.
+ *    A glimpse of rain in front of a vehicle in lane 2 is taken out too.
+ *
+ *  The median works on the distances as the detectors see them
+ *  (clampLIDARDistance()): the window is kept sorted and each new reading
+ *  takes the place of the one leaving, so a reading costs a few passes over
+ *  the window (31 readings at most), never more. The gate has no more to do
+ *  than a counter and, once per run, marking it. Readings the gate takes out
+ *  read 999, empty road.
+ *
+ *  The output is one reading per reading in, with the time it was taken,
+ *  delay() readings late: half the window for the median, minRunLength - 1
+ *  for the gate. Readings the filters don't change go through as they came.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_PRE_FILTER_H__
+#define __DIGAME_PRE_FILTER_H__
+
+#include <digameLIDAR.h>
+
+const int maxPreFilterWindow = 31;
+const int maxMinRunLength = 32;
+
+class LIDARPreFilter
+{
+public:
+  LIDARPreFilter() { reset(); }
+
+  // Take up rc's settings. The filter starts over (as on an empty road) only when they
+  // change, so call this as often as you like.
+  void configure(const RuntimeConfig &rc)
+  {
+    LIDARPreFilterType t = rc.lidarPreFilter;
+    if ((t < 0) || (t >= PREFILTER_TYPES)) t = PREFILTER_NONE;
+    int w = constrain(rc.lidarPreFilterWindow, 3, maxPreFilterWindow) | 1; // Odd
+    if (w > maxPreFilterWindow) w = maxPreFilterWindow;
+    int r = constrain(rc.lidarMinRunLength, 1, maxMinRunLength);
+    float k = (rc.lidarHampelThreshold > 0) ? rc.lidarHampelThreshold : 0;
+    zone1Min = rc.lidarZone1Min; // The lanes can change as we go (lidar.autoLanes)
+    zone1Max = rc.lidarZone1Max;
+    zone2Min = rc.lidarZone2Min;
+    zone2Max = rc.lidarZone2Max;
+
+    if ((t == type) && (w == window) && (r == minRun) && (k == threshold)) return;
+    type = t;
+    window = w;
+    minRun = r;
+    threshold = k;
+    reset();
+  }
+
+  bool active() const { return (type != PREFILTER_NONE) || (minRun > 1); }
+
+  // Readings between one going in and it coming out.
+  int delay() const { return ((type != PREFILTER_NONE) ? window / 2 : 0) + minRun - 1; }
+
+  // Forget everything seen: the windows fill with empty road.
+  void reset()
+  {
+    LIDARSample empty = {0, 999, 0, 0, TFMP_READY};
+    for (int i = 0; i < maxPreFilterWindow; i++)
+    {
+      sorted[i] = 999;
+      windowSamples[i] = empty;
+    }
+    windowHead = 0;
+    for (int i = 0; i < maxMinRunLength; i++)
+    {
+      runSamples[i] = empty;
+      confirmed[i] = false;
+    }
+    runHead = 0;
+    run = 0;
+    runLane = 0;
+  }
+
+  // One reading in, the one delay() readings back out.
+  LIDARSample process(const LIDARSample &sample)
+  {
+    LIDARSample out = (type != PREFILTER_NONE) ? filter(sample) : sample;
+    return (minRun > 1) ? gate(out) : out;
+  }
+
+private:
+  LIDARPreFilterType type = PREFILTER_NONE;
+  int window = 5;
+  int minRun = 1;
+  float threshold = 3;
+  int zone1Min = 0, zone1Max = 0, zone2Min = 0, zone2Max = 0;
+
+  // The median: the last window readings in the order they came and as clamped
+  // distances, in order.
+  LIDARSample windowSamples[maxPreFilterWindow];
+  int16_t sorted[maxPreFilterWindow];
+  int windowHead;
+
+  // The gate: the last minRun readings, whether each is part of a long enough run, and
+  // the run so far.
+  LIDARSample runSamples[maxMinRunLength];
+  bool confirmed[maxMinRunLength];
+  int runHead;
+  int run;
+  int runLane;
+
+  LIDARSample filter(const LIDARSample &sample)
+  {
+    const int h = window / 2;
+
+    // The new reading takes the leaving one's place, then moves along to where it goes.
+    int16_t leaving = clampLIDARDistance(windowSamples[windowHead]);
+    int16_t d = clampLIDARDistance(sample);
+    windowSamples[windowHead] = sample;
+    windowHead = (windowHead + 1 == window) ? 0 : windowHead + 1;
+
+    int i = 0;
+    while (sorted[i] != leaving) i++;
+    sorted[i] = d;
+    while ((i > 0) && (sorted[i - 1] > d))
+    {
+      sorted[i] = sorted[i - 1];
+      sorted[--i] = d;
+    }
+    while ((i + 1 < window) && (sorted[i + 1] < d))
+    {
+      sorted[i] = sorted[i + 1];
+      sorted[++i] = d;
+    }
+
+    // The reading in the middle of the window
+    int middle = windowHead + h;
+    if (middle >= window) middle -= window;
+    LIDARSample out = windowSamples[middle];
+    int16_t centre = clampLIDARDistance(out);
+    int16_t median = sorted[h];
+
+    if (type == PREFILTER_HAMPEL)
+    {
+      // The MAD: the deviations from the median get larger going out from it either way,
+      // so the h + 1th smallest is h steps along, taking the nearer side each time.
+      int lo = h - 1, hi = h + 1;
+      int mad = 0;
+      for (int k = 0; k < h; k++)
+      {
+        int below = (lo >= 0) ? median - sorted[lo] : 32767;
+        int above = (hi < window) ? sorted[hi] - median : 32767;
+        if (below <= above)
+        {
+          mad = below;
+          lo--;
+        }
+        else
+        {
+          mad = above;
+          hi++;
+        }
+      }
+      if (abs(centre - median) <= threshold * 1.4826f * mad) return out; // Not an outlier
+    }
+
+    if (centre != median)
+    {
+      out.dist = median;
+      out.status = TFMP_READY;
+    }
+    return out;
+  }
+
+  // 1 or 2 for readings in a lane, as recordLIDARSample() sees them, 0 otherwise.
+  int laneOf(const LIDARSample &sample) const
+  {
+    int16_t d = clampLIDARDistance(sample);
+    if ((d > zone1Min) && (d < zone1Max)) return 1;
+    if ((d > zone2Min) && (d < zone2Max)) return 2;
+    return 0;
+  }
+
+  LIDARSample gate(const LIDARSample &sample)
+  {
+    runSamples[runHead] = sample;
+    confirmed[runHead] = false;
+
+    int lane = laneOf(sample);
+    if (lane != runLane) run = 0;
+    runLane = lane;
+    if (lane > 0)
+    {
+      run++;
+      if (run == minRun) // The whole run so far is in the buffer: it counts now.
+      {
+        for (int i = 0; i < maxMinRunLength; i++) confirmed[i] = true;
+      }
+      else if (run > minRun)
+      {
+        confirmed[runHead] = true;
+      }
+    }
+
+    // The one minRun - 1 back: its run would have been long enough by now.
+    runHead = (runHead + 1 == minRun) ? 0 : runHead + 1;
+    LIDARSample out = runSamples[runHead];
+    if (!confirmed[runHead] && (laneOf(out) > 0))
+    {
+      out.dist = 999;
+      out.status = TFMP_READY;
+    }
+    return out;
+  }
+};
+
+LIDARPreFilter lidarPreFilter;
+
+#endif // __DIGAME_PRE_FILTER_H__
@@ -0,0 +1,305 @@
+/* digameRawLog.h
+ *
+ *  Raw LIDAR capture to the SD card, compact enough for hours of 100 Hz
+ *  data and cheap enough to leave on without disturbing the detection loop.
+ *
+ *  Each sample (timestamp, distance, flux, temperature) is stored as the
+ *  difference from the one before, packed as a varint -- typically 5 or 6
+ *  bytes per sample instead of a line of text. Records are collected in a
+ *  4 KB block in RAM. When the block fills, it is handed to a background
+ *  task that writes it to the card, and logging carries on in the other
+ *  block. The loop never waits on the card. If the card falls a whole
+ *  block behind, samples are dropped and counted instead.
+ *
+ *  File format: a sequence of 4096-byte blocks (see RawLogBlockHeader).
+ *  Every block stands on its own -- the first record holds absolute values --
+ *  so a file that was cut short or appended to across reboots still
+ *  decodes. src/host/tools/rawlog2csv turns a file back into CSV.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_RAW_LOG_H__
+#define __DIGAME_RAW_LOG_H__
+
+#include <digameDebug.h>
+#include <SD.h>
+#include <atomic>
+
+const size_t RAW_LOG_BLOCK_SIZE = 4096; // A whole number of SD sectors
+const uint32_t RAW_LOG_MAGIC = 0x4C524744; // "DGRL"
+const size_t RAW_LOG_MAX_RECORD = 5 + 3 * 3; // Time delta (32 bit) + three 16-bit deltas
+
+// The start of every block. Little-endian, like the ESP32.
+struct RawLogBlockHeader
+{
+  uint32_t magic;    // RAW_LOG_MAGIC
+  uint16_t used;     // Bytes used in the block, including this header
+  uint16_t records;  // Samples in the block
+  uint32_t sequence; // Block number since logging started. Gaps = lost blocks.
+  uint32_t dropped;  // Samples dropped (card too slow) since logging started
+};
+
+//****************************************************************************************
+// Varint helpers. Signed values are zigzag encoded so small negatives stay small.
+inline uint8_t *putRawLogVarint(uint8_t *p, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    *p++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (uint8_t)value;
+  return p;
+}
+
+inline uint32_t rawLogZigZag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+inline int32_t rawLogUnZigZag(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+
+// Returns NULL if the varint runs past end.
+inline const uint8_t *getRawLogVarint(const uint8_t *p, const uint8_t *end, uint32_t &value)
+{
+  value = 0;
+  for (int shift = 0; (p < end) && (shift < 35); shift += 7)
+  {
+    uint8_t b = *p++;
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return p;
+  }
+  return NULL;
+}
+
+//****************************************************************************************
+// Decode one block. Calls onRecord(uint32_t timeUS, int16_t dist, int16_t flux,
+// int16_t temp) for each sample in order. Returns false if the block is not valid.
+template <typename F>
+bool decodeRawLogBlock(const uint8_t *block, RawLogBlockHeader &header, F onRecord)
+{
+  memcpy(&header, block, sizeof(header));
+  if ((header.magic != RAW_LOG_MAGIC) || (header.used < sizeof(header)) ||
+      (header.used > RAW_LOG_BLOCK_SIZE))
+  {
+    return false;
+  }
+
+  const uint8_t *p = block + sizeof(header);
+  const uint8_t *end = block + header.used;
+  uint32_t timeUS = 0, d;
+  int16_t dist = 0, flux = 0, temp = 0;
+
+  for (int i = 0; i < header.records; i++)
+  {
+    if (!(p = getRawLogVarint(p, end, d))) return false;
+    timeUS += d;
+    if (!(p = getRawLogVarint(p, end, d))) return false;
+    dist = (int16_t)(dist + rawLogUnZigZag(d));
+    if (!(p = getRawLogVarint(p, end, d))) return false;
+    flux = (int16_t)(flux + rawLogUnZigZag(d));
+    if (!(p = getRawLogVarint(p, end, d))) return false;
+    temp = (int16_t)(temp + rawLogUnZigZag(d));
+    onRecord(timeUS, dist, flux, temp);
+  }
+  return p == end;
+}
+
+// Logging state. The detection loop is the only writer of the blocks; the background
+// task only ever reads the one handed to it.
+uint8_t rawLogBlocks[2][RAW_LOG_BLOCK_SIZE];
+int rawLogFilling = 0;                   // The block the loop is adding to
+std::atomic<int> rawLogPending{-1};      // The block waiting for / being written to the card
+uint8_t *rawLogPos;                      // Next free byte in the block being filled
+uint16_t rawLogRecords;                  // Samples in the block being filled
+uint32_t rawLogSequence;
+uint32_t rawLogPrevTime;                 // Previous sample in this block (for the deltas)
+int16_t rawLogPrevDist, rawLogPrevFlux, rawLogPrevTemp;
+
+File rawLogFile;
+SemaphoreHandle_t rawLogReady = NULL;    // Given when a block is pending (or to stop)
+SemaphoreHandle_t rawLogIdle = NULL;     // Given when the writer finishes a block (or exits)
+const TickType_t rawLogStopWait = 2000 / portTICK_PERIOD_MS; // The longest stopRawLog waits on the card
+TaskHandle_t rawLogWriterTask = NULL;
+volatile bool rawLogRunning = false;
+volatile bool rawLogStopping = false;
+volatile bool rawLogWriterDone = true;
+
+unsigned long rawLogSamples = 0;         // Samples logged since start
+unsigned long rawLogDrops = 0;           // Samples lost because the card fell behind
+unsigned long rawLogBlocksWritten = 0;
+unsigned long rawLogWriteErrors = 0;
+
+//****************************************************************************************
+// Start a fresh block in buffer b.
+void beginRawLogBlock(int b)
+{
+  rawLogFilling = b;
+  rawLogPos = rawLogBlocks[b] + sizeof(RawLogBlockHeader);
+  rawLogRecords = 0;
+  rawLogPrevTime = 0;
+  rawLogPrevDist = rawLogPrevFlux = rawLogPrevTemp = 0;
+}
+
+//****************************************************************************************
+// Fill in the header of the block being filled and hand it to the writer.
+void queueRawLogBlock()
+{
+  RawLogBlockHeader header;
+  header.magic = RAW_LOG_MAGIC;
+  header.used = (uint16_t)(rawLogPos - rawLogBlocks[rawLogFilling]);
+  header.records = rawLogRecords;
+  header.sequence = rawLogSequence++;
+  header.dropped = (uint32_t)rawLogDrops;
+  memcpy(rawLogBlocks[rawLogFilling], &header, sizeof(header));
+  memset(rawLogPos, 0, RAW_LOG_BLOCK_SIZE - header.used);
+
+  rawLogPending = rawLogFilling;
+  xSemaphoreGive(rawLogReady);
+  beginRawLogBlock(rawLogFilling ^ 1);
+}
+
+//****************************************************************************************
+// The background task: writes each block it's handed as a whole 4 KB block.
+void rawLogWriter(void * /* parameter */)
+{
+  for (;;)
+  {
+    xSemaphoreTake(rawLogReady, portMAX_DELAY);
+
+    int b = rawLogPending;
+    if (b >= 0)
+    {
+      if (rawLogFile.write(rawLogBlocks[b], RAW_LOG_BLOCK_SIZE) == RAW_LOG_BLOCK_SIZE)
+      {
+        rawLogBlocksWritten++;
+      }
+      else
+      {
+        rawLogWriteErrors++;
+      }
+      rawLogFile.flush();
+      rawLogPending = -1;
+      xSemaphoreGive(rawLogIdle);
+    }
+
+    if (rawLogStopping) break;
+  }
+
+  rawLogFile.close();
+  rawLogWriterDone = true;
+  xSemaphoreGive(rawLogIdle);
+  vTaskDelete(NULL);
+}
+
+//****************************************************************************************
+// Open (append to) fileName and start the writer task.
+bool startRawLog(const char *fileName)
+{
+  if (rawLogRunning) return true;
+  if (!rawLogWriterDone)
+  {
+    debugUART.println("ERROR! The last raw data log is still closing.");
+    return false;
+  }
+
+  rawLogFile = SD.open(fileName, FILE_APPEND);
+  if (!rawLogFile)
+  {
+    debugUART.print("ERROR! Could not open raw data log: ");
+    debugUART.println(fileName);
+    return false;
+  }
+
+  if (rawLogReady == NULL) rawLogReady = xSemaphoreCreateBinary();
+  if (rawLogIdle == NULL) rawLogIdle = xSemaphoreCreateBinary();
+  rawLogPending = -1;
+  rawLogSequence = 0;
+  rawLogSamples = 0;
+  rawLogDrops = 0;
+  beginRawLogBlock(0);
+
+  rawLogStopping = false;
+  rawLogWriterDone = false;
+  rawLogRunning = true;
+  xTaskCreatePinnedToCore(
+    rawLogWriter,      /* Task function. */
+    "Raw Log Writer",  /* name of task. */
+    4096,              /* Stack size of task */
+    NULL,              /* parameter of the task */
+    1,                 /* priority of the task */
+    &rawLogWriterTask, /* Task handle to keep track of created task */
+    0);                /* pin task to core 0 */
+  return true;
+}
+
+//****************************************************************************************
+// Add a sample. Never waits on the card: if both blocks are full the sample is dropped
+// and counted in rawLogDrops.
+void logRawSample(uint32_t timeUS, int16_t dist, int16_t flux, int16_t temp)
+{
+  if (!rawLogRunning) return;
+
+  uint8_t *block = rawLogBlocks[rawLogFilling];
+  if ((rawLogPos + RAW_LOG_MAX_RECORD > block + RAW_LOG_BLOCK_SIZE) || (rawLogRecords == 0xFFFF))
+  {
+    if (rawLogPending >= 0)
+    { // The writer hasn't finished with the other block yet.
+      rawLogDrops++;
+      return;
+    }
+    queueRawLogBlock();
+  }
+
+  uint8_t *p = rawLogPos;
+  p = putRawLogVarint(p, timeUS - rawLogPrevTime);
+  p = putRawLogVarint(p, rawLogZigZag(dist - rawLogPrevDist));
+  p = putRawLogVarint(p, rawLogZigZag(flux - rawLogPrevFlux));
+  p = putRawLogVarint(p, rawLogZigZag(temp - rawLogPrevTemp));
+  rawLogPos = p;
+  rawLogRecords++;
+  rawLogSamples++;
+
+  rawLogPrevTime = timeUS;
+  rawLogPrevDist = dist;
+  rawLogPrevFlux = flux;
+  rawLogPrevTemp = temp;
+}
+
+//****************************************************************************************
+// Sleep until the writer gives rawLogIdle, for at most rawLogStopWait. Clear any old
+// give before checking what we're waiting for, so the wake-up is for news.
+bool waitForRawLogWriter(bool (*finished)())
+{
+  xSemaphoreTake(rawLogIdle, 0);
+  while (!finished())
+  {
+    if (xSemaphoreTake(rawLogIdle, rawLogStopWait) != pdTRUE) return finished();
+  }
+  return true;
+}
+
+//****************************************************************************************
+// Write out the partial block, close the file and end the writer task. Waits for the
+// card (up to rawLogStopWait per step), so call it from the loop, not the detection path.
+void stopRawLog()
+{
+  if (!rawLogRunning) return;
+  rawLogRunning = false;
+
+  if (waitForRawLogWriter([] { return rawLogPending < 0; }))
+  {
+    if (rawLogRecords > 0) queueRawLogBlock();
+  }
+  else
+  { // The card is stuck on the last block: give up on the partial one.
+    rawLogDrops += rawLogRecords;
+    debugUART.println("ERROR! Raw data log: the SD card isn't keeping up. Last block dropped.");
+  }
+
+  rawLogStopping = true;
+  xSemaphoreGive(rawLogReady);
+  if (!waitForRawLogWriter([] { return (bool)rawLogWriterDone; }))
+  {
+    debugUART.println("ERROR! Raw data log: still closing the file.");
+  }
+}
+
+#endif // __DIGAME_RAW_LOG_H__
@@ -0,0 +1,97 @@
+/* digameRingBuffer.h
+ *
+ *  A fixed-size, lock-free ring buffer for handing data from one task to
+ *  another (single producer, single consumer). E.g., a UART reader task on
+ *  one core pushing LIDAR samples to the detection loop on the other.
+ *
+ *  Unlike CircularBuffer, a full ring refuses new items instead of
+ *  overwriting the oldest, so the producer can count what it had to drop.
+ *  No locks, no heap. Capacity must be a power of two.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_RING_BUFFER_H__
+#define __DIGAME_RING_BUFFER_H__
+
+#include <atomic>
+
+template <typename T, size_t N>
+class SPSCRingBuffer
+{
+  static_assert((N & (N - 1)) == 0, "SPSCRingBuffer capacity must be a power of two");
+
+public:
+  static const size_t capacity = N;
+
+  //****************************************************************************************
+  // Producer side. Returns false (and stores nothing) if the ring is full.
+  bool push(const T &item)
+  {
+    uint32_t head = headIndex.load(std::memory_order_relaxed);
+    uint32_t tail = tailIndex.load(std::memory_order_acquire);
+    if ((uint32_t)(head - tail) >= N) return false;
+
+    items[head & (N - 1)] = item;
+    headIndex.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  //****************************************************************************************
+  // Consumer side. Returns false if the ring is empty.
+  bool pop(T &item)
+  {
+    uint32_t tail = tailIndex.load(std::memory_order_relaxed);
+    uint32_t head = headIndex.load(std::memory_order_acquire);
+    if (head == tail) return false;
+
+    item = items[tail & (N - 1)];
+    tailIndex.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  //****************************************************************************************
+  // Consumer side. The oldest item, left in the ring (e.g., until it's been sent). Returns
+  // false if the ring is empty.
+  bool peek(T &item) const
+  {
+    uint32_t tail = tailIndex.load(std::memory_order_relaxed);
+    uint32_t head = headIndex.load(std::memory_order_acquire);
+    if (head == tail) return false;
+
+    item = items[tail & (N - 1)];
+    return true;
+  }
+
+  // Consumer side. Drop the oldest item, after a peek().
+  void discard()
+  {
+    uint32_t tail = tailIndex.load(std::memory_order_relaxed);
+    if (headIndex.load(std::memory_order_acquire) != tail) tailIndex.store(tail + 1, std::memory_order_release);
+  }
+
+  //****************************************************************************************
+  // Consumer side. Copies up to maxItems into out, oldest first. Returns the number copied.
+  size_t popBatch(T *out, size_t maxItems)
+  {
+    uint32_t tail = tailIndex.load(std::memory_order_relaxed);
+    uint32_t head = headIndex.load(std::memory_order_acquire);
+    size_t n = (size_t)(head - tail);
+    if (n > maxItems) n = maxItems;
+
+    for (size_t i = 0; i < n; i++) out[i] = items[(tail + i) & (N - 1)];
+    tailIndex.store(tail + (uint32_t)n, std::memory_order_release);
+    return n;
+  }
+
+  // Either side. (A snapshot: the other side may be moving.)
+  size_t size() const { return (size_t)(headIndex.load() - tailIndex.load()); }
+  bool isEmpty() const { return size() == 0; }
+
+private:
+  T items[N];
+  std::atomic<uint32_t> headIndex{0}; // Written by the producer only
+  std::atomic<uint32_t> tailIndex{0}; // Written by the consumer only
+};
+
+#endif // __DIGAME_RING_BUFFER_H__
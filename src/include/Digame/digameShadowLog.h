@@ -0,0 +1,198 @@
+/* digameShadowLog.h
+ *
+ *  Where shadow detectors (digameDetectors.h) disagree with the one that's
+ *  counting. Each vehicle a detector reports is held for shadowMatchUS,
+ *  waiting for the other side to report one in the same lane. Any it isn't
+ *  matched with by then is a disagreement: logged with the lidarHistoryBuffer
+ *  readings from the moment it was reported, so we can see what one detector
+ *  saw and the other didn't.
+ *
+ *  The counting detector is compared with each shadow; shadows aren't
+ *  compared with each other. The log keeps the last shadowLogSize
+ *  disagreements (and a count of all of them). The web server serves it at
+ *  /shadow.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_SHADOW_LOG_H__
+#define __DIGAME_SHADOW_LOG_H__
+
+#include <digameLIDAR.h>
+
+const int shadowLogSize = 16;           // Disagreements kept
+const int shadowPendingSize = 12;       // Vehicles waiting for a match
+const int shadowHistorySize = 150;      // Readings kept with each (all of lidarHistoryBuffer)
+const uint32_t shadowMatchUS = 2000000; // Same lane, this close: the detectors agree.
+const int shadowMaxDetectors = 3;       // The counting one and two shadows
+
+struct DetectorDisagreement
+{
+  unsigned long timeMS; // millis() when the vehicle was reported
+  uint8_t counted;      // The DetectionAlgorithm that reported it...
+  uint8_t missed;       //   and the one that didn't.
+  uint8_t lane;
+  uint8_t historySize;
+  int16_t history[shadowHistorySize]; // The readings up to the report, oldest first
+};
+
+class DetectorShadowLog
+{
+public:
+  //****************************************************************************************
+  // Who's being compared: detectors[0] is counting, the rest are shadows. Clears the log.
+  void begin(const DetectionAlgorithm *detectors, int n)
+  {
+    numDetectors = (n < shadowMaxDetectors) ? n : shadowMaxDetectors;
+    for (int i = 0; i < numDetectors; i++) ids[i] = detectors[i];
+    clear();
+  }
+
+  void clear()
+  {
+    pendingHead = pendingCount = 0;
+    logHead = logCount = 0;
+    logTotal = 0;
+    for (int i = 0; i < shadowMaxDetectors; i++) reportedCount[i] = missedCount[i] = 0;
+  }
+
+  //****************************************************************************************
+  // Detector slot (0 = the counting one) reported a vehicle in lane at timeUS.
+  void report(int slot, int lane, uint32_t timeUS)
+  {
+    // Events come in time order, so the oldest unmatched one from each other side that's
+    // still waiting is the one to pair with.
+    reportedCount[slot]++;
+    uint8_t matched = 0;
+    for (int k = 0; k < pendingCount; k++)
+    {
+      Pending &p = pending[(pendingHead + k) % shadowPendingSize];
+      if (!compared(p.slot, slot) || (p.lane != lane) || (matched & bit(p.slot))) continue;
+      if (p.matched & bit(slot)) continue;
+      if ((uint32_t)(timeUS - p.timeUS) > shadowMatchUS) continue;
+      p.matched |= bit(slot);
+      matched |= bit(p.slot);
+    }
+
+    if (pendingCount == shadowPendingSize) retire(); // No room: settle the oldest now.
+
+    Pending &p = pending[(pendingHead + pendingCount) % shadowPendingSize];
+    pendingCount++;
+    p.timeUS = timeUS;
+    p.timeMS = millis();
+    p.slot = (uint8_t)slot;
+    p.lane = (uint8_t)lane;
+    p.matched = matched;
+    p.historySize = 0;
+    using index_t = decltype(lidarHistoryBuffer)::index_t;
+    for (index_t i = 0; (i < lidarHistoryBuffer.size()) && (p.historySize < shadowHistorySize); i++)
+    {
+      p.history[p.historySize++] = (int16_t)lidarHistoryBuffer[i];
+    }
+  }
+
+  //****************************************************************************************
+  // Settle the vehicles that have waited long enough for a match. Call now and then with
+  // the time of the latest reading.
+  void expire(uint32_t nowUS)
+  {
+    while ((pendingCount > 0) && ((uint32_t)(nowUS - pending[pendingHead].timeUS) > shadowMatchUS))
+    {
+      retire();
+    }
+  }
+
+  // Vehicles detector slot has reported, and ones it missed that the other side reported.
+  unsigned long reported(int slot) const { return reportedCount[slot]; }
+  unsigned long missed(int slot) const { return missedCount[slot]; }
+
+  // Waiting for a match, or logged (oldest first).
+  int waiting() const { return pendingCount; }
+  int size() const { return logCount; }
+  unsigned long total() const { return logTotal; }
+  const DetectorDisagreement &operator[](int i) const
+  {
+    return log[(logHead + i) % shadowLogSize];
+  }
+
+  //****************************************************************************************
+  // The log as text: a summary, then a line per disagreement with its readings.
+  String toString() const
+  {
+    String s = "";
+    for (int i = 0; i < numDetectors; i++)
+    {
+      s += "# " + String(detectionAlgorithmNames[ids[i]]) + ((i == 0) ? " (counting): " : ": ") +
+           String(reportedCount[i]) + " vehicles, missed " + String(missedCount[i]) + "\n";
+    }
+    s += "# " + String(logTotal) + " disagreements, the last " + String(logCount) + " below\n";
+    s += "# Time (s), Counted by, Missed by, Lane, Readings (cm, oldest first)\n";
+    for (int i = 0; i < logCount; i++)
+    {
+      const DetectorDisagreement &d = (*this)[i];
+      s += String(d.timeMS / 1000.0, 2) + ", " + detectionAlgorithmNames[d.counted] + ", " +
+           detectionAlgorithmNames[d.missed] + ", " + String(d.lane);
+      for (int k = 0; k < d.historySize; k++) s += ", " + String(d.history[k]);
+      s += "\n";
+    }
+    return s;
+  }
+
+private:
+  struct Pending
+  {
+    uint32_t timeUS;
+    unsigned long timeMS;
+    uint8_t slot;
+    uint8_t lane;
+    uint8_t matched; // Bit per slot that has reported the same vehicle
+    uint8_t historySize;
+    int16_t history[shadowHistorySize];
+  };
+
+  static uint8_t bit(int slot) { return (uint8_t)(1 << slot); }
+
+  // The counting detector against each shadow.
+  static bool compared(int a, int b) { return (a != b) && ((a == 0) || (b == 0)); }
+
+  // Take the oldest vehicle off the waiting list, logging whoever missed it.
+  void retire()
+  {
+    const Pending &p = pending[pendingHead];
+    for (int slot = 0; slot < numDetectors; slot++)
+    {
+      if (!compared(p.slot, slot) || (p.matched & bit(slot))) continue;
+
+      DetectorDisagreement &d = log[(logHead + logCount) % shadowLogSize];
+      if (logCount < shadowLogSize) logCount++;
+      else logHead = (logHead + 1) % shadowLogSize; // Full: that overwrote the oldest.
+      logTotal++;
+      missedCount[slot]++;
+
+      d.timeMS = p.timeMS;
+      d.counted = ids[p.slot];
+      d.missed = ids[slot];
+      d.lane = p.lane;
+      d.historySize = p.historySize;
+      for (int k = 0; k < p.historySize; k++) d.history[k] = p.history[k];
+    }
+    pendingHead = (pendingHead + 1) % shadowPendingSize;
+    pendingCount--;
+  }
+
+  uint8_t ids[shadowMaxDetectors];
+  int numDetectors = 0;
+  unsigned long reportedCount[shadowMaxDetectors] = {0, 0, 0};
+  unsigned long missedCount[shadowMaxDetectors] = {0, 0, 0};
+
+  Pending pending[shadowPendingSize];
+  int pendingHead = 0;
+  int pendingCount = 0;
+
+  DetectorDisagreement log[shadowLogSize];
+  int logHead = 0;
+  int logCount = 0;
+  unsigned long logTotal = 0;
+};
+
+#endif // __DIGAME_SHADOW_LOG_H__
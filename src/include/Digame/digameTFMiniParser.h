@@ -0,0 +1,164 @@
+/* digameTFMiniParser.h
+ *
+ *  A streaming parser for the Benewake TFMini / TFMini-Plus serial frame:
+ *
+ *    0x59 0x59 Dist_L Dist_H Flux_L Flux_H Temp_L Temp_H Checksum
+ *
+ *  Hand it whatever bytes came off the UART, in any size of chunk. Frames are
+ *  validated in place in the caller's buffer and handed to a callback as a
+ *  pointer into that buffer -- no copies, except for the few bytes of a frame
+ *  that straddles two chunks. After a corrupt byte the parser picks the next
+ *  header back up within one frame.
+ *
+ *  Each parser keeps its own counters (good frames, checksum errors, resyncs,
+ *  discarded bytes, weak / saturated / flooded readings), so with one parser
+ *  per sensor you can tell a noisy cable from a bad algorithm.
+ *
+ *  Copyright 2022, Digame Systems. All rights reserved.
+ */
+
+#ifndef __DIGAME_TFMINI_PARSER_H__
+#define __DIGAME_TFMINI_PARSER_H__
+
+#include <string.h>
+#include <TFMPlus.h> // For the TFMP_ status codes
+
+const uint8_t TFMINI_HEADER = 0x59;
+
+struct TFMiniStats
+{
+  unsigned long frames = 0;         // Good frames (including weak ones)
+  unsigned long checksumErrors = 0; // Header found but the checksum didn't match
+  unsigned long resyncs = 0;        // Times we lost our place in the stream and had to hunt
+  unsigned long bytesDiscarded = 0; // Bytes skipped while hunting for a header
+  unsigned long weak = 0;           // Signal too weak (dist == -1)
+  unsigned long strong = 0;         // Signal saturated (flux == -1)
+  unsigned long flood = 0;          // Ambient light saturated (dist == -4)
+};
+
+//****************************************************************************************
+// Decode a validated frame. Returns the status code the TFMPlus library would report.
+inline uint8_t decodeTFMiniFrame(const uint8_t *frame, int16_t &dist, int16_t &flux, int16_t &temp)
+{
+  dist = (int16_t)(frame[2] + (frame[3] << 8));
+  flux = (int16_t)(frame[4] + (frame[5] << 8));
+  temp = (int16_t)((int16_t)(frame[6] + (frame[7] << 8)) / 8 - 256);
+
+  if (dist == -1) return TFMP_WEAK;
+  if (flux == -1) return TFMP_STRONG;
+  if (dist == -4) return TFMP_FLOOD;
+  return TFMP_READY;
+}
+
+//****************************************************************************************
+class TFMiniParser
+{
+public:
+  TFMiniStats stats;
+
+  // Parse a chunk of the byte stream. onFrame(const uint8_t *frame) is called for each
+  // good frame, in order. The pointer is only valid during the call.
+  template <typename F>
+  void parse(const uint8_t *data, size_t len, F onFrame)
+  {
+    size_t start = 0;
+
+    if (carryLen > 0)
+    {
+      // Finish the frame left over from the last chunk. Only positions inside the
+      // carried bytes are resolved here; the rest is scanned in place below.
+      uint8_t joined[2 * TFMP_FRAME_SIZE];
+      size_t n = (len < TFMP_FRAME_SIZE - 1) ? len : TFMP_FRAME_SIZE - 1;
+      memcpy(joined, carry, carryLen);
+      memcpy(joined + carryLen, data, n);
+
+      size_t used = scan(joined, carryLen + n, carryLen, onFrame);
+      if (used < carryLen)
+      {
+        // Still not a whole frame. Hang on to what's left for next time.
+        carryLen = carryLen + n - used;
+        memmove(carry, joined + used, carryLen);
+        return;
+      }
+      start = used - carryLen;
+      carryLen = 0;
+    }
+
+    size_t used = start + scan(data + start, len - start, len - start, onFrame);
+
+    carryLen = len - used; // Less than a frame: the start of the next one.
+    memcpy(carry, data + used, carryLen);
+  }
+
+  // Bytes held over for the next chunk: the start of a frame that isn't complete yet.
+  size_t pending() const { return carryLen; }
+
+  // Forget any partial frame (e.g. after the sensor is reset).
+  void reset()
+  {
+    carryLen = 0;
+    inSync = true;
+  }
+
+private:
+  uint8_t carry[TFMP_FRAME_SIZE - 1];
+  size_t carryLen = 0;
+  bool inSync = true; // So the first resync of the session counts, too.
+
+  //****************************************************************************************
+  // Walk buf looking for frames that start before stopAt. Returns the position of the
+  // first byte not dealt with: either stopAt (or just past it, after a frame) or the
+  // start of a frame that runs off the end of buf.
+  template <typename F>
+  size_t scan(const uint8_t *buf, size_t len, size_t stopAt, F &onFrame)
+  {
+    size_t p = 0;
+    while (p < stopAt)
+    {
+      if ((buf[p] != TFMINI_HEADER) || ((p + 1 < len) && (buf[p + 1] != TFMINI_HEADER)))
+      {
+        lostSync();
+        stats.bytesDiscarded++;
+        p++;
+        continue;
+      }
+
+      if (p + TFMP_FRAME_SIZE > len) break; // Partial frame. Wait for the rest.
+
+      const uint8_t *frame = buf + p;
+      uint8_t chkSum = 0;
+      for (int i = 0; i < TFMP_FRAME_SIZE - 1; i++) chkSum += frame[i];
+
+      if (chkSum != frame[TFMP_FRAME_SIZE - 1])
+      {
+        // Could be a corrupt frame or a 0x59 0x59 inside the data of one we came into
+        // part way. Either way, step one byte and look again.
+        stats.checksumErrors++;
+        lostSync();
+        stats.bytesDiscarded++;
+        p++;
+        continue;
+      }
+
+      inSync = true;
+      stats.frames++;
+      int16_t dist = (int16_t)(frame[2] + (frame[3] << 8));
+      int16_t flux = (int16_t)(frame[4] + (frame[5] << 8));
+      if (dist == -1) stats.weak++;
+      else if (flux == -1) stats.strong++;
+      else if (dist == -4) stats.flood++;
+
+      onFrame(frame);
+      p += TFMP_FRAME_SIZE;
+    }
+    return p;
+  }
+
+  void lostSync()
+  {
+    if (inSync) stats.resyncs++;
+    inSync = false;
+  }
+};
+
+#endif // __DIGAME_TFMINI_PARSER_H__
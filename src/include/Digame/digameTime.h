@@ -41,6 +41,7 @@ bool   setRTCTime();   // Set the DS3231 module to the same time as the
 int    getRTCSecond(); // The current second
 int    getRTCMinute(); // The current minute
 int    getRTCHour();   // The current hour
+uint32_t getRTCEpoch(); // The current time in seconds since 1970
 float  getRTCTemperature();
 
 bool   synchTimesToNTP(); // Get time from an NTP server and set both
@@ -190,6 +191,13 @@ int getRTCHour(){
   return now.hour(); 
 }
 
+//*****************************************************************************
+uint32_t getRTCEpoch(){
+  RTClib myRTC;
+  DateTime now = myRTC.now();
+  return now.unixtime(); 
+}
+
 //*****************************************************************************
 float getRTCTemperature(){
     DS3231 clock;